@@ -87,4 +87,10 @@
 
 #define SO_BPF_EXTENSIONS	48
 
+#define SO_ATTACH_REUSEPORT_CBPF	51
+
+#define SO_ZEROCOPY		60
+
+#define SO_LATENCY_HIST	100
+
 #endif /* _UAPI_ASM_SOCKET_H */
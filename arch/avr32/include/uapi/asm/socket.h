@@ -80,4 +80,10 @@
 
 #define SO_BPF_EXTENSIONS	48
 
+#define SO_ATTACH_REUSEPORT_CBPF	51
+
+#define SO_ZEROCOPY		60
+
+#define SO_LATENCY_HIST	100
+
 #endif /* _UAPI__ASM_AVR32_SOCKET_H */
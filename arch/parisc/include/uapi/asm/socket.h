@@ -79,4 +79,10 @@
 
 #define SO_BPF_EXTENSIONS	0x4029
 
+#define SO_ATTACH_REUSEPORT_CBPF	0x4032
+
+#define SO_ZEROCOPY		0x4035
+
+#define SO_LATENCY_HIST	0x4064
+
 #endif /* _UAPI_ASM_SOCKET_H */
@@ -76,6 +76,12 @@
 
 #define SO_BPF_EXTENSIONS	0x0032
 
+#define SO_ATTACH_REUSEPORT_CBPF	0x0035
+
+#define SO_ZEROCOPY		0x003e
+
+#define SO_LATENCY_HIST	0x0064
+
 /* Security levels - as per NRL IPv6 - don't actually do anything */
 #define SO_SECURITY_AUTHENTICATION		0x5001
 #define SO_SECURITY_ENCRYPTION_TRANSPORT	0x5002
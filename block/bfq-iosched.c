@@ -0,0 +1,2170 @@
+/*
+ *  BFQ, or budget fair queueing, disk scheduler.
+ *
+ *  Each process gets a queue and, whenever that queue is selected for
+ *  service, a budget measured in sectors.  The queue keeps the disk until
+ *  the budget is used up, the queue runs out of requests or a timeout
+ *  fires.  Queues are picked by a B-WF2Q+ scheduler working in the
+ *  service (sector) domain, so every process gets its share of the disk
+ *  throughput regardless of how long its requests take.  Budgets adapt
+ *  to the behaviour of each queue, and interactive and soft real-time
+ *  queues have their weight raised for a while to keep latency low.
+ *
+ *  Based on CFQ, Copyright (C) 2003 Jens Axboe <axboe@kernel.dk>
+ */
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/blkdev.h>
+#include <linux/elevator.h>
+#include <linux/jiffies.h>
+#include <linux/rbtree.h>
+#include <linux/ioprio.h>
+#include <linux/math64.h>
+#include <linux/blktrace_api.h>
+#include "blk.h"
+#include "blk-cgroup.h"
+
+/*
+ * tunables
+ */
+/* max requests of the in-service queue in flight at once */
+static const int bfq_quantum = 4;
+static const int bfq_fifo_expire[2] = { HZ / 4, HZ / 8 };
+static int bfq_slice_idle = HZ / 125;
+/* default maximum budget, in sectors */
+static const int bfq_default_max_budget = 16 * 1024;
+/* time a queue may hold the disk before its budget expires */
+static const int bfq_timeout = HZ / 8;
+/* async service is charged this many times more than sync service */
+static const int bfq_async_charge_factor = 10;
+
+/* weight raising */
+static const int bfq_wr_coeff = 30;
+static const int bfq_wr_max_time = HZ * 6;
+static const int bfq_wr_rt_max_time = HZ * 3 / 10;
+static const int bfq_wr_min_idle_time = HZ * 2;
+/* max rate, in sectors/sec, of a queue to be still deemed soft real-time */
+static const int bfq_wr_max_softrt_rate = 7000;
+
+#define BFQ_SERVICE_SHIFT	22
+#define BFQ_MIN_BUDGET_SHIFT	5
+#define BFQ_HW_QUEUE_THRESHOLD	4
+#define BFQ_HW_QUEUE_SAMPLES	32
+
+#define BFQQ_SEEK_THR		(sector_t)(8 * 100)
+#define BFQQ_SECT_THR_NONROT	(sector_t)(2 * 32)
+#define BFQQ_SEEKY(bfqq)	(hweight32(bfqq->seek_history) > 32/8)
+
+#define RQ_BIC(rq)		icq_to_bic((rq)->elv.icq)
+#define RQ_BFQQ(rq)		((struct bfq_queue *) ((rq)->elv.priv[0]))
+
+static struct kmem_cache *bfq_pool;
+
+#define BFQ_IOPRIO_CLASSES	3
+#define bfq_class_idle(bfqq)	((bfqq)->ioprio_class == IOPRIO_CLASS_IDLE)
+#define bfq_class_rt(bfqq)	((bfqq)->ioprio_class == IOPRIO_CLASS_RT)
+
+#define sample_valid(samples)	((samples) > 80)
+
+struct bfq_ttime {
+	unsigned long last_end_request;
+
+	unsigned long ttime_total;
+	unsigned long ttime_samples;
+	unsigned long ttime_mean;
+};
+
+/*
+ * One B-WF2Q+ service tree per ioprio class.  Busy queues that are not in
+ * service sit in @active, sorted by virtual finish time.
+ */
+struct bfq_service_tree {
+	struct rb_root active;
+	/* virtual time of the tree */
+	u64 vtime;
+	/* sum of the weights of the busy queues of this class */
+	unsigned long wsum;
+};
+
+/*
+ * Per process-grouping structure
+ */
+struct bfq_queue {
+	/* reference count */
+	int ref;
+	/* various state flags, see below */
+	unsigned int flags;
+	/* parent bfq_data */
+	struct bfq_data *bfqd;
+	/* service tree member, keyed by finish */
+	struct rb_node rb_node;
+	/* virtual start and finish timestamps */
+	u64 start;
+	u64 finish;
+	/* sorted list of pending requests */
+	struct rb_root sort_list;
+	/* next request to serve */
+	struct request *next_rq;
+	/* requests queued in sort_list */
+	int queued[2];
+	/* currently allocated requests */
+	int allocated[2];
+	/* fifo list of requests in sort_list */
+	struct list_head fifo;
+	/* number of requests that are on the dispatch list or inside driver */
+	int dispatched;
+
+	/* sectors granted for the current service slot */
+	unsigned long budget;
+	/* sectors served in the current service slot */
+	unsigned long service;
+	/* feedback-driven budget assigned at the next slot */
+	unsigned long max_budget;
+	/* the slot ends at this time even if the budget is not used up */
+	unsigned long budget_timeout;
+
+	/* weight from ioprio, and actual weight used for scheduling */
+	unsigned int orig_weight;
+	unsigned int weight;
+	/* weight raising coefficient, start and duration */
+	unsigned int wr_coeff;
+	unsigned long wr_start;
+	unsigned long wr_duration;
+
+	/* when the queue last became busy and service received since */
+	unsigned long last_idle_bklogged;
+	unsigned long service_from_backlogged;
+	/* when the queue last became empty */
+	unsigned long last_empty;
+	/* earliest time the queue may be deemed soft real-time again */
+	unsigned long soft_rt_next_start;
+
+	sector_t last_request_pos;
+	u32 seek_history;
+
+	pid_t pid;
+
+	/* io prio of this group */
+	unsigned short ioprio, org_ioprio;
+	unsigned short ioprio_class;
+
+#ifdef CONFIG_BFQ_GROUP_IOSCHED
+	struct bfq_group *bfqg;
+#endif
+};
+
+/*
+ * Group weight for cgroup support.  Groups do not get service trees of
+ * their own, the weight of a group scales the weights of its queues.
+ */
+struct bfq_group {
+	/* must be the first member */
+	struct blkg_policy_data pd;
+
+	unsigned int weight;
+};
+
+struct bfq_io_cq {
+	struct io_cq		icq;		/* must be the first member */
+	struct bfq_queue	*bfqq[2];
+	struct bfq_ttime	ttime;
+	int			ioprio;		/* the current ioprio */
+#ifdef CONFIG_BFQ_GROUP_IOSCHED
+	uint64_t		blkcg_serial_nr; /* the current blkcg serial */
+#endif
+};
+
+/*
+ * Per block device queue structure
+ */
+struct bfq_data {
+	struct request_queue *queue;
+
+	struct bfq_service_tree st[BFQ_IOPRIO_CLASSES];
+	unsigned int busy_queues;
+
+	struct bfq_queue *in_service_queue;
+	struct bfq_io_cq *in_service_bic;
+
+	int rq_in_driver;
+	int rq_queued;
+
+	/* queue depth detection */
+	int hw_tag;
+	int max_rq_in_driver;
+	int hw_tag_samples;
+
+	/* idle timer of the in-service queue */
+	struct timer_list idle_slice_timer;
+	struct work_struct unplug_work;
+
+	/* async queues, shared by all the processes of each ioprio */
+	struct bfq_queue *async_bfqq[2][IOPRIO_BE_NR];
+	struct bfq_queue *async_idle_bfqq;
+
+	sector_t last_position;
+
+	/*
+	 * tunables, see top of file
+	 */
+	unsigned int bfq_quantum;
+	unsigned int bfq_fifo_expire[2];
+	unsigned int bfq_slice_idle;
+	unsigned int bfq_max_budget;
+	unsigned int bfq_user_max_budget;
+	unsigned int bfq_timeout;
+	unsigned int bfq_async_charge_factor;
+	unsigned int low_latency;
+	unsigned int bfq_wr_coeff;
+	unsigned int bfq_wr_max_time;
+	unsigned int bfq_wr_rt_max_time;
+	unsigned int bfq_wr_min_idle_time;
+	unsigned int bfq_wr_max_softrt_rate;
+
+	/*
+	 * Fallback dummy bfqq for extreme OOM conditions
+	 */
+	struct bfq_queue oom_bfqq;
+
+#ifdef CONFIG_BFQ_GROUP_IOSCHED
+	struct bfq_group *root_group;
+#endif
+};
+
+enum bfqq_expiration {
+	BFQ_BFQQ_TOO_IDLE,		/* idle timer fired */
+	BFQ_BFQQ_BUDGET_TIMEOUT,	/* held the disk for too long */
+	BFQ_BFQQ_BUDGET_EXHAUSTED,	/* used up its budget */
+	BFQ_BFQQ_NO_MORE_REQUESTS,	/* nothing left to dispatch */
+	BFQ_BFQQ_PREEMPTED,		/* a weight-raised queue arrived */
+};
+
+enum bfqq_state_flags {
+	BFQ_BFQQ_FLAG_busy = 0,		/* has requests or is in service */
+	BFQ_BFQQ_FLAG_wait_request,	/* waiting for a request */
+	BFQ_BFQQ_FLAG_must_alloc,	/* must be allowed rq alloc */
+	BFQ_BFQQ_FLAG_fifo_expire,	/* FIFO checked in this slot */
+	BFQ_BFQQ_FLAG_idle_window,	/* slice idling enabled */
+	BFQ_BFQQ_FLAG_prio_changed,	/* task priority has changed */
+	BFQ_BFQQ_FLAG_sync,		/* synchronous queue */
+	BFQ_BFQQ_FLAG_just_created,	/* never been busy yet */
+	BFQ_BFQQ_FLAG_softrt,		/* raised as soft real-time */
+};
+
+#define BFQ_BFQQ_FNS(name)						\
+static inline void bfq_mark_bfqq_##name(struct bfq_queue *bfqq)		\
+{									\
+	(bfqq)->flags |= (1 << BFQ_BFQQ_FLAG_##name);			\
+}									\
+static inline void bfq_clear_bfqq_##name(struct bfq_queue *bfqq)	\
+{									\
+	(bfqq)->flags &= ~(1 << BFQ_BFQQ_FLAG_##name);			\
+}									\
+static inline int bfq_bfqq_##name(const struct bfq_queue *bfqq)		\
+{									\
+	return ((bfqq)->flags & (1 << BFQ_BFQQ_FLAG_##name)) != 0;	\
+}
+
+BFQ_BFQQ_FNS(busy);
+BFQ_BFQQ_FNS(wait_request);
+BFQ_BFQQ_FNS(must_alloc);
+BFQ_BFQQ_FNS(fifo_expire);
+BFQ_BFQQ_FNS(idle_window);
+BFQ_BFQQ_FNS(prio_changed);
+BFQ_BFQQ_FNS(sync);
+BFQ_BFQQ_FNS(just_created);
+BFQ_BFQQ_FNS(softrt);
+#undef BFQ_BFQQ_FNS
+
+#define bfq_log_bfqq(bfqd, bfqq, fmt, args...)	\
+	blk_add_trace_msg((bfqd)->queue, "bfq%d%c " fmt, (bfqq)->pid, \
+			bfq_bfqq_sync((bfqq)) ? 'S' : 'A', ##args)
+#define bfq_log(bfqd, fmt, args...)	\
+	blk_add_trace_msg((bfqd)->queue, "bfq " fmt, ##args)
+
+static void bfq_put_queue(struct bfq_queue *bfqq);
+static struct bfq_queue *bfq_get_queue(struct bfq_data *, bool,
+				       struct bfq_io_cq *, struct bio *,
+				       gfp_t);
+
+static inline struct bfq_io_cq *icq_to_bic(struct io_cq *icq)
+{
+	/* bic->icq is the first member, %NULL will convert to %NULL */
+	return container_of(icq, struct bfq_io_cq, icq);
+}
+
+static inline struct bfq_io_cq *bfq_bic_lookup(struct bfq_data *bfqd,
+					       struct io_context *ioc)
+{
+	if (ioc)
+		return icq_to_bic(ioc_lookup_icq(ioc, bfqd->queue));
+	return NULL;
+}
+
+static inline struct bfq_queue *bic_to_bfqq(struct bfq_io_cq *bic,
+					    bool is_sync)
+{
+	return bic->bfqq[is_sync];
+}
+
+static inline void bic_set_bfqq(struct bfq_io_cq *bic, struct bfq_queue *bfqq,
+				bool is_sync)
+{
+	bic->bfqq[is_sync] = bfqq;
+}
+
+static inline struct bfq_data *bic_to_bfqd(struct bfq_io_cq *bic)
+{
+	return bic->icq.q->elevator->elevator_data;
+}
+
+/*
+ * We regard a request as SYNC, if it's either a read or has the SYNC bit
+ * set (in which case it could also be direct WRITE).
+ */
+static inline bool bfq_bio_sync(struct bio *bio)
+{
+	return bio_data_dir(bio) == READ || (bio->bi_rw & REQ_SYNC);
+}
+
+/*
+ * scheduler run of queue, if there are requests pending and no one in the
+ * driver that will restart queueing
+ */
+static inline void bfq_schedule_dispatch(struct bfq_data *bfqd)
+{
+	if (bfqd->busy_queues) {
+		bfq_log(bfqd, "schedule dispatch");
+		kblockd_schedule_work(&bfqd->unplug_work);
+	}
+}
+
+#ifdef CONFIG_BFQ_GROUP_IOSCHED
+
+static struct blkcg_policy blkcg_policy_bfq;
+
+static inline struct bfq_group *pd_to_bfqg(struct blkg_policy_data *pd)
+{
+	return pd ? container_of(pd, struct bfq_group, pd) : NULL;
+}
+
+static inline struct blkcg_gq *bfqg_to_blkg(struct bfq_group *bfqg)
+{
+	return pd_to_blkg(&bfqg->pd);
+}
+
+static inline struct bfq_group *blkg_to_bfqg(struct blkcg_gq *blkg)
+{
+	return pd_to_bfqg(blkg_to_pd(blkg, &blkcg_policy_bfq));
+}
+
+static void bfq_pd_init(struct blkcg_gq *blkg)
+{
+	blkg_to_bfqg(blkg)->weight = blkg->blkcg->bfq_weight;
+}
+
+/*
+ * Search for the bfq group current task belongs to. request_queue lock must
+ * be held.
+ */
+static struct bfq_group *bfq_lookup_create_bfqg(struct bfq_data *bfqd,
+						struct blkcg *blkcg)
+{
+	struct blkcg_gq *blkg;
+
+	/* avoid lookup for the common case where there's no blkcg */
+	if (blkcg == &blkcg_root)
+		return bfqd->root_group;
+
+	blkg = blkg_lookup_create(blkcg, bfqd->queue);
+	if (IS_ERR(blkg))
+		return bfqd->root_group;
+	return blkg_to_bfqg(blkg);
+}
+
+static void bfq_link_bfqq_bfqg(struct bfq_queue *bfqq, struct bio *bio)
+{
+	struct bfq_data *bfqd = bfqq->bfqd;
+	struct bfq_group *bfqg = bfqd->root_group;
+
+	/* Async queues are shared, they always belong to the root group */
+	if (bfq_bfqq_sync(bfqq))
+		bfqg = bfq_lookup_create_bfqg(bfqd, bio_blkcg(bio));
+
+	bfqq->bfqg = bfqg;
+	/* bfqq reference on bfqg */
+	blkg_get(bfqg_to_blkg(bfqg));
+}
+
+static inline void bfq_unlink_bfqq_bfqg(struct bfq_queue *bfqq)
+{
+	blkg_put(bfqg_to_blkg(bfqq->bfqg));
+}
+
+static inline unsigned int bfqq_group_weight(struct bfq_queue *bfqq)
+{
+	return bfqq->bfqg->weight;
+}
+
+static void check_blkcg_changed(struct bfq_io_cq *bic, struct bio *bio)
+{
+	struct bfq_data *bfqd = bic_to_bfqd(bic);
+	struct bfq_queue *sync_bfqq;
+	uint64_t serial_nr;
+
+	rcu_read_lock();
+	serial_nr = bio_blkcg(bio)->css.serial_nr;
+	rcu_read_unlock();
+
+	/*
+	 * Check whether blkcg has changed.  The condition may trigger
+	 * spuriously on a newly created bic but there's no harm.
+	 */
+	if (unlikely(!bfqd) || likely(bic->blkcg_serial_nr == serial_nr))
+		return;
+
+	sync_bfqq = bic_to_bfqq(bic, 1);
+	if (sync_bfqq) {
+		/*
+		 * Drop reference to sync queue. A new sync queue will be
+		 * assigned in new group upon arrival of a fresh request.
+		 */
+		bfq_log_bfqq(bfqd, sync_bfqq, "changed cgroup");
+		bic_set_bfqq(bic, NULL, 1);
+		bfq_put_queue(sync_bfqq);
+	}
+
+	bic->blkcg_serial_nr = serial_nr;
+}
+
+static int bfq_print_weight(struct seq_file *sf, void *v)
+{
+	seq_printf(sf, "%u\n", css_to_blkcg(seq_css(sf))->bfq_weight);
+	return 0;
+}
+
+static int bfq_set_weight(struct cgroup_subsys_state *css, struct cftype *cft,
+			  u64 val)
+{
+	struct blkcg *blkcg = css_to_blkcg(css);
+	struct blkcg_gq *blkg;
+
+	if (val < BFQ_WEIGHT_MIN || val > BFQ_WEIGHT_MAX)
+		return -EINVAL;
+
+	spin_lock_irq(&blkcg->lock);
+
+	blkcg->bfq_weight = val;
+
+	hlist_for_each_entry(blkg, &blkcg->blkg_list, blkcg_node) {
+		struct bfq_group *bfqg = blkg_to_bfqg(blkg);
+
+		if (bfqg)
+			bfqg->weight = val;
+	}
+
+	spin_unlock_irq(&blkcg->lock);
+	return 0;
+}
+
+static struct cftype bfq_blkcg_files[] = {
+	{
+		.name = "bfq.weight",
+		.flags = CFTYPE_NOT_ON_ROOT,
+		.seq_show = bfq_print_weight,
+		.write_u64 = bfq_set_weight,
+	},
+	{ }	/* terminate */
+};
+
+#else /* CONFIG_BFQ_GROUP_IOSCHED */
+
+static inline void bfq_link_bfqq_bfqg(struct bfq_queue *bfqq,
+				      struct bio *bio) { }
+static inline void bfq_unlink_bfqq_bfqg(struct bfq_queue *bfqq) { }
+static inline unsigned int bfqq_group_weight(struct bfq_queue *bfqq)
+{
+	return BFQ_WEIGHT_DEFAULT;
+}
+static inline void check_blkcg_changed(struct bfq_io_cq *bic,
+				       struct bio *bio) { }
+
+#endif /* CONFIG_BFQ_GROUP_IOSCHED */
+
+/*
+ * Virtual timestamps wrap, compare them the way jiffies are compared.
+ */
+static inline bool bfq_gt(u64 a, u64 b)
+{
+	return (s64)(a - b) > 0;
+}
+
+static inline u64 bfq_delta(unsigned long service, unsigned int weight)
+{
+	return div_u64((u64)service << BFQ_SERVICE_SHIFT, weight);
+}
+
+static inline struct bfq_service_tree *
+bfqq_st(struct bfq_data *bfqd, struct bfq_queue *bfqq)
+{
+	return &bfqd->st[bfqq->ioprio_class - 1];
+}
+
+static inline unsigned long bfq_min_budget(struct bfq_data *bfqd)
+{
+	return bfqd->bfq_max_budget >> BFQ_MIN_BUDGET_SHIFT;
+}
+
+static inline unsigned long bfq_bfqq_budget_left(struct bfq_queue *bfqq)
+{
+	return bfqq->budget > bfqq->service ? bfqq->budget - bfqq->service : 0;
+}
+
+/*
+ * The budget of a new slot is the feedback-driven max_budget, but it must
+ * be large enough for the first request to go through.
+ */
+static void bfq_set_budget(struct bfq_queue *bfqq)
+{
+	bfqq->budget = bfqq->max_budget;
+	if (bfqq->next_rq)
+		bfqq->budget = max_t(unsigned long, bfqq->budget,
+				     blk_rq_sectors(bfqq->next_rq));
+	bfqq->service = 0;
+}
+
+static void bfq_st_insert(struct bfq_service_tree *st,
+			  struct bfq_queue *bfqq)
+{
+	struct rb_node **p = &st->active.rb_node;
+	struct rb_node *parent = NULL;
+	struct bfq_queue *__bfqq;
+
+	while (*p) {
+		parent = *p;
+		__bfqq = rb_entry(parent, struct bfq_queue, rb_node);
+
+		if (bfq_gt(__bfqq->finish, bfqq->finish))
+			p = &parent->rb_left;
+		else
+			p = &parent->rb_right;
+	}
+
+	rb_link_node(&bfqq->rb_node, parent, p);
+	rb_insert_color(&bfqq->rb_node, &st->active);
+}
+
+static void bfq_st_erase(struct bfq_service_tree *st,
+			 struct bfq_queue *bfqq)
+{
+	if (!RB_EMPTY_NODE(&bfqq->rb_node)) {
+		rb_erase(&bfqq->rb_node, &st->active);
+		RB_CLEAR_NODE(&bfqq->rb_node);
+	}
+}
+
+/*
+ * B-WF2Q+ selection: among the eligible queues (start <= vtime) pick the
+ * one with the smallest finish time.  If none is eligible, push the
+ * virtual time forward to the smallest start time.
+ */
+static struct bfq_queue *bfq_st_first_eligible(struct bfq_service_tree *st)
+{
+	struct bfq_queue *bfqq, *min_start = NULL;
+	struct rb_node *n;
+
+	for (n = rb_first(&st->active); n; n = rb_next(n)) {
+		bfqq = rb_entry(n, struct bfq_queue, rb_node);
+		if (!bfq_gt(bfqq->start, st->vtime))
+			return bfqq;
+		if (!min_start || bfq_gt(min_start->start, bfqq->start))
+			min_start = bfqq;
+	}
+
+	if (min_start)
+		st->vtime = min_start->start;
+	return min_start;
+}
+
+/*
+ * Recompute the weight of a busy queue that is not on its service tree.
+ */
+static void bfq_update_weight(struct bfq_data *bfqd, struct bfq_queue *bfqq)
+{
+	struct bfq_service_tree *st = bfqq_st(bfqd, bfqq);
+	unsigned int weight;
+
+	if (bfqq->wr_coeff > 1 &&
+	    time_after(jiffies, bfqq->wr_start + bfqq->wr_duration)) {
+		bfq_log_bfqq(bfqd, bfqq, "weight raising ended");
+		bfqq->wr_coeff = 1;
+		bfq_clear_bfqq_softrt(bfqq);
+	}
+
+	weight = bfqq->orig_weight * bfqq->wr_coeff *
+		bfqq_group_weight(bfqq) / BFQ_WEIGHT_DEFAULT;
+	weight = max(weight, 1U);
+
+	st->wsum += weight;
+	st->wsum -= bfqq->weight;
+	bfqq->weight = weight;
+}
+
+/*
+ * Decide whether a queue that just became busy deserves weight raising.
+ * A sync queue that has been idle for a long time (or never ran) is
+ * likely to belong to an application being started or a user waiting
+ * for it.  A queue that comes back no sooner than it would if it issued
+ * I/O at a bounded rate is likely to be a soft real-time one (audio,
+ * video playback).
+ */
+static void bfq_wr_check(struct bfq_data *bfqd, struct bfq_queue *bfqq)
+{
+	bool interactive, softrt;
+
+	if (!bfqd->low_latency || !bfq_bfqq_sync(bfqq) ||
+	    bfq_class_idle(bfqq))
+		return;
+
+	interactive = bfq_bfqq_just_created(bfqq) ||
+		time_after(jiffies, bfqq->last_empty +
+			   bfqd->bfq_wr_min_idle_time);
+	softrt = bfqd->bfq_wr_max_softrt_rate > 0 &&
+		time_after_eq(jiffies, bfqq->soft_rt_next_start);
+
+	if (interactive) {
+		bfqq->wr_coeff = bfqd->bfq_wr_coeff;
+		bfqq->wr_start = jiffies;
+		bfqq->wr_duration = bfqd->bfq_wr_max_time;
+		bfq_clear_bfqq_softrt(bfqq);
+	} else if (softrt) {
+		/* don't cut short an interactive raising still running */
+		if (bfqq->wr_coeff == 1 || bfq_bfqq_softrt(bfqq)) {
+			bfqq->wr_coeff = bfqd->bfq_wr_coeff;
+			bfqq->wr_start = jiffies;
+			bfqq->wr_duration = bfqd->bfq_wr_rt_max_time;
+			bfq_mark_bfqq_softrt(bfqq);
+		}
+	}
+
+	if (bfqq->wr_coeff > 1)
+		bfq_log_bfqq(bfqd, bfqq, "weight raised x%u %s",
+			     bfqq->wr_coeff,
+			     bfq_bfqq_softrt(bfqq) ? "softrt" : "interactive");
+}
+
+static void bfq_init_prio_data(struct bfq_queue *bfqq, struct bfq_io_cq *bic);
+
+/*
+ * A queue got its first request, put it on its service tree.
+ */
+static void bfq_add_bfqq_busy(struct bfq_data *bfqd, struct bfq_queue *bfqq)
+{
+	struct bfq_service_tree *st;
+
+	BUG_ON(bfq_bfqq_busy(bfqq));
+
+	bfq_wr_check(bfqd, bfqq);
+	bfq_clear_bfqq_just_created(bfqq);
+
+	bfq_mark_bfqq_busy(bfqq);
+	bfqd->busy_queues++;
+	bfqq->weight = 0;
+	bfq_update_weight(bfqd, bfqq);
+	st = bfqq_st(bfqd, bfqq);
+
+	bfqq->last_idle_bklogged = jiffies;
+	bfqq->service_from_backlogged = 0;
+	bfqq->soft_rt_next_start = jiffies + MAX_JIFFY_OFFSET;
+
+	/*
+	 * A queue that got ahead of its share keeps its finish time as the
+	 * new start, otherwise it starts from the current virtual time.
+	 */
+	if (bfq_gt(bfqq->finish, st->vtime))
+		bfqq->start = bfqq->finish;
+	else
+		bfqq->start = st->vtime;
+	bfq_set_budget(bfqq);
+	bfqq->finish = bfqq->start + bfq_delta(bfqq->budget, bfqq->weight);
+	bfq_st_insert(st, bfqq);
+
+	bfq_log_bfqq(bfqd, bfqq, "add_busy weight %u budget %lu",
+		     bfqq->weight, bfqq->budget);
+}
+
+static void bfq_del_bfqq_busy(struct bfq_data *bfqd, struct bfq_queue *bfqq)
+{
+	struct bfq_service_tree *st = bfqq_st(bfqd, bfqq);
+
+	BUG_ON(!bfq_bfqq_busy(bfqq));
+	bfq_log_bfqq(bfqd, bfqq, "del_busy");
+
+	bfq_st_erase(st, bfqq);
+	st->wsum -= bfqq->weight;
+	bfqq->weight = 0;
+	bfq_clear_bfqq_busy(bfqq);
+
+	BUG_ON(!bfqd->busy_queues);
+	bfqd->busy_queues--;
+
+	bfqq->last_empty = jiffies;
+}
+
+/*
+ * Pick the next request in C-LOOK order from the head position.
+ */
+static struct request *
+bfq_choose_req(struct bfq_data *bfqd, struct request *rq1,
+	       struct request *rq2)
+{
+	sector_t last = bfqd->last_position;
+	sector_t s1, s2;
+
+	if (rq1 == NULL || rq1 == rq2)
+		return rq2;
+	if (rq2 == NULL)
+		return rq1;
+
+	if ((rq1->cmd_flags & REQ_META) && !(rq2->cmd_flags & REQ_META))
+		return rq1;
+	else if ((rq2->cmd_flags & REQ_META) && !(rq1->cmd_flags & REQ_META))
+		return rq2;
+
+	s1 = blk_rq_pos(rq1);
+	s2 = blk_rq_pos(rq2);
+
+	if (s1 >= last && s2 >= last)
+		return s1 <= s2 ? rq1 : rq2;
+	if (s1 >= last)
+		return rq1;
+	if (s2 >= last)
+		return rq2;
+	return s1 <= s2 ? rq1 : rq2;
+}
+
+/*
+ * find the next request to serve after @last is removed
+ */
+static struct request *
+bfq_find_next_rq(struct bfq_data *bfqd, struct bfq_queue *bfqq,
+		 struct request *last)
+{
+	struct rb_node *rbnext = rb_next(&last->rb_node);
+	struct rb_node *rbprev = rb_prev(&last->rb_node);
+	struct request *next = NULL, *prev = NULL;
+
+	if (rbprev)
+		prev = rb_entry_rq(rbprev);
+
+	if (rbnext)
+		next = rb_entry_rq(rbnext);
+	else {
+		rbnext = rb_first(&bfqq->sort_list);
+		if (rbnext && rbnext != &last->rb_node)
+			next = rb_entry_rq(rbnext);
+	}
+
+	return bfq_choose_req(bfqd, next, prev);
+}
+
+static void bfq_del_rq_rb(struct request *rq)
+{
+	struct bfq_queue *bfqq = RQ_BFQQ(rq);
+	const int sync = rq_is_sync(rq);
+
+	BUG_ON(!bfqq->queued[sync]);
+	bfqq->queued[sync]--;
+
+	elv_rb_del(&bfqq->sort_list, rq);
+}
+
+static void bfq_add_rq_rb(struct request *rq)
+{
+	struct bfq_queue *bfqq = RQ_BFQQ(rq);
+	struct bfq_data *bfqd = bfqq->bfqd;
+
+	bfqq->queued[rq_is_sync(rq)]++;
+
+	elv_rb_add(&bfqq->sort_list, rq);
+
+	/*
+	 * check if this request is a better next-serve candidate
+	 */
+	bfqq->next_rq = bfq_choose_req(bfqd, bfqq->next_rq, rq);
+	BUG_ON(!bfqq->next_rq);
+
+	if (!bfq_bfqq_busy(bfqq)) {
+		bfq_init_prio_data(bfqq, RQ_BIC(rq));
+		bfq_add_bfqq_busy(bfqd, bfqq);
+	}
+}
+
+static struct request *
+bfq_find_rq_fmerge(struct bfq_data *bfqd, struct bio *bio)
+{
+	struct bfq_io_cq *bic;
+	struct bfq_queue *bfqq;
+
+	bic = bfq_bic_lookup(bfqd, current->io_context);
+	if (!bic)
+		return NULL;
+
+	bfqq = bic_to_bfqq(bic, bfq_bio_sync(bio));
+	if (bfqq)
+		return elv_rb_find(&bfqq->sort_list, bio_end_sector(bio));
+
+	return NULL;
+}
+
+static void bfq_activate_request(struct request_queue *q, struct request *rq)
+{
+	struct bfq_data *bfqd = q->elevator->elevator_data;
+
+	bfqd->rq_in_driver++;
+	bfqd->last_position = blk_rq_pos(rq) + blk_rq_sectors(rq);
+}
+
+static void bfq_deactivate_request(struct request_queue *q,
+				   struct request *rq)
+{
+	struct bfq_data *bfqd = q->elevator->elevator_data;
+
+	WARN_ON(!bfqd->rq_in_driver);
+	bfqd->rq_in_driver--;
+}
+
+static void bfq_remove_request(struct request *rq)
+{
+	struct bfq_queue *bfqq = RQ_BFQQ(rq);
+	struct bfq_data *bfqd = bfqq->bfqd;
+
+	if (bfqq->next_rq == rq)
+		bfqq->next_rq = bfq_find_next_rq(bfqd, bfqq, rq);
+
+	list_del_init(&rq->queuelist);
+	bfq_del_rq_rb(rq);
+	bfqd->rq_queued--;
+
+	/*
+	 * A queue emptied by a merge stays busy only if it is in service,
+	 * bfq_select_queue() will decide whether to idle or expire it.
+	 */
+	if (RB_EMPTY_ROOT(&bfqq->sort_list)) {
+		bfqq->next_rq = NULL;
+		if (bfq_bfqq_busy(bfqq) && bfqq != bfqd->in_service_queue) {
+			bfqq->finish = bfqq->start;
+			bfq_del_bfqq_busy(bfqd, bfqq);
+		}
+	}
+}
+
+static int bfq_merge(struct request_queue *q, struct request **req,
+		     struct bio *bio)
+{
+	struct bfq_data *bfqd = q->elevator->elevator_data;
+	struct request *__rq;
+
+	__rq = bfq_find_rq_fmerge(bfqd, bio);
+	if (__rq && elv_rq_merge_ok(__rq, bio)) {
+		*req = __rq;
+		return ELEVATOR_FRONT_MERGE;
+	}
+
+	return ELEVATOR_NO_MERGE;
+}
+
+static void bfq_merged_request(struct request_queue *q, struct request *req,
+			       int type)
+{
+	if (type == ELEVATOR_FRONT_MERGE) {
+		struct bfq_queue *bfqq = RQ_BFQQ(req);
+
+		elv_rb_del(&bfqq->sort_list, req);
+		elv_rb_add(&bfqq->sort_list, req);
+	}
+}
+
+static void
+bfq_merged_requests(struct request_queue *q, struct request *rq,
+		    struct request *next)
+{
+	struct bfq_queue *bfqq = RQ_BFQQ(rq);
+
+	/*
+	 * reposition in fifo if next is older than rq
+	 */
+	if (!list_empty(&rq->queuelist) && !list_empty(&next->queuelist) &&
+	    time_before(next->fifo_time, rq->fifo_time) &&
+	    bfqq == RQ_BFQQ(next)) {
+		list_move(&rq->queuelist, &next->queuelist);
+		rq->fifo_time = next->fifo_time;
+	}
+
+	if (bfqq->next_rq == next)
+		bfqq->next_rq = rq;
+	bfq_remove_request(next);
+}
+
+static int bfq_allow_merge(struct request_queue *q, struct request *rq,
+			   struct bio *bio)
+{
+	struct bfq_data *bfqd = q->elevator->elevator_data;
+	struct bfq_io_cq *bic;
+	struct bfq_queue *bfqq;
+
+	/*
+	 * Disallow merge of a sync bio into an async request.
+	 */
+	if (bfq_bio_sync(bio) && !rq_is_sync(rq))
+		return false;
+
+	/*
+	 * Lookup the bfqq that this bio will be queued with and allow
+	 * merge only if rq is queued there.
+	 */
+	bic = bfq_bic_lookup(bfqd, current->io_context);
+	if (!bic)
+		return false;
+
+	bfqq = bic_to_bfqq(bic, bfq_bio_sync(bio));
+	return bfqq == RQ_BFQQ(rq);
+}
+
+/*
+ * Grant the disk to the next queue.
+ */
+static struct bfq_queue *bfq_set_in_service_queue(struct bfq_data *bfqd)
+{
+	struct bfq_service_tree *st;
+	struct bfq_queue *bfqq = NULL;
+	int i;
+
+	/* strict priority among classes: RT, then BE, then IDLE */
+	for (i = 0; i < BFQ_IOPRIO_CLASSES; i++) {
+		st = &bfqd->st[i];
+		bfqq = bfq_st_first_eligible(st);
+		if (bfqq)
+			break;
+	}
+
+	if (!bfqq)
+		return NULL;
+
+	bfq_st_erase(st, bfqq);
+	bfqd->in_service_queue = bfqq;
+
+	bfqq->budget_timeout = jiffies + bfqd->bfq_timeout;
+	bfq_clear_bfqq_fifo_expire(bfqq);
+	bfq_clear_bfqq_wait_request(bfqq);
+	bfq_clear_bfqq_must_alloc(bfqq);
+
+	bfq_log_bfqq(bfqd, bfqq, "set_in_service budget %lu weight %u",
+		     bfqq->budget, bfqq->weight);
+	return bfqq;
+}
+
+/*
+ * Feedback on the budget of a queue at the end of its service slot: queues
+ * that use up their budget get a bigger one, queues that run dry get one
+ * close to what they actually used.
+ */
+static void bfq_recalc_budget(struct bfq_data *bfqd, struct bfq_queue *bfqq,
+			      enum bfqq_expiration reason)
+{
+	unsigned long budget = bfqq->max_budget;
+	unsigned long min_budget = bfq_min_budget(bfqd);
+
+	switch (reason) {
+	case BFQ_BFQQ_BUDGET_EXHAUSTED:
+		budget = min_t(unsigned long, budget * 2, bfqd->bfq_max_budget);
+		break;
+	case BFQ_BFQQ_TOO_IDLE:
+	case BFQ_BFQQ_NO_MORE_REQUESTS:
+		/*
+		 * Requests still in flight may be followed by more, don't
+		 * shrink the budget of a queue that is just slow to refill.
+		 */
+		if (!bfqq->dispatched)
+			budget = max(bfqq->service, min_budget);
+		break;
+	case BFQ_BFQQ_BUDGET_TIMEOUT:
+		/* seeky or slow: it will be charged its full budget anyway */
+		break;
+	case BFQ_BFQQ_PREEMPTED:
+		break;
+	}
+
+	/* weight-raised queues must not be slowed down by small budgets */
+	if (bfqq->wr_coeff > 1)
+		budget = max_t(unsigned long, budget, bfqd->bfq_max_budget / 2);
+
+	bfqq->max_budget = clamp_t(unsigned long, budget, min_budget,
+				   bfqd->bfq_max_budget);
+}
+
+/*
+ * Remember when an emptied sync queue may be deemed soft real-time again,
+ * i.e. when it would come back if it never exceeded the soft real-time
+ * rate since it got busy.
+ */
+static void bfq_update_soft_rt_next_start(struct bfq_data *bfqd,
+					  struct bfq_queue *bfqq)
+{
+	unsigned long next;
+
+	if (!bfqd->bfq_wr_max_softrt_rate)
+		return;
+
+	next = bfqq->last_idle_bklogged +
+		div_u64((u64)HZ * bfqq->service_from_backlogged,
+			bfqd->bfq_wr_max_softrt_rate);
+	bfqq->soft_rt_next_start = next;
+	if (time_before(next, jiffies + bfqd->bfq_slice_idle + 4))
+		bfqq->soft_rt_next_start = jiffies + bfqd->bfq_slice_idle + 4;
+}
+
+/*
+ * End the service slot of the in-service queue, charge it and put it back
+ * on its service tree if it still has requests.
+ */
+static void bfq_bfqq_expire(struct bfq_data *bfqd, struct bfq_queue *bfqq,
+			    enum bfqq_expiration reason)
+{
+	struct bfq_service_tree *st = bfqq_st(bfqd, bfqq);
+	unsigned long charge = bfqq->service;
+
+	bfq_log_bfqq(bfqd, bfqq, "expire reason %d service %lu/%lu",
+		     reason, bfqq->service, bfqq->budget);
+
+	BUG_ON(bfqq != bfqd->in_service_queue);
+
+	del_timer(&bfqd->idle_slice_timer);
+	bfq_clear_bfqq_wait_request(bfqq);
+
+	/* hogging the disk costs as much as using up the budget */
+	if (reason == BFQ_BFQQ_BUDGET_TIMEOUT)
+		charge = max(charge, bfqq->budget);
+	if (!bfq_bfqq_sync(bfqq) && bfqq->wr_coeff == 1)
+		charge *= bfqd->bfq_async_charge_factor;
+
+	bfq_recalc_budget(bfqd, bfqq, reason);
+
+	if (st->wsum)
+		st->vtime += bfq_delta(charge, st->wsum);
+	bfqq->finish = bfqq->start + bfq_delta(charge, bfqq->weight);
+
+	bfqd->in_service_queue = NULL;
+	if (bfqd->in_service_bic) {
+		put_io_context(bfqd->in_service_bic->icq.ioc);
+		bfqd->in_service_bic = NULL;
+	}
+
+	if (RB_EMPTY_ROOT(&bfqq->sort_list)) {
+		if (bfq_bfqq_sync(bfqq))
+			bfq_update_soft_rt_next_start(bfqd, bfqq);
+		bfq_del_bfqq_busy(bfqd, bfqq);
+		return;
+	}
+
+	bfq_update_weight(bfqd, bfqq);
+	bfqq->start = bfqq->finish;
+	bfq_set_budget(bfqq);
+	bfqq->finish = bfqq->start + bfq_delta(bfqq->budget, bfqq->weight);
+	bfq_st_insert(st, bfqq);
+}
+
+static inline bool bfq_bfqq_budget_timeout(struct bfq_queue *bfqq)
+{
+	return time_after(jiffies, bfqq->budget_timeout);
+}
+
+/*
+ * Idle for the next request of a queue only if it is likely to come soon
+ * and to be worth waiting for.
+ */
+static bool bfq_may_idle(struct bfq_data *bfqd, struct bfq_queue *bfqq)
+{
+	if (!bfqd->bfq_slice_idle || !bfq_bfqq_sync(bfqq) ||
+	    bfq_class_idle(bfqq))
+		return false;
+
+	/* weight raising is only effective if the queue keeps the disk */
+	if (bfqq->wr_coeff > 1)
+		return true;
+
+	/* a deep queue on a fast device is kept busy by others anyway */
+	if (blk_queue_nonrot(bfqd->queue) && bfqd->hw_tag == 1)
+		return false;
+
+	return bfq_bfqq_idle_window(bfqq);
+}
+
+static void bfq_arm_slice_timer(struct bfq_data *bfqd)
+{
+	struct bfq_queue *bfqq = bfqd->in_service_queue;
+	struct bfq_io_cq *bic = bfqd->in_service_bic;
+	unsigned long sl = bfqd->bfq_slice_idle;
+
+	/* don't wait for a process that has exited */
+	if (!bic || !atomic_read(&bic->icq.ioc->active_ref))
+		return;
+
+	/* let a raised queue wait a bit longer on a seeky disk */
+	if (bfqq->wr_coeff > 1 && !blk_queue_nonrot(bfqd->queue))
+		sl = max_t(unsigned long, sl, msecs_to_jiffies(20));
+
+	bfq_mark_bfqq_wait_request(bfqq);
+	mod_timer(&bfqd->idle_slice_timer, jiffies + sl);
+	bfq_log_bfqq(bfqd, bfqq, "arm_idle: %lu", sl);
+}
+
+/*
+ * Select a queue for service. If we have a current queue in service,
+ * check whether to continue servicing it, or retrieve and set a new one.
+ */
+static struct bfq_queue *bfq_select_queue(struct bfq_data *bfqd)
+{
+	struct bfq_queue *bfqq = bfqd->in_service_queue;
+	enum bfqq_expiration reason;
+
+	if (!bfqq)
+		goto new_queue;
+
+	if (bfq_bfqq_budget_timeout(bfqq)) {
+		reason = BFQ_BFQQ_BUDGET_TIMEOUT;
+		goto expire;
+	}
+
+	if (bfqq->next_rq) {
+		if (blk_rq_sectors(bfqq->next_rq) >
+		    bfq_bfqq_budget_left(bfqq)) {
+			reason = BFQ_BFQQ_BUDGET_EXHAUSTED;
+			goto expire;
+		}
+		if (bfq_bfqq_wait_request(bfqq)) {
+			del_timer(&bfqd->idle_slice_timer);
+			bfq_clear_bfqq_wait_request(bfqq);
+		}
+		return bfqq;
+	}
+
+	/*
+	 * No requests pending.  Keep the disk if we are idling, or wait for
+	 * the completion of the requests in flight before deciding.
+	 */
+	if (timer_pending(&bfqd->idle_slice_timer) ||
+	    (bfqq->dispatched && bfq_may_idle(bfqd, bfqq)))
+		return NULL;
+
+	reason = BFQ_BFQQ_NO_MORE_REQUESTS;
+expire:
+	bfq_bfqq_expire(bfqd, bfqq, reason);
+new_queue:
+	return bfq_set_in_service_queue(bfqd);
+}
+
+/*
+ * return expired entry, or NULL to just start from scratch in rbtree
+ */
+static struct request *bfq_check_fifo(struct bfq_queue *bfqq)
+{
+	struct request *rq;
+
+	if (bfq_bfqq_fifo_expire(bfqq))
+		return NULL;
+
+	bfq_mark_bfqq_fifo_expire(bfqq);
+
+	if (list_empty(&bfqq->fifo))
+		return NULL;
+
+	rq = rq_entry_fifo(bfqq->fifo.next);
+	if (time_before(jiffies, rq->fifo_time))
+		return NULL;
+
+	/* an expired request must still fit in the budget */
+	if (blk_rq_sectors(rq) > bfq_bfqq_budget_left(bfqq))
+		return NULL;
+
+	return rq;
+}
+
+static void bfq_dispatch_insert(struct request_queue *q, struct request *rq)
+{
+	struct bfq_data *bfqd = q->elevator->elevator_data;
+	struct bfq_queue *bfqq = RQ_BFQQ(rq);
+
+	bfq_remove_request(rq);
+	bfqq->dispatched++;
+	elv_dispatch_sort(q, rq);
+
+	bfqq->service += blk_rq_sectors(rq);
+	bfqq->service_from_backlogged += blk_rq_sectors(rq);
+	bfq_log_bfqq(bfqd, bfqq, "dispatched %u sectors, left %lu",
+		     blk_rq_sectors(rq), bfq_bfqq_budget_left(bfqq));
+}
+
+static bool bfq_dispatch_request(struct bfq_data *bfqd, struct bfq_queue *bfqq)
+{
+	struct request *rq;
+
+	BUG_ON(RB_EMPTY_ROOT(&bfqq->sort_list));
+
+	/*
+	 * Don't flood the driver from a single queue, the budget is what
+	 * makes the slot last, not the depth of the device queue.
+	 */
+	if (bfqd->busy_queues > 1 && bfqq->dispatched >= bfqd->bfq_quantum)
+		return false;
+
+	/*
+	 * follow expired path, else get first next available
+	 */
+	rq = bfq_check_fifo(bfqq);
+	if (!rq)
+		rq = bfqq->next_rq;
+
+	bfq_dispatch_insert(bfqd->queue, rq);
+
+	if (!bfqd->in_service_bic) {
+		struct bfq_io_cq *bic = RQ_BIC(rq);
+
+		atomic_long_inc(&bic->icq.ioc->refcount);
+		bfqd->in_service_bic = bic;
+	}
+
+	return true;
+}
+
+/*
+ * Drain our current requests.  Used for barriers and when switching io
+ * schedulers on-the-fly.
+ */
+static int bfq_forced_dispatch(struct bfq_data *bfqd)
+{
+	struct bfq_queue *bfqq;
+	int dispatched = 0;
+
+	if (bfqd->in_service_queue)
+		bfq_bfqq_expire(bfqd, bfqd->in_service_queue,
+				BFQ_BFQQ_PREEMPTED);
+
+	while ((bfqq = bfq_set_in_service_queue(bfqd)) != NULL) {
+		while (bfqq->next_rq) {
+			bfq_dispatch_insert(bfqd->queue, bfqq->next_rq);
+			dispatched++;
+		}
+		bfq_bfqq_expire(bfqd, bfqq, BFQ_BFQQ_NO_MORE_REQUESTS);
+	}
+
+	BUG_ON(bfqd->busy_queues);
+
+	bfq_log(bfqd, "forced_dispatch=%d", dispatched);
+	return dispatched;
+}
+
+static int bfq_dispatch_requests(struct request_queue *q, int force)
+{
+	struct bfq_data *bfqd = q->elevator->elevator_data;
+	struct bfq_queue *bfqq;
+
+	if (!bfqd->busy_queues)
+		return 0;
+
+	if (unlikely(force))
+		return bfq_forced_dispatch(bfqd);
+
+	bfqq = bfq_select_queue(bfqd);
+	if (!bfqq)
+		return 0;
+
+	if (!bfq_dispatch_request(bfqd, bfqq))
+		return 0;
+
+	/* the idle class only gets one request per slot */
+	if (bfqd->busy_queues > 1 && bfq_class_idle(bfqq))
+		bfq_bfqq_expire(bfqd, bfqq, BFQ_BFQQ_BUDGET_EXHAUSTED);
+
+	return 1;
+}
+
+/*
+ * task holds one reference to the queue, dropped when task exits. each rq
+ * in-flight on this queue also holds a reference, dropped when rq is freed.
+ *
+ * queue lock must be held here.
+ */
+static void bfq_put_queue(struct bfq_queue *bfqq)
+{
+	struct bfq_data *bfqd = bfqq->bfqd;
+
+	BUG_ON(bfqq->ref <= 0);
+
+	bfqq->ref--;
+	if (bfqq->ref)
+		return;
+
+	bfq_log_bfqq(bfqd, bfqq, "put_queue");
+	BUG_ON(rb_first(&bfqq->sort_list));
+	BUG_ON(bfqq->allocated[READ] + bfqq->allocated[WRITE]);
+
+	if (unlikely(bfqd->in_service_queue == bfqq)) {
+		bfq_bfqq_expire(bfqd, bfqq, BFQ_BFQQ_NO_MORE_REQUESTS);
+		bfq_schedule_dispatch(bfqd);
+	}
+
+	BUG_ON(bfq_bfqq_busy(bfqq));
+	bfq_unlink_bfqq_bfqg(bfqq);
+	kmem_cache_free(bfq_pool, bfqq);
+}
+
+static void bfq_exit_bfqq(struct bfq_data *bfqd, struct bfq_queue *bfqq)
+{
+	if (unlikely(bfqq == bfqd->in_service_queue)) {
+		bfq_bfqq_expire(bfqd, bfqq, BFQ_BFQQ_NO_MORE_REQUESTS);
+		bfq_schedule_dispatch(bfqd);
+	}
+
+	bfq_put_queue(bfqq);
+}
+
+static void bfq_init_icq(struct io_cq *icq)
+{
+	struct bfq_io_cq *bic = icq_to_bic(icq);
+
+	bic->ttime.last_end_request = jiffies;
+}
+
+static void bfq_exit_icq(struct io_cq *icq)
+{
+	struct bfq_io_cq *bic = icq_to_bic(icq);
+	struct bfq_data *bfqd = bic_to_bfqd(bic);
+
+	if (bic->bfqq[BLK_RW_ASYNC]) {
+		bfq_exit_bfqq(bfqd, bic->bfqq[BLK_RW_ASYNC]);
+		bic->bfqq[BLK_RW_ASYNC] = NULL;
+	}
+
+	if (bic->bfqq[BLK_RW_SYNC]) {
+		bfq_exit_bfqq(bfqd, bic->bfqq[BLK_RW_SYNC]);
+		bic->bfqq[BLK_RW_SYNC] = NULL;
+	}
+}
+
+/*
+ * The weight of a queue follows its ioprio, from 80 for ioprio 0 down to
+ * 10 for ioprio 7.  Changes are applied only while the queue is not busy,
+ * so that the weight sums of the service trees stay consistent.
+ */
+static void bfq_init_prio_data(struct bfq_queue *bfqq, struct bfq_io_cq *bic)
+{
+	struct task_struct *tsk = current;
+	int ioprio_class;
+
+	if (!bfq_bfqq_prio_changed(bfqq) || bfq_bfqq_busy(bfqq))
+		return;
+
+	ioprio_class = IOPRIO_PRIO_CLASS(bic->ioprio);
+	switch (ioprio_class) {
+	default:
+		printk(KERN_ERR "bfq: bad prio %x\n", ioprio_class);
+	case IOPRIO_CLASS_NONE:
+		/*
+		 * no prio set, inherit CPU scheduling settings
+		 */
+		bfqq->ioprio = task_nice_ioprio(tsk);
+		bfqq->ioprio_class = task_nice_ioclass(tsk);
+		break;
+	case IOPRIO_CLASS_RT:
+		bfqq->ioprio = IOPRIO_PRIO_DATA(bic->ioprio);
+		bfqq->ioprio_class = IOPRIO_CLASS_RT;
+		break;
+	case IOPRIO_CLASS_BE:
+		bfqq->ioprio = IOPRIO_PRIO_DATA(bic->ioprio);
+		bfqq->ioprio_class = IOPRIO_CLASS_BE;
+		break;
+	case IOPRIO_CLASS_IDLE:
+		bfqq->ioprio_class = IOPRIO_CLASS_IDLE;
+		bfqq->ioprio = 7;
+		bfq_clear_bfqq_idle_window(bfqq);
+		break;
+	}
+
+	bfqq->org_ioprio = bfqq->ioprio;
+	bfqq->orig_weight = (IOPRIO_BE_NR - bfqq->ioprio) * 10;
+	bfq_clear_bfqq_prio_changed(bfqq);
+}
+
+static void check_ioprio_changed(struct bfq_io_cq *bic, struct bio *bio)
+{
+	int ioprio = bic->icq.ioc->ioprio;
+	struct bfq_data *bfqd = bic_to_bfqd(bic);
+	struct bfq_queue *bfqq;
+
+	/*
+	 * Check whether ioprio has changed.  The condition may trigger
+	 * spuriously on a newly created bic but there's no harm.
+	 */
+	if (unlikely(!bfqd) || likely(bic->ioprio == ioprio))
+		return;
+
+	bfqq = bic->bfqq[BLK_RW_ASYNC];
+	if (bfqq) {
+		struct bfq_queue *new_bfqq;
+
+		new_bfqq = bfq_get_queue(bfqd, BLK_RW_ASYNC, bic, bio,
+					 GFP_ATOMIC);
+		if (new_bfqq) {
+			bic->bfqq[BLK_RW_ASYNC] = new_bfqq;
+			bfq_put_queue(bfqq);
+		}
+	}
+
+	bfqq = bic->bfqq[BLK_RW_SYNC];
+	if (bfqq)
+		bfq_mark_bfqq_prio_changed(bfqq);
+
+	bic->ioprio = ioprio;
+}
+
+static void bfq_init_bfqq(struct bfq_data *bfqd, struct bfq_queue *bfqq,
+			  pid_t pid, bool is_sync)
+{
+	RB_CLEAR_NODE(&bfqq->rb_node);
+	INIT_LIST_HEAD(&bfqq->fifo);
+
+	bfqq->ref = 0;
+	bfqq->bfqd = bfqd;
+
+	bfq_mark_bfqq_prio_changed(bfqq);
+	bfq_mark_bfqq_just_created(bfqq);
+
+	if (is_sync) {
+		bfq_mark_bfqq_idle_window(bfqq);
+		bfq_mark_bfqq_sync(bfqq);
+	}
+	bfqq->pid = pid;
+
+	bfqq->ioprio = IOPRIO_NORM;
+	bfqq->ioprio_class = IOPRIO_CLASS_BE;
+	bfqq->orig_weight = (IOPRIO_BE_NR - IOPRIO_NORM) * 10;
+	bfqq->wr_coeff = 1;
+	bfqq->max_budget = bfqd->bfq_max_budget;
+	bfqq->last_empty = jiffies;
+	bfqq->soft_rt_next_start = jiffies + MAX_JIFFY_OFFSET;
+}
+
+static struct bfq_queue *
+bfq_find_alloc_queue(struct bfq_data *bfqd, bool is_sync,
+		     struct bfq_io_cq *bic, struct bio *bio, gfp_t gfp_mask)
+{
+	struct bfq_queue *bfqq, *new_bfqq = NULL;
+
+retry:
+	rcu_read_lock();
+
+	bfqq = bic_to_bfqq(bic, is_sync);
+
+	/*
+	 * Always try a new alloc if we fell back to the OOM bfqq
+	 * originally, since it should just be a temporary situation.
+	 */
+	if (!bfqq || bfqq == &bfqd->oom_bfqq) {
+		bfqq = NULL;
+		if (new_bfqq) {
+			bfqq = new_bfqq;
+			new_bfqq = NULL;
+		} else if (gfp_mask & __GFP_WAIT) {
+			rcu_read_unlock();
+			spin_unlock_irq(bfqd->queue->queue_lock);
+			new_bfqq = kmem_cache_alloc_node(bfq_pool,
+					gfp_mask | __GFP_ZERO,
+					bfqd->queue->node);
+			spin_lock_irq(bfqd->queue->queue_lock);
+			if (new_bfqq)
+				goto retry;
+			else
+				return &bfqd->oom_bfqq;
+		} else {
+			bfqq = kmem_cache_alloc_node(bfq_pool,
+					gfp_mask | __GFP_ZERO,
+					bfqd->queue->node);
+		}
+
+		if (bfqq) {
+			bfq_init_bfqq(bfqd, bfqq, current->pid, is_sync);
+			bfq_init_prio_data(bfqq, bic);
+			bfq_link_bfqq_bfqg(bfqq, bio);
+			bfq_log_bfqq(bfqd, bfqq, "alloced");
+		} else
+			bfqq = &bfqd->oom_bfqq;
+	}
+
+	if (new_bfqq)
+		kmem_cache_free(bfq_pool, new_bfqq);
+
+	rcu_read_unlock();
+	return bfqq;
+}
+
+static struct bfq_queue **
+bfq_async_queue_prio(struct bfq_data *bfqd, int ioprio_class, int ioprio)
+{
+	switch (ioprio_class) {
+	case IOPRIO_CLASS_RT:
+		return &bfqd->async_bfqq[0][ioprio];
+	case IOPRIO_CLASS_NONE:
+		ioprio = IOPRIO_NORM;
+		/* fall through */
+	case IOPRIO_CLASS_BE:
+		return &bfqd->async_bfqq[1][ioprio];
+	case IOPRIO_CLASS_IDLE:
+		return &bfqd->async_idle_bfqq;
+	default:
+		BUG();
+	}
+}
+
+static struct bfq_queue *
+bfq_get_queue(struct bfq_data *bfqd, bool is_sync, struct bfq_io_cq *bic,
+	      struct bio *bio, gfp_t gfp_mask)
+{
+	const int ioprio_class = IOPRIO_PRIO_CLASS(bic->ioprio);
+	const int ioprio = IOPRIO_PRIO_DATA(bic->ioprio);
+	struct bfq_queue **async_bfqq = NULL;
+	struct bfq_queue *bfqq = NULL;
+
+	if (!is_sync) {
+		async_bfqq = bfq_async_queue_prio(bfqd, ioprio_class, ioprio);
+		bfqq = *async_bfqq;
+	}
+
+	if (!bfqq)
+		bfqq = bfq_find_alloc_queue(bfqd, is_sync, bic, bio, gfp_mask);
+
+	/*
+	 * pin the queue now that it's allocated, scheduler exit will prune it
+	 */
+	if (!is_sync && !(*async_bfqq) && bfqq != &bfqd->oom_bfqq) {
+		bfqq->ref++;
+		*async_bfqq = bfqq;
+	}
+
+	bfqq->ref++;
+	return bfqq;
+}
+
+static void
+bfq_update_io_thinktime(struct bfq_data *bfqd, struct bfq_io_cq *bic)
+{
+	struct bfq_ttime *ttime = &bic->ttime;
+	unsigned long elapsed = jiffies - ttime->last_end_request;
+
+	elapsed = min(elapsed, 2UL * bfqd->bfq_slice_idle);
+
+	ttime->ttime_samples = (7*ttime->ttime_samples + 256) / 8;
+	ttime->ttime_total = (7*ttime->ttime_total + 256*elapsed) / 8;
+	ttime->ttime_mean = (ttime->ttime_total + 128) / ttime->ttime_samples;
+}
+
+static void
+bfq_update_io_seektime(struct bfq_data *bfqd, struct bfq_queue *bfqq,
+		       struct request *rq)
+{
+	sector_t sdist = 0;
+	sector_t n_sec = blk_rq_sectors(rq);
+
+	if (bfqq->last_request_pos) {
+		if (bfqq->last_request_pos < blk_rq_pos(rq))
+			sdist = blk_rq_pos(rq) - bfqq->last_request_pos;
+		else
+			sdist = bfqq->last_request_pos - blk_rq_pos(rq);
+	}
+
+	bfqq->seek_history <<= 1;
+	if (blk_queue_nonrot(bfqd->queue))
+		bfqq->seek_history |= (n_sec < BFQQ_SECT_THR_NONROT);
+	else
+		bfqq->seek_history |= (sdist > BFQQ_SEEK_THR);
+}
+
+/*
+ * Disable idle window if the process thinks too long or seeks so much that
+ * it doesn't matter
+ */
+static void
+bfq_update_idle_window(struct bfq_data *bfqd, struct bfq_queue *bfqq,
+		       struct bfq_io_cq *bic)
+{
+	int enable_idle;
+
+	if (!bfq_bfqq_sync(bfqq) || bfq_class_idle(bfqq))
+		return;
+
+	enable_idle = bfq_bfqq_idle_window(bfqq);
+
+	if (!atomic_read(&bic->icq.ioc->active_ref) ||
+	    !bfqd->bfq_slice_idle || BFQQ_SEEKY(bfqq))
+		enable_idle = 0;
+	else if (sample_valid(bic->ttime.ttime_samples))
+		enable_idle = bic->ttime.ttime_mean <= bfqd->bfq_slice_idle;
+
+	if (enable_idle)
+		bfq_mark_bfqq_idle_window(bfqq);
+	else
+		bfq_clear_bfqq_idle_window(bfqq);
+}
+
+/*
+ * Called when a new fs request (rq) is added (to bfqq). Check if there's
+ * something we should do about it
+ */
+static void
+bfq_rq_enqueued(struct bfq_data *bfqd, struct bfq_queue *bfqq,
+		struct request *rq)
+{
+	struct bfq_io_cq *bic = RQ_BIC(rq);
+	struct bfq_queue *in_service = bfqd->in_service_queue;
+
+	bfqd->rq_queued++;
+
+	if (bfq_bfqq_sync(bfqq))
+		bfq_update_io_thinktime(bfqd, bic);
+	bfq_update_io_seektime(bfqd, bfqq, rq);
+	bfq_update_idle_window(bfqd, bfqq, bic);
+	bfqq->last_request_pos = blk_rq_pos(rq) + blk_rq_sectors(rq);
+
+	if (bfqq == in_service) {
+		/*
+		 * The request we were idling for arrived, restart
+		 * dispatching right away.
+		 */
+		if (bfq_bfqq_wait_request(bfqq)) {
+			del_timer(&bfqd->idle_slice_timer);
+			bfq_clear_bfqq_wait_request(bfqq);
+			__blk_run_queue(bfqd->queue);
+		}
+	} else if (in_service && bfq_bfqq_wait_request(in_service) &&
+		   bfqq->wr_coeff > in_service->wr_coeff) {
+		/*
+		 * Don't keep the disk idle for a non raised queue while a
+		 * weight-raised one is waiting.
+		 */
+		bfq_bfqq_expire(bfqd, in_service, BFQ_BFQQ_PREEMPTED);
+		__blk_run_queue(bfqd->queue);
+	}
+}
+
+static void bfq_insert_request(struct request_queue *q, struct request *rq)
+{
+	struct bfq_data *bfqd = q->elevator->elevator_data;
+	struct bfq_queue *bfqq = RQ_BFQQ(rq);
+
+	bfq_log_bfqq(bfqd, bfqq, "insert_request");
+
+	rq->fifo_time = jiffies + bfqd->bfq_fifo_expire[rq_is_sync(rq)];
+	list_add_tail(&rq->queuelist, &bfqq->fifo);
+	bfq_add_rq_rb(rq);
+	bfq_rq_enqueued(bfqd, bfqq, rq);
+}
+
+/*
+ * Update hw_tag based on peak queue depth over a number of samples under
+ * sufficient load.
+ */
+static void bfq_update_hw_tag(struct bfq_data *bfqd)
+{
+	if (bfqd->rq_in_driver > bfqd->max_rq_in_driver)
+		bfqd->max_rq_in_driver = bfqd->rq_in_driver;
+
+	if (bfqd->hw_tag == 1)
+		return;
+
+	if (bfqd->rq_in_driver + bfqd->rq_queued < BFQ_HW_QUEUE_THRESHOLD)
+		return;
+
+	if (bfqd->hw_tag_samples++ < BFQ_HW_QUEUE_SAMPLES)
+		return;
+
+	bfqd->hw_tag = bfqd->max_rq_in_driver >= BFQ_HW_QUEUE_THRESHOLD;
+	bfqd->max_rq_in_driver = 0;
+	bfqd->hw_tag_samples = 0;
+}
+
+static void bfq_completed_request(struct request_queue *q, struct request *rq)
+{
+	struct bfq_queue *bfqq = RQ_BFQQ(rq);
+	struct bfq_data *bfqd = bfqq->bfqd;
+
+	bfq_update_hw_tag(bfqd);
+
+	WARN_ON(!bfqd->rq_in_driver);
+	WARN_ON(!bfqq->dispatched);
+	bfqd->rq_in_driver--;
+	bfqq->dispatched--;
+
+	if (rq_is_sync(rq))
+		RQ_BIC(rq)->ttime.last_end_request = jiffies;
+
+	/*
+	 * If this is the in-service queue and it has nothing left, either
+	 * wait for its next request or give the disk to somebody else.
+	 */
+	if (bfqd->in_service_queue == bfqq) {
+		if (bfq_bfqq_budget_timeout(bfqq))
+			bfq_bfqq_expire(bfqd, bfqq, BFQ_BFQQ_BUDGET_TIMEOUT);
+		else if (RB_EMPTY_ROOT(&bfqq->sort_list) && !bfqq->dispatched) {
+			if (bfq_may_idle(bfqd, bfqq))
+				bfq_arm_slice_timer(bfqd);
+			else
+				bfq_bfqq_expire(bfqd, bfqq,
+						BFQ_BFQQ_NO_MORE_REQUESTS);
+		}
+	}
+
+	if (!bfqd->rq_in_driver)
+		bfq_schedule_dispatch(bfqd);
+}
+
+static int bfq_may_queue(struct request_queue *q, int rw)
+{
+	struct bfq_data *bfqd = q->elevator->elevator_data;
+	struct bfq_io_cq *bic;
+	struct bfq_queue *bfqq;
+
+	/*
+	 * don't force setup of a queue from here, as a call to may_queue
+	 * does not necessarily imply that a request actually will be queued.
+	 * so just lookup a possibly existing queue, or return 'may queue'
+	 * if that fails
+	 */
+	bic = bfq_bic_lookup(bfqd, current->io_context);
+	if (!bic)
+		return ELV_MQUEUE_MAY;
+
+	bfqq = bic_to_bfqq(bic, rw_is_sync(rw));
+	if (bfqq && bfq_bfqq_wait_request(bfqq) &&
+	    !bfq_bfqq_must_alloc(bfqq)) {
+		bfq_mark_bfqq_must_alloc(bfqq);
+		return ELV_MQUEUE_MUST;
+	}
+
+	return ELV_MQUEUE_MAY;
+}
+
+/*
+ * queue lock held here
+ */
+static void bfq_put_request(struct request *rq)
+{
+	struct bfq_queue *bfqq = RQ_BFQQ(rq);
+
+	if (bfqq) {
+		const int rw = rq_data_dir(rq);
+
+		BUG_ON(!bfqq->allocated[rw]);
+		bfqq->allocated[rw]--;
+
+		rq->elv.priv[0] = NULL;
+
+		bfq_put_queue(bfqq);
+	}
+}
+
+/*
+ * Allocate bfq data structures associated with this request.
+ */
+static int
+bfq_set_request(struct request_queue *q, struct request *rq, struct bio *bio,
+		gfp_t gfp_mask)
+{
+	struct bfq_data *bfqd = q->elevator->elevator_data;
+	struct bfq_io_cq *bic = icq_to_bic(rq->elv.icq);
+	const int rw = rq_data_dir(rq);
+	const bool is_sync = rq_is_sync(rq);
+	struct bfq_queue *bfqq;
+
+	might_sleep_if(gfp_mask & __GFP_WAIT);
+
+	spin_lock_irq(q->queue_lock);
+
+	check_ioprio_changed(bic, bio);
+	check_blkcg_changed(bic, bio);
+
+	bfqq = bic_to_bfqq(bic, is_sync);
+	if (!bfqq || bfqq == &bfqd->oom_bfqq) {
+		bfqq = bfq_get_queue(bfqd, is_sync, bic, bio, gfp_mask);
+		bic_set_bfqq(bic, bfqq, is_sync);
+	}
+
+	bfqq->allocated[rw]++;
+
+	bfqq->ref++;
+	rq->elv.priv[0] = bfqq;
+	spin_unlock_irq(q->queue_lock);
+	return 0;
+}
+
+static void bfq_kick_queue(struct work_struct *work)
+{
+	struct bfq_data *bfqd =
+		container_of(work, struct bfq_data, unplug_work);
+	struct request_queue *q = bfqd->queue;
+
+	spin_lock_irq(q->queue_lock);
+	__blk_run_queue(bfqd->queue);
+	spin_unlock_irq(q->queue_lock);
+}
+
+/*
+ * Timer running if the in-service queue is idling for its next request
+ */
+static void bfq_idle_slice_timer(unsigned long data)
+{
+	struct bfq_data *bfqd = (struct bfq_data *) data;
+	struct bfq_queue *bfqq;
+	unsigned long flags;
+
+	bfq_log(bfqd, "idle timer fired");
+
+	spin_lock_irqsave(bfqd->queue->queue_lock, flags);
+
+	bfqq = bfqd->in_service_queue;
+	if (bfqq) {
+		bfq_clear_bfqq_wait_request(bfqq);
+
+		/* the request we waited for arrived meanwhile */
+		if (!RB_EMPTY_ROOT(&bfqq->sort_list))
+			goto out_kick;
+
+		bfq_bfqq_expire(bfqd, bfqq, BFQ_BFQQ_TOO_IDLE);
+	}
+out_kick:
+	bfq_schedule_dispatch(bfqd);
+	spin_unlock_irqrestore(bfqd->queue->queue_lock, flags);
+}
+
+static void bfq_shutdown_timer_wq(struct bfq_data *bfqd)
+{
+	del_timer_sync(&bfqd->idle_slice_timer);
+	cancel_work_sync(&bfqd->unplug_work);
+}
+
+static void bfq_put_async_queues(struct bfq_data *bfqd)
+{
+	int i;
+
+	for (i = 0; i < IOPRIO_BE_NR; i++) {
+		if (bfqd->async_bfqq[0][i])
+			bfq_put_queue(bfqd->async_bfqq[0][i]);
+		if (bfqd->async_bfqq[1][i])
+			bfq_put_queue(bfqd->async_bfqq[1][i]);
+	}
+
+	if (bfqd->async_idle_bfqq)
+		bfq_put_queue(bfqd->async_idle_bfqq);
+}
+
+static void bfq_exit_queue(struct elevator_queue *e)
+{
+	struct bfq_data *bfqd = e->elevator_data;
+	struct request_queue *q = bfqd->queue;
+
+	bfq_shutdown_timer_wq(bfqd);
+
+	spin_lock_irq(q->queue_lock);
+
+	if (bfqd->in_service_queue)
+		bfq_bfqq_expire(bfqd, bfqd->in_service_queue,
+				BFQ_BFQQ_NO_MORE_REQUESTS);
+
+	bfq_put_async_queues(bfqd);
+
+	spin_unlock_irq(q->queue_lock);
+
+	bfq_shutdown_timer_wq(bfqd);
+
+#ifdef CONFIG_BFQ_GROUP_IOSCHED
+	blkcg_deactivate_policy(q, &blkcg_policy_bfq);
+#endif
+	kfree(bfqd);
+}
+
+static int bfq_init_queue(struct request_queue *q, struct elevator_type *e)
+{
+	struct bfq_data *bfqd;
+	struct elevator_queue *eq;
+	int i;
+
+	eq = elevator_alloc(q, e);
+	if (!eq)
+		return -ENOMEM;
+
+	bfqd = kzalloc_node(sizeof(*bfqd), GFP_KERNEL, q->node);
+	if (!bfqd) {
+		kobject_put(&eq->kobj);
+		return -ENOMEM;
+	}
+	eq->elevator_data = bfqd;
+
+	bfqd->queue = q;
+	spin_lock_irq(q->queue_lock);
+	q->elevator = eq;
+	spin_unlock_irq(q->queue_lock);
+
+#ifdef CONFIG_BFQ_GROUP_IOSCHED
+	i = blkcg_activate_policy(q, &blkcg_policy_bfq);
+	if (i) {
+		kfree(bfqd);
+		kobject_put(&eq->kobj);
+		return i;
+	}
+	bfqd->root_group = blkg_to_bfqg(q->root_blkg);
+#endif
+
+	for (i = 0; i < BFQ_IOPRIO_CLASSES; i++)
+		bfqd->st[i].active = RB_ROOT;
+
+	bfqd->bfq_max_budget = bfq_default_max_budget;
+
+	/*
+	 * Our fallback bfqq if bfq_find_alloc_queue() runs into OOM issues.
+	 * Grab a permanent reference to it, so that the normal code flow
+	 * will not attempt to free it.  It doesn't belong to any group.
+	 */
+	bfq_init_bfqq(bfqd, &bfqd->oom_bfqq, 1, 0);
+	bfqd->oom_bfqq.ref++;
+	bfq_clear_bfqq_just_created(&bfqd->oom_bfqq);
+#ifdef CONFIG_BFQ_GROUP_IOSCHED
+	bfqd->oom_bfqq.bfqg = bfqd->root_group;
+#endif
+
+	init_timer(&bfqd->idle_slice_timer);
+	bfqd->idle_slice_timer.function = bfq_idle_slice_timer;
+	bfqd->idle_slice_timer.data = (unsigned long) bfqd;
+
+	INIT_WORK(&bfqd->unplug_work, bfq_kick_queue);
+
+	bfqd->bfq_quantum = bfq_quantum;
+	bfqd->bfq_fifo_expire[0] = bfq_fifo_expire[0];
+	bfqd->bfq_fifo_expire[1] = bfq_fifo_expire[1];
+	bfqd->bfq_slice_idle = bfq_slice_idle;
+	bfqd->bfq_timeout = bfq_timeout;
+	bfqd->bfq_async_charge_factor = bfq_async_charge_factor;
+	bfqd->low_latency = 1;
+	bfqd->bfq_wr_coeff = bfq_wr_coeff;
+	bfqd->bfq_wr_max_time = bfq_wr_max_time;
+	bfqd->bfq_wr_rt_max_time = bfq_wr_rt_max_time;
+	bfqd->bfq_wr_min_idle_time = bfq_wr_min_idle_time;
+	bfqd->bfq_wr_max_softrt_rate = bfq_wr_max_softrt_rate;
+	bfqd->hw_tag = -1;
+	return 0;
+}
+
+/*
+ * sysfs parts below -->
+ */
+static ssize_t
+bfq_var_show(unsigned int var, char *page)
+{
+	return sprintf(page, "%u\n", var);
+}
+
+static ssize_t
+bfq_var_store(unsigned int *var, const char *page, size_t count)
+{
+	char *p = (char *) page;
+
+	*var = simple_strtoul(p, &p, 10);
+	return count;
+}
+
+#define SHOW_FUNCTION(__FUNC, __VAR, __CONV)				\
+static ssize_t __FUNC(struct elevator_queue *e, char *page)		\
+{									\
+	struct bfq_data *bfqd = e->elevator_data;			\
+	unsigned int __data = __VAR;					\
+	if (__CONV)							\
+		__data = jiffies_to_msecs(__data);			\
+	return bfq_var_show(__data, (page));				\
+}
+SHOW_FUNCTION(bfq_quantum_show, bfqd->bfq_quantum, 0);
+SHOW_FUNCTION(bfq_fifo_expire_sync_show, bfqd->bfq_fifo_expire[1], 1);
+SHOW_FUNCTION(bfq_fifo_expire_async_show, bfqd->bfq_fifo_expire[0], 1);
+SHOW_FUNCTION(bfq_slice_idle_show, bfqd->bfq_slice_idle, 1);
+SHOW_FUNCTION(bfq_max_budget_show, bfqd->bfq_user_max_budget, 0);
+SHOW_FUNCTION(bfq_timeout_show, bfqd->bfq_timeout, 1);
+SHOW_FUNCTION(bfq_async_charge_factor_show, bfqd->bfq_async_charge_factor, 0);
+SHOW_FUNCTION(bfq_low_latency_show, bfqd->low_latency, 0);
+SHOW_FUNCTION(bfq_wr_coeff_show, bfqd->bfq_wr_coeff, 0);
+SHOW_FUNCTION(bfq_wr_max_time_show, bfqd->bfq_wr_max_time, 1);
+SHOW_FUNCTION(bfq_wr_rt_max_time_show, bfqd->bfq_wr_rt_max_time, 1);
+SHOW_FUNCTION(bfq_wr_min_idle_time_show, bfqd->bfq_wr_min_idle_time, 1);
+SHOW_FUNCTION(bfq_wr_max_softrt_rate_show, bfqd->bfq_wr_max_softrt_rate, 0);
+#undef SHOW_FUNCTION
+
+#define STORE_FUNCTION(__FUNC, __PTR, MIN, MAX, __CONV)			\
+static ssize_t __FUNC(struct elevator_queue *e, const char *page, size_t count)	\
+{									\
+	struct bfq_data *bfqd = e->elevator_data;			\
+	unsigned int __data;						\
+	int ret = bfq_var_store(&__data, (page), count);		\
+	if (__data < (MIN))						\
+		__data = (MIN);						\
+	else if (__data > (MAX))					\
+		__data = (MAX);						\
+	if (__CONV)							\
+		*(__PTR) = msecs_to_jiffies(__data);			\
+	else								\
+		*(__PTR) = __data;					\
+	return ret;							\
+}
+STORE_FUNCTION(bfq_quantum_store, &bfqd->bfq_quantum, 1, UINT_MAX, 0);
+STORE_FUNCTION(bfq_fifo_expire_sync_store, &bfqd->bfq_fifo_expire[1], 1,
+		UINT_MAX, 1);
+STORE_FUNCTION(bfq_fifo_expire_async_store, &bfqd->bfq_fifo_expire[0], 1,
+		UINT_MAX, 1);
+STORE_FUNCTION(bfq_slice_idle_store, &bfqd->bfq_slice_idle, 0, UINT_MAX, 1);
+STORE_FUNCTION(bfq_timeout_store, &bfqd->bfq_timeout, 1, UINT_MAX, 1);
+STORE_FUNCTION(bfq_async_charge_factor_store,
+		&bfqd->bfq_async_charge_factor, 1, 100, 0);
+STORE_FUNCTION(bfq_low_latency_store, &bfqd->low_latency, 0, 1, 0);
+STORE_FUNCTION(bfq_wr_coeff_store, &bfqd->bfq_wr_coeff, 1, 100, 0);
+STORE_FUNCTION(bfq_wr_max_time_store, &bfqd->bfq_wr_max_time, 0,
+		UINT_MAX, 1);
+STORE_FUNCTION(bfq_wr_rt_max_time_store, &bfqd->bfq_wr_rt_max_time, 0,
+		UINT_MAX, 1);
+STORE_FUNCTION(bfq_wr_min_idle_time_store, &bfqd->bfq_wr_min_idle_time, 0,
+		UINT_MAX, 1);
+STORE_FUNCTION(bfq_wr_max_softrt_rate_store, &bfqd->bfq_wr_max_softrt_rate,
+		0, UINT_MAX, 0);
+#undef STORE_FUNCTION
+
+/*
+ * Writing 0 restores the default maximum budget.  Any other value is
+ * kept large enough for bfq_min_budget() not to drop to zero.
+ */
+static ssize_t bfq_max_budget_store(struct elevator_queue *e,
+				    const char *page, size_t count)
+{
+	struct bfq_data *bfqd = e->elevator_data;
+	unsigned int __data;
+	int ret = bfq_var_store(&__data, (page), count);
+
+	if (__data > INT_MAX)
+		__data = INT_MAX;
+	else if (__data && __data < 1U << BFQ_MIN_BUDGET_SHIFT)
+		__data = 1U << BFQ_MIN_BUDGET_SHIFT;
+	bfqd->bfq_user_max_budget = __data;
+	bfqd->bfq_max_budget = __data ?: bfq_default_max_budget;
+	return ret;
+}
+
+#define BFQ_ATTR(name) \
+	__ATTR(name, S_IRUGO|S_IWUSR, bfq_##name##_show, bfq_##name##_store)
+
+static struct elv_fs_entry bfq_attrs[] = {
+	BFQ_ATTR(quantum),
+	BFQ_ATTR(fifo_expire_sync),
+	BFQ_ATTR(fifo_expire_async),
+	BFQ_ATTR(slice_idle),
+	BFQ_ATTR(max_budget),
+	BFQ_ATTR(timeout),
+	BFQ_ATTR(async_charge_factor),
+	BFQ_ATTR(low_latency),
+	BFQ_ATTR(wr_coeff),
+	BFQ_ATTR(wr_max_time),
+	BFQ_ATTR(wr_rt_max_time),
+	BFQ_ATTR(wr_min_idle_time),
+	BFQ_ATTR(wr_max_softrt_rate),
+	__ATTR_NULL
+};
+
+static struct elevator_type iosched_bfq = {
+	.ops = {
+		.elevator_merge_fn =		bfq_merge,
+		.elevator_merged_fn =		bfq_merged_request,
+		.elevator_merge_req_fn =	bfq_merged_requests,
+		.elevator_allow_merge_fn =	bfq_allow_merge,
+		.elevator_dispatch_fn =		bfq_dispatch_requests,
+		.elevator_add_req_fn =		bfq_insert_request,
+		.elevator_activate_req_fn =	bfq_activate_request,
+		.elevator_deactivate_req_fn =	bfq_deactivate_request,
+		.elevator_completed_req_fn =	bfq_completed_request,
+		.elevator_former_req_fn =	elv_rb_former_request,
+		.elevator_latter_req_fn =	elv_rb_latter_request,
+		.elevator_init_icq_fn =		bfq_init_icq,
+		.elevator_exit_icq_fn =		bfq_exit_icq,
+		.elevator_set_req_fn =		bfq_set_request,
+		.elevator_put_req_fn =		bfq_put_request,
+		.elevator_may_queue_fn =	bfq_may_queue,
+		.elevator_init_fn =		bfq_init_queue,
+		.elevator_exit_fn =		bfq_exit_queue,
+	},
+	.icq_size	=	sizeof(struct bfq_io_cq),
+	.icq_align	=	__alignof__(struct bfq_io_cq),
+	.elevator_attrs =	bfq_attrs,
+	.elevator_name	=	"bfq",
+	.elevator_owner =	THIS_MODULE,
+};
+
+#ifdef CONFIG_BFQ_GROUP_IOSCHED
+static struct blkcg_policy blkcg_policy_bfq = {
+	.pd_size		= sizeof(struct bfq_group),
+	.cftypes		= bfq_blkcg_files,
+
+	.pd_init_fn		= bfq_pd_init,
+};
+#endif
+
+static int __init bfq_init(void)
+{
+	int ret;
+
+	/*
+	 * could be 0 on HZ < 1000 setups
+	 */
+	if (!bfq_slice_idle)
+		bfq_slice_idle = 1;
+
+#ifdef CONFIG_BFQ_GROUP_IOSCHED
+	ret = blkcg_policy_register(&blkcg_policy_bfq);
+	if (ret)
+		return ret;
+#endif
+
+	ret = -ENOMEM;
+	bfq_pool = KMEM_CACHE(bfq_queue, 0);
+	if (!bfq_pool)
+		goto err_pol_unreg;
+
+	ret = elv_register(&iosched_bfq);
+	if (ret)
+		goto err_free_pool;
+
+	return 0;
+
+err_free_pool:
+	kmem_cache_destroy(bfq_pool);
+err_pol_unreg:
+#ifdef CONFIG_BFQ_GROUP_IOSCHED
+	blkcg_policy_unregister(&blkcg_policy_bfq);
+#endif
+	return ret;
+}
+
+static void __exit bfq_exit(void)
+{
+#ifdef CONFIG_BFQ_GROUP_IOSCHED
+	blkcg_policy_unregister(&blkcg_policy_bfq);
+#endif
+	elv_unregister(&iosched_bfq);
+	kmem_cache_destroy(bfq_pool);
+}
+
+module_init(bfq_init);
+module_exit(bfq_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Budget Fair Queueing IO scheduler");
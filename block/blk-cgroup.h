@@ -28,6 +28,11 @@
 #define CFQ_WEIGHT_MAX		1000
 #define CFQ_WEIGHT_DEFAULT	500
 
+/* BFQ specific, out here for blkcg->bfq_weight */
+#define BFQ_WEIGHT_MIN		1
+#define BFQ_WEIGHT_MAX		1000
+#define BFQ_WEIGHT_DEFAULT	100
+
 #ifdef CONFIG_BLK_CGROUP
 
 enum blkg_rwstat_type {
@@ -53,6 +58,7 @@ struct blkcg {
 	/* TODO: per-policy storage in blkcg */
 	unsigned int			cfq_weight;	/* belongs to cfq */
 	unsigned int			cfq_leaf_weight;
+	unsigned int			bfq_weight;	/* belongs to bfq */
 };
 
 struct blkg_stat {
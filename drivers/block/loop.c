@@ -70,11 +70,12 @@
 #include <linux/writeback.h>
 #include <linux/completion.h>
 #include <linux/highmem.h>
-#include <linux/kthread.h>
 #include <linux/splice.h>
 #include <linux/sysfs.h>
 #include <linux/miscdevice.h>
 #include <linux/falloc.h>
+#include <linux/aio.h>
+#include <linux/uio.h>
 #include "loop.h"
 
 #include <asm/uaccess.h>
@@ -85,6 +86,9 @@ static DEFINE_MUTEX(loop_index_mutex);
 static int max_part;
 static int part_shift;
 
+/* concurrent requests each device's workers may have in flight */
+#define LOOP_WQ_MAX_ACTIVE	16
+
 /*
  * Transfer functions
  */
@@ -411,17 +415,66 @@ lo_receive(struct loop_device *lo, struct bio *bio, int bsize, loff_t pos)
 	return 0;
 }
 
-static int do_bio_filebacked(struct loop_device *lo, struct bio *bio)
+/*
+ * Hand one bio of a request straight to the backing file.  The bio pages
+ * are passed down as a bvec iterator, so with O_DIRECT set on the backing
+ * file the data goes to disk without a copy through its page cache.
+ */
+static int lo_rw_dio(struct loop_device *lo, struct bio *bio, int rw,
+		     loff_t pos)
 {
+	struct file *file = lo->lo_backing_file;
+	struct iov_iter iter;
+	struct kiocb kiocb;
+	ssize_t ret;
+
+	iter.type = ITER_BVEC | rw;
+	iter.bvec = __bvec_iter_bvec(bio->bi_io_vec, bio->bi_iter);
+	iter.nr_segs = bio_segments(bio);
+	iter.iov_offset = bio->bi_iter.bi_bvec_done;
+	iter.count = bio->bi_iter.bi_size;
+
+	init_sync_kiocb(&kiocb, file);
+	kiocb.ki_pos = pos;
+	kiocb.ki_nbytes = iter.count;
+
+	if (rw == WRITE) {
+		file_start_write(file);
+		ret = file->f_op->write_iter(&kiocb, &iter);
+		file_end_write(file);
+	} else {
+		ret = file->f_op->read_iter(&kiocb, &iter);
+	}
+	if (ret == -EIOCBQUEUED)
+		ret = wait_on_sync_kiocb(&kiocb);
+
+	if (ret < 0)
+		return ret;
+	if (ret != bio->bi_iter.bi_size) {
+		struct bvec_iter saved = bio->bi_iter;
+
+		if (rw == WRITE)
+			return -EIO;
+		/* reads beyond the end of the backing file return zeroes */
+		bio_advance(bio, ret);
+		zero_fill_bio(bio);
+		bio->bi_iter = saved;
+	}
+	return 0;
+}
+
+static int do_req_filebacked(struct loop_device *lo, struct request *rq)
+{
+	struct bio *bio;
 	loff_t pos;
-	int ret;
+	int ret = 0;
 
-	pos = ((loff_t) bio->bi_iter.bi_sector << 9) + lo->lo_offset;
+	pos = ((loff_t) blk_rq_pos(rq) << 9) + lo->lo_offset;
 
-	if (bio_rw(bio) == WRITE) {
+	if (rq->cmd_flags & REQ_WRITE) {
 		struct file *file = lo->lo_backing_file;
 
-		if (bio->bi_rw & REQ_FLUSH) {
+		if (rq->cmd_flags & REQ_FLUSH) {
 			ret = vfs_fsync(file, 0);
 			if (unlikely(ret && ret != -EINVAL)) {
 				ret = -EIO;
@@ -435,8 +488,7 @@ static int do_bio_filebacked(struct loop_device *lo, struct bio *bio)
 		 * encryption is enabled, because it may give an attacker
 		 * useful information.
 		 */
-		if (bio->bi_rw & REQ_DISCARD) {
-			struct file *file = lo->lo_backing_file;
+		if (rq->cmd_flags & REQ_DISCARD) {
 			int mode = FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE;
 
 			if ((!file->f_op->fallocate) ||
@@ -445,186 +497,234 @@ static int do_bio_filebacked(struct loop_device *lo, struct bio *bio)
 				goto out;
 			}
 			ret = file->f_op->fallocate(file, mode, pos,
-						    bio->bi_iter.bi_size);
+						    blk_rq_bytes(rq));
 			if (unlikely(ret && ret != -EINVAL &&
 				     ret != -EOPNOTSUPP))
 				ret = -EIO;
 			goto out;
 		}
 
-		ret = lo_send(lo, bio, pos);
+		__rq_for_each_bio(bio, rq) {
+			if (lo->use_dio)
+				ret = lo_rw_dio(lo, bio, WRITE, pos);
+			else
+				ret = lo_send(lo, bio, pos);
+			if (ret < 0)
+				goto out;
+			pos += bio->bi_iter.bi_size;
+		}
 
-		if ((bio->bi_rw & REQ_FUA) && !ret) {
+		if ((rq->cmd_flags & REQ_FUA) && !ret) {
 			ret = vfs_fsync(file, 0);
 			if (unlikely(ret && ret != -EINVAL))
 				ret = -EIO;
 		}
-	} else
-		ret = lo_receive(lo, bio, lo->lo_blocksize, pos);
+	} else {
+		__rq_for_each_bio(bio, rq) {
+			if (lo->use_dio)
+				ret = lo_rw_dio(lo, bio, READ, pos);
+			else
+				ret = lo_receive(lo, bio, lo->lo_blocksize,
+						 pos);
+			if (ret < 0)
+				goto out;
+			pos += bio->bi_iter.bi_size;
+		}
+	}
 
 out:
 	return ret;
 }
 
-/*
- * Add bio to back of pending list
- */
-static void loop_add_bio(struct loop_device *lo, struct bio *bio)
+static void loop_handle_cmd(struct loop_cmd *cmd)
 {
-	lo->lo_bio_count++;
-	bio_list_add(&lo->lo_bio_list, bio);
+	const bool write = cmd->rq->cmd_flags & REQ_WRITE;
+	struct loop_device *lo = cmd->rq->q->queuedata;
+	int ret = -EIO;
+
+	if (write && (lo->lo_flags & LO_FLAGS_READ_ONLY))
+		goto failed;
+
+	ret = do_req_filebacked(lo, cmd->rq);
+
+ failed:
+	if (ret)
+		cmd->rq->errors = -EIO;
+	blk_mq_complete_request(cmd->rq);
 }
 
 /*
- * Grab first pending buffer
+ * Buffered writes go through the backing file's page cache and are
+ * handled in submission order by a single work item per device; reads
+ * and direct writes each get their own work item so they can be in
+ * flight concurrently on the device's workqueue.
  */
-static struct bio *loop_get_bio(struct loop_device *lo)
+static void loop_queue_write_work(struct work_struct *work)
 {
-	lo->lo_bio_count--;
-	return bio_list_pop(&lo->lo_bio_list);
-}
+	struct loop_device *lo =
+		container_of(work, struct loop_device, write_work);
+	LIST_HEAD(cmd_list);
 
-static void loop_make_request(struct request_queue *q, struct bio *old_bio)
-{
-	struct loop_device *lo = q->queuedata;
-	int rw = bio_rw(old_bio);
+	spin_lock_irq(&lo->lo_lock);
+ repeat:
+	list_splice_init(&lo->write_cmd_head, &cmd_list);
+	spin_unlock_irq(&lo->lo_lock);
 
-	if (rw == READA)
-		rw = READ;
+	while (!list_empty(&cmd_list)) {
+		struct loop_cmd *cmd = list_first_entry(&cmd_list,
+				struct loop_cmd, list);
 
-	BUG_ON(!lo || (rw != READ && rw != WRITE));
+		list_del_init(&cmd->list);
+		loop_handle_cmd(cmd);
+	}
 
 	spin_lock_irq(&lo->lo_lock);
-	if (lo->lo_state != Lo_bound)
-		goto out;
-	if (unlikely(rw == WRITE && (lo->lo_flags & LO_FLAGS_READ_ONLY)))
-		goto out;
-	if (lo->lo_bio_count >= q->nr_congestion_on)
-		wait_event_lock_irq(lo->lo_req_wait,
-				    lo->lo_bio_count < q->nr_congestion_off,
-				    lo->lo_lock);
-	loop_add_bio(lo, old_bio);
-	wake_up(&lo->lo_event);
+	if (!list_empty(&lo->write_cmd_head))
+		goto repeat;
+	lo->write_started = false;
 	spin_unlock_irq(&lo->lo_lock);
-	return;
-
-out:
-	spin_unlock_irq(&lo->lo_lock);
-	bio_io_error(old_bio);
 }
 
-struct switch_request {
-	struct file *file;
-	struct completion wait;
-};
-
-static void do_loop_switch(struct loop_device *, struct switch_request *);
-
-static inline void loop_handle_bio(struct loop_device *lo, struct bio *bio)
+static void loop_queue_work(struct work_struct *work)
 {
-	if (unlikely(!bio->bi_bdev)) {
-		do_loop_switch(lo, bio->bi_private);
-		bio_put(bio);
-	} else {
-		int ret = do_bio_filebacked(lo, bio);
-		bio_endio(bio, ret);
-	}
+	struct loop_cmd *cmd = container_of(work, struct loop_cmd, work);
+
+	loop_handle_cmd(cmd);
 }
 
-/*
- * worker thread that handles reads/writes to file backed loop devices,
- * to avoid blocking in our make_request_fn. it also does loop decrypting
- * on reads for block backed loop, as that is too heavy to do from
- * b_end_io context where irqs may be disabled.
- *
- * Loop explanation:  loop_clr_fd() sets lo_state to Lo_rundown before
- * calling kthread_stop().  Therefore once kthread_should_stop() is
- * true, make_request will not place any more requests.  Therefore
- * once kthread_should_stop() is true and lo_bio is NULL, we are
- * done with the loop.
- */
-static int loop_thread(void *data)
+static int loop_queue_rq(struct blk_mq_hw_ctx *hctx, struct request *rq,
+			 bool last)
 {
-	struct loop_device *lo = data;
-	struct bio *bio;
+	struct loop_cmd *cmd = blk_mq_rq_to_pdu(rq);
+	struct loop_device *lo = rq->q->queuedata;
 
-	set_user_nice(current, MIN_NICE);
+	blk_mq_start_request(rq);
 
-	while (!kthread_should_stop() || !bio_list_empty(&lo->lo_bio_list)) {
+	if (lo->lo_state != Lo_bound)
+		return BLK_MQ_RQ_QUEUE_ERROR;
 
-		wait_event_interruptible(lo->lo_event,
-				!bio_list_empty(&lo->lo_bio_list) ||
-				kthread_should_stop());
+	if ((rq->cmd_flags & REQ_WRITE) && !lo->use_dio) {
+		bool need_sched = true;
 
-		if (bio_list_empty(&lo->lo_bio_list))
-			continue;
 		spin_lock_irq(&lo->lo_lock);
-		bio = loop_get_bio(lo);
-		if (lo->lo_bio_count < lo->lo_queue->nr_congestion_off)
-			wake_up(&lo->lo_req_wait);
+		if (lo->write_started)
+			need_sched = false;
+		else
+			lo->write_started = true;
+		list_add_tail(&cmd->list, &lo->write_cmd_head);
 		spin_unlock_irq(&lo->lo_lock);
 
-		BUG_ON(!bio);
-		loop_handle_bio(lo, bio);
+		if (need_sched)
+			queue_work(lo->wq, &lo->write_work);
+	} else {
+		queue_work(lo->wq, &cmd->work);
 	}
 
-	return 0;
+	return BLK_MQ_RQ_QUEUE_OK;
 }
 
-/*
- * loop_switch performs the hard work of switching a backing store.
- * First it needs to flush existing IO, it does this by sending a magic
- * BIO down the pipe. The completion of this BIO does the actual switch.
- */
-static int loop_switch(struct loop_device *lo, struct file *file)
-{
-	struct switch_request w;
-	struct bio *bio = bio_alloc(GFP_KERNEL, 0);
-	if (!bio)
-		return -ENOMEM;
-	init_completion(&w.wait);
-	w.file = file;
-	bio->bi_private = &w;
-	bio->bi_bdev = NULL;
-	loop_make_request(lo->lo_queue, bio);
-	wait_for_completion(&w.wait);
+static void loop_complete_rq(struct request *rq)
+{
+	blk_mq_end_request(rq, rq->errors);
+}
+
+static int loop_init_request(void *data, struct request *rq,
+		unsigned int hctx_idx, unsigned int request_idx,
+		unsigned int numa_node)
+{
+	struct loop_cmd *cmd = blk_mq_rq_to_pdu(rq);
+
+	cmd->rq = rq;
+	INIT_LIST_HEAD(&cmd->list);
+	INIT_WORK(&cmd->work, loop_queue_work);
+
 	return 0;
 }
 
+static struct blk_mq_ops loop_mq_ops = {
+	.queue_rq	= loop_queue_rq,
+	.map_queue	= blk_mq_map_queue,
+	.init_request	= loop_init_request,
+	.complete	= loop_complete_rq,
+};
+
 /*
- * Helper to flush the IOs in loop, but keeping loop thread running
+ * Helper to flush the IOs in loop: freezing the queue waits for every
+ * request that has been started to complete.
  */
-static int loop_flush(struct loop_device *lo)
+static void loop_flush(struct loop_device *lo)
 {
-	/* loop not yet configured, no running thread, nothing to flush */
-	if (!lo->lo_thread)
-		return 0;
+	/* loop not yet configured, nothing to flush */
+	if (lo->lo_state != Lo_bound)
+		return;
 
-	return loop_switch(lo, NULL);
+	blk_mq_freeze_queue(lo->lo_queue);
+	blk_mq_unfreeze_queue(lo->lo_queue);
+}
+
+static bool loop_dio_allowed(struct loop_device *lo)
+{
+	struct file *file = lo->lo_backing_file;
+	struct inode *inode = file->f_mapping->host;
+	unsigned short sb_bsize = 0;
+
+	if (lo->transfer != transfer_none || lo->lo_encrypt_key_size)
+		return false;
+	if (!file->f_mapping->a_ops->direct_IO ||
+	    !file->f_op->read_iter || !file->f_op->write_iter)
+		return false;
+
+	if (inode->i_sb->s_bdev)
+		sb_bsize = bdev_logical_block_size(inode->i_sb->s_bdev);
+	else if (S_ISBLK(inode->i_mode))
+		sb_bsize = bdev_logical_block_size(inode->i_bdev);
+
+	/*
+	 * Every request has to be aligned to the logical block size of
+	 * the device backing the file, which holds when the loop device
+	 * advertises a block size at least that large and lo_offset keeps
+	 * the alignment.
+	 */
+	if (!sb_bsize || (lo->lo_offset & (sb_bsize - 1)))
+		return false;
+	return queue_logical_block_size(lo->lo_queue) >= sb_bsize;
 }
 
 /*
- * Do the actual switch; called from the BIO completion routine
+ * Switch the device between buffered and direct I/O on the backing file.
+ * The queue is frozen across the switch so no request sees a half-updated
+ * mode, and the page cache of the file is written back first so direct
+ * reads do not miss data still sitting in it.
  */
-static void do_loop_switch(struct loop_device *lo, struct switch_request *p)
+static int __loop_update_dio(struct loop_device *lo, bool dio)
 {
-	struct file *file = p->file;
-	struct file *old_file = lo->lo_backing_file;
-	struct address_space *mapping;
+	struct file *file = lo->lo_backing_file;
 
-	/* if no new file, only flush of queued bios requested */
-	if (!file)
-		goto out;
+	if (dio && !loop_dio_allowed(lo))
+		return -EINVAL;
+	if (lo->use_dio == dio)
+		return 0;
 
-	mapping = file->f_mapping;
-	mapping_set_gfp_mask(old_file->f_mapping, lo->old_gfp_mask);
-	lo->lo_backing_file = file;
-	lo->lo_blocksize = S_ISBLK(mapping->host->i_mode) ?
-		mapping->host->i_bdev->bd_block_size : PAGE_SIZE;
-	lo->old_gfp_mask = mapping_gfp_mask(mapping);
-	mapping_set_gfp_mask(mapping, lo->old_gfp_mask & ~(__GFP_IO|__GFP_FS));
-out:
-	complete(&p->wait);
+	vfs_fsync(file, 0);
+
+	blk_mq_freeze_queue(lo->lo_queue);
+	lo->use_dio = dio;
+	spin_lock(&file->f_lock);
+	if (dio)
+		file->f_flags |= O_DIRECT;
+	else
+		file->f_flags &= ~O_DIRECT;
+	spin_unlock(&file->f_lock);
+	if (dio) {
+		lo->lo_flags |= LO_FLAGS_DIRECT_IO;
+		queue_flag_clear_unlocked(QUEUE_FLAG_NOMERGES, lo->lo_queue);
+	} else {
+		lo->lo_flags &= ~LO_FLAGS_DIRECT_IO;
+		queue_flag_set_unlocked(QUEUE_FLAG_NOMERGES, lo->lo_queue);
+	}
+	blk_mq_unfreeze_queue(lo->lo_queue);
+
+	return 0;
 }
 
 
@@ -641,6 +741,7 @@ static int loop_change_fd(struct loop_device *lo, struct block_device *bdev,
 {
 	struct file	*file, *old_file;
 	struct inode	*inode;
+	bool		dio;
 	int		error;
 
 	error = -ENXIO;
@@ -669,10 +770,23 @@ static int loop_change_fd(struct loop_device *lo, struct block_device *bdev,
 	if (get_loop_size(lo, file) != get_loop_size(lo, old_file))
 		goto out_putf;
 
-	/* and ... switch */
-	error = loop_switch(lo, file);
-	if (error)
-		goto out_putf;
+	/* and ... switch, leaving direct I/O on the old file first */
+	dio = lo->use_dio;
+	if (dio)
+		__loop_update_dio(lo, false);
+
+	blk_mq_freeze_queue(lo->lo_queue);
+	mapping_set_gfp_mask(old_file->f_mapping, lo->old_gfp_mask);
+	lo->lo_backing_file = file;
+	lo->lo_blocksize = S_ISBLK(inode->i_mode) ?
+		inode->i_bdev->bd_block_size : PAGE_SIZE;
+	lo->old_gfp_mask = mapping_gfp_mask(file->f_mapping);
+	mapping_set_gfp_mask(file->f_mapping,
+			     lo->old_gfp_mask & ~(__GFP_IO|__GFP_FS));
+	blk_mq_unfreeze_queue(lo->lo_queue);
+
+	if (dio)
+		__loop_update_dio(lo, true);
 
 	fput(old_file);
 	if (lo->lo_flags & LO_FLAGS_PARTSCAN)
@@ -759,18 +873,57 @@ static ssize_t loop_attr_partscan_show(struct loop_device *lo, char *buf)
 	return sprintf(buf, "%s\n", partscan ? "1" : "0");
 }
 
+static ssize_t loop_attr_dio_show(struct loop_device *lo, char *buf)
+{
+	int dio = (lo->lo_flags & LO_FLAGS_DIRECT_IO);
+
+	return sprintf(buf, "%s\n", dio ? "1" : "0");
+}
+
+static ssize_t loop_attr_do_store_dio(struct device *dev,
+				      struct device_attribute *attr,
+				      const char *buf, size_t count)
+{
+	struct loop_device *lo = dev_to_disk(dev)->private_data;
+	bool dio;
+	int err;
+
+	err = strtobool(buf, &dio);
+	if (err)
+		return err;
+
+	mutex_lock(&lo->lo_ctl_mutex);
+	if (lo->lo_state == Lo_bound)
+		err = __loop_update_dio(lo, dio);
+	else
+		err = -ENXIO;
+	mutex_unlock(&lo->lo_ctl_mutex);
+
+	return err ? err : count;
+}
+
 LOOP_ATTR_RO(backing_file);
 LOOP_ATTR_RO(offset);
 LOOP_ATTR_RO(sizelimit);
 LOOP_ATTR_RO(autoclear);
 LOOP_ATTR_RO(partscan);
 
+static ssize_t loop_attr_do_show_dio(struct device *d,
+				     struct device_attribute *attr, char *b)
+{
+	return loop_attr_show(d, b, loop_attr_dio_show);
+}
+static struct device_attribute loop_attr_dio =
+	__ATTR(dio, S_IRUGO | S_IWUSR, loop_attr_do_show_dio,
+	       loop_attr_do_store_dio);
+
 static struct attribute *loop_attrs[] = {
 	&loop_attr_backing_file.attr,
 	&loop_attr_offset.attr,
 	&loop_attr_sizelimit.attr,
 	&loop_attr_autoclear.attr,
 	&loop_attr_partscan.attr,
+	&loop_attr_dio.attr,
 	NULL,
 };
 
@@ -889,12 +1042,10 @@ static int loop_set_fd(struct loop_device *lo, fmode_t mode,
 	lo->transfer = transfer_none;
 	lo->ioctl = NULL;
 	lo->lo_sizelimit = 0;
-	lo->lo_bio_count = 0;
+	lo->use_dio = false;
 	lo->old_gfp_mask = mapping_gfp_mask(mapping);
 	mapping_set_gfp_mask(mapping, lo->old_gfp_mask & ~(__GFP_IO|__GFP_FS));
 
-	bio_list_init(&lo->lo_bio_list);
-
 	if (!(lo_flags & LO_FLAGS_READ_ONLY) && file->f_op->fsync)
 		blk_queue_flush(lo->lo_queue, REQ_FLUSH);
 
@@ -906,14 +1057,14 @@ static int loop_set_fd(struct loop_device *lo, fmode_t mode,
 
 	set_blocksize(bdev, lo_blocksize);
 
-	lo->lo_thread = kthread_create(loop_thread, lo, "loop%d",
-						lo->lo_number);
-	if (IS_ERR(lo->lo_thread)) {
-		error = PTR_ERR(lo->lo_thread);
+	error = -ENOMEM;
+	lo->wq = alloc_workqueue("kloopd%d",
+			WQ_MEM_RECLAIM | WQ_HIGHPRI | WQ_UNBOUND,
+			LOOP_WQ_MAX_ACTIVE, lo->lo_number);
+	if (!lo->wq)
 		goto out_clr;
-	}
+	error = 0;
 	lo->lo_state = Lo_bound;
-	wake_up_process(lo->lo_thread);
 	if (part_shift)
 		lo->lo_flags |= LO_FLAGS_PARTSCAN;
 	if (lo->lo_flags & LO_FLAGS_PARTSCAN)
@@ -927,7 +1078,6 @@ static int loop_set_fd(struct loop_device *lo, fmode_t mode,
 
 out_clr:
 	loop_sysfs_exit(lo);
-	lo->lo_thread = NULL;
 	lo->lo_device = NULL;
 	lo->lo_backing_file = NULL;
 	lo->lo_flags = 0;
@@ -1010,16 +1160,25 @@ static int loop_clr_fd(struct loop_device *lo)
 	if (filp == NULL)
 		return -EINVAL;
 
-	spin_lock_irq(&lo->lo_lock);
-	lo->lo_state = Lo_rundown;
-	spin_unlock_irq(&lo->lo_lock);
-
-	kthread_stop(lo->lo_thread);
+	/* freeze waits for everything already queued to the workers */
+	blk_mq_freeze_queue(lo->lo_queue);
 
 	spin_lock_irq(&lo->lo_lock);
+	lo->lo_state = Lo_rundown;
 	lo->lo_backing_file = NULL;
 	spin_unlock_irq(&lo->lo_lock);
 
+	destroy_workqueue(lo->wq);
+	lo->wq = NULL;
+	if (lo->use_dio) {
+		spin_lock(&filp->f_lock);
+		filp->f_flags &= ~O_DIRECT;
+		spin_unlock(&filp->f_lock);
+		lo->use_dio = false;
+		queue_flag_set_unlocked(QUEUE_FLAG_NOMERGES, lo->lo_queue);
+	}
+	blk_mq_unfreeze_queue(lo->lo_queue);
+
 	loop_release_xfer(lo);
 	lo->transfer = NULL;
 	lo->ioctl = NULL;
@@ -1028,7 +1187,6 @@ static int loop_clr_fd(struct loop_device *lo)
 	lo->lo_offset = 0;
 	lo->lo_sizelimit = 0;
 	lo->lo_encrypt_key_size = 0;
-	lo->lo_thread = NULL;
 	memset(lo->lo_encrypt_key, 0, LO_KEY_SIZE);
 	memset(lo->lo_crypt_name, 0, LO_NAME_SIZE);
 	memset(lo->lo_file_name, 0, LO_NAME_SIZE);
@@ -1064,7 +1222,7 @@ static int loop_clr_fd(struct loop_device *lo)
 }
 
 static int
-loop_set_status(struct loop_device *lo, const struct loop_info64 *info)
+__loop_set_status(struct loop_device *lo, const struct loop_info64 *info)
 {
 	int err;
 	struct loop_func_table *xfer;
@@ -1138,6 +1296,29 @@ loop_set_status(struct loop_device *lo, const struct loop_info64 *info)
 	return 0;
 }
 
+static int
+loop_set_status(struct loop_device *lo, const struct loop_info64 *info)
+{
+	bool was_dio = lo->use_dio;
+	int err;
+
+	if (lo->lo_state != Lo_bound)
+		return -ENXIO;
+
+	/*
+	 * The transfer function and offset must not change under direct
+	 * I/O, so drop back to buffered mode and re-enable direct I/O
+	 * afterwards if the caller asked for it and the new setup still
+	 * allows it. A failed update keeps the old mode.
+	 */
+	if (was_dio)
+		__loop_update_dio(lo, false);
+	err = __loop_set_status(lo, info);
+	if (err ? was_dio : (info->lo_flags & LO_FLAGS_DIRECT_IO))
+		__loop_update_dio(lo, true);
+	return err;
+}
+
 static int
 loop_get_status(struct loop_device *lo, struct loop_info64 *info)
 {
@@ -1523,7 +1704,7 @@ static void __lo_release(struct loop_device *lo)
 
 	if (lo->lo_flags & LO_FLAGS_AUTOCLEAR) {
 		/*
-		 * In autoclear mode, stop the loop thread
+		 * In autoclear mode, stop the loop workers
 		 * and remove configuration after last close.
 		 */
 		err = loop_clr_fd(lo);
@@ -1531,8 +1712,8 @@ static void __lo_release(struct loop_device *lo)
 			return;
 	} else {
 		/*
-		 * Otherwise keep thread (if running) and config,
-		 * but flush possible ongoing bios in thread.
+		 * Otherwise keep the workers (if running) and config,
+		 * but flush possible ongoing requests.
 		 */
 		loop_flush(lo);
 	}
@@ -1632,16 +1813,35 @@ static int loop_add(struct loop_device **l, int i)
 		goto out_free_dev;
 	i = err;
 
-	err = -ENOMEM;
-	lo->lo_queue = blk_alloc_queue(GFP_KERNEL);
-	if (!lo->lo_queue)
+	lo->tag_set.ops = &loop_mq_ops;
+	lo->tag_set.nr_hw_queues = 1;
+	lo->tag_set.queue_depth = 128;
+	lo->tag_set.numa_node = NUMA_NO_NODE;
+	lo->tag_set.cmd_size = sizeof(struct loop_cmd);
+	lo->tag_set.flags = BLK_MQ_F_SHOULD_MERGE | BLK_MQ_F_SG_MERGE;
+	lo->tag_set.driver_data = lo;
+
+	err = blk_mq_alloc_tag_set(&lo->tag_set);
+	if (err)
 		goto out_free_idr;
 
+	lo->lo_queue = blk_mq_init_queue(&lo->tag_set);
+	if (IS_ERR(lo->lo_queue)) {
+		err = PTR_ERR(lo->lo_queue);
+		goto out_cleanup_tags;
+	}
+	lo->lo_queue->queuedata = lo;
+
 	/*
-	 * set queue make_request_fn
+	 * Buffered I/O is handled one bio at a time, so merging only helps
+	 * once direct I/O is switched on.
 	 */
-	blk_queue_make_request(lo->lo_queue, loop_make_request);
-	lo->lo_queue->queuedata = lo;
+	queue_flag_set_unlocked(QUEUE_FLAG_NOMERGES, lo->lo_queue);
+
+	INIT_LIST_HEAD(&lo->write_cmd_head);
+	INIT_WORK(&lo->write_work, loop_queue_write_work);
+
+	err = -ENOMEM;
 
 	disk = lo->lo_disk = alloc_disk(1 << part_shift);
 	if (!disk)
@@ -1670,9 +1870,6 @@ static int loop_add(struct loop_device **l, int i)
 	disk->flags |= GENHD_FL_EXT_DEVT;
 	mutex_init(&lo->lo_ctl_mutex);
 	lo->lo_number		= i;
-	lo->lo_thread		= NULL;
-	init_waitqueue_head(&lo->lo_event);
-	init_waitqueue_head(&lo->lo_req_wait);
 	spin_lock_init(&lo->lo_lock);
 	disk->major		= LOOP_MAJOR;
 	disk->first_minor	= i << part_shift;
@@ -1686,6 +1883,8 @@ static int loop_add(struct loop_device **l, int i)
 
 out_free_queue:
 	blk_cleanup_queue(lo->lo_queue);
+out_cleanup_tags:
+	blk_mq_free_tag_set(&lo->tag_set);
 out_free_idr:
 	idr_remove(&loop_index_idr, i);
 out_free_dev:
@@ -1698,6 +1897,7 @@ static void loop_remove(struct loop_device *lo)
 {
 	del_gendisk(lo->lo_disk);
 	blk_cleanup_queue(lo->lo_queue);
+	blk_mq_free_tag_set(&lo->tag_set);
 	put_disk(lo->lo_disk);
 	kfree(lo);
 }
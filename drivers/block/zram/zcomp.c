@@ -67,6 +67,7 @@ static void zcomp_strm_free(struct zcomp *comp, struct zcomp_strm *zstrm)
 	if (zstrm->private)
 		comp->backend->destroy(zstrm->private);
 	free_pages((unsigned long)zstrm->buffer, 1);
+	free_page((unsigned long)zstrm->scratch);
 	kfree(zstrm);
 }
 
@@ -86,7 +87,8 @@ static struct zcomp_strm *zcomp_strm_alloc(struct zcomp *comp)
 	 * case when compressed size is larger than the original one
 	 */
 	zstrm->buffer = (void *)__get_free_pages(GFP_KERNEL | __GFP_ZERO, 1);
-	if (!zstrm->private || !zstrm->buffer) {
+	zstrm->scratch = (void *)__get_free_page(GFP_KERNEL);
+	if (!zstrm->private || !zstrm->buffer || !zstrm->scratch) {
 		zcomp_strm_free(comp, zstrm);
 		zstrm = NULL;
 	}
@@ -15,6 +15,8 @@
 struct zcomp_strm {
 	/* compression/decompression buffer */
 	void *buffer;
+	/* uncompressed page for partial I/O read-modify-write */
+	void *scratch;
 	/*
 	 * The private data of the compression stream, only compression
 	 * stream backend can touch this (e.g. compression algorithm
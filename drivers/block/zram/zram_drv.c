@@ -354,31 +354,45 @@ static void update_position(u32 *index, int *offset, struct bio_vec *bvec)
 	*offset = (*offset + bvec->bv_len) % PAGE_SIZE;
 }
 
-static int page_zero_filled(void *ptr)
+static int page_same_filled(void *ptr, unsigned long *element)
 {
 	unsigned int pos;
 	unsigned long *page;
 
 	page = (unsigned long *)ptr;
 
-	for (pos = 0; pos != PAGE_SIZE / sizeof(*page); pos++) {
-		if (page[pos])
+	for (pos = 0; pos < PAGE_SIZE / sizeof(*page) - 1; pos++) {
+		if (page[pos] != page[pos + 1])
 			return 0;
 	}
 
+	*element = page[pos];
+
 	return 1;
 }
 
-static void handle_zero_page(struct bio_vec *bvec)
+static void zram_fill_page(void *ptr, unsigned int len, unsigned long value)
+{
+	unsigned long *page = ptr;
+	unsigned int i;
+
+	WARN_ON_ONCE(!IS_ALIGNED(len, sizeof(unsigned long)));
+
+	if (likely(value == 0)) {
+		memset(ptr, 0, len);
+	} else {
+		for (i = 0; i < len / sizeof(*page); i++)
+			page[i] = value;
+	}
+}
+
+static void handle_same_page(struct bio_vec *bvec, unsigned long element)
 {
 	struct page *page = bvec->bv_page;
 	void *user_mem;
 
 	user_mem = kmap_atomic(page);
-	if (is_partial_io(bvec))
-		memset(user_mem + bvec->bv_offset, 0, bvec->bv_len);
-	else
-		clear_page(user_mem);
+	zram_fill_page(user_mem + bvec->bv_offset, bvec->bv_len, element);
 	kunmap_atomic(user_mem);
 
 	flush_dcache_page(page);
@@ -393,20 +407,25 @@ static void handle_zero_page(struct bio_vec *bvec)
 static void zram_free_page(struct zram *zram, size_t index)
 {
 	struct zram_meta *meta = zram->meta;
-	unsigned long handle = meta->table[index].handle;
+	unsigned long handle;
 
-	if (unlikely(!handle)) {
-		/*
-		 * No memory is allocated for zero filled pages.
-		 * Simply clear zero page flag.
-		 */
-		if (zram_test_flag(meta, index, ZRAM_ZERO)) {
-			zram_clear_flag(meta, index, ZRAM_ZERO);
+	/*
+	 * No memory is allocated for same element filled pages.
+	 * Simply clear same page flag.
+	 */
+	if (zram_test_flag(meta, index, ZRAM_SAME)) {
+		zram_clear_flag(meta, index, ZRAM_SAME);
+		if (!meta->table[index].element)
 			atomic64_dec(&zram->stats.zero_pages);
-		}
+		meta->table[index].element = 0;
+		atomic64_dec(&zram->stats.same_pages);
 		return;
 	}
 
+	handle = meta->table[index].handle;
+	if (unlikely(!handle))
+		return;
+
 	zs_free(meta->mem_pool, handle);
 
 	atomic64_sub(zram_get_obj_size(meta, index),
@@ -426,10 +445,18 @@ static int zram_decompress_page(struct zram *zram, char *mem, u32 index)
 	size_t size;
 
 	bit_spin_lock(ZRAM_ACCESS, &meta->table[index].value);
+	if (zram_test_flag(meta, index, ZRAM_SAME)) {
+		unsigned long element = meta->table[index].element;
+
+		bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
+		zram_fill_page(mem, PAGE_SIZE, element);
+		return 0;
+	}
+
 	handle = meta->table[index].handle;
 	size = zram_get_obj_size(meta, index);
 
-	if (!handle || zram_test_flag(meta, index, ZRAM_ZERO)) {
+	if (!handle) {
 		bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
 		clear_page(mem);
 		return 0;
@@ -459,31 +486,33 @@ static int zram_bvec_read(struct zram *zram, struct bio_vec *bvec,
 	struct page *page;
 	unsigned char *user_mem, *uncmem = NULL;
 	struct zram_meta *meta = zram->meta;
+	struct zcomp_strm *zstrm = NULL;
 	page = bvec->bv_page;
 
 	bit_spin_lock(ZRAM_ACCESS, &meta->table[index].value);
-	if (unlikely(!meta->table[index].handle) ||
-			zram_test_flag(meta, index, ZRAM_ZERO)) {
+	if (zram_test_flag(meta, index, ZRAM_SAME) ||
+			unlikely(!meta->table[index].handle)) {
+		unsigned long element = 0;
+
+		if (zram_test_flag(meta, index, ZRAM_SAME))
+			element = meta->table[index].element;
 		bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
-		handle_zero_page(bvec);
+		handle_same_page(bvec, element);
 		return 0;
 	}
 	bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
 
-	if (is_partial_io(bvec))
-		/* Use  a temporary buffer to decompress the page */
-		uncmem = kmalloc(PAGE_SIZE, GFP_NOIO);
+	if (is_partial_io(bvec)) {
+		/* Decompress into the stream's scratch page */
+		zstrm = zcomp_strm_find(zram->comp);
+		uncmem = zstrm->scratch;
+		atomic64_inc(&zram->stats.partial_reads);
+	}
 
 	user_mem = kmap_atomic(page);
 	if (!is_partial_io(bvec))
 		uncmem = user_mem;
 
-	if (!uncmem) {
-		pr_info("Unable to allocate temp memory\n");
-		ret = -ENOMEM;
-		goto out_cleanup;
-	}
-
 	ret = zram_decompress_page(zram, uncmem, index);
 	/* Should NEVER happen. Return bio error if it does. */
 	if (unlikely(ret))
@@ -497,8 +526,8 @@ static int zram_bvec_read(struct zram *zram, struct bio_vec *bvec,
 	ret = 0;
 out_cleanup:
 	kunmap_atomic(user_mem);
-	if (is_partial_io(bvec))
-		kfree(uncmem);
+	if (zstrm)
+		zcomp_strm_release(zram->comp, zstrm);
 	return ret;
 }
 
@@ -529,25 +558,23 @@ static int zram_bvec_write(struct zram *zram, struct bio_vec *bvec, u32 index,
 	struct zcomp_strm *zstrm;
 	bool locked = false;
 	unsigned long alloced_pages;
+	unsigned long element;
 
 	page = bvec->bv_page;
+	zstrm = zcomp_strm_find(zram->comp);
+	locked = true;
 	if (is_partial_io(bvec)) {
 		/*
 		 * This is a partial IO. We need to read the full page
 		 * before to write the changes.
 		 */
-		uncmem = kmalloc(PAGE_SIZE, GFP_NOIO);
-		if (!uncmem) {
-			ret = -ENOMEM;
-			goto out;
-		}
+		uncmem = zstrm->scratch;
+		atomic64_inc(&zram->stats.partial_writes);
 		ret = zram_decompress_page(zram, uncmem, index);
 		if (ret)
 			goto out;
 	}
 
-	zstrm = zcomp_strm_find(zram->comp);
-	locked = true;
 	user_mem = kmap_atomic(page);
 
 	if (is_partial_io(bvec)) {
@@ -559,16 +586,19 @@ static int zram_bvec_write(struct zram *zram, struct bio_vec *bvec, u32 index,
 		uncmem = user_mem;
 	}
 
-	if (page_zero_filled(uncmem)) {
+	if (page_same_filled(uncmem, &element)) {
 		if (user_mem)
 			kunmap_atomic(user_mem);
 		/* Free memory associated with this sector now. */
 		bit_spin_lock(ZRAM_ACCESS, &meta->table[index].value);
 		zram_free_page(zram, index);
-		zram_set_flag(meta, index, ZRAM_ZERO);
+		zram_set_flag(meta, index, ZRAM_SAME);
+		meta->table[index].element = element;
 		bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
 
-		atomic64_inc(&zram->stats.zero_pages);
+		atomic64_inc(&zram->stats.same_pages);
+		if (!element)
+			atomic64_inc(&zram->stats.zero_pages);
 		ret = 0;
 		goto out;
 	}
@@ -639,8 +669,6 @@ static int zram_bvec_write(struct zram *zram, struct bio_vec *bvec, u32 index,
 out:
 	if (locked)
 		zcomp_strm_release(zram->comp, zstrm);
-	if (is_partial_io(bvec))
-		kfree(uncmem);
 	return ret;
 }
 
@@ -650,13 +678,10 @@ static int zram_bvec_rw(struct zram *zram, struct bio_vec *bvec, u32 index,
 	int ret;
 	int rw = bio_data_dir(bio);
 
-	if (rw == READ) {
-		atomic64_inc(&zram->stats.num_reads);
+	if (rw == READ)
 		ret = zram_bvec_read(zram, bvec, index, offset, bio);
-	} else {
-		atomic64_inc(&zram->stats.num_writes);
+	else
 		ret = zram_bvec_write(zram, bvec, index, offset);
-	}
 
 	if (unlikely(ret)) {
 		if (rw == READ)
@@ -678,6 +703,7 @@ static void zram_bio_discard(struct zram *zram, u32 index,
 {
 	size_t n = bio->bi_iter.bi_size;
 	struct zram_meta *meta = zram->meta;
+	u64 nr_pages = 0;
 
 	/*
 	 * zram manages data in physical block size units. Because logical block
@@ -698,13 +724,24 @@ static void zram_bio_discard(struct zram *zram, u32 index,
 	}
 
 	while (n >= PAGE_SIZE) {
-		bit_spin_lock(ZRAM_ACCESS, &meta->table[index].value);
-		zram_free_page(zram, index);
-		bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
-		atomic64_inc(&zram->stats.notify_free);
+		/*
+		 * Slots that hold nothing need no locking: a write racing
+		 * with the discard of the same page may land either side
+		 * of it.  This keeps trimming a mostly empty device, which
+		 * is the common case for a filesystem on zram, a plain scan.
+		 */
+		if (meta->table[index].handle ||
+		    zram_test_flag(meta, index, ZRAM_SAME)) {
+			bit_spin_lock(ZRAM_ACCESS, &meta->table[index].value);
+			zram_free_page(zram, index);
+			bit_spin_unlock(ZRAM_ACCESS,
+					&meta->table[index].value);
+		}
+		nr_pages++;
 		index++;
 		n -= PAGE_SIZE;
 	}
+	atomic64_add(nr_pages, &zram->stats.notify_free);
 }
 
 static void zram_reset_device(struct zram *zram, bool reset_capacity)
@@ -725,7 +762,7 @@ static void zram_reset_device(struct zram *zram, bool reset_capacity)
 	/* Free all pages that are still in this zram device */
 	for (index = 0; index < zram->disksize >> PAGE_SHIFT; index++) {
 		unsigned long handle = meta->table[index].handle;
-		if (!handle)
+		if (!handle || zram_test_flag(meta, index, ZRAM_SAME))
 			continue;
 
 		zs_free(meta->mem_pool, handle);
@@ -851,10 +888,24 @@ out:
 	return ret;
 }
 
+/*
+ * Account a whole bio's worth of page I/O at once rather than bouncing
+ * the shared counter cacheline once per segment of a large bio.
+ */
+static inline void zram_account_io(struct zram *zram, struct bio *bio,
+				   u64 nr_segs)
+{
+	if (bio_data_dir(bio) == READ)
+		atomic64_add(nr_segs, &zram->stats.num_reads);
+	else
+		atomic64_add(nr_segs, &zram->stats.num_writes);
+}
+
 static void __zram_make_request(struct zram *zram, struct bio *bio)
 {
 	int offset;
 	u32 index;
+	u64 nr_segs = 0;
 	struct bio_vec bvec;
 	struct bvec_iter iter;
 
@@ -882,25 +933,31 @@ static void __zram_make_request(struct zram *zram, struct bio *bio)
 			bv.bv_len = max_transfer_size;
 			bv.bv_offset = bvec.bv_offset;
 
+			nr_segs++;
 			if (zram_bvec_rw(zram, &bv, index, offset, bio) < 0)
 				goto out;
 
 			bv.bv_len = bvec.bv_len - max_transfer_size;
 			bv.bv_offset += max_transfer_size;
+			nr_segs++;
 			if (zram_bvec_rw(zram, &bv, index + 1, 0, bio) < 0)
 				goto out;
-		} else
+		} else {
+			nr_segs++;
 			if (zram_bvec_rw(zram, &bvec, index, offset, bio) < 0)
 				goto out;
+		}
 
 		update_position(&index, &offset, &bvec);
 	}
 
+	zram_account_io(zram, bio, nr_segs);
 	set_bit(BIO_UPTODATE, &bio->bi_flags);
 	bio_endio(bio, 0);
 	return;
 
 out:
+	zram_account_io(zram, bio, nr_segs);
 	bio_io_error(bio);
 }
 
@@ -1008,6 +1065,9 @@ ZRAM_ATTR_RO(failed_writes);
 ZRAM_ATTR_RO(invalid_io);
 ZRAM_ATTR_RO(notify_free);
 ZRAM_ATTR_RO(zero_pages);
+ZRAM_ATTR_RO(same_pages);
+ZRAM_ATTR_RO(partial_reads);
+ZRAM_ATTR_RO(partial_writes);
 ZRAM_ATTR_RO(compr_data_size);
 
 static struct attribute *zram_disk_attrs[] = {
@@ -1021,6 +1081,9 @@ static struct attribute *zram_disk_attrs[] = {
 	&dev_attr_invalid_io.attr,
 	&dev_attr_notify_free.attr,
 	&dev_attr_zero_pages.attr,
+	&dev_attr_same_pages.attr,
+	&dev_attr_partial_reads.attr,
+	&dev_attr_partial_writes.attr,
 	&dev_attr_orig_data_size.attr,
 	&dev_attr_compr_data_size.attr,
 	&dev_attr_mem_used_total.attr,
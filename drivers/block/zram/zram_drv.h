@@ -66,8 +66,8 @@ static const size_t max_zpage_size = PAGE_SIZE / 4 * 3;
 
 /* Flags for zram pages (table[page_no].value) */
 enum zram_pageflags {
-	/* Page consists entirely of zeros */
-	ZRAM_ZERO = ZRAM_FLAG_SHIFT + 1,
+	/* Page consists of one repeated word, stored in table.element */
+	ZRAM_SAME = ZRAM_FLAG_SHIFT + 1,
 	ZRAM_ACCESS,	/* page in now accessed */
 
 	__NR_ZRAM_PAGEFLAGS,
@@ -77,7 +77,10 @@ enum zram_pageflags {
 
 /* Allocated for each disk page */
 struct zram_table_entry {
-	unsigned long handle;
+	union {
+		unsigned long handle;
+		unsigned long element;	/* fill word of ZRAM_SAME pages */
+	};
 	unsigned long value;
 };
 
@@ -90,6 +93,11 @@ struct zram_stats {
 	atomic64_t invalid_io;	/* non-page-aligned I/O requests */
 	atomic64_t notify_free;	/* no. of swap slot free notifications */
 	atomic64_t zero_pages;		/* no. of zero filled pages */
+	atomic64_t same_pages;		/* no. of same element filled pages,
+					   including zero filled ones */
+	atomic64_t partial_reads;	/* sub-page compressed reads */
+	atomic64_t partial_writes;	/* sub-page writes needing a
+					   read-modify-write of the page */
 	atomic64_t pages_stored;	/* no. of pages currently stored */
 	atomic_long_t max_used_pages;	/* no. of maximum pages stored */
 };
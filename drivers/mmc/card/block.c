@@ -28,6 +28,7 @@
 #include <linux/hdreg.h>
 #include <linux/kdev_t.h>
 #include <linux/blkdev.h>
+#include <linux/blk-mq.h>
 #include <linux/mutex.h>
 #include <linux/scatterlist.h>
 #include <linux/string_helpers.h>
@@ -152,6 +153,20 @@ static inline void mmc_blk_clear_packed(struct mmc_queue_req *mqrq)
 	packed->blocks = 0;
 }
 
+/*
+ * Complete @nr_bytes of @req and end it once nothing is left.  Returns
+ * true while part of the request is still outstanding.
+ */
+static bool mmc_blk_end_request(struct request *req, int error,
+				unsigned int nr_bytes)
+{
+	if (blk_update_request(req, error, nr_bytes))
+		return true;
+
+	__blk_mq_end_request(req, error);
+	return false;
+}
+
 static struct mmc_blk_data *mmc_blk_get(struct gendisk *disk)
 {
 	struct mmc_blk_data *md;
@@ -180,6 +195,7 @@ static void mmc_blk_put(struct mmc_blk_data *md)
 	if (md->usage == 0) {
 		int devidx = mmc_get_devidx(md->disk);
 		blk_cleanup_queue(md->queue.queue);
+		blk_mq_free_tag_set(&md->queue.tag_set);
 
 		__clear_bit(devidx, dev_use);
 
@@ -1223,7 +1239,7 @@ out:
 		goto retry;
 	if (!err)
 		mmc_blk_reset_success(md, type);
-	blk_end_request(req, err, blk_rq_bytes(req));
+	mmc_blk_end_request(req, err, blk_rq_bytes(req));
 
 	return err ? 0 : 1;
 }
@@ -1290,7 +1306,7 @@ out_retry:
 	if (!err)
 		mmc_blk_reset_success(md, type);
 out:
-	blk_end_request(req, err, blk_rq_bytes(req));
+	mmc_blk_end_request(req, err, blk_rq_bytes(req));
 
 	return err ? 0 : 1;
 }
@@ -1305,7 +1321,7 @@ static int mmc_blk_issue_flush(struct mmc_queue *mq, struct request *req)
 	if (ret)
 		ret = -EIO;
 
-	blk_end_request_all(req, ret);
+	blk_mq_end_request(req, ret);
 
 	return ret ? 0 : 1;
 }
@@ -1715,6 +1731,7 @@ static u8 mmc_blk_prep_packed_list(struct mmc_queue *mq, struct request *req)
 	    !IS_ALIGNED(blk_rq_sectors(cur), 8))
 		goto no_packed;
 
+	mqrq->packed = mmc_queue_get_packed(mq);
 	mmc_blk_clear_packed(mqrq);
 
 	max_blk_count = min(card->host->max_blk_count,
@@ -1737,9 +1754,7 @@ static u8 mmc_blk_prep_packed_list(struct mmc_queue *mq, struct request *req)
 			break;
 		}
 
-		spin_lock_irq(q->queue_lock);
-		next = blk_fetch_request(q);
-		spin_unlock_irq(q->queue_lock);
+		next = mmc_queue_fetch(mq);
 		if (!next) {
 			put_back = false;
 			break;
@@ -1773,11 +1788,8 @@ static u8 mmc_blk_prep_packed_list(struct mmc_queue *mq, struct request *req)
 		reqs++;
 	} while (1);
 
-	if (put_back) {
-		spin_lock_irq(q->queue_lock);
-		blk_requeue_request(q, next);
-		spin_unlock_irq(q->queue_lock);
-	}
+	if (put_back)
+		mmc_queue_requeue(mq, next);
 
 	if (reqs > 0) {
 		list_add(&req->queuelist, &mqrq->packed->list);
@@ -1895,11 +1907,12 @@ static int mmc_blk_cmd_err(struct mmc_blk_data *md, struct mmc_card *card,
 
 		blocks = mmc_sd_num_wr_blocks(card);
 		if (blocks != (u32)-1) {
-			ret = blk_end_request(req, 0, blocks << 9);
+			ret = mmc_blk_end_request(req, 0, blocks << 9);
 		}
 	} else {
 		if (!mmc_packed_cmd(mq_rq->cmd_type))
-			ret = blk_end_request(req, 0, brq->data.bytes_xfered);
+			ret = mmc_blk_end_request(req, 0,
+						  brq->data.bytes_xfered);
 	}
 	return ret;
 }
@@ -1928,7 +1941,7 @@ static int mmc_blk_end_packed_req(struct mmc_queue_req *mq_rq)
 			return ret;
 		}
 		list_del_init(&prq->queuelist);
-		blk_end_request(prq, 0, blk_rq_bytes(prq));
+		mmc_blk_end_request(prq, 0, blk_rq_bytes(prq));
 		i++;
 	}
 
@@ -1946,7 +1959,7 @@ static void mmc_blk_abort_packed_req(struct mmc_queue_req *mq_rq)
 	while (!list_empty(&packed->list)) {
 		prq = list_entry_rq(packed->list.next);
 		list_del_init(&prq->queuelist);
-		blk_end_request(prq, -EIO, blk_rq_bytes(prq));
+		mmc_blk_end_request(prq, -EIO, blk_rq_bytes(prq));
 	}
 
 	mmc_blk_clear_packed(mq_rq);
@@ -1956,7 +1969,6 @@ static void mmc_blk_revert_packed_req(struct mmc_queue *mq,
 				      struct mmc_queue_req *mq_rq)
 {
 	struct request *prq;
-	struct request_queue *q = mq->queue;
 	struct mmc_packed *packed = mq_rq->packed;
 
 	BUG_ON(!packed);
@@ -1965,9 +1977,7 @@ static void mmc_blk_revert_packed_req(struct mmc_queue *mq,
 		prq = list_entry_rq(packed->list.prev);
 		if (prq->queuelist.prev != &packed->list) {
 			list_del_init(&prq->queuelist);
-			spin_lock_irq(q->queue_lock);
-			blk_requeue_request(mq->queue, prq);
-			spin_unlock_irq(q->queue_lock);
+			mmc_queue_requeue(mq, prq);
 		} else {
 			list_del_init(&prq->queuelist);
 		}
@@ -1980,7 +1990,7 @@ static int mmc_blk_issue_rw_rq(struct mmc_queue *mq, struct request *rqc)
 {
 	struct mmc_blk_data *md = mq->data;
 	struct mmc_card *card = md->queue.card;
-	struct mmc_blk_request *brq = &mq->mqrq_cur->brq;
+	struct mmc_blk_request *brq;
 	int ret = 1, disable_multi = 0, retry = 0, type, retune_retry_done = 0;
 	enum mmc_blk_status status;
 	struct mmc_queue_req *mq_rq;
@@ -1989,7 +1999,7 @@ static int mmc_blk_issue_rw_rq(struct mmc_queue *mq, struct request *rqc)
 	const u8 packed_nr = 2;
 	u8 reqs = 0;
 
-	if (!rqc && !mq->mqrq_prev->req)
+	if (!rqc && !mq->mqrq_prev)
 		return 0;
 
 	if (rqc)
@@ -1998,10 +2008,13 @@ static int mmc_blk_issue_rw_rq(struct mmc_queue *mq, struct request *rqc)
 	do {
 		if (rqc) {
 			/*
+			 * The current request was prepared by mmc_queue_rq()
+			 * when it was queued.
+			 *
 			 * When 4KB native sector is enabled, only 8 blocks
 			 * multiple read or write is allowed
 			 */
-			if ((brq->data.blocks & 0x07) &&
+			if ((mq->mqrq_cur->brq.data.blocks & 0x07) &&
 			    (card->ext_csd.data_sector_size == 4096)) {
 				pr_err("%s: Transfer size is not 4KB sector size aligned\n",
 					req->rq_disk->disk_name);
@@ -2012,8 +2025,6 @@ static int mmc_blk_issue_rw_rq(struct mmc_queue *mq, struct request *rqc)
 			if (reqs >= packed_nr)
 				mmc_blk_packed_hdr_wrq_prep(mq->mqrq_cur,
 							    card, mq);
-			else
-				mmc_blk_rw_rq_prep(mq->mqrq_cur, card, 0, mq);
 			areq = &mq->mqrq_cur->mmc_active;
 		} else
 			areq = NULL;
@@ -2042,12 +2053,12 @@ static int mmc_blk_issue_rw_rq(struct mmc_queue *mq, struct request *rqc)
 				ret = mmc_blk_end_packed_req(mq_rq);
 				break;
 			} else {
-				ret = blk_end_request(req, 0,
+				ret = mmc_blk_end_request(req, 0,
 						brq->data.bytes_xfered);
 			}
 
 			/*
-			 * If the blk_end_request function returns non-zero even
+			 * If mmc_blk_end_request() returns non-zero even
 			 * though all data has been transferred and no errors
 			 * were returned by the host controller, it's a bug.
 			 */
@@ -2097,7 +2108,7 @@ static int mmc_blk_issue_rw_rq(struct mmc_queue *mq, struct request *rqc)
 			 * time, so we only reach here after trying to
 			 * read a single sector.
 			 */
-			ret = blk_end_request(req, -EIO,
+			ret = mmc_blk_end_request(req, -EIO,
 						brq->data.blksz);
 			if (!ret)
 				goto start_new_req;
@@ -2141,7 +2152,7 @@ static int mmc_blk_issue_rw_rq(struct mmc_queue *mq, struct request *rqc)
 		if (mmc_card_removed(card))
 			req->cmd_flags |= REQ_QUIET;
 		while (ret)
-			ret = blk_end_request(req, -EIO,
+			ret = mmc_blk_end_request(req, -EIO,
 					blk_rq_cur_bytes(req));
 	}
 
@@ -2149,7 +2160,7 @@ static int mmc_blk_issue_rw_rq(struct mmc_queue *mq, struct request *rqc)
 	if (rqc) {
 		if (mmc_card_removed(card)) {
 			rqc->cmd_flags |= REQ_QUIET;
-			blk_end_request_all(rqc, -EIO);
+			blk_mq_end_request(rqc, -EIO);
 		} else {
 			/*
 			 * If current request is packed, it needs to put back.
@@ -2175,14 +2186,14 @@ static int mmc_blk_issue_rq(struct mmc_queue *mq, struct request *req)
 	unsigned long flags;
 	unsigned int cmd_flags = req ? req->cmd_flags : 0;
 
-	if (req && !mq->mqrq_prev->req)
+	if (req && !mq->mqrq_prev)
 		/* claim host only for the first request */
 		mmc_get_card(card);
 
 	ret = mmc_blk_part_switch(card, md);
 	if (ret) {
 		if (req) {
-			blk_end_request_all(req, -EIO);
+			blk_mq_end_request(req, -EIO);
 		}
 		ret = 0;
 		goto out;
@@ -2218,12 +2229,24 @@ out:
 		 * Release host when there are no more requests
 		 * and after special request(discard, flush) is done.
 		 * In case sepecial request, there is no reentry to
-		 * the 'mmc_blk_issue_rq' with 'mqrq_prev->req'.
+		 * the 'mmc_blk_issue_rq' with 'mqrq_prev'.
 		 */
 		mmc_put_card(card);
 	return ret;
 }
 
+/*
+ * Called by mmc_queue_rq() in the context submitting the request, so
+ * that reads and writes reach the issue thread ready to be started.
+ */
+static void mmc_blk_prep_rq(struct mmc_queue *mq, struct mmc_queue_req *mqrq)
+{
+	if (mqrq->req->cmd_flags & MMC_REQ_SPECIAL_MASK)
+		return;
+
+	mmc_blk_rw_rq_prep(mqrq, mq->card, 0, mq);
+}
+
 static inline int mmc_blk_readonly(struct mmc_card *card)
 {
 	return mmc_card_readonly(card) ||
@@ -2287,6 +2310,7 @@ static struct mmc_blk_data *mmc_blk_alloc_req(struct mmc_card *card,
 		goto err_putdisk;
 
 	md->queue.issue_fn = mmc_blk_issue_rq;
+	md->queue.prep_fn = mmc_blk_prep_rq;
 	md->queue.data = md;
 
 	md->disk->major	= MMC_BLOCK_MAJOR;
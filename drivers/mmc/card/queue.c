@@ -12,6 +12,7 @@
 #include <linux/slab.h>
 #include <linux/module.h>
 #include <linux/blkdev.h>
+#include <linux/blk-mq.h>
 #include <linux/freezer.h>
 #include <linux/kthread.h>
 #include <linux/scatterlist.h>
@@ -23,13 +24,21 @@
 
 #define MMC_QUEUE_BOUNCESZ	65536
 
+/*
+ * Number of tags per queue.  Requests are prepared when they are queued
+ * and wait on the pending list until the issue thread starts them, so a
+ * deeper queue lets packed writes pick up more requests.  Bounce buffers
+ * are large and allocated per request, so bouncing hosts get just enough
+ * for the two-deep prepare/issue overlap.
+ */
+#define MMC_QUEUE_DEPTH		32
+#define MMC_QUEUE_BOUNCE_DEPTH	2
+
 /*
  * Prepare a MMC request. This just filters out odd stuff.
  */
-static int mmc_prep_request(struct request_queue *q, struct request *req)
+static int mmc_prep_request(struct mmc_queue *mq, struct request *req)
 {
-	struct mmc_queue *mq = q->queuedata;
-
 	/*
 	 * We only like normal block requests and discards.
 	 */
@@ -38,34 +47,79 @@ static int mmc_prep_request(struct request_queue *q, struct request *req)
 		return BLKPREP_KILL;
 	}
 
-	if (mq && (mmc_card_removed(mq->card) || mmc_access_rpmb(mq)))
+	if (mmc_card_removed(mq->card) || mmc_access_rpmb(mq))
 		return BLKPREP_KILL;
 
-	req->cmd_flags |= REQ_DONTPREP;
-
 	return BLKPREP_OK;
 }
 
+static struct request *__mmc_queue_fetch(struct mmc_queue *mq)
+{
+	struct request *req;
+
+	if (list_empty(&mq->pending))
+		return NULL;
+
+	req = list_first_entry(&mq->pending, struct request, queuelist);
+	list_del_init(&req->queuelist);
+
+	return req;
+}
+
+/**
+ * mmc_queue_fetch - take the next prepared request
+ * @mq: MMC queue
+ *
+ * Removes the oldest request from the pending list of @mq, or returns
+ * NULL if there is none.
+ */
+struct request *mmc_queue_fetch(struct mmc_queue *mq)
+{
+	struct request *req;
+	unsigned long flags;
+
+	spin_lock_irqsave(mq->lock, flags);
+	req = __mmc_queue_fetch(mq);
+	spin_unlock_irqrestore(mq->lock, flags);
+
+	return req;
+}
+
+/**
+ * mmc_queue_requeue - put a fetched request back
+ * @mq: MMC queue
+ * @req: request taken with mmc_queue_fetch()
+ *
+ * Returns @req to the head of the pending list, so that it is the next
+ * one to be fetched.
+ */
+void mmc_queue_requeue(struct mmc_queue *mq, struct request *req)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(mq->lock, flags);
+	list_add(&req->queuelist, &mq->pending);
+	spin_unlock_irqrestore(mq->lock, flags);
+}
+
 static int mmc_queue_thread(void *d)
 {
 	struct mmc_queue *mq = d;
-	struct request_queue *q = mq->queue;
 
 	current->flags |= PF_MEMALLOC;
 
 	down(&mq->thread_sem);
 	do {
 		struct request *req = NULL;
-		struct mmc_queue_req *tmp;
 		unsigned int cmd_flags = 0;
 
-		spin_lock_irq(q->queue_lock);
+		spin_lock_irq(mq->lock);
 		set_current_state(TASK_INTERRUPTIBLE);
-		req = blk_fetch_request(q);
-		mq->mqrq_cur->req = req;
-		spin_unlock_irq(q->queue_lock);
+		req = __mmc_queue_fetch(mq);
+		mq->mqrq_cur = req ? blk_mq_rq_to_pdu(req) : NULL;
+		spin_unlock_irq(mq->lock);
 
-		if (req || mq->mqrq_prev->req) {
+		if (req || mq->mqrq_prev) {
 			set_current_state(TASK_RUNNING);
 			cmd_flags = req ? req->cmd_flags : 0;
 			mq->issue_fn(mq, req);
@@ -75,20 +129,17 @@ static int mmc_queue_thread(void *d)
 			}
 
 			/*
-			 * Current request becomes previous request
-			 * and vice versa.
+			 * Current request is now in flight and becomes the
+			 * previous request.
 			 * In case of special requests, current request
 			 * has been finished. Do not assign it to previous
 			 * request.
 			 */
-			if (cmd_flags & MMC_REQ_SPECIAL_MASK)
-				mq->mqrq_cur->req = NULL;
-
-			mq->mqrq_prev->brq.mrq.data = NULL;
-			mq->mqrq_prev->req = NULL;
-			tmp = mq->mqrq_prev;
-			mq->mqrq_prev = mq->mqrq_cur;
-			mq->mqrq_cur = tmp;
+			if (req && !(cmd_flags & MMC_REQ_SPECIAL_MASK))
+				mq->mqrq_prev = mq->mqrq_cur;
+			else
+				mq->mqrq_prev = NULL;
+			mq->mqrq_cur = NULL;
 		} else {
 			if (kthread_should_stop()) {
 				set_current_state(TASK_RUNNING);
@@ -105,28 +156,16 @@ static int mmc_queue_thread(void *d)
 }
 
 /*
- * Generic MMC request handler.  This is called for any queue on a
- * particular host.  When the host is not busy, we look for a request
- * on any queue on this host, and attempt to issue it.  This may
- * not be the queue we were asked to process.
+ * Called with mq->lock held once a request has been added to the pending
+ * list.  Wakes the issue thread if it is idle, or has it stop waiting for
+ * the request in flight so that it can start the new one behind it.
  */
-static void mmc_request_fn(struct request_queue *q)
+static void mmc_queue_kick(struct mmc_queue *mq)
 {
-	struct mmc_queue *mq = q->queuedata;
-	struct request *req;
+	struct mmc_context_info *cntx = &mq->card->host->context_info;
 	unsigned long flags;
-	struct mmc_context_info *cntx;
-
-	if (!mq) {
-		while ((req = blk_fetch_request(q)) != NULL) {
-			req->cmd_flags |= REQ_QUIET;
-			__blk_end_request_all(req, -EIO);
-		}
-		return;
-	}
 
-	cntx = &mq->card->host->context_info;
-	if (!mq->mqrq_cur->req && mq->mqrq_prev->req) {
+	if (!mq->mqrq_cur && mq->mqrq_prev) {
 		/*
 		 * New MMC request arrived when MMC thread may be
 		 * blocked on the previous request to be complete
@@ -138,10 +177,52 @@ static void mmc_request_fn(struct request_queue *q)
 			wake_up_interruptible(&cntx->wait);
 		}
 		spin_unlock_irqrestore(&cntx->lock, flags);
-	} else if (!mq->mqrq_cur->req && !mq->mqrq_prev->req)
+	} else if (!mq->mqrq_cur && !mq->mqrq_prev)
 		wake_up_process(mq->thread);
 }
 
+/*
+ * Queue a request on the MMC queue.  Building the host request, mapping
+ * the scatterlist and filling bounce buffers is done here, in the
+ * context that submits the request, so that the issue thread only has
+ * to start it on the host.
+ */
+static int mmc_queue_rq(struct blk_mq_hw_ctx *hctx, struct request *req,
+			bool last)
+{
+	struct mmc_queue *mq = req->q->queuedata;
+	struct mmc_queue_req *mqrq = blk_mq_rq_to_pdu(req);
+	unsigned long flags;
+
+	if (!mq) {
+		req->cmd_flags |= REQ_QUIET;
+		return BLK_MQ_RQ_QUEUE_ERROR;
+	}
+
+	if (mmc_prep_request(mq, req) != BLKPREP_OK)
+		return BLK_MQ_RQ_QUEUE_ERROR;
+
+	blk_mq_start_request(req);
+
+	mqrq->req = req;
+	mqrq->cmd_type = MMC_PACKED_NONE;
+	mqrq->packed = NULL;
+	mq->prep_fn(mq, mqrq);
+
+	spin_lock_irqsave(mq->lock, flags);
+	if (!req->q->queuedata) {
+		/* raced with mmc_cleanup_queue() */
+		spin_unlock_irqrestore(mq->lock, flags);
+		req->cmd_flags |= REQ_QUIET;
+		return BLK_MQ_RQ_QUEUE_ERROR;
+	}
+	list_add_tail(&req->queuelist, &mq->pending);
+	mmc_queue_kick(mq);
+	spin_unlock_irqrestore(mq->lock, flags);
+
+	return BLK_MQ_RQ_QUEUE_OK;
+}
+
 static struct scatterlist *mmc_alloc_sg(int sg_len, int *err)
 {
 	struct scatterlist *sg;
@@ -157,6 +238,82 @@ static struct scatterlist *mmc_alloc_sg(int sg_len, int *err)
 	return sg;
 }
 
+static void mmc_exit_request(void *data, struct request *req,
+			     unsigned int hctx_idx, unsigned int request_idx)
+{
+	struct mmc_queue_req *mqrq = blk_mq_rq_to_pdu(req);
+
+	kfree(mqrq->bounce_sg);
+	mqrq->bounce_sg = NULL;
+
+	kfree(mqrq->sg);
+	mqrq->sg = NULL;
+
+	kfree(mqrq->bounce_buf);
+	mqrq->bounce_buf = NULL;
+}
+
+/*
+ * Every request carries its own struct mmc_queue_req, with the
+ * scatterlist and bounce buffer it is prepared into.
+ */
+static int mmc_init_request(void *data, struct request *req,
+			    unsigned int hctx_idx, unsigned int request_idx,
+			    unsigned int numa_node)
+{
+	struct mmc_queue *mq = data;
+	struct mmc_queue_req *mqrq = blk_mq_rq_to_pdu(req);
+	int ret;
+
+	if (mq->bouncesz) {
+		mqrq->bounce_buf = kmalloc(mq->bouncesz, GFP_KERNEL);
+		if (!mqrq->bounce_buf) {
+			ret = -ENOMEM;
+			goto err;
+		}
+
+		mqrq->sg = mmc_alloc_sg(1, &ret);
+		if (ret)
+			goto err;
+
+		mqrq->bounce_sg = mmc_alloc_sg(mq->bouncesz / 512, &ret);
+		if (ret)
+			goto err;
+	} else {
+		mqrq->sg = mmc_alloc_sg(mq->card->host->max_segs, &ret);
+		if (ret)
+			goto err;
+	}
+
+	return 0;
+ err:
+	/* blk-mq only calls ->exit_request for requests it set up */
+	mmc_exit_request(data, req, hctx_idx, request_idx);
+	return ret;
+}
+
+static struct blk_mq_ops mmc_mq_ops = {
+	.queue_rq	= mmc_queue_rq,
+	.map_queue	= blk_mq_map_queue,
+	.init_request	= mmc_init_request,
+	.exit_request	= mmc_exit_request,
+};
+
+static int mmc_queue_alloc_tag_set(struct mmc_queue *mq)
+{
+	memset(&mq->tag_set, 0, sizeof(mq->tag_set));
+	mq->tag_set.ops = &mmc_mq_ops;
+	mq->tag_set.nr_hw_queues = 1;
+	mq->tag_set.queue_depth = mq->bouncesz ? MMC_QUEUE_BOUNCE_DEPTH :
+						 MMC_QUEUE_DEPTH;
+	mq->tag_set.numa_node = NUMA_NO_NODE;
+	mq->tag_set.cmd_size = sizeof(struct mmc_queue_req);
+	mq->tag_set.flags = BLK_MQ_F_SHOULD_MERGE | BLK_MQ_F_SG_MERGE;
+	mq->tag_set.driver_data = mq;
+
+	return blk_mq_alloc_tag_set(&mq->tag_set);
+}
+
 static void mmc_queue_setup_discard(struct request_queue *q,
 				    struct mmc_card *card)
 {
@@ -182,7 +339,7 @@ static void mmc_queue_setup_discard(struct request_queue *q,
  * mmc_init_queue - initialise a queue structure.
  * @mq: mmc queue
  * @card: mmc card to attach this queue
- * @lock: queue lock
+ * @lock: lock protecting the list of pending requests
  * @subname: partition subname
  *
  * Initialise a MMC card request queue.
@@ -193,26 +350,16 @@ int mmc_init_queue(struct mmc_queue *mq, struct mmc_card *card,
 	struct mmc_host *host = card->host;
 	u64 limit = BLK_BOUNCE_HIGH;
 	int ret;
-	struct mmc_queue_req *mqrq_cur = &mq->mqrq[0];
-	struct mmc_queue_req *mqrq_prev = &mq->mqrq[1];
 
 	if (mmc_dev(host)->dma_mask && *mmc_dev(host)->dma_mask)
 		limit = (u64)dma_max_pfn(mmc_dev(host)) << PAGE_SHIFT;
 
 	mq->card = card;
-	mq->queue = blk_init_queue(mmc_request_fn, lock);
-	if (!mq->queue)
-		return -ENOMEM;
-
-	mq->mqrq_cur = mqrq_cur;
-	mq->mqrq_prev = mqrq_prev;
-	mq->queue->queuedata = mq;
-
-	blk_queue_prep_rq(mq->queue, mmc_prep_request);
-	queue_flag_set_unlocked(QUEUE_FLAG_NONROT, mq->queue);
-	queue_flag_clear_unlocked(QUEUE_FLAG_ADD_RANDOM, mq->queue);
-	if (mmc_can_erase(card))
-		mmc_queue_setup_discard(mq->queue, card);
+	mq->lock = lock;
+	INIT_LIST_HEAD(&mq->pending);
+	mq->mqrq_cur = NULL;
+	mq->mqrq_prev = NULL;
+	mq->bouncesz = 0;
 
 #ifdef CONFIG_MMC_BLOCK_BOUNCE
 	if (host->max_segs == 1) {
@@ -227,63 +374,45 @@ int mmc_init_queue(struct mmc_queue *mq, struct mmc_card *card,
 		if (bouncesz > (host->max_blk_count * 512))
 			bouncesz = host->max_blk_count * 512;
 
-		if (bouncesz > 512) {
-			mqrq_cur->bounce_buf = kmalloc(bouncesz, GFP_KERNEL);
-			if (!mqrq_cur->bounce_buf) {
-				pr_warn("%s: unable to allocate bounce cur buffer\n",
-					mmc_card_name(card));
-			}
-			mqrq_prev->bounce_buf = kmalloc(bouncesz, GFP_KERNEL);
-			if (!mqrq_prev->bounce_buf) {
-				pr_warn("%s: unable to allocate bounce prev buffer\n",
-					mmc_card_name(card));
-				kfree(mqrq_cur->bounce_buf);
-				mqrq_cur->bounce_buf = NULL;
-			}
-		}
-
-		if (mqrq_cur->bounce_buf && mqrq_prev->bounce_buf) {
-			blk_queue_bounce_limit(mq->queue, BLK_BOUNCE_ANY);
-			blk_queue_max_hw_sectors(mq->queue, bouncesz / 512);
-			blk_queue_max_segments(mq->queue, bouncesz / 512);
-			blk_queue_max_segment_size(mq->queue, bouncesz);
-
-			mqrq_cur->sg = mmc_alloc_sg(1, &ret);
-			if (ret)
-				goto cleanup_queue;
-
-			mqrq_cur->bounce_sg =
-				mmc_alloc_sg(bouncesz / 512, &ret);
-			if (ret)
-				goto cleanup_queue;
-
-			mqrq_prev->sg = mmc_alloc_sg(1, &ret);
-			if (ret)
-				goto cleanup_queue;
-
-			mqrq_prev->bounce_sg =
-				mmc_alloc_sg(bouncesz / 512, &ret);
-			if (ret)
-				goto cleanup_queue;
-		}
+		if (bouncesz > 512)
+			mq->bouncesz = bouncesz;
 	}
 #endif
 
-	if (!mqrq_cur->bounce_buf && !mqrq_prev->bounce_buf) {
+	ret = mmc_queue_alloc_tag_set(mq);
+	if (ret && mq->bouncesz) {
+		pr_warn("%s: unable to allocate bounce buffers\n",
+			mmc_card_name(card));
+		mq->bouncesz = 0;
+		ret = mmc_queue_alloc_tag_set(mq);
+	}
+	if (ret)
+		return ret;
+
+	mq->queue = blk_mq_init_queue(&mq->tag_set);
+	if (IS_ERR(mq->queue)) {
+		ret = PTR_ERR(mq->queue);
+		goto free_tag_set;
+	}
+
+	mq->queue->queuedata = mq;
+
+	queue_flag_set_unlocked(QUEUE_FLAG_NONROT, mq->queue);
+	queue_flag_clear_unlocked(QUEUE_FLAG_ADD_RANDOM, mq->queue);
+	if (mmc_can_erase(card))
+		mmc_queue_setup_discard(mq->queue, card);
+
+	if (mq->bouncesz) {
+		blk_queue_bounce_limit(mq->queue, BLK_BOUNCE_ANY);
+		blk_queue_max_hw_sectors(mq->queue, mq->bouncesz / 512);
+		blk_queue_max_segments(mq->queue, mq->bouncesz / 512);
+		blk_queue_max_segment_size(mq->queue, mq->bouncesz);
+	} else {
 		blk_queue_bounce_limit(mq->queue, limit);
 		blk_queue_max_hw_sectors(mq->queue,
 			min(host->max_blk_count, host->max_req_size / 512));
 		blk_queue_max_segments(mq->queue, host->max_segs);
 		blk_queue_max_segment_size(mq->queue, host->max_seg_size);
-
-		mqrq_cur->sg = mmc_alloc_sg(host->max_segs, &ret);
-		if (ret)
-			goto cleanup_queue;
-
-
-		mqrq_prev->sg = mmc_alloc_sg(host->max_segs, &ret);
-		if (ret)
-			goto cleanup_queue;
 	}
 
 	sema_init(&mq->thread_sem, 1);
@@ -293,28 +422,15 @@ int mmc_init_queue(struct mmc_queue *mq, struct mmc_card *card,
 
 	if (IS_ERR(mq->thread)) {
 		ret = PTR_ERR(mq->thread);
-		goto free_bounce_sg;
+		goto cleanup_queue;
 	}
 
 	return 0;
- free_bounce_sg:
-	kfree(mqrq_cur->bounce_sg);
-	mqrq_cur->bounce_sg = NULL;
-	kfree(mqrq_prev->bounce_sg);
-	mqrq_prev->bounce_sg = NULL;
 
  cleanup_queue:
-	kfree(mqrq_cur->sg);
-	mqrq_cur->sg = NULL;
-	kfree(mqrq_cur->bounce_buf);
-	mqrq_cur->bounce_buf = NULL;
-
-	kfree(mqrq_prev->sg);
-	mqrq_prev->sg = NULL;
-	kfree(mqrq_prev->bounce_buf);
-	mqrq_prev->bounce_buf = NULL;
-
 	blk_cleanup_queue(mq->queue);
+ free_tag_set:
+	blk_mq_free_tag_set(&mq->tag_set);
 	return ret;
 }
 
@@ -322,8 +438,8 @@ void mmc_cleanup_queue(struct mmc_queue *mq)
 {
 	struct request_queue *q = mq->queue;
 	unsigned long flags;
-	struct mmc_queue_req *mqrq_cur = mq->mqrq_cur;
-	struct mmc_queue_req *mqrq_prev = mq->mqrq_prev;
+	LIST_HEAD(pending);
+	struct request *req;
 
 	/* Make sure the queue isn't suspended, as that will deadlock */
 	mmc_queue_resume(mq);
@@ -332,74 +448,67 @@ void mmc_cleanup_queue(struct mmc_queue *mq)
 	kthread_stop(mq->thread);
 
 	/* Empty the queue */
-	spin_lock_irqsave(q->queue_lock, flags);
+	spin_lock_irqsave(mq->lock, flags);
 	q->queuedata = NULL;
-	blk_start_queue(q);
-	spin_unlock_irqrestore(q->queue_lock, flags);
-
-	kfree(mqrq_cur->bounce_sg);
-	mqrq_cur->bounce_sg = NULL;
-
-	kfree(mqrq_cur->sg);
-	mqrq_cur->sg = NULL;
-
-	kfree(mqrq_cur->bounce_buf);
-	mqrq_cur->bounce_buf = NULL;
-
-	kfree(mqrq_prev->bounce_sg);
-	mqrq_prev->bounce_sg = NULL;
-
-	kfree(mqrq_prev->sg);
-	mqrq_prev->sg = NULL;
-
-	kfree(mqrq_prev->bounce_buf);
-	mqrq_prev->bounce_buf = NULL;
+	list_splice_init(&mq->pending, &pending);
+	spin_unlock_irqrestore(mq->lock, flags);
+
+	while (!list_empty(&pending)) {
+		req = list_first_entry(&pending, struct request, queuelist);
+		list_del_init(&req->queuelist);
+		req->cmd_flags |= REQ_QUIET;
+		blk_mq_end_request(req, -EIO);
+	}
 
 	mq->card = NULL;
 }
 EXPORT_SYMBOL(mmc_cleanup_queue);
 
+/*
+ * Packed commands are only built by the issue thread, for the current
+ * request, while at most the previous one is in flight.  So two packed
+ * command headers per queue are enough, used in turn.
+ */
 int mmc_packed_init(struct mmc_queue *mq, struct mmc_card *card)
 {
-	struct mmc_queue_req *mqrq_cur = &mq->mqrq[0];
-	struct mmc_queue_req *mqrq_prev = &mq->mqrq[1];
-	int ret = 0;
-
+	int i;
 
-	mqrq_cur->packed = kzalloc(sizeof(struct mmc_packed), GFP_KERNEL);
-	if (!mqrq_cur->packed) {
-		pr_warn("%s: unable to allocate packed cmd for mqrq_cur\n",
-			mmc_card_name(card));
-		ret = -ENOMEM;
-		goto out;
+	for (i = 0; i < ARRAY_SIZE(mq->packed); i++) {
+		mq->packed[i] = kzalloc(sizeof(struct mmc_packed), GFP_KERNEL);
+		if (!mq->packed[i]) {
+			pr_warn("%s: unable to allocate packed cmd\n",
+				mmc_card_name(card));
+			mmc_packed_clean(mq);
+			return -ENOMEM;
+		}
+		INIT_LIST_HEAD(&mq->packed[i]->list);
 	}
 
-	mqrq_prev->packed = kzalloc(sizeof(struct mmc_packed), GFP_KERNEL);
-	if (!mqrq_prev->packed) {
-		pr_warn("%s: unable to allocate packed cmd for mqrq_prev\n",
-			mmc_card_name(card));
-		kfree(mqrq_cur->packed);
-		mqrq_cur->packed = NULL;
-		ret = -ENOMEM;
-		goto out;
-	}
+	return 0;
+}
 
-	INIT_LIST_HEAD(&mqrq_cur->packed->list);
-	INIT_LIST_HEAD(&mqrq_prev->packed->list);
+void mmc_packed_clean(struct mmc_queue *mq)
+{
+	int i;
 
-out:
-	return ret;
+	for (i = 0; i < ARRAY_SIZE(mq->packed); i++) {
+		kfree(mq->packed[i]);
+		mq->packed[i] = NULL;
+	}
 }
 
-void mmc_packed_clean(struct mmc_queue *mq)
+/**
+ * mmc_queue_get_packed - pick a packed command header for a request
+ * @mq: MMC queue
+ *
+ * Returns the header that is not used by the request in flight.
+ */
+struct mmc_packed *mmc_queue_get_packed(struct mmc_queue *mq)
 {
-	struct mmc_queue_req *mqrq_cur = &mq->mqrq[0];
-	struct mmc_queue_req *mqrq_prev = &mq->mqrq[1];
+	if (mq->mqrq_prev && mq->mqrq_prev->packed == mq->packed[0])
+		return mq->packed[1];
 
-	kfree(mqrq_cur->packed);
-	mqrq_cur->packed = NULL;
-	kfree(mqrq_prev->packed);
-	mqrq_prev->packed = NULL;
+	return mq->packed[0];
 }
 
 /**
@@ -412,15 +521,10 @@ void mmc_packed_clean(struct mmc_queue *mq)
  */
 void mmc_queue_suspend(struct mmc_queue *mq)
 {
-	struct request_queue *q = mq->queue;
-	unsigned long flags;
-
 	if (!(mq->flags & MMC_QUEUE_SUSPENDED)) {
 		mq->flags |= MMC_QUEUE_SUSPENDED;
 
-		spin_lock_irqsave(q->queue_lock, flags);
-		blk_stop_queue(q);
-		spin_unlock_irqrestore(q->queue_lock, flags);
+		blk_mq_stop_hw_queues(mq->queue);
 
 		down(&mq->thread_sem);
 	}
@@ -432,17 +536,12 @@ void mmc_queue_suspend(struct mmc_queue *mq)
  */
 void mmc_queue_resume(struct mmc_queue *mq)
 {
-	struct request_queue *q = mq->queue;
-	unsigned long flags;
-
 	if (mq->flags & MMC_QUEUE_SUSPENDED) {
 		mq->flags &= ~MMC_QUEUE_SUSPENDED;
 
 		up(&mq->thread_sem);
 
-		spin_lock_irqsave(q->queue_lock, flags);
-		blk_start_queue(q);
-		spin_unlock_irqrestore(q->queue_lock, flags);
+		blk_mq_start_stopped_hw_queues(mq->queue, true);
 	}
 }
 
@@ -53,11 +53,17 @@ struct mmc_queue {
 #define MMC_QUEUE_NEW_REQUEST	(1 << 1)
 
 	int			(*issue_fn)(struct mmc_queue *, struct request *);
+	void			(*prep_fn)(struct mmc_queue *,
+					   struct mmc_queue_req *);
 	void			*data;
 	struct request_queue	*queue;
-	struct mmc_queue_req	mqrq[2];
-	struct mmc_queue_req	*mqrq_cur;
-	struct mmc_queue_req	*mqrq_prev;
+	struct blk_mq_tag_set	tag_set;
+	spinlock_t		*lock;		/* protects pending */
+	struct list_head	pending;	/* prepared, not yet issued */
+	unsigned int		bouncesz;	/* per-request bounce buffer */
+	struct mmc_packed	*packed[2];
+	struct mmc_queue_req	*mqrq_cur;	/* being issued */
+	struct mmc_queue_req	*mqrq_prev;	/* in flight */
 };
 
 extern int mmc_init_queue(struct mmc_queue *, struct mmc_card *, spinlock_t *,
@@ -65,6 +71,8 @@ extern int mmc_init_queue(struct mmc_queue *, struct mmc_card *, spinlock_t *,
 extern void mmc_cleanup_queue(struct mmc_queue *);
 extern void mmc_queue_suspend(struct mmc_queue *);
 extern void mmc_queue_resume(struct mmc_queue *);
+extern struct request *mmc_queue_fetch(struct mmc_queue *);
+extern void mmc_queue_requeue(struct mmc_queue *, struct request *);
 
 extern unsigned int mmc_queue_map_sg(struct mmc_queue *,
 				     struct mmc_queue_req *);
@@ -73,6 +81,7 @@ extern void mmc_queue_bounce_post(struct mmc_queue_req *);
 
 extern int mmc_packed_init(struct mmc_queue *, struct mmc_card *);
 extern void mmc_packed_clean(struct mmc_queue *);
+extern struct mmc_packed *mmc_queue_get_packed(struct mmc_queue *);
 
 extern int mmc_access_rpmb(struct mmc_queue *);
 
@@ -12,6 +12,7 @@
 #include <linux/slab.h>
 #include <linux/ethtool.h>
 #include <linux/etherdevice.h>
+#include <linux/filter.h>
 #include <linux/u64_stats_sync.h>
 
 #include <net/rtnetlink.h>
@@ -35,6 +36,7 @@ struct pcpu_vstats {
 struct veth_priv {
 	struct net_device __rcu	*peer;
 	atomic64_t		dropped;
+	struct bpf_prog __rcu	*xdp_prog;	/* run on frames we receive */
 };
 
 /*
@@ -108,6 +110,8 @@ static const struct ethtool_ops veth_ethtool_ops = {
 static netdev_tx_t veth_xmit(struct sk_buff *skb, struct net_device *dev)
 {
 	struct veth_priv *priv = netdev_priv(dev);
+	struct veth_priv *rcv_priv;
+	struct bpf_prog *xdp_prog;
 	struct net_device *rcv;
 	int length = skb->len;
 
@@ -117,6 +121,24 @@ static netdev_tx_t veth_xmit(struct sk_buff *skb, struct net_device *dev)
 		kfree_skb(skb);
 		goto drop;
 	}
+
+	/* The peer's early receive program decides before the frame is
+	 * scrubbed and queued to the backlog.
+	 */
+	rcv_priv = netdev_priv(rcv);
+	xdp_prog = rcu_dereference(rcv_priv->xdp_prog);
+	if (xdp_prog) {
+		switch (bpf_prog_run_xdp_skb(xdp_prog, skb)) {
+		case XDP_PASS:
+			break;
+		case XDP_TX:
+			rcv = dev;
+			break;
+		default:
+			kfree_skb(skb);
+			goto drop;
+		}
+	}
 	/* don't change ip_summed == CHECKSUM_PARTIAL, as that
 	 * will cause bad checksum on forwarded packets
 	 */
@@ -244,10 +266,39 @@ static int veth_dev_init(struct net_device *dev)
 
 static void veth_dev_free(struct net_device *dev)
 {
+	struct veth_priv *priv = netdev_priv(dev);
+	struct bpf_prog *xdp_prog;
+
+	xdp_prog = rcu_dereference_protected(priv->xdp_prog, 1);
+	if (xdp_prog)
+		bpf_prog_destroy(xdp_prog);
+
 	free_percpu(dev->vstats);
 	free_netdev(dev);
 }
 
+static int veth_xdp(struct net_device *dev, struct netdev_xdp *xdp)
+{
+	struct veth_priv *priv = netdev_priv(dev);
+	struct bpf_prog *old_prog;
+
+	switch (xdp->command) {
+	case XDP_SETUP_PROG:
+		old_prog = rtnl_dereference(priv->xdp_prog);
+		rcu_assign_pointer(priv->xdp_prog, xdp->prog);
+		if (old_prog) {
+			synchronize_net();
+			bpf_prog_destroy(old_prog);
+		}
+		return 0;
+	case XDP_QUERY_PROG:
+		xdp->prog_attached = !!rtnl_dereference(priv->xdp_prog);
+		return 0;
+	default:
+		return -EINVAL;
+	}
+}
+
 #ifdef CONFIG_NET_POLL_CONTROLLER
 static void veth_poll_controller(struct net_device *dev)
 {
@@ -275,6 +326,7 @@ static const struct net_device_ops veth_netdev_ops = {
 #ifdef CONFIG_NET_POLL_CONTROLLER
 	.ndo_poll_controller	= veth_poll_controller,
 #endif
+	.ndo_xdp		= veth_xdp,
 };
 
 #define VETH_FEATURES (NETIF_F_SG | NETIF_F_FRAGLIST | NETIF_F_ALL_TSO |    \
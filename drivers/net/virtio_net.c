@@ -27,6 +27,7 @@
 #include <linux/slab.h>
 #include <linux/cpu.h>
 #include <linux/average.h>
+#include <linux/filter.h>
 #include <net/busy_poll.h>
 
 static int napi_weight = NAPI_POLL_WEIGHT;
@@ -137,6 +138,9 @@ struct virtnet_info {
 
 	/* CPU hot plug notifier */
 	struct notifier_block nb;
+
+	/* Early receive program, see virtnet_xdp() */
+	struct bpf_prog __rcu *xdp_prog;
 };
 
 struct skb_vnet_hdr {
@@ -430,6 +434,27 @@ err_buf:
 	return NULL;
 }
 
+/* Run the early receive program on a frame that fits in one mergeable
+ * buffer, before page_to_skb() allocates anything for it.  Larger frames
+ * are handed to the program once their skb has been put together.
+ */
+static u32 virtnet_xdp_run_buf(struct virtnet_info *vi, struct bpf_prog *prog,
+			       void *buf, unsigned int len, bool *done)
+{
+	struct virtio_net_hdr_mrg_rxbuf *mhdr = buf;
+	struct xdp_buff xdp;
+
+	if (mhdr->num_buffers != 1)
+		return XDP_PASS;
+
+	xdp.data = buf + sizeof(*mhdr);
+	xdp.data_end = buf + len;
+	xdp.dev = vi->dev;
+	*done = true;
+
+	return bpf_prog_run_xdp(prog, &xdp);
+}
+
 static void receive_buf(struct receive_queue *rq, void *buf, unsigned int len)
 {
 	struct virtnet_info *vi = rq->vq->vdev->priv;
@@ -437,6 +462,9 @@ static void receive_buf(struct receive_queue *rq, void *buf, unsigned int len)
 	struct virtnet_stats *stats = this_cpu_ptr(vi->stats);
 	struct sk_buff *skb;
 	struct skb_vnet_hdr *hdr;
+	struct bpf_prog *xdp_prog;
+	u32 act = XDP_PASS;
+	bool xdp_done = false;
 
 	if (unlikely(len < sizeof(struct virtio_net_hdr) + ETH_HLEN)) {
 		pr_debug("%s: short packet %i\n", dev->name, len);
@@ -453,6 +481,20 @@ static void receive_buf(struct receive_queue *rq, void *buf, unsigned int len)
 		return;
 	}
 
+	rcu_read_lock();
+	xdp_prog = rcu_dereference(vi->xdp_prog);
+	if (xdp_prog && vi->mergeable_rx_bufs) {
+		void *base = mergeable_ctx_to_buf_address((unsigned long)buf);
+
+		act = virtnet_xdp_run_buf(vi, xdp_prog, base, len, &xdp_done);
+		if (act != XDP_PASS && act != XDP_TX) {
+			rcu_read_unlock();
+			dev->stats.rx_dropped++;
+			put_page(virt_to_head_page(base));
+			return;
+		}
+	}
+
 	if (vi->mergeable_rx_bufs)
 		skb = receive_mergeable(dev, rq, (unsigned long)buf, len);
 	else if (vi->big_packets)
@@ -460,8 +502,20 @@ static void receive_buf(struct receive_queue *rq, void *buf, unsigned int len)
 	else
 		skb = receive_small(buf, len);
 
-	if (unlikely(!skb))
+	if (unlikely(!skb)) {
+		rcu_read_unlock();
 		return;
+	}
+
+	if (xdp_prog && !xdp_done)
+		act = bpf_prog_run_xdp_skb(xdp_prog, skb);
+	rcu_read_unlock();
+
+	if (act != XDP_PASS && act != XDP_TX) {
+		dev->stats.rx_dropped++;
+		dev_kfree_skb(skb);
+		return;
+	}
 
 	hdr = skb_vnet_hdr(skb);
 
@@ -525,6 +579,15 @@ static void receive_buf(struct receive_queue *rq, void *buf, unsigned int len)
 		skb_shinfo(skb)->gso_segs = 0;
 	}
 
+	/* Bounce the frame back to the host, with checksum and GSO state
+	 * already taken over from the virtio header.
+	 */
+	if (unlikely(act == XDP_TX)) {
+		skb_push(skb, ETH_HLEN);
+		dev_queue_xmit(skb);
+		return;
+	}
+
 	skb_mark_napi_id(skb, &rq->napi);
 
 	netif_receive_skb(skb);
@@ -1390,6 +1453,28 @@ static int virtnet_change_mtu(struct net_device *dev, int new_mtu)
 	return 0;
 }
 
+static int virtnet_xdp(struct net_device *dev, struct netdev_xdp *xdp)
+{
+	struct virtnet_info *vi = netdev_priv(dev);
+	struct bpf_prog *old_prog;
+
+	switch (xdp->command) {
+	case XDP_SETUP_PROG:
+		old_prog = rtnl_dereference(vi->xdp_prog);
+		rcu_assign_pointer(vi->xdp_prog, xdp->prog);
+		if (old_prog) {
+			synchronize_net();
+			bpf_prog_destroy(old_prog);
+		}
+		return 0;
+	case XDP_QUERY_PROG:
+		xdp->prog_attached = !!rtnl_dereference(vi->xdp_prog);
+		return 0;
+	default:
+		return -EINVAL;
+	}
+}
+
 static const struct net_device_ops virtnet_netdev = {
 	.ndo_open            = virtnet_open,
 	.ndo_stop   	     = virtnet_close,
@@ -1407,6 +1492,7 @@ static const struct net_device_ops virtnet_netdev = {
 #ifdef CONFIG_NET_RX_BUSY_POLL
 	.ndo_busy_poll		= virtnet_busy_poll,
 #endif
+	.ndo_xdp		= virtnet_xdp,
 };
 
 static void virtnet_config_changed_work(struct work_struct *work)
@@ -1910,6 +1996,7 @@ static void remove_vq_common(struct virtnet_info *vi)
 static void virtnet_remove(struct virtio_device *vdev)
 {
 	struct virtnet_info *vi = vdev->priv;
+	struct bpf_prog *xdp_prog;
 
 	unregister_hotcpu_notifier(&vi->nb);
 
@@ -1920,6 +2007,11 @@ static void virtnet_remove(struct virtio_device *vdev)
 
 	remove_vq_common(vi);
 
+	/* The device is gone, nobody else can see the program any more. */
+	xdp_prog = rcu_dereference_protected(vi->xdp_prog, 1);
+	if (xdp_prog)
+		bpf_prog_destroy(xdp_prog);
+
 	free_percpu(vi->stats);
 	free_netdev(vi->dev);
 }
@@ -61,6 +61,10 @@ static bool support_p2p_device = true;
 module_param(support_p2p_device, bool, 0444);
 MODULE_PARM_DESC(support_p2p_device, "Support P2P-Device interface type");
 
+static bool use_txq;
+module_param(use_txq, bool, 0444);
+MODULE_PARM_DESC(use_txq, "Use mac80211 intermediate tx queues");
+
 /**
  * enum hwsim_regtest - the type of regulatory tests we offer
  *
@@ -2144,7 +2148,21 @@ static void mac80211_hwsim_get_et_stats(struct ieee80211_hw *hw,
 	WARN_ON(i != MAC80211_HWSIM_SSTATS_LEN);
 }
 
-static const struct ieee80211_ops mac80211_hwsim_ops = {
+static void mac80211_hwsim_wake_tx_queue(struct ieee80211_hw *hw,
+					 struct ieee80211_txq *txq)
+{
+	struct ieee80211_tx_control control = {
+		.sta = txq->sta,
+	};
+	struct sk_buff *skb;
+
+	rcu_read_lock();
+	while ((skb = ieee80211_tx_dequeue(hw, txq)))
+		mac80211_hwsim_tx(hw, &control, skb);
+	rcu_read_unlock();
+}
+
+static struct ieee80211_ops mac80211_hwsim_ops = {
 	.tx = mac80211_hwsim_tx,
 	.start = mac80211_hwsim_start,
 	.stop = mac80211_hwsim_stop,
@@ -3148,6 +3166,9 @@ static int __init init_mac80211_hwsim(void)
 	if (channels < 1)
 		return -EINVAL;
 
+	if (use_txq)
+		mac80211_hwsim_ops.wake_tx_queue = mac80211_hwsim_wake_tx_queue;
+
 	mac80211_hwsim_mchan_ops = mac80211_hwsim_ops;
 	mac80211_hwsim_mchan_ops.hw_scan = mac80211_hwsim_hw_scan;
 	mac80211_hwsim_mchan_ops.cancel_hw_scan = mac80211_hwsim_cancel_hw_scan;
@@ -43,6 +43,7 @@
 #include <linux/seq_file.h>
 #include <linux/compat.h>
 #include <linux/rculist.h>
+#include <linux/llist.h>
 
 /*
  * LOCKING:
@@ -53,11 +54,12 @@
  * 3) ep->lock (spinlock)
  *
  * The acquire order is the one listed above, from 1 to 3.
- * We need a spinlock (ep->lock) because we manipulate objects
- * from inside the poll callback, that might be triggered from
- * a wake_up() that in turn might be called from IRQ context.
- * So we can't sleep inside the poll callback and hence we need
- * a spinlock. During the event transfer loop (from kernel to
+ * The poll callback, that might be triggered from a wake_up() that in
+ * turn might be called from IRQ context, takes no epoll lock at all:
+ * it pushes the item on the lockless ep->pending list and the consumers
+ * move pending items to ep->rdllist under the ep->lock spinlock, which
+ * also protects the ready list against the epoll_ctl() paths.
+ * During the event transfer loop (from kernel to
  * user space) we could end up sleeping due a copy_to_user(), so
  * we need a lock that will allow us to sleep. This lock is a
  * mutex (ep->mtx). It is acquired during the event transfer loop,
@@ -93,7 +95,10 @@
  */
 
 /* Epoll private bits inside the event mask */
-#define EP_PRIVATE_BITS (EPOLLWAKEUP | EPOLLONESHOT | EPOLLET)
+#define EP_PRIVATE_BITS (EPOLLNOREPOLL | EPOLLWAKEUP | EPOLLONESHOT | EPOLLET)
+
+/* Set in eppoll_entry->revents when a wakeup did not report its events */
+#define EP_REVENTS_UNKNOWN (1U << 31)
 
 /* Maximum number of nesting allowed inside epoll sets */
 #define EP_MAX_NESTS 4
@@ -146,10 +151,10 @@ struct epitem {
 	struct list_head rdllink;
 
 	/*
-	 * Works together "struct eventpoll"->ovflist in keeping the
-	 * single linked chain of items.
+	 * Links the item on "struct eventpoll"->pending.  Holds
+	 * EP_UNACTIVE_PTR while the item is not queued there.
 	 */
-	struct epitem *next;
+	struct llist_node pllink;
 
 	/* The file descriptor information this item refers to */
 	struct epoll_filefd ffd;
@@ -203,11 +208,10 @@ struct eventpoll {
 	struct rb_root rbr;
 
 	/*
-	 * This is a single linked list that chains all the "struct epitem" that
-	 * happened while transferring ready events to userspace w/out
-	 * holding ->lock.
+	 * Items reported ready by the poll callback, which adds to this list
+	 * without taking ->lock.  They are moved to ->rdllist under ->lock.
 	 */
-	struct epitem *ovflist;
+	struct llist_head pending;
 
 	/* wakeup_source used when ep_scan_ready_list is running */
 	struct wakeup_source *ws;
@@ -238,6 +242,9 @@ struct eppoll_entry {
 
 	/* The wait queue head that linked the "wait" wait queue item */
 	wait_queue_head_t *whead;
+
+	/* Events reported by wakeups since the item was last delivered */
+	unsigned int revents;
 };
 
 /* Wrapper struct used by poll queueing */
@@ -377,7 +384,49 @@ static void ep_nested_calls_init(struct nested_calls *ncalls)
  */
 static inline int ep_events_available(struct eventpoll *ep)
 {
-	return !list_empty(&ep->rdllist) || ep->ovflist != EP_UNACTIVE_PTR;
+	return !list_empty(&ep->rdllist) || !llist_empty(&ep->pending);
+}
+
+/*
+ * Queue @epi on the pending list without taking any lock.  Returns true if
+ * the item was queued by us, false if it is already waiting there.
+ */
+static inline bool ep_queue_pending(struct eventpoll *ep, struct epitem *epi)
+{
+	if (cmpxchg(&epi->pllink.next, EP_UNACTIVE_PTR, NULL) !=
+	    EP_UNACTIVE_PTR)
+		return false;
+
+	llist_add(&epi->pllink, &ep->pending);
+	return true;
+}
+
+/* Atomically OR the events of a keyed wakeup into @pwq->revents */
+static inline void ep_pwq_add_revents(struct eppoll_entry *pwq,
+				      unsigned int events)
+{
+	unsigned int old;
+
+	do {
+		old = ACCESS_ONCE(pwq->revents);
+		if ((old & events) == events)
+			return;
+	} while (cmpxchg(&pwq->revents, old, old | events) != old);
+}
+
+/*
+ * Collect and clear the events reported by the wakeups of @epi since its
+ * last delivery.  Must be called with "ep->mtx" held.
+ */
+static unsigned int ep_take_revents(struct epitem *epi)
+{
+	struct eppoll_entry *pwq;
+	unsigned int revents = 0;
+
+	list_for_each_entry(pwq, &epi->pwqlist, llink)
+		revents |= xchg(&pwq->revents, 0);
+
+	return revents;
 }
 
 /**
@@ -519,8 +568,12 @@ static void ep_remove_wait_queue(struct eppoll_entry *pwq)
 	wait_queue_head_t *whead;
 
 	rcu_read_lock();
-	/* If it is cleared by POLLFREE, it should be rcu-safe */
-	whead = rcu_dereference(pwq->whead);
+	/*
+	 * If it is cleared by POLLFREE, it should be rcu-safe.  The acquire
+	 * pairs with the release in ep_poll_callback(): a NULL ->whead means
+	 * the callback is done with pwq and epi.
+	 */
+	whead = smp_load_acquire(&pwq->whead);
 	if (whead)
 		remove_wait_queue(whead, &pwq->wait);
 	rcu_read_unlock();
@@ -577,6 +630,34 @@ static inline void ep_pm_stay_awake_rcu(struct epitem *epi)
 	rcu_read_unlock();
 }
 
+/*
+ * Move the items queued by the poll callback to the ready list.  Must be
+ * called with "ep->lock" held.
+ */
+static void ep_flush_pending(struct eventpoll *ep)
+{
+	struct llist_node *node;
+	struct epitem *epi;
+
+	node = llist_reverse_order(llist_del_all(&ep->pending));
+	while (node) {
+		epi = llist_entry(node, struct epitem, pllink);
+		node = node->next;
+
+		/* From here on the poll callback may queue the item again */
+		smp_store_release(&epi->pllink.next, EP_UNACTIVE_PTR);
+
+		/*
+		 * The item may still be on the ready list, or on the txlist
+		 * of an ep_scan_ready_list() that is about to splice it back.
+		 */
+		if (!ep_is_linked(&epi->rdllink)) {
+			list_add_tail(&epi->rdllink, &ep->rdllist);
+			ep_pm_stay_awake(epi);
+		}
+	}
+}
+
 /**
  * ep_scan_ready_list - Scans the ready list in a way that makes possible for
  *                      the scan code, to call f_op->poll(). Also allows for
@@ -597,7 +678,6 @@ static int ep_scan_ready_list(struct eventpoll *ep,
 {
 	int error, pwake = 0;
 	unsigned long flags;
-	struct epitem *epi, *nepi;
 	LIST_HEAD(txlist);
 
 	/*
@@ -610,15 +690,14 @@ static int ep_scan_ready_list(struct eventpoll *ep,
 
 	/*
 	 * Steal the ready list, and re-init the original one to the
-	 * empty list. Also, set ep->ovflist to NULL so that events
-	 * happening while looping w/out locks, are not lost. We cannot
-	 * have the poll callback to queue directly on ep->rdllist,
-	 * because we want the "sproc" callback to be able to do it
-	 * in a lockless way.
+	 * empty list. Events happening while looping w/out locks are
+	 * left by the poll callback on ep->pending and are not lost.
+	 * The "sproc" callback is the only one re-adding to
+	 * ep->rdllist, so it is able to do it in a lockless way.
 	 */
 	spin_lock_irqsave(&ep->lock, flags);
+	ep_flush_pending(ep);
 	list_splice_init(&ep->rdllist, &txlist);
-	ep->ovflist = NULL;
 	spin_unlock_irqrestore(&ep->lock, flags);
 
 	/*
@@ -630,33 +709,23 @@ static int ep_scan_ready_list(struct eventpoll *ep,
 	/*
 	 * During the time we spent inside the "sproc" callback, some
 	 * other events might have been queued by the poll callback.
-	 * We re-insert them inside the main ready-list here.
-	 */
-	for (nepi = ep->ovflist; (epi = nepi) != NULL;
-	     nepi = epi->next, epi->next = EP_UNACTIVE_PTR) {
-		/*
-		 * We need to check if the item is already in the list.
-		 * During the "sproc" callback execution time, items are
-		 * queued into ->ovflist but the "txlist" might already
-		 * contain them, and the list_splice() below takes care of them.
-		 */
-		if (!ep_is_linked(&epi->rdllink)) {
-			list_add_tail(&epi->rdllink, &ep->rdllist);
-			ep_pm_stay_awake(epi);
-		}
-	}
-	/*
-	 * We need to set back ep->ovflist to EP_UNACTIVE_PTR, so that after
-	 * releasing the lock, events will be queued in the normal way inside
-	 * ep->rdllist.
+	 * We insert them inside the main ready-list here; items that
+	 * are still on "txlist" are taken care of by the list_splice()
+	 * below.
 	 */
-	ep->ovflist = EP_UNACTIVE_PTR;
+	ep_flush_pending(ep);
 
 	/*
 	 * Quickly re-inject items left on "txlist".
 	 */
 	list_splice(&txlist, &ep->rdllist);
-	__pm_relax(ep->ws);
+
+	/*
+	 * A callback racing with us keeps ep->ws active until its item
+	 * is flushed by the next scan.
+	 */
+	if (llist_empty(&ep->pending))
+		__pm_relax(ep->ws);
 
 	if (!list_empty(&ep->rdllist)) {
 		/*
@@ -664,7 +733,7 @@ static int ep_scan_ready_list(struct eventpoll *ep,
 		 * the ->poll() wait list (delayed after we release the lock).
 		 */
 		if (waitqueue_active(&ep->wq))
-			wake_up_locked(&ep->wq);
+			wake_up(&ep->wq);
 		if (waitqueue_active(&ep->poll_wait))
 			pwake++;
 	}
@@ -696,12 +765,11 @@ static int ep_remove(struct eventpoll *ep, struct epitem *epi)
 	struct file *file = epi->ffd.file;
 
 	/*
-	 * Removes poll wait queue hooks. We _have_ to do this without holding
-	 * the "ep->lock" otherwise a deadlock might occur. This because of the
-	 * sequence of the lock acquisition. Here we do "ep->lock" then the wait
-	 * queue head lock when unregistering the wait queue. The wakeup callback
-	 * will run by holding the wait queue head lock and will call our callback
-	 * that will try to get "ep->lock".
+	 * Removes poll wait queue hooks. remove_wait_queue() takes the lock
+	 * each wakeup callback runs under, and a queue torn down by POLLFREE
+	 * clears ->whead only after its callback is done with the item, so
+	 * once this returns no callback is running for the item and it cannot
+	 * be queued on ep->pending again.
 	 */
 	ep_unregister_pollwait(ep, epi);
 
@@ -712,7 +780,12 @@ static int ep_remove(struct eventpoll *ep, struct epitem *epi)
 
 	rb_erase(&epi->rbn, &ep->rbr);
 
+	/*
+	 * No callback can queue the item any more, but it may still sit on
+	 * ep->pending from an earlier wakeup.
+	 */
 	spin_lock_irqsave(&ep->lock, flags);
+	ep_flush_pending(ep);
 	if (ep_is_linked(&epi->rdllink))
 		list_del_init(&epi->rdllink);
 	spin_unlock_irqrestore(&ep->lock, flags);
@@ -801,6 +874,25 @@ static inline unsigned int ep_item_poll(struct epitem *epi, poll_table *pt)
 	return epi->ffd.file->f_op->poll(epi->ffd.file, pt) & epi->event.events;
 }
 
+/*
+ * Events to deliver for a ready item.  An EPOLLNOREPOLL item whose wakeups
+ * all reported their events is delivered from those, which saves calling
+ * the file's ->poll() again; the item is edge-triggered, so a stale bit
+ * only costs userspace one -EAGAIN.  Anything else is polled.  Must be
+ * called with "ep->mtx" held.
+ */
+static inline unsigned int ep_item_revents(struct epitem *epi, poll_table *pt)
+{
+	if (epi->event.events & EPOLLNOREPOLL) {
+		unsigned int revents = ep_take_revents(epi);
+
+		if (revents && !(revents & EP_REVENTS_UNKNOWN))
+			return revents & epi->event.events;
+	}
+
+	return ep_item_poll(epi, pt);
+}
+
 static int ep_read_events_proc(struct eventpoll *ep, struct list_head *head,
 			       void *priv)
 {
@@ -954,7 +1046,7 @@ static int ep_alloc(struct eventpoll **pep)
 	init_waitqueue_head(&ep->poll_wait);
 	INIT_LIST_HEAD(&ep->rdllist);
 	ep->rbr = RB_ROOT;
-	ep->ovflist = EP_UNACTIVE_PTR;
+	init_llist_head(&ep->pending);
 	ep->user = user;
 
 	*pep = ep;
@@ -1002,23 +1094,10 @@ static struct epitem *ep_find(struct eventpoll *ep, struct file *file, int fd)
  */
 static int ep_poll_callback(wait_queue_t *wait, unsigned mode, int sync, void *key)
 {
-	int pwake = 0;
-	unsigned long flags;
-	struct epitem *epi = ep_item_from_wait(wait);
+	struct eppoll_entry *pwq = ep_pwq_from_wait(wait);
+	struct epitem *epi = pwq->base;
 	struct eventpoll *ep = epi->ep;
-
-	if ((unsigned long)key & POLLFREE) {
-		ep_pwq_from_wait(wait)->whead = NULL;
-		/*
-		 * whead = NULL above can race with ep_remove_wait_queue()
-		 * which can do another remove_wait_queue() after us, so we
-		 * can't use __remove_wait_queue(). whead->lock is held by
-		 * the caller.
-		 */
-		list_del_init(&wait->task_list);
-	}
-
-	spin_lock_irqsave(&ep->lock, flags);
+	unsigned int events;
 
 	/*
 	 * If the event mask does not contain any poll(2) event, we consider the
@@ -1026,8 +1105,9 @@ static int ep_poll_callback(wait_queue_t *wait, unsigned mode, int sync, void *k
 	 * EPOLLONESHOT bit that disables the descriptor when an event is received,
 	 * until the next EPOLL_CTL_MOD will be issued.
 	 */
-	if (!(epi->event.events & ~EP_PRIVATE_BITS))
-		goto out_unlock;
+	events = ACCESS_ONCE(epi->event.events);
+	if (!(events & ~EP_PRIVATE_BITS))
+		goto out;
 
 	/*
 	 * Check the events coming with the callback. At this stage, not
@@ -1035,53 +1115,61 @@ static int ep_poll_callback(wait_queue_t *wait, unsigned mode, int sync, void *k
 	 * callback. We need to be able to handle both cases here, hence the
 	 * test for "key" != NULL before the event match test.
 	 */
-	if (key && !((unsigned long) key & epi->event.events))
-		goto out_unlock;
+	if (key && !((unsigned long) key & events))
+		goto out;
 
 	/*
-	 * If we are transferring events to userspace, we can hold no locks
-	 * (because we're accessing user memory, and because of linux f_op->poll()
-	 * semantics). All the events that happen during that period of time are
-	 * chained in ep->ovflist and requeued later on.
+	 * Remember what the wakeup reported, so that EPOLLNOREPOLL items
+	 * can be delivered without calling ->poll() again.
 	 */
-	if (unlikely(ep->ovflist != EP_UNACTIVE_PTR)) {
-		if (epi->next == EP_UNACTIVE_PTR) {
-			epi->next = ep->ovflist;
-			ep->ovflist = epi;
-			if (epi->ws) {
-				/*
-				 * Activate ep->ws since epi->ws may get
-				 * deactivated at any time.
-				 */
-				__pm_stay_awake(ep->ws);
-			}
-
-		}
-		goto out_unlock;
-	}
+	if (events & EPOLLNOREPOLL)
+		ep_pwq_add_revents(pwq, key ?
+				   (unsigned long) key & ~POLLFREE :
+				   EP_REVENTS_UNKNOWN);
 
-	/* If this file is already in the ready list we exit soon */
-	if (!ep_is_linked(&epi->rdllink)) {
-		list_add_tail(&epi->rdllink, &ep->rdllist);
-		ep_pm_stay_awake_rcu(epi);
+	/*
+	 * If this item is already waiting to be moved to the ready list, the
+	 * task that queued it does the wakeup.  We hold no epoll lock here, so
+	 * transferring events to userspace never holds back the callback.
+	 */
+	if (!ep_queue_pending(ep, epi))
+		goto out;
+	ep_pm_stay_awake_rcu(epi);
+	if (rcu_access_pointer(epi->ws)) {
+		/*
+		 * Activate ep->ws since epi->ws may get deactivated at any
+		 * time by a concurrent ep_send_events_proc().
+		 */
+		__pm_stay_awake(ep->ws);
 	}
 
 	/*
 	 * Wake up ( if active ) both the eventpoll wait list and the ->poll()
-	 * wait list.
+	 * wait list.  llist_add() above implies a full barrier, pairing with
+	 * set_current_state() in ep_poll().
 	 */
 	if (waitqueue_active(&ep->wq))
-		wake_up_locked(&ep->wq);
+		wake_up(&ep->wq);
 	if (waitqueue_active(&ep->poll_wait))
-		pwake++;
-
-out_unlock:
-	spin_unlock_irqrestore(&ep->lock, flags);
-
-	/* We have to call this outside the lock */
-	if (pwake)
 		ep_poll_safewake(&ep->poll_wait);
 
+out:
+	if ((unsigned long)key & POLLFREE) {
+		/*
+		 * whead->lock is held by the caller, and a concurrent
+		 * ep_remove_wait_queue() that still sees ->whead takes it
+		 * too, so it cannot use __remove_wait_queue().
+		 */
+		list_del_init(&wait->task_list);
+		/*
+		 * Once ->whead is cleared nothing keeps ep_remove() or
+		 * ep_free() from freeing pwq and epi, so this must be the
+		 * last access to either.  Pairs with smp_load_acquire() in
+		 * ep_remove_wait_queue().
+		 */
+		smp_store_release(&pwq->whead, NULL);
+	}
+
 	return 1;
 }
 
@@ -1099,6 +1187,7 @@ static void ep_ptable_queue_proc(struct file *file, wait_queue_head_t *whead,
 		init_waitqueue_func_entry(&pwq->wait, ep_poll_callback);
 		pwq->whead = whead;
 		pwq->base = epi;
+		pwq->revents = 0;
 		add_wait_queue(whead, &pwq->wait);
 		list_add_tail(&pwq->llink, &epi->pwqlist);
 		epi->nwait++;
@@ -1288,7 +1377,7 @@ static int ep_insert(struct eventpoll *ep, struct epoll_event *event,
 	ep_set_ffd(&epi->ffd, tfile, fd);
 	epi->event = *event;
 	epi->nwait = 0;
-	epi->next = EP_UNACTIVE_PTR;
+	epi->pllink.next = EP_UNACTIVE_PTR;
 	if (epi->event.events & EPOLLWAKEUP) {
 		error = ep_create_wakeup_source(epi);
 		if (error)
@@ -1345,7 +1434,7 @@ static int ep_insert(struct eventpoll *ep, struct epoll_event *event,
 
 		/* Notify waiting tasks that events are available */
 		if (waitqueue_active(&ep->wq))
-			wake_up_locked(&ep->wq);
+			wake_up(&ep->wq);
 		if (waitqueue_active(&ep->poll_wait))
 			pwake++;
 	}
@@ -1372,11 +1461,10 @@ error_unregister:
 
 	/*
 	 * We need to do this because an event could have been arrived on some
-	 * allocated wait queue. Note that we don't care about the ep->ovflist
-	 * list, since that is used/cleaned only inside a section bound by "mtx".
-	 * And ep_insert() is called with "mtx" held.
+	 * allocated wait queue, leaving the item on ep->pending.
 	 */
 	spin_lock_irqsave(&ep->lock, flags);
+	ep_flush_pending(ep);
 	if (ep_is_linked(&epi->rdllink))
 		list_del_init(&epi->rdllink);
 	spin_unlock_irqrestore(&ep->lock, flags);
@@ -1422,8 +1510,8 @@ static int ep_modify(struct eventpoll *ep, struct epitem *epi, struct epoll_even
 	 *    we do not miss events from ep_poll_callback if an
 	 *    event occurs immediately after we call f_op->poll().
 	 *    We need this because we did not take ep->lock while
-	 *    changing epi above (but ep_poll_callback does take
-	 *    ep->lock).
+	 *    changing epi above (and ep_poll_callback takes no
+	 *    lock at all).
 	 *
 	 * 2) We also need to ensure we do not miss _past_ events
 	 *    when calling f_op->poll().  This barrier also
@@ -1453,7 +1541,7 @@ static int ep_modify(struct eventpoll *ep, struct epitem *epi, struct epoll_even
 
 			/* Notify waiting tasks that events are available */
 			if (waitqueue_active(&ep->wq))
-				wake_up_locked(&ep->wq);
+				wake_up(&ep->wq);
 			if (waitqueue_active(&ep->poll_wait))
 				pwake++;
 		}
@@ -1507,7 +1595,7 @@ static int ep_send_events_proc(struct eventpoll *ep, struct list_head *head,
 
 		list_del_init(&epi->rdllink);
 
-		revents = ep_item_poll(epi, &pt);
+		revents = ep_item_revents(epi, &pt);
 
 		/*
 		 * If the event mask intersect the caller-requested one,
@@ -1536,7 +1624,7 @@ static int ep_send_events_proc(struct eventpoll *ep, struct list_head *head,
 				 * into ep->rdllist besides us. The epoll_ctl()
 				 * callers are locked out by
 				 * ep_scan_ready_list() holding "mtx" and the
-				 * poll callback will queue them in ep->ovflist.
+				 * poll callback will queue them in ep->pending.
 				 */
 				list_add_tail(&epi->rdllink, &ep->rdllist);
 				ep_pm_stay_awake(epi);
@@ -1590,7 +1678,6 @@ static int ep_poll(struct eventpoll *ep, struct epoll_event __user *events,
 		   int maxevents, long timeout)
 {
 	int res = 0, eavail, timed_out = 0;
-	unsigned long flags;
 	long slack = 0;
 	wait_queue_t wait;
 	ktime_t expires, *to = NULL;
@@ -1607,13 +1694,10 @@ static int ep_poll(struct eventpoll *ep, struct epoll_event __user *events,
 		 * caller specified a non blocking operation.
 		 */
 		timed_out = 1;
-		spin_lock_irqsave(&ep->lock, flags);
 		goto check_events;
 	}
 
 fetch_events:
-	spin_lock_irqsave(&ep->lock, flags);
-
 	if (!ep_events_available(ep)) {
 		/*
 		 * We don't have any available event to return to the caller.
@@ -1621,7 +1705,7 @@ fetch_events:
 		 * ep_poll_callback() when events will become available.
 		 */
 		init_waitqueue_entry(&wait, current);
-		__add_wait_queue_exclusive(&ep->wq, &wait);
+		add_wait_queue_exclusive(&ep->wq, &wait);
 
 		for (;;) {
 			/*
@@ -1637,14 +1721,11 @@ fetch_events:
 				break;
 			}
 
-			spin_unlock_irqrestore(&ep->lock, flags);
 			if (!freezable_schedule_hrtimeout_range(to, slack,
 								HRTIMER_MODE_ABS))
 				timed_out = 1;
-
-			spin_lock_irqsave(&ep->lock, flags);
 		}
-		__remove_wait_queue(&ep->wq, &wait);
+		remove_wait_queue(&ep->wq, &wait);
 
 		set_current_state(TASK_RUNNING);
 	}
@@ -1652,8 +1733,6 @@ check_events:
 	/* Is it worth to try to dig for events ? */
 	eavail = ep_events_available(ep);
 
-	spin_unlock_irqrestore(&ep->lock, flags);
-
 	/*
 	 * Try to transfer events to user space. In case we get 0 events and
 	 * there's still timeout left over, we go trying again in search of
@@ -1857,6 +1936,12 @@ SYSCALL_DEFINE4(epoll_ctl, int, epfd, int, op, int, fd,
 	if (ep_op_has_event(op))
 		ep_take_care_of_epollwakeup(&epds);
 
+	/* Skipping the re-poll is only valid for edge-triggered items */
+	error = -EINVAL;
+	if (ep_op_has_event(op) && (epds.events & EPOLLNOREPOLL) &&
+	    !(epds.events & EPOLLET))
+		goto error_tgt_fput;
+
 	/*
 	 * We have to check that the file structure underneath the file descriptor
 	 * the user passed to us _is_ an eventpoll file. And also we do not permit
@@ -94,6 +94,8 @@ struct fuse_req *fuse_request_alloc_nofs(unsigned npages)
 
 void fuse_request_free(struct fuse_req *req)
 {
+	if (req->passthrough_filp)
+		fput(req->passthrough_filp);
 	if (req->pages != req->inline_pages) {
 		kfree(req->pages);
 		kfree(req->page_descs);
@@ -1640,7 +1642,7 @@ static int fuse_retrieve(struct fuse_conn *fc, struct inode *inode,
 		num = file_size - outarg->offset;
 
 	num_pages = (num + offset + PAGE_SIZE - 1) >> PAGE_SHIFT;
-	num_pages = min(num_pages, FUSE_MAX_PAGES_PER_REQ);
+	num_pages = min_t(unsigned, num_pages, fc->max_pages);
 
 	req = fuse_get_req(fc, num_pages);
 	if (IS_ERR(req))
@@ -1869,6 +1871,8 @@ static ssize_t fuse_dev_do_write(struct fuse_conn *fc,
 	if (req->in.h.opcode == FUSE_CANONICAL_PATH) {
 		req->out.h.error = kern_path((char *)req->out.args[0].value, 0,
 							req->canonical_path);
+	} else if (!err) {
+		fuse_passthrough_setup(fc, req);
 	}
 	fuse_copy_finish(cs);
 
@@ -0,0 +1,174 @@
+/*
+  FUSE: Filesystem in Userspace
+  Passthrough of read and write to a backing file
+
+  This program can be distributed under the terms of the GNU GPL.
+  See the file COPYING.
+*/
+
+#include "fuse_i.h"
+
+#include <linux/file.h>
+#include <linux/fs.h>
+#include <linux/aio.h>
+#include <linux/pagemap.h>
+#include <linux/uio.h>
+
+/*
+ * Passthrough lets the daemon answer OPEN or CREATE with a file
+ * descriptor of its own (normally a file on a local filesystem).  Reads
+ * and writes on the fuse file are then sent straight to that file
+ * instead of going through the daemon.  Everything else (permission
+ * checks, attributes, release) still goes to the daemon as usual.
+ */
+
+/*
+ * Called from fuse_dev_do_write() in the context of the daemon writing
+ * the reply, so that the descriptor is looked up in its file table.
+ */
+void fuse_passthrough_setup(struct fuse_conn *fc, struct fuse_req *req)
+{
+	struct fuse_open_out *outarg;
+	struct inode *lower_inode;
+	struct file *lower;
+
+	if (!fc->passthrough || req->out.h.error)
+		return;
+
+	if (req->in.h.opcode != FUSE_OPEN && req->in.h.opcode != FUSE_CREATE)
+		return;
+
+	outarg = req->out.args[req->out.numargs - 1].value;
+	if (!(outarg->open_flags & FOPEN_PASSTHROUGH))
+		return;
+
+	/* If the backing file is not usable, fall back to the daemon */
+	outarg->open_flags &= ~FOPEN_PASSTHROUGH;
+	if (outarg->open_flags & FOPEN_DIRECT_IO)
+		return;
+
+	lower = fget(outarg->passthrough_fd);
+	if (!lower)
+		return;
+
+	lower_inode = file_inode(lower);
+	if (!S_ISREG(lower_inode->i_mode) ||
+	    !lower->f_op->read_iter || !lower->f_op->write_iter ||
+	    lower_inode->i_sb->s_magic == FUSE_SUPER_MAGIC) {
+		fput(lower);
+		return;
+	}
+
+	outarg->open_flags |= FOPEN_PASSTHROUGH;
+	req->passthrough_filp = lower;
+}
+
+/*
+ * Move the backing file picked up by fuse_passthrough_setup() from the
+ * OPEN/CREATE request to the newly opened fuse file.
+ */
+void fuse_passthrough_open(struct fuse_file *ff, struct fuse_req *req)
+{
+	ff->passthrough_filp = req->passthrough_filp;
+	req->passthrough_filp = NULL;
+}
+
+void fuse_passthrough_release(struct fuse_file *ff)
+{
+	if (ff->passthrough_filp) {
+		fput(ff->passthrough_filp);
+		ff->passthrough_filp = NULL;
+	}
+}
+
+/*
+ * Pages may still be in the fuse page cache if the file is also mapped.
+ * Push them out through the daemon first, so the backing file is never
+ * behind the mapping.
+ */
+static int fuse_passthrough_sync(struct inode *inode, loff_t pos, size_t count)
+{
+	if (!inode->i_mapping->nrpages || !count)
+		return 0;
+
+	return filemap_write_and_wait_range(inode->i_mapping, pos,
+					    pos + count - 1);
+}
+
+ssize_t fuse_passthrough_read_iter(struct kiocb *iocb, struct iov_iter *to)
+{
+	struct file *file = iocb->ki_filp;
+	struct fuse_file *ff = file->private_data;
+	struct file *lower = ff->passthrough_filp;
+	struct inode *inode = file_inode(file);
+	size_t count = iov_iter_count(to);
+	struct kiocb kiocb;
+	ssize_t ret;
+
+	if (!(lower->f_mode & FMODE_READ))
+		return -EBADF;
+
+	ret = fuse_passthrough_sync(inode, iocb->ki_pos, count);
+	if (ret)
+		return ret;
+
+	init_sync_kiocb(&kiocb, lower);
+	kiocb.ki_pos = iocb->ki_pos;
+	kiocb.ki_nbytes = count;
+	ret = lower->f_op->read_iter(&kiocb, to);
+	if (ret == -EIOCBQUEUED)
+		ret = wait_on_sync_kiocb(&kiocb);
+	if (ret >= 0) {
+		iocb->ki_pos = kiocb.ki_pos;
+		fuse_invalidate_atime(inode);
+	}
+
+	return ret;
+}
+
+ssize_t fuse_passthrough_write_iter(struct kiocb *iocb, struct iov_iter *from)
+{
+	struct file *file = iocb->ki_filp;
+	struct fuse_file *ff = file->private_data;
+	struct file *lower = ff->passthrough_filp;
+	struct inode *inode = file_inode(file);
+	size_t count = iov_iter_count(from);
+	loff_t pos = iocb->ki_pos;
+	struct kiocb kiocb;
+	ssize_t ret;
+
+	if (!(lower->f_mode & FMODE_WRITE))
+		return -EBADF;
+
+	mutex_lock(&inode->i_mutex);
+
+	if (file->f_flags & O_APPEND)
+		pos = i_size_read(file_inode(lower));
+
+	ret = fuse_passthrough_sync(inode, pos, count);
+	if (ret)
+		goto out;
+
+	init_sync_kiocb(&kiocb, lower);
+	kiocb.ki_pos = pos;
+	kiocb.ki_nbytes = count;
+	file_start_write(lower);
+	ret = lower->f_op->write_iter(&kiocb, from);
+	if (ret == -EIOCBQUEUED)
+		ret = wait_on_sync_kiocb(&kiocb);
+	file_end_write(lower);
+
+	if (ret > 0) {
+		iocb->ki_pos = kiocb.ki_pos;
+		fuse_write_update_size(inode, kiocb.ki_pos);
+		if (inode->i_mapping->nrpages)
+			invalidate_inode_pages2_range(inode->i_mapping,
+					pos >> PAGE_CACHE_SHIFT,
+					(kiocb.ki_pos - 1) >> PAGE_CACHE_SHIFT);
+	}
+	fuse_invalidate_attr(inode);
+out:
+	mutex_unlock(&inode->i_mutex);
+
+	return ret;
+}
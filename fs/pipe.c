@@ -22,6 +22,9 @@
 #include <linux/syscalls.h>
 #include <linux/fcntl.h>
 #include <linux/aio.h>
+#include <linux/cpu.h>
+#include <linux/percpu.h>
+#include <linux/shrinker.h>
 
 #include <asm/uaccess.h>
 #include <asm/ioctls.h>
@@ -39,6 +42,34 @@ unsigned int pipe_max_size = 1048576;
  */
 unsigned int pipe_min_size = PAGE_SIZE;
 
+/*
+ * Pipes that keep filling up are grown automatically, up to
+ * PIPE_AUTO_MAX_BUFFERS (and never beyond pipe_max_size). A pipe is
+ * doubled once a writer has found it full PIPE_GROW_THRESHOLD times, and
+ * goes back to PIPE_DEF_BUFFERS once it has been drained and no writer
+ * has hit the limit for PIPE_SHRINK_DELAY.
+ */
+#define PIPE_AUTO_MAX_BUFFERS	64
+#define PIPE_GROW_THRESHOLD	8
+#define PIPE_SHRINK_DELAY	HZ
+
+/*
+ * Per-cpu cache of free pipe pages, so that the page of a consumed
+ * buffer can be reused by the next write to any pipe on this cpu
+ * without going back to the page allocator.  The lock is only ever
+ * contended by the shrinker, which hands the pages back under memory
+ * pressure.
+ */
+#define PIPE_PAGE_POOL_SIZE	16
+
+struct pipe_page_pool {
+	spinlock_t lock;
+	unsigned int nr;
+	struct page *pages[PIPE_PAGE_POOL_SIZE];
+};
+
+static DEFINE_PER_CPU(struct pipe_page_pool, pipe_page_pool);
+
 /*
  * We use a start+len construction, which provides full use of the 
  * allocated memory.
@@ -116,20 +147,104 @@ void pipe_wait(struct pipe_inode_info *pipe)
 	pipe_lock(pipe);
 }
 
+static struct page *pipe_page_alloc(void)
+{
+	struct pipe_page_pool *pool;
+	struct page *page = NULL;
+
+	pool = &get_cpu_var(pipe_page_pool);
+	spin_lock(&pool->lock);
+	if (pool->nr)
+		page = pool->pages[--pool->nr];
+	spin_unlock(&pool->lock);
+	put_cpu_var(pipe_page_pool);
+
+	if (!page)
+		page = alloc_page(GFP_HIGHUSER);
+	return page;
+}
+
+/*
+ * Only pages nobody else holds a reference to can go back to the pool,
+ * anything else just has our reference dropped.
+ */
+static void pipe_page_free(struct page *page)
+{
+	struct pipe_page_pool *pool;
+
+	if (page_count(page) == 1) {
+		pool = &get_cpu_var(pipe_page_pool);
+		spin_lock(&pool->lock);
+		if (pool->nr < PIPE_PAGE_POOL_SIZE) {
+			pool->pages[pool->nr++] = page;
+			page = NULL;
+		}
+		spin_unlock(&pool->lock);
+		put_cpu_var(pipe_page_pool);
+		if (!page)
+			return;
+	}
+	page_cache_release(page);
+}
+
+static unsigned long pipe_page_pool_drain(unsigned int cpu,
+					  unsigned long nr_to_free)
+{
+	struct pipe_page_pool *pool = &per_cpu(pipe_page_pool, cpu);
+	unsigned long freed = 0;
+
+	spin_lock(&pool->lock);
+	while (pool->nr && freed < nr_to_free) {
+		__free_page(pool->pages[--pool->nr]);
+		freed++;
+	}
+	spin_unlock(&pool->lock);
+	return freed;
+}
+
+static unsigned long pipe_page_pool_count(struct shrinker *shrink,
+					  struct shrink_control *sc)
+{
+	unsigned long count = 0;
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		count += ACCESS_ONCE(per_cpu(pipe_page_pool, cpu).nr);
+	return count;
+}
+
+static unsigned long pipe_page_pool_scan(struct shrinker *shrink,
+					 struct shrink_control *sc)
+{
+	unsigned long freed = 0;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		if (freed >= sc->nr_to_scan)
+			break;
+		freed += pipe_page_pool_drain(cpu, sc->nr_to_scan - freed);
+	}
+	return freed;
+}
+
+static struct shrinker pipe_page_pool_shrinker = {
+	.count_objects	= pipe_page_pool_count,
+	.scan_objects	= pipe_page_pool_scan,
+	.seeks		= DEFAULT_SEEKS,
+};
+
+static int pipe_cpu_notify(struct notifier_block *self,
+			   unsigned long action, void *hcpu)
+{
+	if (action == CPU_DEAD || action == CPU_DEAD_FROZEN)
+		pipe_page_pool_drain((unsigned long)hcpu, ULONG_MAX);
+	return NOTIFY_OK;
+}
+
 static void anon_pipe_buf_release(struct pipe_inode_info *pipe,
 				  struct pipe_buffer *buf)
 {
-	struct page *page = buf->page;
-
-	/*
-	 * If nobody else uses this page, and we don't already have a
-	 * temporary page, let's keep track of it as a one-deep
-	 * allocation cache. (Otherwise just release our reference to it)
-	 */
-	if (page_count(page) == 1 && !pipe->tmp_page)
-		pipe->tmp_page = page;
-	else
-		page_cache_release(page);
+	pipe_page_free(buf->page);
 }
 
 /**
@@ -226,6 +341,42 @@ static const struct pipe_buf_operations packet_pipe_buf_ops = {
 	.get = generic_pipe_buf_get,
 };
 
+static long pipe_set_size(struct pipe_inode_info *pipe, unsigned long nr_pages);
+
+/*
+ * Called with the pipe locked when a writer finds it full. Returns true
+ * if the pipe was grown and there is room for the writer again.
+ */
+static bool pipe_auto_grow(struct pipe_inode_info *pipe)
+{
+	unsigned int max = min_t(unsigned int, PIPE_AUTO_MAX_BUFFERS,
+				 pipe_max_size >> PAGE_SHIFT);
+
+	pipe->last_full = jiffies;
+	if (pipe->user_sized || pipe->buffers >= max)
+		return false;
+	if (++pipe->full_count < PIPE_GROW_THRESHOLD)
+		return false;
+
+	pipe->full_count = 0;
+	return pipe_set_size(pipe, pipe->buffers * 2) > 0;
+}
+
+/*
+ * Called with the pipe locked when a reader has drained it. Once writers
+ * have stopped hitting the limit, go back to the default size.
+ */
+static void pipe_auto_shrink(struct pipe_inode_info *pipe)
+{
+	if (pipe->user_sized ||
+	    time_before(jiffies, pipe->last_full + PIPE_SHRINK_DELAY))
+		return;
+
+	pipe->full_count = 0;
+	if (pipe->buffers > PIPE_DEF_BUFFERS)
+		pipe_set_size(pipe, PIPE_DEF_BUFFERS);
+}
+
 static ssize_t
 pipe_read(struct kiocb *iocb, struct iov_iter *to)
 {
@@ -285,6 +436,8 @@ pipe_read(struct kiocb *iocb, struct iov_iter *to)
 				pipe->curbuf = curbuf;
 				pipe->nrbufs = --bufs;
 				do_wakeup = 1;
+				if (!bufs)
+					pipe_auto_shrink(pipe);
 			}
 			total_len -= chars;
 			if (!total_len)
@@ -397,16 +550,13 @@ pipe_write(struct kiocb *iocb, struct iov_iter *from)
 		if (bufs < pipe->buffers) {
 			int newbuf = (pipe->curbuf + bufs) & (pipe->buffers-1);
 			struct pipe_buffer *buf = pipe->bufs + newbuf;
-			struct page *page = pipe->tmp_page;
+			struct page *page;
 			int copied;
 
-			if (!page) {
-				page = alloc_page(GFP_HIGHUSER);
-				if (unlikely(!page)) {
-					ret = ret ? : -ENOMEM;
-					break;
-				}
-				pipe->tmp_page = page;
+			page = pipe_page_alloc();
+			if (unlikely(!page)) {
+				ret = ret ? : -ENOMEM;
+				break;
 			}
 			/* Always wake up, even if the copy fails. Otherwise
 			 * we lock up (O_NONBLOCK-)readers that sleep due to
@@ -416,6 +566,7 @@ pipe_write(struct kiocb *iocb, struct iov_iter *from)
 			do_wakeup = 1;
 			copied = copy_page_from_iter(page, 0, PAGE_SIZE, from);
 			if (unlikely(copied < PAGE_SIZE && iov_iter_count(from))) {
+				pipe_page_free(page);
 				if (!ret)
 					ret = -EFAULT;
 				break;
@@ -433,12 +584,11 @@ pipe_write(struct kiocb *iocb, struct iov_iter *from)
 				buf->flags = PIPE_BUF_FLAG_PACKET;
 			}
 			pipe->nrbufs = ++bufs;
-			pipe->tmp_page = NULL;
 
 			if (!iov_iter_count(from))
 				break;
 		}
-		if (bufs < pipe->buffers)
+		if (bufs < pipe->buffers || pipe_auto_grow(pipe))
 			continue;
 		if (filp->f_flags & O_NONBLOCK) {
 			if (!ret)
@@ -596,6 +746,7 @@ struct pipe_inode_info *alloc_pipe_info(void)
 			init_waitqueue_head(&pipe->wait);
 			pipe->r_counter = pipe->w_counter = 1;
 			pipe->buffers = PIPE_DEF_BUFFERS;
+			pipe->last_full = jiffies;
 			mutex_init(&pipe->mutex);
 			return pipe;
 		}
@@ -614,8 +765,6 @@ void free_pipe_info(struct pipe_inode_info *pipe)
 		if (buf->ops)
 			buf->ops->release(pipe, buf);
 	}
-	if (pipe->tmp_page)
-		__free_page(pipe->tmp_page);
 	kfree(pipe->bufs);
 	kfree(pipe);
 }
@@ -1072,6 +1221,8 @@ long pipe_fcntl(struct file *file, unsigned int cmd, unsigned long arg)
 			goto out;
 		}
 		ret = pipe_set_size(pipe, nr_pages);
+		if (ret > 0)
+			pipe->user_sized = true;
 		break;
 		}
 	case F_GETPIPE_SZ:
@@ -1113,8 +1264,12 @@ static struct file_system_type pipe_fs_type = {
 
 static int __init init_pipe_fs(void)
 {
-	int err = register_filesystem(&pipe_fs_type);
+	int err, cpu;
 
+	for_each_possible_cpu(cpu)
+		spin_lock_init(&per_cpu(pipe_page_pool, cpu).lock);
+
+	err = register_filesystem(&pipe_fs_type);
 	if (!err) {
 		pipe_mnt = kern_mount(&pipe_fs_type);
 		if (IS_ERR(pipe_mnt)) {
@@ -1122,7 +1277,12 @@ static int __init init_pipe_fs(void)
 			unregister_filesystem(&pipe_fs_type);
 		}
 	}
-	return err;
+	if (err)
+		return err;
+
+	hotcpu_notifier(pipe_cpu_notify, 0);
+	register_shrinker(&pipe_page_pool_shrinker);
+	return 0;
 }
 
 fs_initcall(init_pipe_fs);
@@ -400,6 +400,65 @@ out:
 	return err;
 }
 
+/*
+ * Sdcardfs splice_read, splice straight from the lower file's page cache
+ * instead of copying through sdcardfs_read
+ */
+static ssize_t sdcardfs_splice_read(struct file *file, loff_t *ppos,
+				    struct pipe_inode_info *pipe, size_t len,
+				    unsigned int flags)
+{
+	ssize_t err;
+	struct file *lower_file;
+
+	lower_file = sdcardfs_lower_file(file);
+	if (!lower_file->f_op->splice_read)
+		return -EINVAL;
+
+	err = lower_file->f_op->splice_read(lower_file, ppos, pipe, len, flags);
+	/* update upper inode atime as needed */
+	if (err >= 0)
+		fsstack_copy_attr_atime(file->f_path.dentry->d_inode,
+					file_inode(lower_file));
+	return err;
+}
+
+/*
+ * Sdcardfs splice_write, hand the pipe to the lower file so that
+ * SPLICE_F_MOVE can move pages into the lower page cache
+ */
+static ssize_t sdcardfs_splice_write(struct pipe_inode_info *pipe,
+				     struct file *file, loff_t *ppos,
+				     size_t len, unsigned int flags)
+{
+	ssize_t err;
+	struct file *lower_file;
+	struct dentry *dentry = file->f_path.dentry;
+
+	/* check disk space */
+	if (!check_min_free_space(dentry, len, 0)) {
+		pr_err("No minimum free space.\n");
+		return -ENOSPC;
+	}
+
+	lower_file = sdcardfs_lower_file(file);
+	if (!lower_file->f_op->splice_write)
+		return -EINVAL;
+
+	file_start_write(lower_file);
+	err = lower_file->f_op->splice_write(pipe, lower_file, ppos, len,
+					     flags);
+	file_end_write(lower_file);
+	/* update upper inode times/sizes as needed */
+	if (err >= 0) {
+		fsstack_copy_inode_size(dentry->d_inode,
+					file_inode(lower_file));
+		fsstack_copy_attr_times(dentry->d_inode,
+					file_inode(lower_file));
+	}
+	return err;
+}
+
 const struct file_operations sdcardfs_main_fops = {
 	.llseek		= generic_file_llseek,
 	.read		= sdcardfs_read,
@@ -416,6 +475,8 @@ const struct file_operations sdcardfs_main_fops = {
 	.fasync		= sdcardfs_fasync,
 	.read_iter	= sdcardfs_read_iter,
 	.write_iter	= sdcardfs_write_iter,
+	.splice_read	= sdcardfs_splice_read,
+	.splice_write	= sdcardfs_splice_write,
 };
 
 /* trimmed directory options */
@@ -924,6 +924,144 @@ ssize_t splice_from_pipe(struct pipe_inode_info *pipe, struct file *out,
 	return ret;
 }
 
+/*
+ * A stolen pipe page may only go into the page cache if nobody else can
+ * see it: not mapped, not in any mapping, and only referenced by the pipe.
+ */
+static int splice_check_stolen_page(struct page *page)
+{
+	if (page_mapcount(page) ||
+	    page->mapping != NULL ||
+	    page_count(page) != 1 ||
+	    (page->flags & PAGE_FLAGS_CHECK_AT_PREP &
+	     ~(1 << PG_locked |
+	       1 << PG_referenced |
+	       1 << PG_uptodate |
+	       1 << PG_lru |
+	       1 << PG_active |
+	       1 << PG_reclaim)))
+		return 1;
+	return 0;
+}
+
+/**
+ * splice_move_to_page_cache - move a pipe buffer page into the page cache
+ * @pipe:	pipe the buffer belongs to
+ * @buf:	the buffer at the head of @pipe
+ * @sd:		information about the splice operation
+ *
+ * Description:
+ *    For SPLICE_F_MOVE, a buffer covering a whole page that lands on a page
+ *    boundary of the file is put into the page cache in place of the page
+ *    the filesystem's ->write_begin() handed out, instead of being copied.
+ *    This is only done for files written through generic_file_write_iter(),
+ *    whose write path is exactly what we do here.  Filesystems whose
+ *    ->write_begin() attaches buffer heads to the page (ext2, ext3, fat
+ *    and other block_write_begin() users) still get a copy.  Returns the
+ *    number of bytes moved, 0 if the buffer has to be copied, or an error.
+ */
+static ssize_t splice_move_to_page_cache(struct pipe_inode_info *pipe,
+					 struct pipe_buffer *buf,
+					 struct splice_desc *sd)
+{
+	struct file *file = sd->u.file;
+	struct address_space *mapping = file->f_mapping;
+	const struct address_space_operations *a_ops = mapping->a_ops;
+	struct inode *inode = mapping->host;
+	struct page *page = buf->page, *oldpage, *target;
+	size_t count = PAGE_CACHE_SIZE;
+	loff_t pos = sd->pos;
+	void *fsdata;
+	ssize_t ret;
+	int err;
+
+	if (buf->offset || buf->len != PAGE_CACHE_SIZE ||
+	    sd->total_len < PAGE_CACHE_SIZE || (pos & ~PAGE_CACHE_MASK))
+		return 0;
+	if (file->f_op->write_iter != generic_file_write_iter ||
+	    (file->f_flags & (O_APPEND | O_DIRECT)))
+		return 0;
+
+	/* let the caller sort out buffers that are not ready */
+	if (buf->ops->confirm(pipe, buf))
+		return 0;
+	if (buf->ops->steal(pipe, buf))
+		return 0;
+	if (splice_check_stolen_page(page)) {
+		unlock_page(page);
+		return 0;
+	}
+
+	mutex_lock(&inode->i_mutex);
+	ret = generic_write_checks(file, &pos, &count, 0);
+	if (ret || count != PAGE_CACHE_SIZE)
+		goto out_unlock;
+	ret = file_remove_suid(file);
+	if (ret)
+		goto out_unlock;
+	ret = file_update_time(file);
+	if (ret)
+		goto out_unlock;
+
+	ret = a_ops->write_begin(file, mapping, pos, PAGE_CACHE_SIZE,
+				 AOP_FLAG_UNINTERRUPTIBLE, &oldpage, &fsdata);
+	if (ret)
+		goto out_unlock;
+
+	/*
+	 * The page we replace must not carry anything of its own: mappings,
+	 * filesystem private data such as buffer heads, or dirty and
+	 * writeback state.  Those cases, shmem pages that would have to
+	 * change LRU, and stolen pages still charged to another memcg are
+	 * copied into the page we were given instead.
+	 */
+	ret = -EBUSY;
+	if (!page_mapped(oldpage) && !page_has_private(oldpage) &&
+	    !PageDirty(oldpage) && !PageWriteback(oldpage) &&
+	    !PageMlocked(oldpage) &&
+	    !(PageSwapBacked(oldpage) && (buf->flags & PIPE_BUF_FLAG_LRU)) &&
+	    mem_cgroup_can_replace_page(oldpage, page)) {
+		ClearPageMappedToDisk(page);
+		SetPageUptodate(page);
+		if (PageSwapBacked(oldpage))
+			__SetPageSwapBacked(page);
+		ret = replace_page_cache_page(oldpage, page, GFP_KERNEL);
+		if (ret)
+			__ClearPageSwapBacked(page);
+	}
+
+	if (ret) {
+		copy_highpage(oldpage, page);
+		flush_dcache_page(oldpage);
+		unlock_page(page);
+		target = oldpage;
+	} else {
+		/* ->write_end() drops the reference ->write_begin() took */
+		page_cache_get(page);
+		if (!(buf->flags & PIPE_BUF_FLAG_LRU))
+			lru_cache_add(page);
+		unlock_page(oldpage);
+		page_cache_release(oldpage);
+		target = page;
+	}
+
+	ret = a_ops->write_end(file, mapping, pos, PAGE_CACHE_SIZE,
+			       PAGE_CACHE_SIZE, target, fsdata);
+	mutex_unlock(&inode->i_mutex);
+	if (ret <= 0)
+		return ret;
+
+	balance_dirty_pages_ratelimited(mapping);
+	sd->pos += ret;
+	err = generic_write_sync(file, pos, ret);
+	return err < 0 ? err : ret;
+
+out_unlock:
+	mutex_unlock(&inode->i_mutex);
+	unlock_page(page);
+	return ret;
+}
+
 /**
  * iter_file_splice_write - splice data from a pipe to a file
  * @pipe:	pipe info
@@ -969,6 +1107,30 @@ iter_file_splice_write(struct pipe_inode_info *pipe, struct file *out,
 		if (ret <= 0)
 			break;
 
+		if (sd.flags & SPLICE_F_MOVE) {
+			struct pipe_buffer *buf = pipe->bufs + pipe->curbuf;
+			const struct pipe_buf_operations *ops = buf->ops;
+
+			ret = splice_move_to_page_cache(pipe, buf, &sd);
+			if (ret < 0)
+				break;
+			if (ret) {
+				sd.num_spliced += ret;
+				sd.total_len -= ret;
+				*ppos = sd.pos;
+
+				buf->len = 0;
+				buf->ops = NULL;
+				ops->release(pipe, buf);
+				pipe->curbuf = (pipe->curbuf + 1) &
+					       (pipe->buffers - 1);
+				pipe->nrbufs--;
+				if (pipe->files)
+					sd.need_wakeup = true;
+				continue;
+			}
+		}
+
 		if (unlikely(nbufs < pipe->buffers)) {
 			kfree(array);
 			nbufs = pipe->buffers;
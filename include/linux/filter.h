@@ -380,7 +380,20 @@ static inline void bpf_prog_unlock_free(struct bpf_prog *fp)
 int bpf_prog_create(struct bpf_prog **pfp, struct sock_fprog_kern *fprog);
 void bpf_prog_destroy(struct bpf_prog *fp);
 
+/* A received frame as seen by an IFLA_XDP program, from the Ethernet
+ * header up to data_end.
+ */
+struct xdp_buff {
+	void *data;
+	void *data_end;
+	struct net_device *dev;
+};
+
+u32 bpf_prog_run_xdp(const struct bpf_prog *prog, struct xdp_buff *xdp);
+u32 bpf_prog_run_xdp_skb(const struct bpf_prog *prog, struct sk_buff *skb);
+
 int sk_attach_filter(struct sock_fprog *fprog, struct sock *sk);
+int sk_reuseport_attach_filter(struct sock_fprog *fprog, struct sock *sk);
 int sk_detach_filter(struct sock *sk);
 
 int bpf_check_classic(const struct sock_filter *filter, unsigned int flen);
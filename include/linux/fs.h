@@ -771,6 +771,8 @@ struct file_ra_state {
 
 	unsigned int ra_pages;		/* Maximum readahead window */
 	unsigned int mmap_miss;		/* Cache miss stat for mmap accesses */
+	unsigned int thrash_max;	/* Window cap learned from thrashing,
+					   0 if none */
 	loff_t prev_pos;		/* Cache last read() position */
 };
 
@@ -42,6 +42,7 @@ enum mem_cgroup_stat_index {
 	MEM_CGROUP_STAT_RSS,		/* # of pages charged as anon rss */
 	MEM_CGROUP_STAT_RSS_HUGE,	/* # of pages charged as anon huge */
 	MEM_CGROUP_STAT_FILE_MAPPED,	/* # of pages charged as file rss */
+	MEM_CGROUP_STAT_DIRTY,		/* # of dirty pages in page cache */
 	MEM_CGROUP_STAT_WRITEBACK,	/* # of pages under writeback */
 	MEM_CGROUP_STAT_SWAP,		/* # of pages, swapped out */
 	MEM_CGROUP_STAT_NSTATS,
@@ -64,6 +65,7 @@ void mem_cgroup_uncharge_list(struct list_head *page_list);
 
 void mem_cgroup_migrate(struct page *oldpage, struct page *newpage,
 			bool lrucare);
+bool mem_cgroup_can_replace_page(struct page *oldpage, struct page *newpage);
 
 struct lruvec *mem_cgroup_zone_lruvec(struct zone *, struct mem_cgroup *);
 struct lruvec *mem_cgroup_page_lruvec(struct page *, struct zone *);
@@ -158,6 +160,14 @@ static inline void mem_cgroup_dec_page_stat(struct mem_cgroup *memcg,
 	mem_cgroup_update_page_stat(memcg, idx, -1);
 }
 
+void mem_cgroup_dec_locked_page_stat(struct page *page,
+				     enum mem_cgroup_stat_index idx);
+
+void mem_cgroup_writeout_inc(struct mem_cgroup *memcg);
+void mem_cgroup_writeout_new_period(int periods);
+bool mem_cgroup_dirty_limits(unsigned long dirty_thresh,
+			     unsigned long *pdirty, unsigned long *pthresh);
+
 unsigned long mem_cgroup_soft_limit_reclaim(struct zone *zone, int order,
 						gfp_t gfp_mask,
 						unsigned long *total_scanned);
@@ -214,6 +224,12 @@ static inline void mem_cgroup_migrate(struct page *oldpage,
 {
 }
 
+static inline bool mem_cgroup_can_replace_page(struct page *oldpage,
+					       struct page *newpage)
+{
+	return true;
+}
+
 static inline struct lruvec *mem_cgroup_zone_lruvec(struct zone *zone,
 						    struct mem_cgroup *memcg)
 {
@@ -329,6 +345,26 @@ static inline void mem_cgroup_dec_page_stat(struct mem_cgroup *memcg,
 {
 }
 
+static inline void mem_cgroup_dec_locked_page_stat(struct page *page,
+					enum mem_cgroup_stat_index idx)
+{
+}
+
+static inline void mem_cgroup_writeout_inc(struct mem_cgroup *memcg)
+{
+}
+
+static inline void mem_cgroup_writeout_new_period(int periods)
+{
+}
+
+static inline bool mem_cgroup_dirty_limits(unsigned long dirty_thresh,
+					   unsigned long *pdirty,
+					   unsigned long *pthresh)
+{
+	return false;
+}
+
 static inline
 unsigned long mem_cgroup_soft_limit_reclaim(struct zone *zone, int order,
 					    gfp_t gfp_mask,
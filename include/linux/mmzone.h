@@ -704,6 +704,12 @@ struct node_active_region {
 extern struct page *mem_map;
 #endif
 
+/*
+ * Upper bound on the number of kswapd threads per node, see
+ * vm.kswapd_threads.
+ */
+#define MAX_KSWAPD_THREADS	16
+
 /*
  * The pg_data_t structure is used in machines with CONFIG_DISCONTIGMEM
  * (mostly NUMA machines?) to denote a higher-level memory zone than the
@@ -749,8 +755,8 @@ typedef struct pglist_data {
 	int node_id;
 	wait_queue_head_t kswapd_wait;
 	wait_queue_head_t pfmemalloc_wait;
-	struct task_struct *kswapd;	/* Protected by
-					   mem_hotplug_begin/end() */
+	/* Protected by mem_hotplug_begin/end() */
+	struct task_struct *kswapd[MAX_KSWAPD_THREADS];
 	int kswapd_max_order;
 	enum zone_type classzone_idx;
 #ifdef CONFIG_NUMA_BALANCING
@@ -893,6 +899,9 @@ int percpu_pagelist_fraction_sysctl_handler(struct ctl_table *, int,
 					void __user *, size_t *, loff_t *);
 int sysctl_min_unmapped_ratio_sysctl_handler(struct ctl_table *, int,
 			void __user *, size_t *, loff_t *);
+extern int kswapd_threads;
+int kswapd_threads_sysctl_handler(struct ctl_table *, int,
+			void __user *, size_t *, loff_t *);
 int sysctl_min_slab_ratio_sysctl_handler(struct ctl_table *, int,
 			void __user *, size_t *, loff_t *);
 
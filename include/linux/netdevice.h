@@ -55,6 +55,7 @@
 struct netpoll_info;
 struct device;
 struct phy_device;
+struct netdev_lat_hist;
 /* 802.11 specific */
 struct wireless_dev;
 
@@ -750,6 +751,25 @@ struct netdev_phys_port_id {
 	unsigned char id_len;
 };
 
+struct bpf_prog;
+
+enum xdp_netdev_command {
+	/* Attach a new program, or detach the current one if prog is
+	 * NULL.  On success the driver owns prog and destroys the old one.
+	 */
+	XDP_SETUP_PROG,
+	/* Report whether a program is attached in prog_attached. */
+	XDP_QUERY_PROG,
+};
+
+struct netdev_xdp {
+	enum xdp_netdev_command command;
+	union {
+		struct bpf_prog *prog;
+		bool prog_attached;
+	};
+};
+
 typedef u16 (*select_queue_fallback_t)(struct net_device *dev,
 				       struct sk_buff *skb);
 
@@ -1004,6 +1024,11 @@ typedef u16 (*select_queue_fallback_t)(struct net_device *dev,
  *	performing GSO on a packet. The device returns true if it is
  *	able to GSO the packet, false otherwise. If the return value is
  *	false the stack will do software GSO.
+ *
+ * int (*ndo_xdp)(struct net_device *dev, struct netdev_xdp *xdp);
+ *	Called under RTNL to attach, detach or query the program that the
+ *	driver runs on received frames in its NAPI poll, ahead of the
+ *	stack. See enum xdp_netdev_command.
  */
 struct net_device_ops {
 	int			(*ndo_init)(struct net_device *dev);
@@ -1155,6 +1180,8 @@ struct net_device_ops {
 	int			(*ndo_get_lock_subclass)(struct net_device *dev);
 	bool			(*ndo_gso_check) (struct sk_buff *skb,
 						  struct net_device *dev);
+	int			(*ndo_xdp)(struct net_device *dev,
+					   struct netdev_xdp *xdp);
 };
 
 /**
@@ -1398,6 +1425,7 @@ enum netdev_priv_flags {
  *	@watchdog_timer:	List of timers
  *
  *	@pcpu_refcnt:		Number of references to this device
+ *	@lat_hist:		Per-cpu latency histograms, see net/lat_hist.h
  *	@todo_list:		Delayed register/unregister
  *	@index_hlist:		Device index hash chain
  *	@link_watch_list:	XXX: need comments on this one
@@ -1630,6 +1658,7 @@ struct net_device {
 	struct timer_list	watchdog_timer;
 
 	int __percpu		*pcpu_refcnt;
+	struct netdev_lat_hist __percpu *lat_hist;
 	struct list_head	todo_list;
 
 	struct hlist_node	index_hlist;
@@ -2869,6 +2898,7 @@ int dev_set_mac_address(struct net_device *, struct sockaddr *);
 int dev_change_carrier(struct net_device *, bool new_carrier);
 int dev_get_phys_port_id(struct net_device *dev,
 			 struct netdev_phys_port_id *ppid);
+int dev_change_xdp(struct net_device *dev, struct bpf_prog *prog);
 struct sk_buff *validate_xmit_skb_list(struct sk_buff *skb, struct net_device *dev);
 struct sk_buff *dev_hard_start_xmit(struct sk_buff *skb, struct net_device *dev,
 				    struct netdev_queue *txq, int *ret);
@@ -3574,6 +3604,7 @@ static inline bool net_gso_ok(netdev_features_t features, int gso_type)
 	BUILD_BUG_ON(SKB_GSO_UDP_TUNNEL != (NETIF_F_GSO_UDP_TUNNEL >> NETIF_F_GSO_SHIFT));
 	BUILD_BUG_ON(SKB_GSO_UDP_TUNNEL_CSUM != (NETIF_F_GSO_UDP_TUNNEL_CSUM >> NETIF_F_GSO_SHIFT));
 	BUILD_BUG_ON(SKB_GSO_MPLS    != (NETIF_F_GSO_MPLS >> NETIF_F_GSO_SHIFT));
+	BUILD_BUG_ON(SKB_GSO_UDP_L4  != (NETIF_F_GSO_UDP_L4 >> NETIF_F_GSO_SHIFT));
 
 	return (features & feature) == feature;
 }
@@ -20,6 +20,8 @@ struct ip_conntrack_stat {
 	unsigned int expect_create;
 	unsigned int expect_delete;
 	unsigned int search_restart;
+	unsigned int expired;
+	unsigned int early_drop_fail;
 };
 
 /* call to create an explicit dependency on nf_conntrack. */
@@ -50,15 +50,17 @@ struct udp_sock {
 	__u8		 encap_type;	/* Is this an Encapsulation socket? */
 	unsigned char	 no_check6_tx:1,/* Send zero UDP6 checksums on TX? */
 			 no_check6_rx:1,/* Allow zero UDP6 checksums on RX? */
-			 convert_csum:1;/* On receive, convert checksum
+			 convert_csum:1,/* On receive, convert checksum
 					 * unnecessary to checksum complete
 					 * if possible.
 					 */
+			 gro_enabled:1;	/* Coalesce received datagrams */
 	/*
 	 * Following member retains the information to create a UDP header
 	 * when the socket is uncorked.
 	 */
 	__u16		 len;		/* total length of pending frames */
+	__u16		 gso_size;	/* UDP_SEGMENT payload size, 0 if off */
 	/*
 	 * Fields specific to UDP-Lite.
 	 */
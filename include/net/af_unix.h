@@ -6,10 +6,12 @@
 #include <linux/mutex.h>
 #include <net/sock.h>
 
+struct scm_fp_list;
+
 void unix_inflight(struct file *fp);
 void unix_notinflight(struct file *fp);
 void unix_gc(void);
-void wait_for_unix_gc(void);
+void wait_for_unix_gc(struct scm_fp_list *fpl);
 struct sock *unix_get_socket(struct file *filp);
 struct sock *unix_peer_get(struct sock *);
 
@@ -17,13 +19,14 @@ struct sock *unix_peer_get(struct sock *);
 #define UNIX_HASH_BITS	8
 
 extern unsigned int unix_tot_inflight;
-extern spinlock_t unix_table_lock;
+extern spinlock_t unix_table_locks[2 * UNIX_HASH_SIZE];
 extern struct hlist_head unix_socket_table[2 * UNIX_HASH_SIZE];
 
 struct unix_address {
 	atomic_t	refcnt;
 	int		len;
 	unsigned int	hash;
+	struct rcu_head	rcu;
 	struct sockaddr_un name[0];
 };
 
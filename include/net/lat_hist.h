@@ -0,0 +1,92 @@
+#ifndef _NET_LAT_HIST_H
+#define _NET_LAT_HIST_H
+
+#include <linux/kernel.h>
+#include <linux/log2.h>
+#include <linux/skbuff.h>
+#include <linux/static_key.h>
+#include <uapi/linux/net_lat_hist.h>
+
+struct net_device;
+struct sock;
+
+struct net_lat_hist {
+	u64	buckets[NET_LAT_BUCKETS];
+};
+
+/* per cpu, hangs off net_device->lat_hist */
+struct netdev_lat_hist {
+	struct net_lat_hist	rx_backlog;
+	struct net_lat_hist	tx_qdisc;
+};
+
+/* enabled through the net.core.latency_hist sysctl */
+extern struct static_key net_lat_hist_needed;
+
+static inline void net_lat_hist_add(struct net_lat_hist *hist, s64 ns)
+{
+	unsigned int b = 0;
+
+	if (ns >= 1024)
+		b = min_t(unsigned int, ilog2((u64)ns) - 9,
+			  NET_LAT_BUCKETS - 1);
+	hist->buckets[b]++;
+}
+
+void __net_lat_hist_rx(const struct sk_buff *skb);
+void __net_lat_hist_dequeue(struct net_device *dev, struct sk_buff *skb);
+void __sk_lat_hist_rx(struct sock *sk, const struct sk_buff *skb);
+void netdev_lat_hist_read(const struct net_device *dev,
+			  struct netdev_lat_hist *sum);
+void net_lat_hist_set(bool enable);
+
+/* The driver hands skb to the stack. Stamp it here, before GRO holds
+ * it, and even when netdev_tstamp_prequeue is off, which would defer
+ * the stamp to __netif_receive_skb_core() and make every sample zero.
+ */
+static inline void net_lat_hist_handoff(struct sk_buff *skb)
+{
+	if (static_key_false(&net_lat_hist_needed) && !skb->tstamp.tv64)
+		__net_timestamp(skb);
+}
+
+/* skb reached protocol demux, skb->tstamp is the driver hand-off time */
+static inline void net_lat_hist_rx(const struct sk_buff *skb)
+{
+	if (static_key_false(&net_lat_hist_needed))
+		__net_lat_hist_rx(skb);
+}
+
+/* skb->tstamp carries no meaning on the way out, a queued skb keeps
+ * its enqueue time there until net_lat_hist_dequeue() clears it.
+ */
+static inline void net_lat_hist_enqueue(struct sk_buff *skb)
+{
+	if (static_key_false(&net_lat_hist_needed)) {
+		skb->tstamp = ktime_get();
+		skb->lat_hist_stamped = 1;
+	}
+}
+
+/* skb may be a list, as returned by dequeue_skb(). The stamp is cleared
+ * even once sampling is turned off, so that a monotonic time never
+ * reaches a receiver that loops the skb back and reports it as
+ * SO_TIMESTAMP.
+ */
+static inline void net_lat_hist_dequeue(struct net_device *dev,
+					struct sk_buff *skb)
+{
+	if (static_key_false(&net_lat_hist_needed)) {
+		__net_lat_hist_dequeue(dev, skb);
+		return;
+	}
+
+	for (; skb; skb = skb->next) {
+		if (unlikely(skb->lat_hist_stamped)) {
+			skb->tstamp.tv64 = 0;
+			skb->lat_hist_stamped = 0;
+		}
+	}
+}
+
+#endif /* _NET_LAT_HIST_H */
@@ -69,6 +69,7 @@
 #include <net/checksum.h>
 #include <linux/net_tstamp.h>
 #include <net/tcp_states.h>
+#include <net/lat_hist.h>
 
 struct cgroup;
 struct cgroup_subsys;
@@ -235,6 +236,7 @@ struct cg_proto;
   *	@sk_wmem_alloc: transmit queue bytes committed
   *	@sk_write_queue: Packet sending queue
   *	@sk_omem_alloc: "o" is "option" or "other"
+  *	@sk_zckey: counter to order MSG_ZEROCOPY notifications
   *	@sk_wmem_queued: persistent queue size
   *	@sk_forward_alloc: space allocated forward
   *	@sk_napi_id: id of the last napi context to receive data for sk
@@ -279,6 +281,7 @@ struct cg_proto;
   *	@sk_protinfo: private area, net family specific, when not using slab
   *	@sk_timer: sock cleanup timer
   *	@sk_stamp: time stamp of last packet received
+  *	@sk_lat_hist: receive latency histogram, see SO_LATENCY_HIST
   *	@sk_tsflags: SO_TIMESTAMPING socket options
   *	@sk_tskey: counter to disambiguate concurrent tstamp requests
   *	@sk_socket: Identd and reporting IO signals
@@ -297,6 +300,8 @@ struct cg_proto;
   *	@sk_error_report: callback to indicate errors (e.g. %MSG_ERRQUEUE)
   *	@sk_backlog_rcv: callback to process the backlog
   *	@sk_destruct: called at sock freeing time, i.e. when all refcnt == 0
+  *	@sk_reuseport_cb: reuseport group container
+  *	@sk_rcu: used to free the sock after an RCU grace period
  */
 struct sock {
 	/*
@@ -371,6 +376,7 @@ struct sock {
 	spinlock_t		sk_dst_lock;
 	atomic_t		sk_wmem_alloc;
 	atomic_t		sk_omem_alloc;
+	atomic_t		sk_zckey;
 	int			sk_sndbuf;
 	struct sk_buff_head	sk_write_queue;
 	kmemcheck_bitfield_begin(flags);
@@ -411,6 +417,7 @@ struct sock {
 	void			*sk_protinfo;
 	struct timer_list	sk_timer;
 	ktime_t			sk_stamp;
+	struct net_lat_hist	*sk_lat_hist;
 	u16			sk_tsflags;
 	u32			sk_tskey;
 	struct socket		*sk_socket;
@@ -433,6 +440,8 @@ struct sock {
 	int			(*sk_backlog_rcv)(struct sock *sk,
 						  struct sk_buff *skb);
 	void                    (*sk_destruct)(struct sock *sk);
+	struct sock_reuseport __rcu	*sk_reuseport_cb;
+	struct rcu_head		sk_rcu;
 };
 
 #define __sk_user_data(sk) ((*((void __rcu **)&(sk)->sk_user_data)))
@@ -715,6 +724,7 @@ enum sock_flags {
 		     */
 	SOCK_FILTER_LOCKED, /* Filter cannot be changed anymore */
 	SOCK_SELECT_ERR_QUEUE, /* Wake select on error queue */
+	SOCK_RCU_FREE, /* free the sock memory after an RCU grace period */
 };
 
 static inline void sock_copy_flags(struct sock *nsk, struct sock *osk)
@@ -2035,6 +2045,13 @@ static inline void skb_set_owner_r(struct sk_buff *skb, struct sock *sk)
 	sk_mem_charge(sk, skb->truesize);
 }
 
+/* skb is being queued to sk's receive queue */
+static inline void sk_lat_hist_rx(struct sock *sk, const struct sk_buff *skb)
+{
+	if (static_key_false(&net_lat_hist_needed) && sk->sk_lat_hist)
+		__sk_lat_hist_rx(sk, skb);
+}
+
 void sk_reset_timer(struct sock *sk, struct timer_list *timer,
 		    unsigned long expires);
 
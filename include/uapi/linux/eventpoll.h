@@ -26,6 +26,15 @@
 #define EPOLL_CTL_DEL 2
 #define EPOLL_CTL_MOD 3
 
+/*
+ * Deliver the events reported by the wakeups of an edge-triggered source
+ * instead of calling its ->poll() again when it becomes ready.  Sources
+ * that do not report their events on wakeup are still polled.
+ *
+ * Requires EPOLLET
+ */
+#define EPOLLNOREPOLL (1 << 26)
+
 /*
  * Request the handling of system wakeup events so as to prevent system suspends
  * from happening while those events are being processed.
@@ -81,5 +81,16 @@ struct sock_fprog {	/* Required for SO_ATTACH_FILTER. */
 #define SKF_NET_OFF   (-0x100000)
 #define SKF_LL_OFF    (-0x200000)
 
+/* Return values of a program attached to a device with IFLA_XDP.
+ * The program sees the frame from the Ethernet header on, before the
+ * driver has built an sk_buff for it.
+ */
+enum xdp_action {
+	XDP_ABORTED = 0,	/* program error, dropped */
+	XDP_DROP,		/* drop the frame */
+	XDP_PASS,		/* hand the frame to the stack */
+	XDP_TX,			/* send the frame back out the device */
+};
+
 
 #endif /* _UAPI__LINUX_FILTER_H__ */
@@ -145,6 +145,13 @@ enum {
 	IFLA_CARRIER,
 	IFLA_PHYS_PORT_ID,
 	IFLA_CARRIER_CHANGES,
+
+	/* Private to this tree: IFLA_XDP does not carry upstream's nested
+	 * attributes.  Numbered well clear of upstream's attributes so
+	 * that newer userspace is never taken for one of these.
+	 */
+	IFLA_XDP = 80,
+	IFLA_LAT_HIST,		/* nested, see linux/net_lat_hist.h */
 	__IFLA_MAX
 };
 
@@ -165,6 +172,18 @@ enum {
 
 #define IFLA_INET_MAX (__IFLA_INET_MAX - 1)
 
+/* Early receive program section.  IFLA_XDP without IFLA_XDP_OPS detaches
+ * the current program.
+ */
+enum {
+	IFLA_XDP_UNSPEC,
+	IFLA_XDP_OPS,		/* array of struct sock_filter */
+	IFLA_XDP_ATTACHED,	/* u8, reported in dumps only */
+	__IFLA_XDP_MAX,
+};
+
+#define IFLA_XDP_MAX (__IFLA_XDP_MAX - 1)
+
 /* ifi_flags.
 
    IFF_* flags.
@@ -124,9 +124,13 @@ enum {
 	INET_DIAG_PEERS,
 	INET_DIAG_PAD,
 	INET_DIAG_MARK,
+	INET_DIAG_BBRINFO,
+
+	/* Private to this tree, numbered clear of upstream's attributes */
+	INET_DIAG_LAT_HIST = 64,	/* __u64[NET_LAT_BUCKETS] */
 };
 
-#define INET_DIAG_MAX INET_DIAG_MARK
+#define INET_DIAG_MAX INET_DIAG_LAT_HIST
 
 /* INET_DIAG_MEM */
 
@@ -156,4 +160,15 @@ struct tcp_dctcp_info {
 	__u32	dctcp_ab_tot;
 };
 
+/* INET_DIAG_BBRINFO */
+
+struct tcp_bbr_info {
+	/* u64 bw: max-filtered BW (app throughput) estimate in Byte/sec: */
+	__u32	bbr_bw_lo;		/* lower 32 bits of bw */
+	__u32	bbr_bw_hi;		/* upper 32 bits of bw */
+	__u32	bbr_min_rtt;		/* min-filtered RTT in uSec */
+	__u32	bbr_pacing_gain;	/* pacing gain shifted left 8 bits */
+	__u32	bbr_cwnd_gain;		/* cwnd gain shifted left 8 bits */
+};
+
 #endif /* _UAPI_INET_DIAG_H_ */
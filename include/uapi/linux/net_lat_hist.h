@@ -0,0 +1,42 @@
+/*
+ * Userspace API for the software latency histograms of the network stack
+ */
+
+#ifndef _UAPI_LINUX_NET_LAT_HIST_H
+#define _UAPI_LINUX_NET_LAT_HIST_H
+
+#include <linux/types.h>
+
+/*
+ * Histograms are arrays of NET_LAT_BUCKETS __u64 packet counts with
+ * log2 spaced buckets: bucket 0 counts samples below 1024ns, bucket n
+ * counts samples in [2^(n+9), 2^(n+10)) ns and the last bucket also
+ * takes everything above.  Samples are only taken while the
+ * net.core.latency_hist sysctl is set.
+ *
+ * Per device, reported in IFLA_LAT_HIST:
+ *  IFLA_LAT_HIST_RX_BACKLOG: driver hand-off (netif_rx, netif_receive_skb
+ *			      or napi_gro_receive) to protocol demux in
+ *			      __netif_receive_skb_core(): time held by GRO
+ *			      and queued on the RPS/netif_rx backlog.  A
+ *			      NAPI driver that passes frames straight to
+ *			      netif_receive_skb() without RPS has no such
+ *			      queueing and records samples near zero.
+ *  IFLA_LAT_HIST_TX_QDISC:   qdisc enqueue to dequeue for transmit
+ *
+ * Per socket, after setsockopt(SO_LATENCY_HIST), reported in
+ * INET_DIAG_LAT_HIST:
+ *  driver hand-off to the socket receive queue
+ */
+#define NET_LAT_BUCKETS		20
+
+enum {
+	IFLA_LAT_HIST_UNSPEC,
+	IFLA_LAT_HIST_RX_BACKLOG,	/* __u64[NET_LAT_BUCKETS] */
+	IFLA_LAT_HIST_TX_QDISC,		/* __u64[NET_LAT_BUCKETS] */
+	__IFLA_LAT_HIST_MAX,
+};
+
+#define IFLA_LAT_HIST_MAX (__IFLA_LAT_HIST_MAX - 1)
+
+#endif /* _UAPI_LINUX_NET_LAT_HIST_H */
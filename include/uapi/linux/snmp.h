@@ -265,6 +265,8 @@ enum
 	LINUX_MIB_TCPWANTZEROWINDOWADV,		/* TCPWantZeroWindowAdv */
 	LINUX_MIB_TCPSYNRETRANS,		/* TCPSynRetrans */
 	LINUX_MIB_TCPORIGDATASENT,		/* TCPOrigDataSent */
+	LINUX_MIB_TCPZEROCOPYRXBYTES,		/* TCPZeroCopyRxBytes */
+	LINUX_MIB_TCPZEROCOPYRXFALLBACK,	/* TCPZeroCopyRxFallback */
 	__LINUX_MIB_MAX
 };
 
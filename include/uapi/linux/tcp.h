@@ -112,6 +112,7 @@ enum {
 #define TCP_FASTOPEN		23	/* Enable FastOpen on listeners */
 #define TCP_TIMESTAMP		24
 #define TCP_NOTSENT_LOWAT	25	/* limit number of unsent bytes in write queue */
+#define TCP_ZEROCOPY_RECEIVE	35	/* map received payload, see below */
 
 struct tcp_repair_opt {
 	__u32	opt_code;
@@ -202,4 +203,17 @@ struct tcp_md5sig {
 	__u8	tcpm_key[TCP_MD5SIG_MAXKEYLEN];		/* key (binary) */
 };
 
+/* getsockopt(fd, IPPROTO_TCP, TCP_ZEROCOPY_RECEIVE, ...)
+ *
+ * address must point into a PROT_READ, MAP_SHARED mapping of the socket
+ * itself.  Whole pages of in-order payload are mapped there and consumed;
+ * recv_skip_hint tells how many bytes must be read with recvmsg() before
+ * the next call can map again.
+ */
+struct tcp_zerocopy_receive {
+	__u64 address;		/* in: address of mapping */
+	__u32 length;		/* in/out: number of bytes to map/mapped */
+	__u32 recv_skip_hint;	/* out: amount of bytes to skip */
+};
+
 #endif /* _UAPI_LINUX_TCP_H */
@@ -56,6 +56,8 @@
 #include <linux/oom.h>
 #include <linux/lockdep.h>
 #include <linux/file.h>
+#include <linux/flex_proportions.h>
+#include <linux/writeback.h>
 #include "internal.h"
 #include <net/sock.h>
 #include <net/ip.h>
@@ -93,6 +95,7 @@ static const char * const mem_cgroup_stat_names[] = {
 	"rss",
 	"rss_huge",
 	"mapped_file",
+	"dirty",
 	"writeback",
 	"swap",
 };
@@ -286,9 +289,25 @@ struct mem_cgroup {
 
 	unsigned long soft_limit;
 
+	/*
+	 * Background reclaim: when usage exceeds @high, high_work
+	 * reclaims the group back down so that charging tasks do not
+	 * run into the hard limit and reclaim synchronously.
+	 */
+	unsigned long high;
+	struct work_struct high_work;
+
+	/* Time charging tasks spent in direct reclaim, in nanoseconds */
+	atomic64_t direct_reclaim_ns;
+	/* Pages reclaimed by the background reclaimer */
+	atomic_long_t background_reclaimed;
+
 	/* vmpressure notifications */
 	struct vmpressure vmpressure;
 
+	/* Share of recently completed page writeout, see memcg_writeout */
+	struct fprop_local_percpu completions;
+
 	/* css_online() has been completed */
 	int initialized;
 
@@ -2202,6 +2221,108 @@ void mem_cgroup_update_page_stat(struct mem_cgroup *memcg,
 		this_cpu_add(memcg->stat->count[idx], val);
 }
 
+/**
+ * mem_cgroup_dec_locked_page_stat - update statistics of a locked page
+ * @page: the page, locked by the caller
+ * @idx: page state item to account
+ *
+ * mem_cgroup_move_account() only trylocks the page and skips it when
+ * that fails, so holding the page lock keeps the page with its memcg
+ * and no mem_cgroup_begin_page_stat() transaction is needed.  The page
+ * lock is the only requirement: neither the mapping's tree_lock nor
+ * the move lock has to be held, and clear_page_dirty_for_io() and
+ * cancel_dirty_page() call this without either.
+ */
+void mem_cgroup_dec_locked_page_stat(struct page *page,
+				     enum mem_cgroup_stat_index idx)
+{
+	struct page_cgroup *pc;
+
+	VM_BUG_ON_PAGE(!PageLocked(page), page);
+
+	if (mem_cgroup_disabled())
+		return;
+
+	pc = lookup_page_cgroup(page);
+	if (pc->mem_cgroup && PageCgroupUsed(pc))
+		this_cpu_dec(pc->mem_cgroup->stat->count[idx]);
+}
+
+/*
+ * Per-memcg writeback: dirty pages are accounted per memcg, and every
+ * memcg tracks its share of recently completed page writeout, in the
+ * same way as the per-bdi shares in mm/page-writeback.c.  A memcg
+ * gets that share of the global dirty limit, so that its dirtiers are
+ * throttled by the rate at which its own pages get cleaned and not by
+ * the dirty pages of other groups.
+ */
+static struct fprop_global memcg_writeout;
+
+/*
+ * Every non-root memcg can dirty at least this fraction of the global
+ * limit, even if it has not written anything out recently.
+ */
+#define MEMCG_MIN_DIRTY_SHARE	16
+
+/* Called when writeback of a page of @memcg completes, irqs disabled */
+void mem_cgroup_writeout_inc(struct mem_cgroup *memcg)
+{
+	if (memcg && !mem_cgroup_is_root(memcg))
+		__fprop_inc_percpu(&memcg_writeout, &memcg->completions);
+}
+
+/* Age the writeout shares, from the period timer in page-writeback.c */
+void mem_cgroup_writeout_new_period(int periods)
+{
+	if (!mem_cgroup_disabled())
+		fprop_new_period(&memcg_writeout, periods);
+}
+
+/**
+ * mem_cgroup_dirty_limits - dirty state of the current task's memcg
+ * @dirty_thresh: global dirty limit in pages
+ * @pdirty: number of dirty and writeback pages of the memcg
+ * @pthresh: the memcg's share of @dirty_thresh
+ *
+ * Returns false if the current task is in the root memcg, in which
+ * case only the global and per-bdi limits apply.
+ */
+bool mem_cgroup_dirty_limits(unsigned long dirty_thresh,
+			     unsigned long *pdirty, unsigned long *pthresh)
+{
+	struct mem_cgroup *memcg;
+	unsigned long numerator, denominator;
+	unsigned long thresh, limit;
+	long dirty;
+
+	if (mem_cgroup_disabled())
+		return false;
+
+	memcg = get_mem_cgroup_from_mm(current->mm);
+	if (mem_cgroup_is_root(memcg)) {
+		css_put(&memcg->css);
+		return false;
+	}
+
+	fprop_fraction_percpu(&memcg_writeout, &memcg->completions,
+			      &numerator, &denominator);
+	thresh = div_u64((u64)dirty_thresh * numerator, denominator);
+	thresh = max(thresh, dirty_thresh / MEMCG_MIN_DIRTY_SHARE);
+
+	/* Don't let a small group fill its memory with dirty pages */
+	limit = ACCESS_ONCE(memcg->memory.limit);
+	if (vm_dirty_ratio)
+		thresh = min(thresh, limit / 100 * vm_dirty_ratio);
+
+	dirty = mem_cgroup_read_stat(memcg, MEM_CGROUP_STAT_DIRTY) +
+		mem_cgroup_read_stat(memcg, MEM_CGROUP_STAT_WRITEBACK);
+	css_put(&memcg->css);
+
+	*pdirty = max(dirty, 0L);
+	*pthresh = max(thresh, 1UL);
+	return true;
+}
+
 /*
  * size of first charge trial. "32" comes from vmscan.c's magic value.
  * TODO: maybe necessary to use big numbers in big irons.
@@ -2404,6 +2525,44 @@ static int memcg_cpu_hotplug_callback(struct notifier_block *nb,
 	return NOTIFY_OK;
 }
 
+/* Workqueue that runs the per-memcg background reclaimers */
+static struct workqueue_struct *memcg_bgreclaim_wq;
+
+static void high_work_func(struct work_struct *work)
+{
+	struct mem_cgroup *memcg;
+	unsigned long usage, nr_reclaimed;
+	int nr_retries = MEM_CGROUP_RECLAIM_RETRIES;
+
+	memcg = container_of(work, struct mem_cgroup, high_work);
+
+	while (nr_retries--) {
+		usage = page_counter_read(&memcg->memory);
+		if (usage <= memcg->high)
+			break;
+
+		/*
+		 * Leave some headroom below the watermark, like kswapd
+		 * does between the low and high zone watermarks, so
+		 * that the next few charges do not wake us right away.
+		 */
+		nr_reclaimed = mem_cgroup_shrink_background(memcg,
+					usage - memcg->high + CHARGE_BATCH);
+		atomic_long_add(nr_reclaimed, &memcg->background_reclaimed);
+		if (!nr_reclaimed)
+			break;
+		cond_resched();
+	}
+}
+
+static void mem_cgroup_wake_high_work(struct mem_cgroup *memcg)
+{
+	do {
+		if (page_counter_read(&memcg->memory) > memcg->high)
+			queue_work(memcg_bgreclaim_wq, &memcg->high_work);
+	} while ((memcg = parent_mem_cgroup(memcg)));
+}
+
 static int try_charge(struct mem_cgroup *memcg, gfp_t gfp_mask,
 		      unsigned int nr_pages)
 {
@@ -2414,6 +2573,7 @@ static int try_charge(struct mem_cgroup *memcg, gfp_t gfp_mask,
 	unsigned long nr_reclaimed;
 	bool may_swap = true;
 	bool drained = false;
+	u64 start;
 	int ret = 0;
 
 	if (mem_cgroup_is_root(memcg))
@@ -2456,8 +2616,10 @@ retry:
 	if (!(gfp_mask & __GFP_WAIT))
 		goto nomem;
 
+	start = local_clock();
 	nr_reclaimed = try_to_free_mem_cgroup_pages(mem_over_limit, nr_pages,
 						    gfp_mask, may_swap);
+	atomic64_add(local_clock() - start, &mem_over_limit->direct_reclaim_ns);
 
 	if (mem_cgroup_margin(mem_over_limit) >= nr_pages)
 		goto retry;
@@ -2508,6 +2670,11 @@ done_restock:
 	css_get_many(&memcg->css, batch);
 	if (batch > nr_pages)
 		refill_stock(memcg, batch - nr_pages);
+	/*
+	 * Kick off background reclaim for every level of the hierarchy
+	 * that went above its high watermark with this charge.
+	 */
+	mem_cgroup_wake_high_work(memcg);
 done:
 	return ret;
 }
@@ -3257,6 +3424,14 @@ static int mem_cgroup_move_account(struct page *page,
 			       nr_pages);
 	}
 
+	if (PageDirty(page) && page_mapping(page) &&
+	    mapping_cap_account_dirty(page_mapping(page))) {
+		__this_cpu_sub(from->stat->count[MEM_CGROUP_STAT_DIRTY],
+			       nr_pages);
+		__this_cpu_add(to->stat->count[MEM_CGROUP_STAT_DIRTY],
+			       nr_pages);
+	}
+
 	if (PageWriteback(page)) {
 		__this_cpu_sub(from->stat->count[MEM_CGROUP_STAT_WRITEBACK],
 			       nr_pages);
@@ -3727,6 +3902,7 @@ enum {
 	RES_MAX_USAGE,
 	RES_FAILCNT,
 	RES_SOFT_LIMIT,
+	RES_HIGH,
 };
 
 static u64 mem_cgroup_read_u64(struct cgroup_subsys_state *css,
@@ -3764,6 +3940,8 @@ static u64 mem_cgroup_read_u64(struct cgroup_subsys_state *css,
 		return counter->failcnt;
 	case RES_SOFT_LIMIT:
 		return (u64)memcg->soft_limit * PAGE_SIZE;
+	case RES_HIGH:
+		return (u64)memcg->high * PAGE_SIZE;
 	default:
 		BUG();
 	}
@@ -3887,7 +4065,7 @@ static int memcg_update_kmem_limit(struct mem_cgroup *memcg,
 
 /*
  * The user of this function is...
- * RES_LIMIT.
+ * RES_LIMIT, RES_SOFT_LIMIT and RES_HIGH.
  */
 static ssize_t mem_cgroup_write(struct kernfs_open_file *of,
 				char *buf, size_t nbytes, loff_t off)
@@ -3923,6 +4101,16 @@ static ssize_t mem_cgroup_write(struct kernfs_open_file *of,
 		memcg->soft_limit = nr_pages;
 		ret = 0;
 		break;
+	case RES_HIGH:
+		if (mem_cgroup_is_root(memcg)) {
+			ret = -EINVAL;
+			break;
+		}
+		memcg->high = nr_pages;
+		if (page_counter_read(&memcg->memory) > nr_pages)
+			queue_work(memcg_bgreclaim_wq, &memcg->high_work);
+		ret = 0;
+		break;
 	}
 	return ret ?: nbytes;
 }
@@ -4083,6 +4271,12 @@ static int memcg_stat_show(struct seq_file *m, void *v)
 		seq_printf(m, "hierarchical_memsw_limit %llu\n",
 			   (u64)memsw * PAGE_SIZE);
 
+	seq_printf(m, "direct_reclaim_stall_us %llu\n",
+		   div_u64(atomic64_read(&memcg->direct_reclaim_ns),
+			   NSEC_PER_USEC));
+	seq_printf(m, "background_reclaimed %lu\n",
+		   atomic_long_read(&memcg->background_reclaimed));
+
 	for (i = 0; i < MEM_CGROUP_STAT_NSTATS; i++) {
 		long long val = 0;
 
@@ -4784,6 +4978,12 @@ static struct cftype mem_cgroup_files[] = {
 		.write = mem_cgroup_write,
 		.read_u64 = mem_cgroup_read_u64,
 	},
+	{
+		.name = "high_in_bytes",
+		.private = MEMFILE_PRIVATE(_MEM, RES_HIGH),
+		.write = mem_cgroup_write,
+		.read_u64 = mem_cgroup_read_u64,
+	},
 	{
 		.name = "failcnt",
 		.private = MEMFILE_PRIVATE(_MEM, RES_FAILCNT),
@@ -4946,9 +5146,13 @@ static struct mem_cgroup *mem_cgroup_alloc(void)
 	memcg->stat = alloc_percpu(struct mem_cgroup_stat_cpu);
 	if (!memcg->stat)
 		goto out_free;
+	if (fprop_local_init_percpu(&memcg->completions, GFP_KERNEL))
+		goto out_free_stat;
 	spin_lock_init(&memcg->pcp_counter_lock);
 	return memcg;
 
+out_free_stat:
+	free_percpu(memcg->stat);
 out_free:
 	kfree(memcg);
 	return NULL;
@@ -4975,6 +5179,7 @@ static void __mem_cgroup_free(struct mem_cgroup *memcg)
 		free_mem_cgroup_per_zone_info(memcg, node);
 
 	free_percpu(memcg->stat);
+	fprop_local_destroy_percpu(&memcg->completions);
 
 	/*
 	 * We need to make sure that (at least for now), the jump label
@@ -5049,6 +5254,8 @@ mem_cgroup_css_alloc(struct cgroup_subsys_state *parent_css)
 	}
 
 	memcg->last_scanned_node = MAX_NUMNODES;
+	memcg->high = PAGE_COUNTER_MAX;
+	INIT_WORK(&memcg->high_work, high_work_func);
 	INIT_LIST_HEAD(&memcg->oom_notify);
 	memcg->move_charge_at_immigrate = 0;
 	mutex_init(&memcg->thresholds_lock);
@@ -5144,6 +5351,7 @@ static void mem_cgroup_css_free(struct cgroup_subsys_state *css)
 {
 	struct mem_cgroup *memcg = mem_cgroup_from_css(css);
 
+	cancel_work_sync(&memcg->high_work);
 	memcg_destroy_kmem(memcg);
 	__mem_cgroup_free(memcg);
 }
@@ -5169,6 +5377,7 @@ static void mem_cgroup_css_reset(struct cgroup_subsys_state *css)
 	mem_cgroup_resize_memsw_limit(memcg, PAGE_COUNTER_MAX);
 	memcg_update_kmem_limit(memcg, PAGE_COUNTER_MAX);
 	memcg->soft_limit = 0;
+	memcg->high = PAGE_COUNTER_MAX;
 }
 
 #ifdef CONFIG_MMU
@@ -6174,6 +6383,7 @@ void mem_cgroup_uncharge_list(struct list_head *page_list)
 void mem_cgroup_migrate(struct page *oldpage, struct page *newpage,
 			bool lrucare)
 {
+	struct mem_cgroup *memcg;
 	struct page_cgroup *pc;
 	int isolated;
 
@@ -6209,7 +6419,46 @@ void mem_cgroup_migrate(struct page *oldpage, struct page *newpage,
 	if (lrucare)
 		unlock_page_lru(oldpage, isolated);
 
-	commit_charge(newpage, pc->mem_cgroup, lrucare);
+	memcg = pc->mem_cgroup;
+	commit_charge(newpage, memcg, lrucare);
+
+	/*
+	 * A dirty @newpage was dirtied before it had a memcg, so its
+	 * dirty accounting missed the group.  It is locked and cannot be
+	 * moved to another memcg under us.
+	 */
+	if (PageDirty(newpage) && page_mapping(newpage) &&
+	    mapping_cap_account_dirty(page_mapping(newpage)))
+		this_cpu_inc(memcg->stat->count[MEM_CGROUP_STAT_DIRTY]);
+}
+
+/**
+ * mem_cgroup_can_replace_page - check charges for a page cache replacement
+ * @oldpage: page cache page to be replaced
+ * @newpage: page that takes its place
+ *
+ * replace_page_cache_page() moves @oldpage's charge to @newpage only if
+ * @newpage is uncharged.  A @newpage that is already charged keeps its
+ * charge, which is only right if it belongs to the same memcg.
+ *
+ * Both pages must be locked.
+ */
+bool mem_cgroup_can_replace_page(struct page *oldpage, struct page *newpage)
+{
+	struct page_cgroup *pc, *oldpc;
+
+	VM_BUG_ON_PAGE(!PageLocked(oldpage), oldpage);
+	VM_BUG_ON_PAGE(!PageLocked(newpage), newpage);
+
+	if (mem_cgroup_disabled())
+		return true;
+
+	pc = lookup_page_cgroup(newpage);
+	if (!PageCgroupUsed(pc))
+		return true;
+
+	oldpc = lookup_page_cgroup(oldpage);
+	return PageCgroupUsed(oldpc) && oldpc->mem_cgroup == pc->mem_cgroup;
 }
 
 /*
@@ -6223,9 +6472,13 @@ void mem_cgroup_migrate(struct page *oldpage, struct page *newpage,
 static int __init mem_cgroup_init(void)
 {
 	hotcpu_notifier(memcg_cpu_hotplug_callback, 0);
+	memcg_bgreclaim_wq = alloc_workqueue("memcg_bgreclaim",
+					     WQ_MEM_RECLAIM | WQ_UNBOUND, 0);
+	BUG_ON(!memcg_bgreclaim_wq);
 	enable_swap_cgroup();
 	mem_cgroup_soft_limit_tree_init();
 	memcg_stock_init();
+	fprop_global_init(&memcg_writeout, GFP_KERNEL);
 	return 0;
 }
 subsys_initcall(mem_cgroup_init);
@@ -443,6 +443,7 @@ static void writeout_period(unsigned long t)
 	int miss_periods = (jiffies - writeout_period_time) /
 						 VM_COMPLETIONS_PERIOD_LEN;
 
+	mem_cgroup_writeout_new_period(miss_periods + 1);
 	if (fprop_new_period(&writeout_completions, miss_periods + 1)) {
 		writeout_period_time = wp_next_time(writeout_period_time +
 				miss_periods * VM_COMPLETIONS_PERIOD_LEN);
@@ -842,6 +843,21 @@ static unsigned long bdi_position_ratio(struct backing_dev_info *bdi,
 	return pos_ratio;
 }
 
+/*
+ * Scale down a task's position ratio when its memory cgroup is above its
+ * share of the dirty limit (see mem_cgroup_dirty_limits()), so that the
+ * group is held back by its own writeout rate.  The ratio is capped at
+ * the balanced rate first, so this never speeds up a task that the
+ * global and per-bdi limits would throttle.
+ */
+static unsigned long memcg_position_ratio(unsigned long pos_ratio,
+					  unsigned long memcg_dirty,
+					  unsigned long memcg_thresh)
+{
+	pos_ratio = min(pos_ratio, 1UL << RATELIMIT_CALC_SHIFT);
+	return div_u64((u64)pos_ratio * memcg_thresh, memcg_dirty);
+}
+
 static void bdi_update_write_bandwidth(struct backing_dev_info *bdi,
 				       unsigned long elapsed,
 				       unsigned long written)
@@ -1365,6 +1381,9 @@ static void balance_dirty_pages(struct address_space *mapping,
 		unsigned long uninitialized_var(bdi_dirty);
 		unsigned long dirty;
 		unsigned long bg_thresh;
+		unsigned long uninitialized_var(memcg_dirty);
+		unsigned long uninitialized_var(memcg_thresh);
+		bool memcg_exceeded;
 
 		/*
 		 * Unstable writes are a feature of certain networked
@@ -1390,6 +1409,15 @@ static void balance_dirty_pages(struct address_space *mapping,
 			bg_thresh = background_thresh;
 		}
 
+		/*
+		 * A memcg over its share of the dirty limit is throttled
+		 * even while the system as a whole is in freerun.
+		 */
+		memcg_exceeded = mem_cgroup_dirty_limits(dirty_thresh,
+							 &memcg_dirty,
+							 &memcg_thresh) &&
+				 memcg_dirty > memcg_thresh;
+
 		/*
 		 * Throttle it only when the background writeback cannot
 		 * catch-up. This avoids (excessively) small writeouts
@@ -1399,7 +1427,8 @@ static void balance_dirty_pages(struct address_space *mapping,
 		 * and limits. Small writeouts when the bdi limits are ramping
 		 * up are the price we consciously pay for strictlimit-ing.
 		 */
-		if (dirty <= dirty_freerun_ceiling(thresh, bg_thresh)) {
+		if (dirty <= dirty_freerun_ceiling(thresh, bg_thresh) &&
+		    !memcg_exceeded) {
 			current->dirty_paused_when = now;
 			current->nr_dirtied = 0;
 			current->nr_dirtied_pause =
@@ -1427,6 +1456,10 @@ static void balance_dirty_pages(struct address_space *mapping,
 		pos_ratio = bdi_position_ratio(bdi, dirty_thresh,
 					       background_thresh, nr_dirty,
 					       bdi_thresh, bdi_dirty);
+		if (memcg_exceeded)
+			pos_ratio = memcg_position_ratio(pos_ratio,
+							 memcg_dirty,
+							 memcg_thresh);
 		task_ratelimit = ((u64)dirty_ratelimit * pos_ratio) >>
 							RATELIMIT_CALC_SHIFT;
 		max_pause = bdi_max_pause(bdi, bdi_dirty);
@@ -2090,13 +2123,19 @@ int __set_page_dirty_no_writeback(struct page *page)
 
 /*
  * Helper function for set_page_dirty family.
+ *
+ * Caller must hold mem_cgroup_begin_page_stat() across setting the page
+ * dirty and accounting it, and pass the memcg it returned.
+ *
  * NOTE: This relies on being atomic wrt interrupts.
  */
-void account_page_dirtied(struct page *page, struct address_space *mapping)
+void account_page_dirtied(struct page *page, struct address_space *mapping,
+			  struct mem_cgroup *memcg)
 {
 	trace_writeback_dirty_page(page, mapping);
 
 	if (mapping_cap_account_dirty(mapping)) {
+		mem_cgroup_inc_page_stat(memcg, MEM_CGROUP_STAT_DIRTY);
 		__inc_zone_page_state(page, NR_FILE_DIRTY);
 		__inc_zone_page_state(page, NR_DIRTIED);
 		__inc_bdi_stat(mapping->backing_dev_info, BDI_RECLAIMABLE);
@@ -2122,26 +2161,35 @@ EXPORT_SYMBOL(account_page_dirtied);
  */
 int __set_page_dirty_nobuffers(struct page *page)
 {
+	unsigned long memcg_flags;
+	struct mem_cgroup *memcg;
+	bool locked;
+
+	memcg = mem_cgroup_begin_page_stat(page, &locked, &memcg_flags);
 	if (!TestSetPageDirty(page)) {
 		struct address_space *mapping = page_mapping(page);
 		unsigned long flags;
 
-		if (!mapping)
+		if (!mapping) {
+			mem_cgroup_end_page_stat(memcg, locked, memcg_flags);
 			return 1;
+		}
 
 		spin_lock_irqsave(&mapping->tree_lock, flags);
 		BUG_ON(page_mapping(page) != mapping);
 		WARN_ON_ONCE(!PagePrivate(page) && !PageUptodate(page));
-		account_page_dirtied(page, mapping);
+		account_page_dirtied(page, mapping, memcg);
 		radix_tree_tag_set(&mapping->page_tree, page_index(page),
 				   PAGECACHE_TAG_DIRTY);
 		spin_unlock_irqrestore(&mapping->tree_lock, flags);
+		mem_cgroup_end_page_stat(memcg, locked, memcg_flags);
 		if (mapping->host) {
 			/* !PageAnon && !swapper_space */
 			__mark_inode_dirty(mapping->host, I_DIRTY_PAGES);
 		}
 		return 1;
 	}
+	mem_cgroup_end_page_stat(memcg, locked, memcg_flags);
 	return 0;
 }
 EXPORT_SYMBOL(__set_page_dirty_nobuffers);
@@ -2297,6 +2345,8 @@ int clear_page_dirty_for_io(struct page *page)
 		 * exclusion.
 		 */
 		if (TestClearPageDirty(page)) {
+			mem_cgroup_dec_locked_page_stat(page,
+						MEM_CGROUP_STAT_DIRTY);
 			dec_zone_page_state(page, NR_FILE_DIRTY);
 			dec_bdi_stat(mapping->backing_dev_info,
 					BDI_RECLAIMABLE);
@@ -2330,6 +2380,7 @@ int test_clear_page_writeback(struct page *page)
 			if (bdi_cap_account_writeback(bdi)) {
 				__dec_bdi_stat(bdi, BDI_WRITEBACK);
 				__bdi_writeout_inc(bdi);
+				mem_cgroup_writeout_inc(memcg);
 			}
 		}
 		spin_unlock_irqrestore(&mapping->tree_lock, flags);
@@ -17,6 +17,7 @@
 #include <linux/pagemap.h>
 #include <linux/syscalls.h>
 #include <linux/file.h>
+#include <linux/swap.h>
 
 #include "internal.h"
 
@@ -196,8 +197,10 @@ int __do_page_cache_readahead(struct address_space *mapping, struct file *filp,
 	 * uptodate then the caller will launch readpage again, and
 	 * will then handle the error.
 	 */
-	if (ret)
+	if (ret) {
 		read_pages(mapping, filp, &page_pool, ret);
+		count_vm_events(READAHEAD_PAGES, ret);
+	}
 	BUG_ON(!list_empty(&page_pool));
 out:
 	return ret;
@@ -280,6 +283,95 @@ static unsigned long get_next_ra_size(struct file_ra_state *ra,
 	return min(newsize, max);
 }
 
+/*
+ * Smallest window that thrashing will shrink a stream down to.
+ */
+#define MIN_THRASH_RA_PAGES	4
+
+/*
+ * The readahead window cap for @ra: the configured maximum, or the
+ * smaller size learned from earlier thrashing of this stream.
+ */
+static unsigned long ra_window_max(struct file_ra_state *ra)
+{
+	unsigned long max = max_sane_readahead(ra->ra_pages);
+
+	if (ra->thrash_max && ra->thrash_max < max)
+		max = ra->thrash_max;
+	return max;
+}
+
+/*
+ * The stream consumed a whole window without losing any of it to
+ * reclaim: additively give back some of the window size that an
+ * earlier thrashing event took away.
+ */
+static void ra_thrash_recover(struct file_ra_state *ra)
+{
+	if (!ra->thrash_max)
+		return;
+
+	ra->thrash_max += max(ra->thrash_max / 8, 1U);
+	if (ra->thrash_max >= max_sane_readahead(ra->ra_pages))
+		ra->thrash_max = 0;
+}
+
+/*
+ * Detect readahead thrashing: a synchronous cache miss at @offset
+ * inside the current readahead window means that pages we read ahead
+ * were reclaimed before the reader got to them.
+ *
+ * The shadow entry left behind by the evicted page tells how long ago
+ * it was reclaimed.  A refault distance smaller than the window means
+ * the page would have survived had the window been that much smaller,
+ * so the window is the problem and gets cut down; pages that were
+ * evicted long ago are not held against the readahead size.
+ *
+ * Returns 1 if the window was shrunk, 0 otherwise.
+ */
+static int ra_thrashed(struct address_space *mapping,
+		       struct file_ra_state *ra, pgoff_t offset)
+{
+	unsigned long distance;
+	unsigned long nr_thrashed = 0;
+	unsigned long size;
+	pgoff_t index;
+	void *shadow;
+
+	if (!ra_has_index(ra, offset))
+		return 0;
+
+	rcu_read_lock();
+	shadow = radix_tree_lookup(&mapping->page_tree, offset);
+	rcu_read_unlock();
+	if (!radix_tree_exceptional_entry(shadow))
+		return 0;
+
+	distance = workingset_refault_distance(shadow);
+	if (distance >= ra->size)
+		return 0;
+
+	rcu_read_lock();
+	for (index = offset; index < ra->start + ra->size; index++) {
+		shadow = radix_tree_lookup(&mapping->page_tree, index);
+		if (radix_tree_exceptional_entry(shadow))
+			nr_thrashed++;
+	}
+	rcu_read_unlock();
+
+	count_vm_events(READAHEAD_THRASHED, nr_thrashed);
+
+	/*
+	 * Shrink at least by half so that we converge quickly under
+	 * sustained memory pressure.
+	 */
+	size = min_t(unsigned long, ra->size - distance, ra->size / 2);
+	ra->thrash_max = max_t(unsigned long, size, MIN_THRASH_RA_PAGES);
+	count_vm_event(READAHEAD_SHRINK);
+
+	return 1;
+}
+
 /*
  * On-demand readahead design.
  *
@@ -317,6 +409,13 @@ static unsigned long get_next_ra_size(struct file_ra_state *ra,
  *
  * The code ramps up the readahead size aggressively at first, but slow down as
  * it approaches max_readhead.
+ *
+ * Under memory pressure, readahead pages can be reclaimed before the
+ * application reads them, which costs the I/O twice.  When that is
+ * detected, the window of the stream is capped (ra->thrash_max) and
+ * the lost pages are counted in the readahead_thrashed vm event.  The
+ * cap is relaxed again each time the stream consumes a full window
+ * without loss.
  */
 
 /*
@@ -380,7 +479,7 @@ ondemand_readahead(struct address_space *mapping,
 		   bool hit_readahead_marker, pgoff_t offset,
 		   unsigned long req_size)
 {
-	unsigned long max = max_sane_readahead(ra->ra_pages);
+	unsigned long max = ra_window_max(ra);
 	pgoff_t prev_offset;
 
 	/*
@@ -395,6 +494,8 @@ ondemand_readahead(struct address_space *mapping,
 	 */
 	if ((offset == (ra->start + ra->size - ra->async_size) ||
 	     offset == (ra->start + ra->size))) {
+		ra_thrash_recover(ra);
+		max = ra_window_max(ra);
 		ra->start += ra->size;
 		ra->size = get_next_ra_size(ra, max);
 		ra->async_size = ra->size;
@@ -425,6 +526,15 @@ ondemand_readahead(struct address_space *mapping,
 		goto readit;
 	}
 
+	/*
+	 * Our own readahead pages were reclaimed before use: restart
+	 * the stream here with a smaller window.
+	 */
+	if (ra_thrashed(mapping, ra, offset)) {
+		max = ra_window_max(ra);
+		goto initial_readahead;
+	}
+
 	/*
 	 * oversize read
 	 */
@@ -2843,6 +2843,68 @@ unsigned long mem_cgroup_shrink_node_zone(struct mem_cgroup *memcg,
 	return sc.nr_reclaimed;
 }
 
+/*
+ * Background reclaim does not escalate beyond this priority: if the
+ * group cannot be brought under its high watermark with moderate
+ * scanning, the charging tasks will do the rest at the hard limit.
+ */
+#define MEMCG_BG_RECLAIM_MIN_PRIORITY	(DEF_PRIORITY - 4)
+
+/**
+ * mem_cgroup_shrink_background - kswapd-style reclaim for a memory cgroup
+ * @memcg: the group whose usage is above its high watermark
+ * @nr_pages: number of pages to reclaim
+ *
+ * Walks the LRU lists of @memcg and its descendants in every zone with
+ * shrink_lruvec(), raising the scan priority until @nr_pages have been
+ * reclaimed.  Unlike try_to_free_mem_cgroup_pages() this is not direct
+ * reclaim on behalf of an allocation: it does not count as an
+ * allocation stall and never enters the OOM path.
+ *
+ * Returns the number of pages reclaimed.
+ */
+unsigned long mem_cgroup_shrink_background(struct mem_cgroup *memcg,
+					   unsigned long nr_pages)
+{
+	struct scan_control sc = {
+		.nr_to_reclaim = max(nr_pages, SWAP_CLUSTER_MAX),
+		.gfp_mask = GFP_KERNEL,
+		.target_mem_cgroup = memcg,
+		.priority = DEF_PRIORITY,
+		.may_writepage = !laptop_mode,
+		.may_unmap = 1,
+		.may_swap = 1,
+	};
+	struct zone *zone;
+
+	trace_mm_vmscan_memcg_reclaim_begin(0, sc.may_writepage, sc.gfp_mask);
+
+	do {
+		for_each_populated_zone(zone) {
+			struct mem_cgroup *iter;
+
+			iter = mem_cgroup_iter(memcg, NULL, NULL);
+			do {
+				struct lruvec *lruvec;
+
+				lruvec = mem_cgroup_zone_lruvec(zone, iter);
+				shrink_lruvec(lruvec,
+					      mem_cgroup_swappiness(iter), &sc);
+
+				if (sc.nr_reclaimed >= sc.nr_to_reclaim) {
+					mem_cgroup_iter_break(memcg, iter);
+					goto out;
+				}
+				iter = mem_cgroup_iter(memcg, iter, NULL);
+			} while (iter);
+		}
+	} while (--sc.priority >= MEMCG_BG_RECLAIM_MIN_PRIORITY);
+out:
+	trace_mm_vmscan_memcg_reclaim_end(sc.nr_reclaimed);
+
+	return sc.nr_reclaimed;
+}
+
 unsigned long try_to_free_mem_cgroup_pages(struct mem_cgroup *memcg,
 					   unsigned long nr_pages,
 					   gfp_t gfp_mask,
@@ -3019,7 +3081,8 @@ static bool kswapd_shrink_zone(struct zone *zone,
 			       int classzone_idx,
 			       struct scan_control *sc,
 			       unsigned long lru_pages,
-			       unsigned long *nr_attempted)
+			       unsigned long *nr_attempted,
+			       bool do_slab)
 {
 	int testorder = sc->order;
 	unsigned long balance_gap;
@@ -3062,12 +3125,20 @@ static bool kswapd_shrink_zone(struct zone *zone,
 		return true;
 
 	shrink_zone(zone, sc);
-	nodes_clear(shrink.nodes_to_scan);
-	node_set(zone_to_nid(zone), shrink.nodes_to_scan);
 
-	reclaim_state->reclaimed_slab = 0;
-	shrink_slab(&shrink, sc->nr_scanned, lru_pages);
-	sc->nr_reclaimed += reclaim_state->reclaimed_slab;
+	/*
+	 * Slab caches are per node rather than per zone: leave them to
+	 * the first kswapd thread of the node so that helper threads
+	 * do not apply the same pressure several times over.
+	 */
+	if (do_slab) {
+		nodes_clear(shrink.nodes_to_scan);
+		node_set(zone_to_nid(zone), shrink.nodes_to_scan);
+
+		reclaim_state->reclaimed_slab = 0;
+		shrink_slab(&shrink, sc->nr_scanned, lru_pages);
+		sc->nr_reclaimed += reclaim_state->reclaimed_slab;
+	}
 
 	/* Account for the number of pages attempted to reclaim */
 	*nr_attempted += sc->nr_to_reclaim;
@@ -3109,9 +3180,17 @@ static bool kswapd_shrink_zone(struct zone *zone,
  * lower zones regardless of the number of free pages in the lower zones. This
  * interoperates with the page allocator fallback scheme to ensure that aging
  * of pages is balanced across the zones.
+ *
+ * With several kswapd threads per node (vm.kswapd_threads), all of them
+ * run balance_pgdat() concurrently.  They all keep the dma->highmem
+ * order below, and within a zone they isolate disjoint batches from the
+ * LRU lists and share the memcg iterator position, so they split the
+ * LRUs rather than repeat each other's work.  Node-wide work (slab
+ * shrinking, soft limit reclaim, compaction) is done only by the first
+ * thread.
  */
 static unsigned long balance_pgdat(pg_data_t *pgdat, int order,
-							int *classzone_idx)
+					int *classzone_idx, int idx)
 {
 	int i;
 	int end_zone = 0;	/* Inclusive.  0 = ZONE_DMA */
@@ -3230,14 +3309,17 @@ static unsigned long balance_pgdat(pg_data_t *pgdat, int order,
 
 			sc.nr_scanned = 0;
 
-			nr_soft_scanned = 0;
 			/*
 			 * Call soft limit reclaim before calling shrink_zone.
 			 */
-			nr_soft_reclaimed = mem_cgroup_soft_limit_reclaim(zone,
+			if (!idx) {
+				nr_soft_scanned = 0;
+				nr_soft_reclaimed =
+					mem_cgroup_soft_limit_reclaim(zone,
 							order, sc.gfp_mask,
 							&nr_soft_scanned);
-			sc.nr_reclaimed += nr_soft_reclaimed;
+				sc.nr_reclaimed += nr_soft_reclaimed;
+			}
 
 			/*
 			 * There should be no need to raise the scanning
@@ -3246,7 +3328,7 @@ static unsigned long balance_pgdat(pg_data_t *pgdat, int order,
 			 * efficiency.
 			 */
 			if (kswapd_shrink_zone(zone, end_zone, &sc,
-					lru_pages, &nr_attempted))
+					lru_pages, &nr_attempted, !idx))
 				raise_priority = false;
 		}
 
@@ -3278,7 +3360,8 @@ static unsigned long balance_pgdat(pg_data_t *pgdat, int order,
 		 * Compact if necessary and kswapd is reclaiming at least the
 		 * high watermark number of pages as requsted
 		 */
-		if (pgdat_needs_compaction && sc.nr_reclaimed > nr_attempted)
+		if (!idx && pgdat_needs_compaction &&
+		    sc.nr_reclaimed > nr_attempted)
 			compact_pgdat(pgdat, order);
 
 		/*
@@ -3301,7 +3384,8 @@ out:
 	return order;
 }
 
-static void kswapd_try_to_sleep(pg_data_t *pgdat, int order, int classzone_idx)
+static void kswapd_try_to_sleep(pg_data_t *pgdat, int order, int classzone_idx,
+				int idx)
 {
 	long remaining = 0;
 	DEFINE_WAIT(wait);
@@ -3332,21 +3416,30 @@ static void kswapd_try_to_sleep(pg_data_t *pgdat, int order, int classzone_idx)
 		 * watermarks being breached while under pressure, we reduce the
 		 * per-cpu vmstat threshold while kswapd is awake and restore
 		 * them before going back to sleep.
+		 *
+		 * The node-wide state is managed by the first kswapd thread
+		 * only, helpers just come and go.
 		 */
-		set_pgdat_percpu_threshold(pgdat, calculate_normal_threshold);
+		if (!idx) {
+			set_pgdat_percpu_threshold(pgdat,
+						   calculate_normal_threshold);
 
-		/*
-		 * Compaction records what page blocks it recently failed to
-		 * isolate pages from and skips them in the future scanning.
-		 * When kswapd is going to sleep, it is reasonable to assume
-		 * that pages and compaction may succeed so reset the cache.
-		 */
-		reset_isolation_suitable(pgdat);
+			/*
+			 * Compaction records what page blocks it recently
+			 * failed to isolate pages from and skips them in the
+			 * future scanning.  When kswapd is going to sleep, it
+			 * is reasonable to assume that pages and compaction
+			 * may succeed so reset the cache.
+			 */
+			reset_isolation_suitable(pgdat);
+		}
 
 		if (!kthread_should_stop())
 			schedule();
 
-		set_pgdat_percpu_threshold(pgdat, calculate_pressure_threshold);
+		if (!idx)
+			set_pgdat_percpu_threshold(pgdat,
+					calculate_pressure_threshold);
 	} else {
 		if (remaining)
 			count_vm_event(KSWAPD_LOW_WMARK_HIT_QUICKLY);
@@ -3377,6 +3470,7 @@ static int kswapd(void *p)
 	int balanced_classzone_idx;
 	pg_data_t *pgdat = (pg_data_t*)p;
 	struct task_struct *tsk = current;
+	int idx;
 
 	struct reclaim_state reclaim_state = {
 		.reclaimed_slab = 0,
@@ -3385,6 +3479,12 @@ static int kswapd(void *p)
 
 	lockdep_set_current_reclaim_state(GFP_KERNEL);
 
+	/* kswapd_create() publishes us in pgdat->kswapd[] before waking */
+	for (idx = 0; idx < MAX_KSWAPD_THREADS; idx++)
+		if (pgdat->kswapd[idx] == tsk)
+			break;
+	BUG_ON(idx == MAX_KSWAPD_THREADS);
+
 	if (!cpumask_empty(cpumask))
 		set_cpus_allowed_ptr(tsk, cpumask);
 	current->reclaim_state = &reclaim_state;
@@ -3420,8 +3520,11 @@ static int kswapd(void *p)
 					balanced_order == new_order) {
 			new_order = pgdat->kswapd_max_order;
 			new_classzone_idx = pgdat->classzone_idx;
-			pgdat->kswapd_max_order =  0;
-			pgdat->classzone_idx = pgdat->nr_zones - 1;
+			/* helper threads only look at the request */
+			if (!idx) {
+				pgdat->kswapd_max_order =  0;
+				pgdat->classzone_idx = pgdat->nr_zones - 1;
+			}
 		}
 
 		if (order < new_order || classzone_idx > new_classzone_idx) {
@@ -3433,13 +3536,15 @@ static int kswapd(void *p)
 			classzone_idx = new_classzone_idx;
 		} else {
 			kswapd_try_to_sleep(pgdat, balanced_order,
-						balanced_classzone_idx);
+						balanced_classzone_idx, idx);
 			order = pgdat->kswapd_max_order;
 			classzone_idx = pgdat->classzone_idx;
 			new_order = order;
 			new_classzone_idx = classzone_idx;
-			pgdat->kswapd_max_order = 0;
-			pgdat->classzone_idx = pgdat->nr_zones - 1;
+			if (!idx) {
+				pgdat->kswapd_max_order = 0;
+				pgdat->classzone_idx = pgdat->nr_zones - 1;
+			}
 		}
 
 		ret = try_to_freeze();
@@ -3454,7 +3559,7 @@ static int kswapd(void *p)
 			trace_mm_vmscan_kswapd_wake(pgdat->node_id, order);
 			balanced_classzone_idx = classzone_idx;
 			balanced_order = balance_pgdat(pgdat, order,
-						&balanced_classzone_idx);
+						&balanced_classzone_idx, idx);
 		}
 	}
 
@@ -3538,7 +3643,7 @@ unsigned long shrink_all_memory(unsigned long nr_to_reclaim)
 static int cpu_callback(struct notifier_block *nfb, unsigned long action,
 			void *hcpu)
 {
-	int nid;
+	int nid, i;
 
 	if (action == CPU_ONLINE || action == CPU_ONLINE_FROZEN) {
 		for_each_node_state(nid, N_MEMORY) {
@@ -3547,33 +3652,97 @@ static int cpu_callback(struct notifier_block *nfb, unsigned long action,
 
 			mask = cpumask_of_node(pgdat->node_id);
 
-			if (cpumask_any_and(cpu_online_mask, mask) < nr_cpu_ids)
-				/* One of our CPUs online: restore mask */
-				set_cpus_allowed_ptr(pgdat->kswapd, mask);
+			if (cpumask_any_and(cpu_online_mask, mask) >= nr_cpu_ids)
+				continue;
+
+			/* One of our CPUs online: restore mask */
+			for (i = 0; i < MAX_KSWAPD_THREADS; i++)
+				if (pgdat->kswapd[i])
+					set_cpus_allowed_ptr(pgdat->kswapd[i],
+							     mask);
 		}
 	}
 	return NOTIFY_OK;
 }
 
+/*
+ * Number of kswapd threads per node.  The first thread of a node is
+ * always "kswapd<nid>", helpers are named "kswapd<nid>:<idx>".
+ */
+int kswapd_threads = 1;
+static DEFINE_MUTEX(kswapd_threads_mutex);
+
+static int kswapd_create(pg_data_t *pgdat, int idx)
+{
+	struct task_struct *tsk;
+
+	if (idx)
+		tsk = kthread_create_on_node(kswapd, pgdat, pgdat->node_id,
+					     "kswapd%d:%d",
+					     pgdat->node_id, idx);
+	else
+		tsk = kthread_create_on_node(kswapd, pgdat, pgdat->node_id,
+					     "kswapd%d", pgdat->node_id);
+	if (IS_ERR(tsk))
+		return PTR_ERR(tsk);
+
+	pgdat->kswapd[idx] = tsk;
+	wake_up_process(tsk);
+	return 0;
+}
+
+/*
+ * Threads are started from index 0 up and stopped from the top down, so
+ * the running ones are always the first few.
+ */
+static int kswapd_nr_threads(pg_data_t *pgdat)
+{
+	int i;
+
+	for (i = 0; i < MAX_KSWAPD_THREADS && pgdat->kswapd[i]; i++)
+		;
+	return i;
+}
+
+/*
+ * Start kswapd threads up to vm.kswapd_threads and stop the ones above it.
+ */
+static int kswapd_update_threads(int nid)
+{
+	pg_data_t *pgdat = NODE_DATA(nid);
+	int i, ret = 0;
+
+	for (i = MAX_KSWAPD_THREADS - 1; i >= kswapd_threads; i--) {
+		if (pgdat->kswapd[i]) {
+			kthread_stop(pgdat->kswapd[i]);
+			pgdat->kswapd[i] = NULL;
+		}
+	}
+
+	for (i = 0; i < kswapd_threads; i++) {
+		if (pgdat->kswapd[i])
+			continue;
+
+		ret = kswapd_create(pgdat, i);
+		if (ret)
+			break;
+	}
+	return ret;
+}
+
 /*
  * This kswapd start function will be called by init and node-hot-add.
  * On node-hot-add, kswapd will moved to proper cpus if cpus are hot-added.
  */
 int kswapd_run(int nid)
 {
-	pg_data_t *pgdat = NODE_DATA(nid);
-	int ret = 0;
-
-	if (pgdat->kswapd)
-		return 0;
+	int ret;
 
-	pgdat->kswapd = kthread_run(kswapd, pgdat, "kswapd%d", nid);
-	if (IS_ERR(pgdat->kswapd)) {
+	ret = kswapd_update_threads(nid);
+	if (ret) {
 		/* failure at boot is fatal */
 		BUG_ON(system_state == SYSTEM_BOOTING);
 		pr_err("Failed to start kswapd on node %d\n", nid);
-		ret = PTR_ERR(pgdat->kswapd);
-		pgdat->kswapd = NULL;
 	}
 	return ret;
 }
@@ -3584,14 +3753,63 @@ int kswapd_run(int nid)
  */
 void kswapd_stop(int nid)
 {
-	struct task_struct *kswapd = NODE_DATA(nid)->kswapd;
+	pg_data_t *pgdat = NODE_DATA(nid);
+	int i;
 
-	if (kswapd) {
-		kthread_stop(kswapd);
-		NODE_DATA(nid)->kswapd = NULL;
+	for (i = MAX_KSWAPD_THREADS - 1; i >= 0; i--) {
+		if (pgdat->kswapd[i]) {
+			kthread_stop(pgdat->kswapd[i]);
+			pgdat->kswapd[i] = NULL;
+		}
 	}
 }
 
+int kswapd_threads_sysctl_handler(struct ctl_table *table, int write,
+		void __user *buffer, size_t *length, loff_t *ppos)
+{
+	int old, nid, ret;
+
+	mutex_lock(&kswapd_threads_mutex);
+	old = kswapd_threads;
+	ret = proc_dointvec_minmax(table, write, buffer, length, ppos);
+	if (ret || !write || kswapd_threads == old)
+		goto out;
+
+	get_online_mems();
+	for_each_node_state(nid, N_MEMORY) {
+		ret = kswapd_update_threads(nid);
+		if (ret) {
+			pr_err("Failed to start kswapd threads on node %d\n",
+			       nid);
+			break;
+		}
+	}
+	if (ret) {
+		int running = old;
+
+		/*
+		 * Go back to the old thread count everywhere, including the
+		 * nodes already updated, so the sysctl reads back what runs.
+		 * If some node cannot get its old threads back either, settle
+		 * on the count every node still has, which only stops threads.
+		 */
+		kswapd_threads = old;
+		for_each_node_state(nid, N_MEMORY)
+			if (kswapd_update_threads(nid))
+				running = min(running,
+					      kswapd_nr_threads(NODE_DATA(nid)));
+		if (running != old) {
+			kswapd_threads = running;
+			for_each_node_state(nid, N_MEMORY)
+				kswapd_update_threads(nid);
+		}
+	}
+	put_online_mems();
+out:
+	mutex_unlock(&kswapd_threads_mutex);
+	return ret;
+}
+
 static int __init kswapd_init(void)
 {
 	int nid;
@@ -838,6 +838,10 @@ const char * const vmstat_text[] = {
 	"drop_pagecache",
 	"drop_slab",
 
+	"readahead_pages",
+	"readahead_thrashed",
+	"readahead_window_shrink",
+
 #ifdef CONFIG_NUMA_BALANCING
 	"numa_pte_updates",
 	"numa_huge_pte_updates",
@@ -243,6 +243,25 @@ bool workingset_refault(void *shadow)
 	return false;
 }
 
+/**
+ * workingset_refault_distance - refault distance of an evicted page
+ * @shadow: shadow entry of the evicted page
+ *
+ * Returns the number of inactive evictions and activations that
+ * happened in the evicted page's zone since its eviction.  Unlike
+ * workingset_refault(), this does not account a refault and is
+ * meant for callers that merely want to know how long ago a page
+ * left the cache, such as readahead thrashing detection.
+ */
+unsigned long workingset_refault_distance(void *shadow)
+{
+	unsigned long refault_distance;
+	struct zone *zone;
+
+	unpack_shadow(shadow, &zone, &refault_distance);
+	return refault_distance;
+}
+
 /**
  * workingset_activation - note a page activation
  * @page: page that is being activated
@@ -30,7 +30,9 @@
 #include <linux/types.h>
 #include <linux/atomic.h>
 #include <linux/frontswap.h>
-#include <linux/rbtree.h>
+#include <linux/radix-tree.h>
+#include <linux/rcupdate.h>
+#include <linux/blkdev.h>
 #include <linux/swap.h>
 #include <linux/crypto.h>
 #include <linux/mempool.h>
@@ -49,6 +51,8 @@
 static u64 zswap_pool_total_size;
 /* The number of compressed pages currently stored in zswap */
 static atomic_t zswap_stored_pages = ATOMIC_INIT(0);
+/* The number of same-value filled pages currently stored in zswap */
+static atomic_t zswap_same_filled_pages = ATOMIC_INIT(0);
 
 /*
  * The statistics below are not protected from concurrent access for
@@ -71,6 +75,8 @@ static u64 zswap_reject_alloc_fail;
 static u64 zswap_reject_kmemcache_fail;
 /* Duplicate store was encountered (rare) */
 static u64 zswap_duplicate_entry;
+/* Pages written back along with an evicted neighbour */
+static u64 zswap_written_back_batched;
 
 /*********************************
 * tunables
@@ -84,11 +90,23 @@ module_param_named(enabled, zswap_enabled, bool, 0444);
 static char *zswap_compressor = ZSWAP_COMPRESSOR_DEFAULT;
 module_param_named(compressor, zswap_compressor, charp, 0444);
 
+/* Store pages filled with one repeated word without compressing them */
+static bool zswap_same_filled_pages_enabled = true;
+module_param_named(same_filled_pages_enabled, zswap_same_filled_pages_enabled,
+		   bool, 0644);
+
 /* The maximum percentage of memory that the compressed pool can occupy */
 static unsigned int zswap_max_pool_percent = 20;
 module_param_named(max_pool_percent,
 			zswap_max_pool_percent, uint, 0644);
 
+/*
+ * Maximum number of swap-contiguous pages written back together when the
+ * pool evicts an entry, so that the swap device sees one large write.
+ */
+static unsigned int zswap_writeback_batch = 8;
+module_param_named(writeback_batch, zswap_writeback_batch, uint, 0644);
+
 /* Compressed storage to use */
 #define ZSWAP_ZPOOL_DEFAULT "zbud"
 static char *zswap_zpool_type = ZSWAP_ZPOOL_DEFAULT;
@@ -165,24 +183,35 @@ static void zswap_comp_exit(void)
  * This structure contains the metadata for tracking a single compressed
  * page within zswap.
  *
- * rbnode - links the entry into red-black tree for the appropriate swap type
+ * offset - the swap offset for the entry.  Index into the tree.
  * refcount - the number of outstanding reference to the entry. This is needed
  *            to protect against premature freeing of the entry by code
- *            concurrent calls to load, invalidate, and writeback.  The lock
- *            for the zswap_tree structure that contains the entry must
- *            be held while changing the refcount.  Since the lock must
- *            be held, there is no reason to also make refcount atomic.
- * offset - the swap offset for the entry.  Index into the red-black tree.
+ *            concurrent calls to load, invalidate, and writeback.  The
+ *            tree holds one reference for as long as the entry is
+ *            linked into it.  Lookups take their reference without the
+ *            tree lock, so the refcount is atomic.
  * handle - zpool allocation handle that stores the compressed page data
+ * value - the word a same-value filled page is made of.  Such pages take
+ *         no zpool space, so this shares space with the handle.
  * length - the length in bytes of the compressed page data.  Needed during
- *          decompression
+ *          decompression.  Zero for same-value filled pages.
+ * rcu - frees the entry after a grace period, as lockless lookups may
+ *       still be looking at it.  Only used once the last reference is
+ *       gone, so it can share space with the data fields.
  */
 struct zswap_entry {
-	struct rb_node rbnode;
 	pgoff_t offset;
-	int refcount;
-	unsigned int length;
-	unsigned long handle;
+	atomic_t refcount;
+	union {
+		struct {
+			unsigned int length;
+			union {
+				unsigned long handle;
+				unsigned long value;
+			};
+		};
+		struct rcu_head rcu;
+	};
 };
 
 struct zswap_header {
@@ -190,13 +219,24 @@ struct zswap_header {
 };
 
 /*
- * The tree lock in the zswap_tree struct protects a few things:
- * - the rbtree
- * - the refcount field of each entry in the tree
+ * The entries of a swap type are split into shards by swap offset range,
+ * so that concurrent swap-out from several CPUs, which allocate swap
+ * slots from different clusters, do not contend on a single lock.
+ *
+ * Each shard indexes its entries in a radix tree.  The shard lock
+ * serializes insertion and removal; lookups walk the tree under RCU
+ * and take their reference with atomic_inc_not_zero().
  */
-struct zswap_tree {
-	struct rb_root rbroot;
+#define ZSWAP_TREE_SHARD_SHIFT	8	/* SWAPFILE_CLUSTER pages per range */
+#define ZSWAP_TREE_SHARDS	16
+
+struct zswap_tree_shard {
 	spinlock_t lock;
+	struct radix_tree_root root;
+} ____cacheline_aligned_in_smp;
+
+struct zswap_tree {
+	struct zswap_tree_shard shards[ZSWAP_TREE_SHARDS];
 };
 
 static struct zswap_tree *zswap_trees[MAX_SWAPFILES];
@@ -223,8 +263,7 @@ static struct zswap_entry *zswap_entry_cache_alloc(gfp_t gfp)
 	entry = kmem_cache_alloc(zswap_entry_cache, gfp);
 	if (!entry)
 		return NULL;
-	entry->refcount = 1;
-	RB_CLEAR_NODE(&entry->rbnode);
+	atomic_set(&entry->refcount, 1);
 	return entry;
 }
 
@@ -233,59 +272,36 @@ static void zswap_entry_cache_free(struct zswap_entry *entry)
 	kmem_cache_free(zswap_entry_cache, entry);
 }
 
+static void zswap_entry_free_rcu(struct rcu_head *head)
+{
+	zswap_entry_cache_free(container_of(head, struct zswap_entry, rcu));
+}
+
 /*********************************
-* rbtree functions
+* tree functions
 **********************************/
-static struct zswap_entry *zswap_rb_search(struct rb_root *root, pgoff_t offset)
+static struct zswap_tree_shard *zswap_tree_shard(struct zswap_tree *tree,
+						 pgoff_t offset)
 {
-	struct rb_node *node = root->rb_node;
-	struct zswap_entry *entry;
+	unsigned int i = offset >> ZSWAP_TREE_SHARD_SHIFT;
 
-	while (node) {
-		entry = rb_entry(node, struct zswap_entry, rbnode);
-		if (entry->offset > offset)
-			node = node->rb_left;
-		else if (entry->offset < offset)
-			node = node->rb_right;
-		else
-			return entry;
-	}
-	return NULL;
+	return &tree->shards[i & (ZSWAP_TREE_SHARDS - 1)];
 }
 
 /*
- * In the case that a entry with the same offset is found, a pointer to
- * the existing entry is stored in dupentry and the function returns -EEXIST
+ * Unlink @entry from @shard if it is still there.  Returns true if the
+ * caller now owns the reference the tree held on the entry.
  */
-static int zswap_rb_insert(struct rb_root *root, struct zswap_entry *entry,
-			struct zswap_entry **dupentry)
-{
-	struct rb_node **link = &root->rb_node, *parent = NULL;
-	struct zswap_entry *myentry;
-
-	while (*link) {
-		parent = *link;
-		myentry = rb_entry(parent, struct zswap_entry, rbnode);
-		if (myentry->offset > entry->offset)
-			link = &(*link)->rb_left;
-		else if (myentry->offset < entry->offset)
-			link = &(*link)->rb_right;
-		else {
-			*dupentry = myentry;
-			return -EEXIST;
-		}
-	}
-	rb_link_node(&entry->rbnode, parent, link);
-	rb_insert_color(&entry->rbnode, root);
-	return 0;
-}
-
-static void zswap_rb_erase(struct rb_root *root, struct zswap_entry *entry)
+static bool zswap_tree_remove(struct zswap_tree_shard *shard,
+			      struct zswap_entry *entry)
 {
-	if (!RB_EMPTY_NODE(&entry->rbnode)) {
-		rb_erase(&entry->rbnode, root);
-		RB_CLEAR_NODE(&entry->rbnode);
-	}
+	void *item;
+
+	spin_lock(&shard->lock);
+	item = radix_tree_delete_item(&shard->root, entry->offset, entry);
+	spin_unlock(&shard->lock);
+
+	return item == entry;
 }
 
 /*
@@ -294,42 +310,40 @@ static void zswap_rb_erase(struct rb_root *root, struct zswap_entry *entry)
  */
 static void zswap_free_entry(struct zswap_entry *entry)
 {
-	zpool_free(zswap_pool, entry->handle);
-	zswap_entry_cache_free(entry);
+	if (!entry->length) {
+		atomic_dec(&zswap_same_filled_pages);
+	} else {
+		zpool_free(zswap_pool, entry->handle);
+		zswap_pool_total_size = zpool_get_total_size(zswap_pool);
+	}
+	call_rcu(&entry->rcu, zswap_entry_free_rcu);
 	atomic_dec(&zswap_stored_pages);
-	zswap_pool_total_size = zpool_get_total_size(zswap_pool);
 }
 
-/* caller must hold the tree lock */
-static void zswap_entry_get(struct zswap_entry *entry)
-{
-	entry->refcount++;
-}
-
-/* caller must hold the tree lock
-* remove from the tree and free it, if nobody reference the entry
-*/
-static void zswap_entry_put(struct zswap_tree *tree,
-			struct zswap_entry *entry)
+/*
+ * Drop a reference and free the entry if it was the last one.  The entry
+ * must already be unlinked from its tree when the last reference goes.
+ */
+static void zswap_entry_put(struct zswap_entry *entry)
 {
-	int refcount = --entry->refcount;
+	int refcount = atomic_dec_return(&entry->refcount);
 
 	BUG_ON(refcount < 0);
-	if (refcount == 0) {
-		zswap_rb_erase(&tree->rbroot, entry);
+	if (refcount == 0)
 		zswap_free_entry(entry);
-	}
 }
 
-/* caller must hold the tree lock */
-static struct zswap_entry *zswap_entry_find_get(struct rb_root *root,
+/* lockless lookup, returns the entry with a reference held */
+static struct zswap_entry *zswap_entry_find_get(struct zswap_tree_shard *shard,
 				pgoff_t offset)
 {
-	struct zswap_entry *entry = NULL;
+	struct zswap_entry *entry;
 
-	entry = zswap_rb_search(root, offset);
-	if (entry)
-		zswap_entry_get(entry);
+	rcu_read_lock();
+	entry = radix_tree_lookup(&shard->root, offset);
+	if (entry && !atomic_inc_not_zero(&entry->refcount))
+		entry = NULL;
+	rcu_read_unlock();
 
 	return entry;
 }
@@ -408,6 +422,35 @@ cleanup:
 	return -ENOMEM;
 }
 
+/*********************************
+* same-value filled pages
+**********************************/
+static bool zswap_is_page_same_filled(void *ptr, unsigned long *value)
+{
+	unsigned long *page = ptr;
+	unsigned int pos;
+
+	for (pos = 1; pos < PAGE_SIZE / sizeof(*page); pos++) {
+		if (page[pos] != page[0])
+			return false;
+	}
+	*value = page[0];
+	return true;
+}
+
+static void zswap_fill_page(void *ptr, unsigned long value)
+{
+	unsigned long *page = ptr;
+	unsigned int pos;
+
+	if (!value) {
+		memset(ptr, 0, PAGE_SIZE);
+		return;
+	}
+	for (pos = 0; pos < PAGE_SIZE / sizeof(*page); pos++)
+		page[pos] = value;
+}
+
 /*********************************
 * helpers
 **********************************/
@@ -529,14 +572,13 @@ static int zswap_get_swap_cache_page(swp_entry_t entry,
  * in the first place.  After the page has been decompressed into
  * the swap cache, the compressed version stored by zswap can be
  * freed.
+ *
+ * The caller holds a reference on @entry, which is dropped here.
  */
-static int zswap_writeback_entry(struct zpool *pool, unsigned long handle)
+static int zswap_writeback_page(struct zswap_tree_shard *shard,
+				swp_entry_t swpentry,
+				struct zswap_entry *entry)
 {
-	struct zswap_header *zhdr;
-	swp_entry_t swpentry;
-	struct zswap_tree *tree;
-	pgoff_t offset;
-	struct zswap_entry *entry;
 	struct page *page;
 	u8 *src, *dst;
 	unsigned int dlen;
@@ -545,23 +587,7 @@ static int zswap_writeback_entry(struct zpool *pool, unsigned long handle)
 		.sync_mode = WB_SYNC_NONE,
 	};
 
-	/* extract swpentry from data */
-	zhdr = zpool_map_handle(pool, handle, ZPOOL_MM_RO);
-	swpentry = zhdr->swpentry; /* here */
-	zpool_unmap_handle(pool, handle);
-	tree = zswap_trees[swp_type(swpentry)];
-	offset = swp_offset(swpentry);
-
-	/* find and ref zswap entry */
-	spin_lock(&tree->lock);
-	entry = zswap_entry_find_get(&tree->rbroot, offset);
-	if (!entry) {
-		/* entry was invalidated */
-		spin_unlock(&tree->lock);
-		return 0;
-	}
-	spin_unlock(&tree->lock);
-	BUG_ON(offset != entry->offset);
+	BUG_ON(swp_offset(swpentry) != entry->offset);
 
 	/* try to allocate swap cache page */
 	switch (zswap_get_swap_cache_page(swpentry, &page)) {
@@ -576,6 +602,14 @@ static int zswap_writeback_entry(struct zpool *pool, unsigned long handle)
 		goto fail;
 
 	case ZSWAP_SWAPCACHE_NEW: /* page is locked */
+		if (!entry->length) {
+			dst = kmap_atomic(page);
+			zswap_fill_page(dst, entry->value);
+			kunmap_atomic(dst);
+			SetPageUptodate(page);
+			break;
+		}
+
 		/* decompress */
 		dlen = PAGE_SIZE;
 		src = (u8 *)zpool_map_handle(zswap_pool, entry->handle,
@@ -600,22 +634,14 @@ static int zswap_writeback_entry(struct zpool *pool, unsigned long handle)
 	page_cache_release(page);
 	zswap_written_back_pages++;
 
-	spin_lock(&tree->lock);
-	/* drop local reference */
-	zswap_entry_put(tree, entry);
-
 	/*
-	* There are two possible situations for entry here:
-	* (1) refcount is 1(normal case),  entry is valid and on the tree
-	* (2) refcount is 0, entry is freed and not on the tree
-	*     because invalidate happened during writeback
-	*  search the tree and free the entry if find entry
-	*/
-	if (entry == zswap_rb_search(&tree->rbroot, offset))
-		zswap_entry_put(tree, entry);
-	spin_unlock(&tree->lock);
-
-	goto end;
+	 * The data now lives in the swap cache: drop the reference of
+	 * the tree, unless an invalidate already unlinked the entry while
+	 * we were writing it back.
+	 */
+	if (zswap_tree_remove(shard, entry))
+		zswap_entry_put(entry);
+	ret = 0;
 
 	/*
 	* if we get here due to ZSWAP_SWAPCACHE_EXIST
@@ -625,11 +651,69 @@ static int zswap_writeback_entry(struct zpool *pool, unsigned long handle)
 	* it it either okay to return !0
 	*/
 fail:
-	spin_lock(&tree->lock);
-	zswap_entry_put(tree, entry);
-	spin_unlock(&tree->lock);
+	/* drop local reference */
+	zswap_entry_put(entry);
+	return ret;
+}
+
+/*
+ * Write back the entries that directly follow @swpentry in the swap
+ * device, up to zswap_writeback_batch pages in total.  Called under the
+ * plug of the first write, so the block layer merges the pages into a
+ * single contiguous request instead of issuing one I/O per page.
+ */
+static void zswap_writeback_neighbours(struct zswap_tree *tree,
+				       swp_entry_t swpentry)
+{
+	unsigned type = swp_type(swpentry);
+	pgoff_t offset = swp_offset(swpentry);
+	struct zswap_tree_shard *shard;
+	struct zswap_entry *entry;
+	unsigned int i;
+
+	for (i = 1; i < zswap_writeback_batch; i++) {
+		shard = zswap_tree_shard(tree, offset + i);
+		entry = zswap_entry_find_get(shard, offset + i);
+		if (!entry)
+			break;
+		if (zswap_writeback_page(shard, swp_entry(type, offset + i),
+					 entry))
+			break;
+		zswap_written_back_batched++;
+	}
+}
+
+/* zpool eviction callback */
+static int zswap_writeback_entry(struct zpool *pool, unsigned long handle)
+{
+	struct zswap_header *zhdr;
+	swp_entry_t swpentry;
+	struct zswap_tree *tree;
+	struct zswap_tree_shard *shard;
+	struct zswap_entry *entry;
+	struct blk_plug plug;
+	int ret;
+
+	/* extract swpentry from data */
+	zhdr = zpool_map_handle(pool, handle, ZPOOL_MM_RO);
+	swpentry = zhdr->swpentry; /* here */
+	zpool_unmap_handle(pool, handle);
+	tree = zswap_trees[swp_type(swpentry)];
+	shard = zswap_tree_shard(tree, swp_offset(swpentry));
+
+	/* find and ref zswap entry */
+	entry = zswap_entry_find_get(shard, swp_offset(swpentry));
+	if (!entry) {
+		/* entry was invalidated */
+		return 0;
+	}
+
+	blk_start_plug(&plug);
+	ret = zswap_writeback_page(shard, swpentry, entry);
+	if (!ret)
+		zswap_writeback_neighbours(tree, swpentry);
+	blk_finish_plug(&plug);
 
-end:
 	return ret;
 }
 
@@ -641,19 +725,45 @@ static int zswap_frontswap_store(unsigned type, pgoff_t offset,
 				struct page *page)
 {
 	struct zswap_tree *tree = zswap_trees[type];
-	struct zswap_entry *entry, *dupentry;
+	struct zswap_tree_shard *shard;
+	struct zswap_entry *entry, *dupentry = NULL;
+	void **slot;
 	int ret;
 	unsigned int dlen = PAGE_SIZE, len;
-	unsigned long handle;
+	unsigned long handle, value;
 	char *buf;
 	u8 *src, *dst;
 	struct zswap_header *zhdr;
+	bool same_filled = false;
 
 	if (!tree) {
 		ret = -ENODEV;
 		goto reject;
 	}
 
+	/*
+	 * Same-value filled pages need no pool space, so they are checked
+	 * for before reclaiming any.
+	 */
+	if (zswap_same_filled_pages_enabled) {
+		src = kmap_atomic(page);
+		same_filled = zswap_is_page_same_filled(src, &value);
+		kunmap_atomic(src);
+	}
+	if (same_filled) {
+		entry = zswap_entry_cache_alloc(GFP_KERNEL);
+		if (!entry) {
+			zswap_reject_kmemcache_fail++;
+			ret = -ENOMEM;
+			goto reject;
+		}
+		entry->offset = offset;
+		entry->length = 0;
+		entry->value = value;
+		atomic_inc(&zswap_same_filled_pages);
+		goto insert;
+	}
+
 	/* reclaim space if needed */
 	if (zswap_is_full()) {
 		zswap_pool_limit_hit++;
@@ -706,22 +816,41 @@ static int zswap_frontswap_store(unsigned type, pgoff_t offset,
 	entry->handle = handle;
 	entry->length = dlen;
 
+insert:
 	/* map */
-	spin_lock(&tree->lock);
-	do {
-		ret = zswap_rb_insert(&tree->rbroot, entry, &dupentry);
-		if (ret == -EEXIST) {
-			zswap_duplicate_entry++;
-			/* remove from rbtree */
-			zswap_rb_erase(&tree->rbroot, dupentry);
-			zswap_entry_put(tree, dupentry);
-		}
-	} while (ret == -EEXIST);
-	spin_unlock(&tree->lock);
+	ret = radix_tree_preload(GFP_KERNEL);
+	if (ret) {
+		zswap_reject_kmemcache_fail++;
+		if (entry->length)
+			zpool_free(zswap_pool, handle);
+		else
+			atomic_dec(&zswap_same_filled_pages);
+		zswap_entry_cache_free(entry);
+		goto reject;
+	}
+	shard = zswap_tree_shard(tree, offset);
+	spin_lock(&shard->lock);
+	slot = radix_tree_lookup_slot(&shard->root, offset);
+	if (slot) {
+		/* replace in place, lockless lookups never see a hole */
+		zswap_duplicate_entry++;
+		dupentry = radix_tree_deref_slot_protected(slot, &shard->lock);
+		radix_tree_replace_slot(slot, entry);
+	} else {
+		ret = radix_tree_insert(&shard->root, offset, entry);
+		BUG_ON(ret);
+	}
+	spin_unlock(&shard->lock);
+	radix_tree_preload_end();
+
+	/* drop the reference the tree held on the replaced entry */
+	if (dupentry)
+		zswap_entry_put(dupentry);
 
 	/* update stats */
 	atomic_inc(&zswap_stored_pages);
-	zswap_pool_total_size = zpool_get_total_size(zswap_pool);
+	if (entry->length)
+		zswap_pool_total_size = zpool_get_total_size(zswap_pool);
 
 	return 0;
 
@@ -746,14 +875,19 @@ static int zswap_frontswap_load(unsigned type, pgoff_t offset,
 	int ret;
 
 	/* find */
-	spin_lock(&tree->lock);
-	entry = zswap_entry_find_get(&tree->rbroot, offset);
+	entry = zswap_entry_find_get(zswap_tree_shard(tree, offset), offset);
 	if (!entry) {
 		/* entry was written back */
-		spin_unlock(&tree->lock);
 		return -1;
 	}
-	spin_unlock(&tree->lock);
+
+	if (!entry->length) {
+		dst = kmap_atomic(page);
+		zswap_fill_page(dst, entry->value);
+		kunmap_atomic(dst);
+		zswap_entry_put(entry);
+		return 0;
+	}
 
 	/* decompress */
 	dlen = PAGE_SIZE;
@@ -766,9 +900,7 @@ static int zswap_frontswap_load(unsigned type, pgoff_t offset,
 	zpool_unmap_handle(zswap_pool, entry->handle);
 	BUG_ON(ret);
 
-	spin_lock(&tree->lock);
-	zswap_entry_put(tree, entry);
-	spin_unlock(&tree->lock);
+	zswap_entry_put(entry);
 
 	return 0;
 }
@@ -777,41 +909,53 @@ static int zswap_frontswap_load(unsigned type, pgoff_t offset,
 static void zswap_frontswap_invalidate_page(unsigned type, pgoff_t offset)
 {
 	struct zswap_tree *tree = zswap_trees[type];
+	struct zswap_tree_shard *shard = zswap_tree_shard(tree, offset);
 	struct zswap_entry *entry;
 
-	/* find */
-	spin_lock(&tree->lock);
-	entry = zswap_rb_search(&tree->rbroot, offset);
+	/* find and remove from the tree */
+	spin_lock(&shard->lock);
+	entry = radix_tree_delete(&shard->root, offset);
+	spin_unlock(&shard->lock);
 	if (!entry) {
 		/* entry was written back */
-		spin_unlock(&tree->lock);
 		return;
 	}
 
-	/* remove from rbtree */
-	zswap_rb_erase(&tree->rbroot, entry);
-
 	/* drop the initial reference from entry creation */
-	zswap_entry_put(tree, entry);
-
-	spin_unlock(&tree->lock);
+	zswap_entry_put(entry);
 }
 
 /* frees all zswap entries for the given swap type */
 static void zswap_frontswap_invalidate_area(unsigned type)
 {
 	struct zswap_tree *tree = zswap_trees[type];
-	struct zswap_entry *entry, *n;
+	struct zswap_tree_shard *shard;
+	struct zswap_entry *entries[16];
+	unsigned int i, j, nr;
+	pgoff_t index;
 
 	if (!tree)
 		return;
 
-	/* walk the tree and free everything */
-	spin_lock(&tree->lock);
-	rbtree_postorder_for_each_entry_safe(entry, n, &tree->rbroot, rbnode)
-		zswap_free_entry(entry);
-	tree->rbroot = RB_ROOT;
-	spin_unlock(&tree->lock);
+	/* walk the trees and free everything */
+	for (i = 0; i < ZSWAP_TREE_SHARDS; i++) {
+		shard = &tree->shards[i];
+		index = 0;
+		spin_lock(&shard->lock);
+		while ((nr = radix_tree_gang_lookup(&shard->root,
+						(void **)entries, index,
+						ARRAY_SIZE(entries)))) {
+			for (j = 0; j < nr; j++) {
+				index = entries[j]->offset + 1;
+				radix_tree_delete(&shard->root,
+						  entries[j]->offset);
+				zswap_free_entry(entries[j]);
+			}
+		}
+		spin_unlock(&shard->lock);
+	}
+	/* let lockless lookups that raced with swapoff finish */
+	synchronize_rcu();
 	kfree(tree);
 	zswap_trees[type] = NULL;
 }
@@ -823,6 +967,8 @@ static struct zpool_ops zswap_zpool_ops = {
 static void zswap_frontswap_init(unsigned type)
 {
 	struct zswap_tree *tree;
+	struct zswap_tree_shard *shard;
+	int i;
 
 	tree = kzalloc(sizeof(struct zswap_tree), GFP_KERNEL);
 	if (!tree) {
@@ -830,8 +976,11 @@ static void zswap_frontswap_init(unsigned type)
 		return;
 	}
 
-	tree->rbroot = RB_ROOT;
-	spin_lock_init(&tree->lock);
+	for (i = 0; i < ZSWAP_TREE_SHARDS; i++) {
+		shard = &tree->shards[i];
+		spin_lock_init(&shard->lock);
+		INIT_RADIX_TREE(&shard->root, GFP_ATOMIC | __GFP_NOWARN);
+	}
 	zswap_trees[type] = tree;
 }
 
@@ -872,10 +1021,14 @@ static int __init zswap_debugfs_init(void)
 			zswap_debugfs_root, &zswap_reject_compress_poor);
 	debugfs_create_u64("written_back_pages", S_IRUGO,
 			zswap_debugfs_root, &zswap_written_back_pages);
+	debugfs_create_u64("written_back_batched", S_IRUGO,
+			zswap_debugfs_root, &zswap_written_back_batched);
 	debugfs_create_u64("duplicate_entry", S_IRUGO,
 			zswap_debugfs_root, &zswap_duplicate_entry);
 	debugfs_create_u64("pool_total_size", S_IRUGO,
 			zswap_debugfs_root, &zswap_pool_total_size);
+	debugfs_create_atomic_t("same_filled_pages", S_IRUGO,
+			zswap_debugfs_root, &zswap_same_filled_pages);
 	debugfs_create_atomic_t("stored_pages", S_IRUGO,
 			zswap_debugfs_root, &zswap_stored_pages);
 
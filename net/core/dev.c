@@ -101,6 +101,7 @@
 #include <net/dst.h>
 #include <net/pkt_sched.h>
 #include <net/checksum.h>
+#include <net/lat_hist.h>
 #include <net/xfrm.h>
 #include <linux/highmem.h>
 #include <linux/init.h>
@@ -1725,7 +1726,7 @@ static inline int deliver_skb(struct sk_buff *skb,
 			      struct packet_type *pt_prev,
 			      struct net_device *orig_dev)
 {
-	if (unlikely(skb_orphan_frags(skb, GFP_ATOMIC)))
+	if (unlikely(skb_orphan_frags_rx(skb, GFP_ATOMIC)))
 		return -ENOMEM;
 	atomic_inc(&skb->users);
 	return pt_prev->func(skb, skb->dev, pt_prev, orig_dev);
@@ -2681,7 +2682,7 @@ static struct sk_buff *validate_xmit_skb(struct sk_buff *skb, struct net_device
 
 		segs = skb_gso_segment(skb, features);
 		if (IS_ERR(segs)) {
-			segs = NULL;
+			goto out_kfree_skb;
 		} else if (segs) {
 			consume_skb(skb);
 			skb = segs;
@@ -2818,6 +2819,7 @@ static inline int __dev_xmit_skb(struct sk_buff *skb, struct Qdisc *q,
 
 		rc = NET_XMIT_SUCCESS;
 	} else {
+		net_lat_hist_enqueue(skb);
 		rc = q->enqueue(skb, q) & NET_XMIT_MASK;
 		if (qdisc_run_begin(q)) {
 			if (unlikely(contended)) {
@@ -3339,6 +3341,7 @@ static int netif_rx_internal(struct sk_buff *skb)
 	int ret;
 
 	net_timestamp_check(netdev_tstamp_prequeue, skb);
+	net_lat_hist_handoff(skb);
 
 	trace_netif_rx(skb);
 #ifdef CONFIG_RPS
@@ -3620,6 +3623,7 @@ static int __netif_receive_skb_core(struct sk_buff *skb, bool pfmemalloc)
 	__be16 type;
 
 	net_timestamp_check(!netdev_tstamp_prequeue, skb);
+	net_lat_hist_rx(skb);
 
 	trace_netif_receive_skb(skb);
 
@@ -3733,7 +3737,7 @@ ncls:
 	}
 
 	if (pt_prev) {
-		if (unlikely(skb_orphan_frags(skb, GFP_ATOMIC)))
+		if (unlikely(skb_orphan_frags_rx(skb, GFP_ATOMIC)))
 			goto drop;
 		else
 			ret = pt_prev->func(skb, skb->dev, pt_prev, orig_dev);
@@ -3780,6 +3784,7 @@ static int __netif_receive_skb(struct sk_buff *skb)
 static int netif_receive_skb_internal(struct sk_buff *skb)
 {
 	net_timestamp_check(netdev_tstamp_prequeue, skb);
+	net_lat_hist_handoff(skb);
 
 	if (skb_defer_rx_timestamp(skb))
 		return NET_RX_SUCCESS;
@@ -4149,6 +4154,7 @@ static gro_result_t napi_skb_finish(gro_result_t ret, struct sk_buff *skb)
 gro_result_t napi_gro_receive(struct napi_struct *napi, struct sk_buff *skb)
 {
 	trace_napi_gro_receive_entry(skb);
+	net_lat_hist_handoff(skb);
 
 	skb_gro_reset_offset(skb);
 
@@ -5797,6 +5803,31 @@ int dev_get_phys_port_id(struct net_device *dev,
 }
 EXPORT_SYMBOL(dev_get_phys_port_id);
 
+/**
+ *	dev_change_xdp - set or clear the early receive program
+ *	@dev: device
+ *	@prog: classic BPF program, or NULL to detach
+ *
+ *	On success the device owns @prog. Must be called under RTNL.
+ */
+int dev_change_xdp(struct net_device *dev, struct bpf_prog *prog)
+{
+	const struct net_device_ops *ops = dev->netdev_ops;
+	struct netdev_xdp xdp;
+
+	ASSERT_RTNL();
+
+	if (!ops->ndo_xdp)
+		return -EOPNOTSUPP;
+
+	memset(&xdp, 0, sizeof(xdp));
+	xdp.command = XDP_SETUP_PROG;
+	xdp.prog = prog;
+
+	return ops->ndo_xdp(dev, &xdp);
+}
+EXPORT_SYMBOL(dev_change_xdp);
+
 /**
  *	dev_new_index	-	allocate an ifindex
  *	@net: the applicable net namespace
@@ -6654,6 +6685,10 @@ struct net_device *alloc_netdev_mqs(int sizeof_priv, const char *name,
 	if (!dev->pcpu_refcnt)
 		goto free_dev;
 
+	dev->lat_hist = alloc_percpu(struct netdev_lat_hist);
+	if (!dev->lat_hist)
+		goto free_pcpu;
+
 	if (dev_addr_init(dev))
 		goto free_pcpu;
 
@@ -6701,6 +6736,7 @@ free_all:
 	return NULL;
 
 free_pcpu:
+	free_percpu(dev->lat_hist);
 	free_percpu(dev->pcpu_refcnt);
 free_dev:
 	netdev_freemem(dev);
@@ -6737,6 +6773,8 @@ void free_netdev(struct net_device *dev)
 
 	free_percpu(dev->pcpu_refcnt);
 	dev->pcpu_refcnt = NULL;
+	free_percpu(dev->lat_hist);
+	dev->lat_hist = NULL;
 
 	/*  Compatibility with error handling in drivers */
 	if (dev->reg_state == NETREG_UNINITIALIZED) {
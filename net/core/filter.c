@@ -44,6 +44,7 @@
 #include <linux/ratelimit.h>
 #include <linux/seccomp.h>
 #include <linux/if_vlan.h>
+#include <net/sock_reuseport.h>
 
 /**
  *	sk_filter - run a packet through a socket filter
@@ -1015,37 +1016,76 @@ void bpf_prog_destroy(struct bpf_prog *fp)
 EXPORT_SYMBOL_GPL(bpf_prog_destroy);
 
 /**
- *	sk_attach_filter - attach a socket filter
- *	@fprog: the filter program
- *	@sk: the socket to use
+ *	bpf_prog_run_xdp - run an early receive program on a raw frame
+ *	@prog: program attached with IFLA_XDP
+ *	@xdp: the frame, still in the driver's receive buffer
  *
- * Attach the user's filter code. We first run some sanity checks on
- * it to make sure it does not explode on us later. If an error
- * occurs or there is insufficient memory for the filter a negative
- * errno code is returned. On success the return is zero.
+ *	Called by drivers from their NAPI poll before an sk_buff is allocated
+ *	for the frame. Classic BPF loads are relative to an sk_buff, so the
+ *	program runs on one on the stack that only describes the linear
+ *	frame; nothing outside this function ever sees it.
+ *
+ *	Returns one of enum xdp_action.
  */
-int sk_attach_filter(struct sock_fprog *fprog, struct sock *sk)
+u32 bpf_prog_run_xdp(const struct bpf_prog *prog, struct xdp_buff *xdp)
+{
+	struct sk_buff skb;
+
+	memset(&skb, 0, sizeof(skb));
+	skb.head = xdp->data;
+	skb.data = xdp->data;
+	skb.len = xdp->data_end - xdp->data;
+	skb_set_tail_pointer(&skb, skb.len);
+	skb_reset_mac_header(&skb);
+	skb_set_network_header(&skb, ETH_HLEN);
+	skb.protocol = eth_hdr(&skb)->h_proto;
+	skb.dev = xdp->dev;
+
+	return BPF_PROG_RUN(prog, &skb);
+}
+EXPORT_SYMBOL_GPL(bpf_prog_run_xdp);
+
+/**
+ *	bpf_prog_run_xdp_skb - run an early receive program on an sk_buff
+ *	@prog: program attached with IFLA_XDP
+ *	@skb: received frame, skb->data at the Ethernet header
+ *
+ *	For receive paths where the frame already lives in an sk_buff, e.g.
+ *	copybreak rings or software devices. The program gets the same view
+ *	as with bpf_prog_run_xdp().
+ */
+u32 bpf_prog_run_xdp_skb(const struct bpf_prog *prog, struct sk_buff *skb)
+{
+	skb_reset_mac_header(skb);
+	skb_set_network_header(skb, ETH_HLEN);
+	skb->protocol = eth_hdr(skb)->h_proto;
+
+	return BPF_PROG_RUN(prog, skb);
+}
+EXPORT_SYMBOL_GPL(bpf_prog_run_xdp_skb);
+
+static struct bpf_prog *__get_filter(struct sock_fprog *fprog,
+				     struct sock *sk)
 {
-	struct sk_filter *fp, *old_fp;
 	unsigned int fsize = bpf_classic_proglen(fprog);
 	unsigned int bpf_fsize = bpf_prog_size(fprog->len);
 	struct bpf_prog *prog;
 	int err;
 
 	if (sock_flag(sk, SOCK_FILTER_LOCKED))
-		return -EPERM;
+		return ERR_PTR(-EPERM);
 
 	/* Make sure new filter is there and in the right amounts. */
 	if (fprog->filter == NULL)
-		return -EINVAL;
+		return ERR_PTR(-EINVAL);
 
 	prog = bpf_prog_alloc(bpf_fsize, 0);
 	if (!prog)
-		return -ENOMEM;
+		return ERR_PTR(-ENOMEM);
 
 	if (copy_from_user(prog->insns, fprog->filter, fsize)) {
 		__bpf_prog_free(prog);
-		return -EFAULT;
+		return ERR_PTR(-EFAULT);
 	}
 
 	prog->len = fprog->len;
@@ -1053,13 +1093,30 @@ int sk_attach_filter(struct sock_fprog *fprog, struct sock *sk)
 	err = bpf_prog_store_orig_filter(prog, fprog);
 	if (err) {
 		__bpf_prog_free(prog);
-		return -ENOMEM;
+		return ERR_PTR(-ENOMEM);
 	}
 
 	/* bpf_prepare_filter() already takes care of freeing
 	 * memory in case something goes wrong.
 	 */
-	prog = bpf_prepare_filter(prog);
+	return bpf_prepare_filter(prog);
+}
+
+/**
+ *	sk_attach_filter - attach a socket filter
+ *	@fprog: the filter program
+ *	@sk: the socket to use
+ *
+ * Attach the user's filter code. We first run some sanity checks on
+ * it to make sure it does not explode on us later. If an error
+ * occurs or there is insufficient memory for the filter a negative
+ * errno code is returned. On success the return is zero.
+ */
+int sk_attach_filter(struct sock_fprog *fprog, struct sock *sk)
+{
+	struct sk_filter *fp, *old_fp;
+	struct bpf_prog *prog = __get_filter(fprog, sk);
+
 	if (IS_ERR(prog))
 		return PTR_ERR(prog);
 
@@ -1088,6 +1145,30 @@ int sk_attach_filter(struct sock_fprog *fprog, struct sock *sk)
 }
 EXPORT_SYMBOL_GPL(sk_attach_filter);
 
+/**
+ *	sk_reuseport_attach_filter - attach a SO_REUSEPORT selector
+ *	@fprog: the filter program
+ *	@sk: the socket to use
+ *
+ * The program's return value is used as an index into the socket's
+ * reuseport group; see reuseport_select_sock(). It runs with the skb
+ * data pointing at the transport payload.
+ */
+int sk_reuseport_attach_filter(struct sock_fprog *fprog, struct sock *sk)
+{
+	struct bpf_prog *prog = __get_filter(fprog, sk);
+	int err;
+
+	if (IS_ERR(prog))
+		return PTR_ERR(prog);
+
+	err = reuseport_attach_prog(sk, prog);
+	if (err)
+		__bpf_prog_release(prog);
+
+	return err;
+}
+
 int sk_detach_filter(struct sock *sk)
 {
 	int ret = -ENOENT;
@@ -0,0 +1,117 @@
+/*
+ * Software latency histograms for the network stack.
+ *
+ * Receive samples use skb->tstamp, which netif_rx(), netif_receive_skb()
+ * and napi_gro_receive() set at the driver hand-off while the histograms
+ * are on, whatever netdev_tstamp_prequeue says.  Turning them on also
+ * holds a reference on net_enable_timestamp().
+ * Transmit samples stamp skb->tstamp at qdisc enqueue and clear it
+ * again at dequeue.
+ *
+ *	This program is free software; you can redistribute it and/or
+ *	modify it under the terms of the GNU General Public License
+ *	as published by the Free Software Foundation; either version
+ *	2 of the License, or (at your option) any later version.
+ */
+
+#include <linux/mutex.h>
+#include <linux/netdevice.h>
+#include <linux/percpu.h>
+#include <net/lat_hist.h>
+#include <net/sock.h>
+
+struct static_key net_lat_hist_needed __read_mostly;
+EXPORT_SYMBOL(net_lat_hist_needed);
+
+static DEFINE_MUTEX(net_lat_hist_mutex);
+static bool net_lat_hist_enabled;
+
+static s64 net_lat_hist_since_rx(const struct sk_buff *skb)
+{
+	return ktime_to_ns(ktime_sub(ktime_get_real(), skb->tstamp));
+}
+
+void __net_lat_hist_rx(const struct sk_buff *skb)
+{
+	struct netdev_lat_hist __percpu *hist = skb->dev->lat_hist;
+
+	if (!hist || !skb->tstamp.tv64)
+		return;
+
+	net_lat_hist_add(&this_cpu_ptr(hist)->rx_backlog,
+			 net_lat_hist_since_rx(skb));
+}
+EXPORT_SYMBOL(__net_lat_hist_rx);
+
+void __net_lat_hist_dequeue(struct net_device *dev, struct sk_buff *skb)
+{
+	struct netdev_lat_hist *hist = NULL;
+	s64 now = ktime_to_ns(ktime_get());
+
+	if (dev->lat_hist)
+		hist = this_cpu_ptr(dev->lat_hist);
+
+	for (; skb; skb = skb->next) {
+		if (!skb->lat_hist_stamped)
+			continue;
+		if (hist)
+			net_lat_hist_add(&hist->tx_qdisc,
+					 now - ktime_to_ns(skb->tstamp));
+		/* see net_lat_hist_dequeue() */
+		skb->tstamp.tv64 = 0;
+		skb->lat_hist_stamped = 0;
+	}
+}
+EXPORT_SYMBOL(__net_lat_hist_dequeue);
+
+/* Updates are not atomic: two cpus queueing to the same socket at
+ * once may lose a count, which a histogram can live with.
+ */
+void __sk_lat_hist_rx(struct sock *sk, const struct sk_buff *skb)
+{
+	struct net_lat_hist *hist = ACCESS_ONCE(sk->sk_lat_hist);
+
+	if (!hist || !skb->tstamp.tv64)
+		return;
+
+	net_lat_hist_add(hist, net_lat_hist_since_rx(skb));
+}
+EXPORT_SYMBOL(__sk_lat_hist_rx);
+
+void netdev_lat_hist_read(const struct net_device *dev,
+			  struct netdev_lat_hist *sum)
+{
+	int cpu, i;
+
+	memset(sum, 0, sizeof(*sum));
+	if (!dev->lat_hist)
+		return;
+
+	for_each_possible_cpu(cpu) {
+		const struct netdev_lat_hist *hist;
+
+		hist = per_cpu_ptr(dev->lat_hist, cpu);
+		for (i = 0; i < NET_LAT_BUCKETS; i++) {
+			sum->rx_backlog.buckets[i] += hist->rx_backlog.buckets[i];
+			sum->tx_qdisc.buckets[i] += hist->tx_qdisc.buckets[i];
+		}
+	}
+}
+EXPORT_SYMBOL(netdev_lat_hist_read);
+
+void net_lat_hist_set(bool enable)
+{
+	mutex_lock(&net_lat_hist_mutex);
+	if (enable != net_lat_hist_enabled) {
+		if (enable) {
+			net_enable_timestamp();
+			static_key_slow_inc(&net_lat_hist_needed);
+		} else {
+			static_key_slow_dec(&net_lat_hist_needed);
+			net_disable_timestamp();
+		}
+		net_lat_hist_enabled = enable;
+	}
+	mutex_unlock(&net_lat_hist_mutex);
+}
+EXPORT_SYMBOL(net_lat_hist_set);
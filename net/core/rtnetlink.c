@@ -53,6 +53,7 @@
 #include <net/fib_rules.h>
 #include <net/rtnetlink.h>
 #include <net/net_namespace.h>
+#include <net/lat_hist.h>
 
 struct rtnl_link {
 	rtnl_doit_func		doit;
@@ -838,6 +839,25 @@ static size_t rtnl_port_size(const struct net_device *dev,
 		return port_self_size;
 }
 
+static size_t rtnl_xdp_size(const struct net_device *dev)
+{
+	if (!dev->netdev_ops->ndo_xdp)
+		return 0;
+
+	return nla_total_size(0) +	/* nest IFLA_XDP */
+	       nla_total_size(1);	/* IFLA_XDP_ATTACHED */
+}
+
+static size_t rtnl_lat_hist_size(const struct net_device *dev)
+{
+	if (!dev->lat_hist)
+		return 0;
+
+	return nla_total_size(0) +	/* nest IFLA_LAT_HIST */
+	       nla_total_size(sizeof(struct net_lat_hist)) + /* RX_BACKLOG */
+	       nla_total_size(sizeof(struct net_lat_hist)); /* TX_QDISC */
+}
+
 static noinline size_t if_nlmsg_size(const struct net_device *dev,
 				     u32 ext_filter_mask)
 {
@@ -868,7 +888,9 @@ static noinline size_t if_nlmsg_size(const struct net_device *dev,
 	       + rtnl_port_size(dev, ext_filter_mask) /* IFLA_VF_PORTS + IFLA_PORT_SELF */
 	       + rtnl_link_get_size(dev) /* IFLA_LINKINFO */
 	       + rtnl_link_get_af_size(dev) /* IFLA_AF_SPEC */
-	       + nla_total_size(MAX_PHYS_PORT_ID_LEN); /* IFLA_PHYS_PORT_ID */
+	       + nla_total_size(MAX_PHYS_PORT_ID_LEN) /* IFLA_PHYS_PORT_ID */
+	       + rtnl_xdp_size(dev) /* IFLA_XDP */
+	       + rtnl_lat_hist_size(dev); /* IFLA_LAT_HIST */
 }
 
 static int rtnl_vf_ports_fill(struct sk_buff *skb, struct net_device *dev)
@@ -967,6 +989,60 @@ static int rtnl_phys_port_id_fill(struct sk_buff *skb, struct net_device *dev)
 	return 0;
 }
 
+static int rtnl_xdp_fill(struct sk_buff *skb, struct net_device *dev)
+{
+	const struct net_device_ops *ops = dev->netdev_ops;
+	struct netdev_xdp xdp;
+	struct nlattr *xdp_attr;
+	int err;
+
+	if (!ops->ndo_xdp)
+		return 0;
+
+	memset(&xdp, 0, sizeof(xdp));
+	xdp.command = XDP_QUERY_PROG;
+	err = ops->ndo_xdp(dev, &xdp);
+	if (err)
+		return err;
+
+	xdp_attr = nla_nest_start(skb, IFLA_XDP);
+	if (!xdp_attr)
+		return -EMSGSIZE;
+	if (nla_put_u8(skb, IFLA_XDP_ATTACHED, xdp.prog_attached)) {
+		nla_nest_cancel(skb, xdp_attr);
+		return -EMSGSIZE;
+	}
+	nla_nest_end(skb, xdp_attr);
+
+	return 0;
+}
+
+static int rtnl_lat_hist_fill(struct sk_buff *skb, struct net_device *dev)
+{
+	struct netdev_lat_hist hist;
+	struct nlattr *attr;
+
+	/* only while collecting, dumps stay lean otherwise */
+	if (!static_key_enabled(&net_lat_hist_needed) || !dev->lat_hist)
+		return 0;
+
+	netdev_lat_hist_read(dev, &hist);
+
+	attr = nla_nest_start(skb, IFLA_LAT_HIST);
+	if (!attr)
+		return -EMSGSIZE;
+	if (nla_put(skb, IFLA_LAT_HIST_RX_BACKLOG, sizeof(hist.rx_backlog),
+		    &hist.rx_backlog) ||
+	    nla_put(skb, IFLA_LAT_HIST_TX_QDISC, sizeof(hist.tx_qdisc),
+		    &hist.tx_qdisc)) {
+		nla_nest_cancel(skb, attr);
+		return -EMSGSIZE;
+	}
+	nla_nest_end(skb, attr);
+
+	return 0;
+}
+
 static int rtnl_fill_ifinfo(struct sk_buff *skb, struct net_device *dev,
 			    int type, u32 pid, u32 seq, u32 change,
 			    unsigned int flags, u32 ext_filter_mask)
@@ -1041,6 +1117,12 @@ static int rtnl_fill_ifinfo(struct sk_buff *skb, struct net_device *dev,
 	if (rtnl_phys_port_id_fill(skb, dev))
 		goto nla_put_failure;
 
+	if (rtnl_xdp_fill(skb, dev))
+		goto nla_put_failure;
+
+	if (rtnl_lat_hist_fill(skb, dev))
+		goto nla_put_failure;
+
 	attr = nla_reserve(skb, IFLA_STATS,
 			sizeof(struct rtnl_link_stats));
 	if (attr == NULL)
@@ -1200,6 +1282,13 @@ static const struct nla_policy ifla_policy[IFLA_MAX+1] = {
 	[IFLA_NUM_RX_QUEUES]	= { .type = NLA_U32 },
 	[IFLA_PHYS_PORT_ID]	= { .type = NLA_BINARY, .len = MAX_PHYS_PORT_ID_LEN },
 	[IFLA_CARRIER_CHANGES]	= { .type = NLA_U32 },  /* ignored */
+	[IFLA_XDP]		= { .type = NLA_NESTED },
+	[IFLA_LAT_HIST]		= { .type = NLA_NESTED },  /* ignored */
+};
+
+static const struct nla_policy ifla_xdp_policy[IFLA_XDP_MAX+1] = {
+	[IFLA_XDP_OPS]		= { .type = NLA_BINARY },
+	[IFLA_XDP_ATTACHED]	= { .type = NLA_U8 },
 };
 
 static const struct nla_policy ifla_info_policy[IFLA_INFO_MAX+1] = {
@@ -1486,6 +1575,22 @@ static int do_set_master(struct net_device *dev, int ifindex)
 #define DO_SETLINK_MODIFIED	0x01
 /* notify flag means notify + modified. */
 #define DO_SETLINK_NOTIFY	0x03
+static int rtnl_xdp_prog_create(const struct nlattr *ops,
+				struct bpf_prog **prog)
+{
+	struct sock_fprog_kern fprog;
+	unsigned int len = nla_len(ops);
+
+	if (len == 0 || len % sizeof(struct sock_filter) ||
+	    len / sizeof(struct sock_filter) > BPF_MAXINSNS)
+		return -EINVAL;
+
+	fprog.len = len / sizeof(struct sock_filter);
+	fprog.filter = nla_data(ops);
+
+	return bpf_prog_create(prog, &fprog);
+}
+
 static int do_setlink(const struct sk_buff *skb,
 		      struct net_device *dev, struct ifinfomsg *ifm,
 		      struct nlattr **tb, char *ifname, int status)
@@ -1720,6 +1825,36 @@ static int do_setlink(const struct sk_buff *skb,
 	}
 	err = 0;
 
+	if (tb[IFLA_XDP]) {
+		struct nlattr *xdp[IFLA_XDP_MAX+1];
+		struct bpf_prog *prog = NULL;
+
+		err = nla_parse_nested(xdp, IFLA_XDP_MAX, tb[IFLA_XDP],
+				       ifla_xdp_policy);
+		if (err < 0)
+			goto errout;
+
+		if (xdp[IFLA_XDP_ATTACHED]) {
+			err = -EINVAL;
+			goto errout;
+		}
+
+		if (xdp[IFLA_XDP_OPS]) {
+			err = rtnl_xdp_prog_create(xdp[IFLA_XDP_OPS], &prog);
+			if (err < 0)
+				goto errout;
+		}
+
+		err = dev_change_xdp(dev, prog);
+		if (err < 0) {
+			if (prog)
+				bpf_prog_destroy(prog);
+			goto errout;
+		}
+		status |= DO_SETLINK_NOTIFY;
+	}
+	err = 0;
+
 errout:
 	if (status & DO_SETLINK_MODIFIED) {
 		if (status & DO_SETLINK_NOTIFY)
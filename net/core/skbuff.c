@@ -517,13 +517,7 @@ static void skb_release_data(struct sk_buff *skb)
 	 * If skb buf is from userspace, we need to notify the caller
 	 * the lower device DMA has done;
 	 */
-	if (shinfo->tx_flags & SKBTX_DEV_ZEROCOPY) {
-		struct ubuf_info *uarg;
-
-		uarg = shinfo->destructor_arg;
-		if (uarg->callback)
-			uarg->callback(uarg, true);
-	}
+	skb_zcopy_clear(skb, true);
 
 	if (shinfo->frag_list)
 		kfree_skb_list(shinfo->frag_list);
@@ -652,14 +646,7 @@ EXPORT_SYMBOL(kfree_skb_list);
  */
 void skb_tx_error(struct sk_buff *skb)
 {
-	if (skb_shinfo(skb)->tx_flags & SKBTX_DEV_ZEROCOPY) {
-		struct ubuf_info *uarg;
-
-		uarg = skb_shinfo(skb)->destructor_arg;
-		if (uarg->callback)
-			uarg->callback(uarg, false);
-		skb_shinfo(skb)->tx_flags &= ~SKBTX_DEV_ZEROCOPY;
-	}
+	skb_zcopy_clear(skb, false);
 }
 EXPORT_SYMBOL(skb_tx_error);
 
@@ -810,10 +797,17 @@ EXPORT_SYMBOL_GPL(skb_morph);
 int skb_copy_ubufs(struct sk_buff *skb, gfp_t gfp_mask)
 {
 	int i;
-	int num_frags = skb_shinfo(skb)->nr_frags;
+	int num_frags;
 	struct page *page, *head = NULL;
-	struct ubuf_info *uarg = skb_shinfo(skb)->destructor_arg;
 
+	/* MSG_ZEROCOPY frags may be shared with the clones still queued for
+	 * transmit: replace them in a private skb_shared_info only.
+	 */
+	if (skb_zcopy_is_sock(skb_uarg(skb)) &&
+	    (skb_shared(skb) || skb_unclone(skb, gfp_mask)))
+		return -EINVAL;
+
+	num_frags = skb_shinfo(skb)->nr_frags;
 	for (i = 0; i < num_frags; i++) {
 		u8 *vaddr;
 		skb_frag_t *f = &skb_shinfo(skb)->frags[i];
@@ -839,7 +833,7 @@ int skb_copy_ubufs(struct sk_buff *skb, gfp_t gfp_mask)
 	for (i = 0; i < num_frags; i++)
 		skb_frag_unref(skb, i);
 
-	uarg->callback(uarg, false);
+	skb_zcopy_clear(skb, false);
 
 	/* skb frags point to kernel buffers */
 	for (i = num_frags - 1; i >= 0; i--) {
@@ -848,11 +842,300 @@ int skb_copy_ubufs(struct sk_buff *skb, gfp_t gfp_mask)
 		head = (struct page *)page_private(head);
 	}
 
-	skb_shinfo(skb)->tx_flags &= ~SKBTX_DEV_ZEROCOPY;
 	return 0;
 }
 EXPORT_SYMBOL_GPL(skb_copy_ubufs);
 
+/**
+ *	skb_zerocopy_clone - share the zerocopy state of @orig with @nskb
+ *	@nskb: skb that is being given frags of @orig
+ *	@orig: MSG_ZEROCOPY (or other zerocopy) source skb
+ *	@gfp_mask: allocation priority, or 0 if @nskb is known to be fresh
+ *
+ *	Must be called after skb_orphan_frags(@orig), whenever frags of
+ *	@orig are referenced from another skb_shared_info.
+ */
+int skb_zerocopy_clone(struct sk_buff *nskb, struct sk_buff *orig,
+		       gfp_t gfp_mask)
+{
+	if (skb_zcopy(orig)) {
+		if (skb_zcopy(nskb)) {
+			/* !gfp_mask callers are verified to !skb_zcopy(nskb) */
+			if (!gfp_mask) {
+				WARN_ON_ONCE(1);
+				return -ENOMEM;
+			}
+			if (skb_uarg(nskb) == skb_uarg(orig))
+				return 0;
+			if (skb_copy_ubufs(nskb, GFP_ATOMIC))
+				return -EIO;
+		}
+		skb_zcopy_set(nskb, skb_uarg(orig));
+	}
+	return 0;
+}
+EXPORT_SYMBOL_GPL(skb_zerocopy_clone);
+
+static void sock_ofree(struct sk_buff *skb)
+{
+	struct sock *sk = skb->sk;
+
+	atomic_sub(skb->truesize, &sk->sk_omem_alloc);
+}
+
+/**
+ *	sock_zerocopy_alloc - start tracking a MSG_ZEROCOPY send
+ *	@sk: sending socket
+ *	@size: number of bytes passed to the send call
+ *
+ *	The tracking state lives in the control block of the skb that is
+ *	later queued on @sk's error queue as the completion notification,
+ *	so completing a send never needs to allocate. The skb is charged to
+ *	the socket option memory, which bounds the number of outstanding
+ *	notifications.
+ */
+struct ubuf_info *sock_zerocopy_alloc(struct sock *sk, size_t size)
+{
+	struct ubuf_info *uarg;
+	struct sk_buff *skb;
+
+	if (atomic_read(&sk->sk_omem_alloc) + SKB_TRUESIZE(0) >
+	    sysctl_optmem_max)
+		return NULL;
+
+	skb = alloc_skb(0, sk->sk_allocation);
+	if (!skb)
+		return NULL;
+
+	atomic_add(skb->truesize, &sk->sk_omem_alloc);
+	skb->sk = sk;
+	skb->destructor = sock_ofree;
+
+	BUILD_BUG_ON(sizeof(*uarg) > sizeof(skb->cb));
+	uarg = (void *)skb->cb;
+	uarg->callback = sock_zerocopy_callback;
+	uarg->id = ((u32)atomic_inc_return(&sk->sk_zckey)) - 1;
+	uarg->len = 1;
+	uarg->bytelen = size;
+	uarg->zerocopy = 1;
+	atomic_set(&uarg->refcnt, 1);
+	sock_hold(sk);
+
+	return uarg;
+}
+EXPORT_SYMBOL_GPL(sock_zerocopy_alloc);
+
+static inline struct sk_buff *skb_from_uarg(struct ubuf_info *uarg)
+{
+	return container_of((void *)uarg, struct sk_buff, cb);
+}
+
+/**
+ *	sock_zerocopy_realloc - extend or start MSG_ZEROCOPY tracking
+ *	@sk: sending socket, owned by the caller
+ *	@size: number of bytes passed to the send call
+ *	@uarg: tracking state of the skb the data will be appended to
+ *
+ *	Consecutive send calls appending to the same skb share one ubuf_info
+ *	and, in the end, one notification covering the whole range of calls.
+ */
+struct ubuf_info *sock_zerocopy_realloc(struct sock *sk, size_t size,
+					struct ubuf_info *uarg)
+{
+	if (uarg && skb_zcopy_is_sock(uarg)) {
+		const u32 byte_limit = 1 << 19;		/* limit to a few TSO */
+		u32 bytelen, next;
+
+		/* realloc only when socket is locked (TCP), so uarg->len
+		 * and sk_zckey access is serialized
+		 */
+		if (!sock_owned_by_user(sk)) {
+			WARN_ON_ONCE(1);
+			return NULL;
+		}
+
+		bytelen = uarg->bytelen + size;
+		if (uarg->len == USHRT_MAX - 1 || bytelen > byte_limit) {
+			/* TCP can create new skb to attach new uarg */
+			if (sk->sk_type == SOCK_STREAM)
+				goto new_alloc;
+			return NULL;
+		}
+
+		next = (u32)atomic_read(&sk->sk_zckey);
+		if ((u32)(uarg->id + uarg->len) == next) {
+			uarg->len++;
+			uarg->bytelen = bytelen;
+			atomic_set(&sk->sk_zckey, ++next);
+			sock_zerocopy_get(uarg);
+			return uarg;
+		}
+	}
+
+new_alloc:
+	return sock_zerocopy_alloc(sk, size);
+}
+EXPORT_SYMBOL_GPL(sock_zerocopy_realloc);
+
+static bool skb_zerocopy_notify_extend(struct sk_buff *skb, u32 lo, u16 len)
+{
+	struct sock_exterr_skb *serr = SKB_EXT_ERR(skb);
+	u32 old_lo, old_hi;
+	u64 sum_len;
+
+	old_lo = serr->ee.ee_info;
+	old_hi = serr->ee.ee_data;
+	sum_len = old_hi - old_lo + 1ULL + len;
+
+	if (sum_len >= (1ULL << 32))
+		return false;
+
+	if (lo != old_hi + 1)
+		return false;
+
+	serr->ee.ee_data += len;
+	return true;
+}
+
+/**
+ *	sock_zerocopy_callback - queue the completion of MSG_ZEROCOPY sends
+ *	@uarg: tracking state, no longer referenced by any skb
+ *	@success: false if any of the data had to be copied after all
+ *
+ *	Reports the range of completed send calls [ee_info, ee_data] on the
+ *	socket error queue, merging with a notification still queued there
+ *	when the ranges are contiguous.
+ */
+void sock_zerocopy_callback(struct ubuf_info *uarg, bool success)
+{
+	struct sk_buff *tail, *skb = skb_from_uarg(uarg);
+	struct sock_exterr_skb *serr;
+	struct sock *sk = skb->sk;
+	struct sk_buff_head *q;
+	unsigned long flags;
+	u32 lo, hi;
+	u16 len;
+
+	/* if !len, there was only 1 call, and it was aborted
+	 * so do not queue a completion notification
+	 */
+	if (!uarg->len || sock_flag(sk, SOCK_DEAD))
+		goto release;
+
+	len = uarg->len;
+	lo = uarg->id;
+	hi = uarg->id + len - 1;
+
+	serr = SKB_EXT_ERR(skb);
+	memset(serr, 0, sizeof(*serr));
+	serr->ee.ee_errno = 0;
+	serr->ee.ee_origin = SO_EE_ORIGIN_ZEROCOPY;
+	serr->ee.ee_data = hi;
+	serr->ee.ee_info = lo;
+	if (!success)
+		serr->ee.ee_code |= SO_EE_CODE_ZEROCOPY_COPIED;
+
+	q = &sk->sk_error_queue;
+	spin_lock_irqsave(&q->lock, flags);
+	tail = skb_peek_tail(q);
+	if (!tail || SKB_EXT_ERR(tail)->ee.ee_origin != SO_EE_ORIGIN_ZEROCOPY ||
+	    !skb_zerocopy_notify_extend(tail, lo, len)) {
+		__skb_queue_tail(q, skb);
+		skb = NULL;
+	}
+	spin_unlock_irqrestore(&q->lock, flags);
+
+	sk->sk_error_report(sk);
+
+release:
+	consume_skb(skb);
+	sock_put(sk);
+}
+EXPORT_SYMBOL_GPL(sock_zerocopy_callback);
+
+void sock_zerocopy_put(struct ubuf_info *uarg)
+{
+	if (uarg && atomic_dec_and_test(&uarg->refcnt))
+		uarg->callback(uarg, uarg->zerocopy);
+}
+EXPORT_SYMBOL_GPL(sock_zerocopy_put);
+
+/* Undo sock_zerocopy_realloc() for a send call that queued no data */
+void sock_zerocopy_put_abort(struct ubuf_info *uarg)
+{
+	if (uarg) {
+		struct sock *sk = skb_from_uarg(uarg)->sk;
+
+		atomic_dec(&sk->sk_zckey);
+		uarg->len--;
+
+		sock_zerocopy_put(uarg);
+	}
+}
+EXPORT_SYMBOL_GPL(sock_zerocopy_put_abort);
+
+/**
+ *	skb_zerocopy_iter_stream - append user pages to a stream skb
+ *	@sk: owning socket, its send memory is charged
+ *	@skb: skb to append frags to
+ *	@from: user buffer
+ *	@len: number of bytes wanted
+ *	@uarg: MSG_ZEROCOPY tracking state of this send call
+ *
+ *	Pins as much of @from as fits in the remaining frag slots of @skb.
+ *	Returns the number of bytes appended, -EMSGSIZE if @skb has no frag
+ *	slot left, -EEXIST if @skb already belongs to another send call or
+ *	-EFAULT.
+ */
+int skb_zerocopy_iter_stream(struct sock *sk, struct sk_buff *skb,
+			     const void __user *from, int len,
+			     struct ubuf_info *uarg)
+{
+	struct ubuf_info *orig_uarg = skb_zcopy(skb);
+	struct page *pages[MAX_SKB_FRAGS];
+	unsigned long base = (unsigned long)from;
+	int frag = skb_shinfo(skb)->nr_frags;
+	int copied = 0;
+	int i, n;
+
+	if (orig_uarg && uarg != orig_uarg)
+		return -EEXIST;
+
+	if (frag == MAX_SKB_FRAGS)
+		return -EMSGSIZE;
+
+	n = DIV_ROUND_UP((base & ~PAGE_MASK) + len, PAGE_SIZE);
+	n = min_t(int, n, MAX_SKB_FRAGS - frag);
+	n = get_user_pages_fast(base, n, 0, pages);
+	if (n <= 0)
+		return -EFAULT;
+
+	for (i = 0; i < n; i++) {
+		int off = base & ~PAGE_MASK;
+		int size = min_t(int, len - copied, PAGE_SIZE - off);
+
+		if (skb_can_coalesce(skb, frag, pages[i], off)) {
+			skb_frag_size_add(&skb_shinfo(skb)->frags[frag - 1],
+					  size);
+			put_page(pages[i]);
+		} else {
+			skb_fill_page_desc(skb, frag++, pages[i], off, size);
+		}
+		base += size;
+		copied += size;
+	}
+
+	skb->len += copied;
+	skb->data_len += copied;
+	skb->truesize += copied;
+	sk->sk_wmem_queued += copied;
+	sk_mem_charge(sk, copied);
+
+	skb_zcopy_set(skb, uarg);
+	return copied;
+}
+EXPORT_SYMBOL_GPL(skb_zerocopy_iter_stream);
+
 /**
  *	skb_clone	-	duplicate an sk_buff
  *	@skb: buffer to clone
@@ -1009,7 +1292,8 @@ struct sk_buff *__pskb_copy_fclone(struct sk_buff *skb, int headroom,
 	if (skb_shinfo(skb)->nr_frags) {
 		int i;
 
-		if (skb_orphan_frags(skb, gfp_mask)) {
+		if (skb_orphan_frags(skb, gfp_mask) ||
+		    skb_zerocopy_clone(n, skb, gfp_mask)) {
 			kfree_skb(n);
 			n = NULL;
 			goto out;
@@ -1089,6 +1373,8 @@ int pskb_expand_head(struct sk_buff *skb, int nhead, int ntail,
 		/* copy this zero copy skb frags */
 		if (skb_orphan_frags(skb, gfp_mask))
 			goto nofrags;
+		if (skb_zcopy(skb))
+			sock_zerocopy_get(skb_uarg(skb));
 		for (i = 0; i < skb_shinfo(skb)->nr_frags; i++)
 			skb_frag_ref(skb, i);
 
@@ -2195,6 +2481,7 @@ skb_zerocopy(struct sk_buff *to, struct sk_buff *from, int len, int hlen)
 		skb_tx_error(from);
 		return -ENOMEM;
 	}
+	skb_zerocopy_clone(to, from, GFP_ATOMIC);
 
 	for (i = 0; i < skb_shinfo(from)->nr_frags; i++) {
 		if (!len)
@@ -2472,6 +2759,7 @@ void skb_split(struct sk_buff *skb, struct sk_buff *skb1, const u32 len)
 	int pos = skb_headlen(skb);
 
 	skb_shinfo(skb1)->tx_flags = skb_shinfo(skb)->tx_flags & SKBTX_SHARED_FRAG;
+	skb_zerocopy_clone(skb1, skb, 0);
 	if (len < pos)	/* Split line is inside header. */
 		skb_split_inside_header(skb, skb1, len, pos);
 	else		/* Second chunk has no header, nothing to copy. */
@@ -2514,6 +2802,10 @@ int skb_shift(struct sk_buff *tgt, struct sk_buff *skb, int shiftlen)
 	BUG_ON(shiftlen > skb->len);
 	BUG_ON(skb_headlen(skb));	/* Would corrupt stream */
 
+	/* The frags of different MSG_ZEROCOPY sends can't be mixed */
+	if (skb_zcopy(tgt) || skb_zcopy(skb))
+		return 0;
+
 	todo = shiftlen;
 	from = 0;
 	to = skb_shinfo(tgt)->nr_frags;
@@ -3044,6 +3336,8 @@ struct sk_buff *skb_segment(struct sk_buff *head_skb,
 
 			if (unlikely(skb_orphan_frags(frag_skb, GFP_ATOMIC)))
 				goto err;
+			if (skb_zerocopy_clone(nskb, frag_skb, GFP_ATOMIC))
+				goto err;
 
 			*nskb_frag = *frag;
 			__skb_frag_ref(nskb_frag);
@@ -133,6 +133,7 @@
 #include <net/netprio_cgroup.h>
 
 #include <linux/filter.h>
+#include <net/sock_reuseport.h>
 
 #include <trace/events/sock.h>
 
@@ -457,6 +458,7 @@ int sock_queue_rcv_skb(struct sock *sk, struct sk_buff *skb)
 
 	skb->dev = NULL;
 	skb_set_owner_r(skb, sk);
+	sk_lat_hist_rx(sk, skb);
 
 	/* we escape from rcu protected region, make sure we dont leak
 	 * a norefcounted dst
@@ -889,6 +891,19 @@ set_rcvbuf:
 		}
 		break;
 
+	case SO_ATTACH_REUSEPORT_CBPF:
+		ret = -EINVAL;
+		if (optlen == sizeof(struct sock_fprog)) {
+			struct sock_fprog fprog;
+
+			ret = -EFAULT;
+			if (copy_from_user(&fprog, optval, sizeof(fprog)))
+				break;
+
+			ret = sk_reuseport_attach_filter(&fprog, sk);
+		}
+		break;
+
 	case SO_DETACH_FILTER:
 		ret = sk_detach_filter(sk);
 		break;
@@ -958,6 +973,39 @@ set_rcvbuf:
 					 sk->sk_max_pacing_rate);
 		break;
 
+	case SO_ZEROCOPY:
+		if (sk->sk_family != PF_INET && sk->sk_family != PF_INET6)
+			ret = -ENOTSUPP;
+		else if (sk->sk_protocol != IPPROTO_TCP)
+			ret = -ENOTSUPP;
+		else if (sk->sk_state != TCP_CLOSE)
+			ret = -EBUSY;
+		else if (val < 0 || val > 1)
+			ret = -EINVAL;
+		else
+			sock_valbool_flag(sk, SOCK_ZEROCOPY, valbool);
+		break;
+
+	case SO_LATENCY_HIST:
+		/* The histogram lives as long as the socket, so writing
+		 * any value starts collection or restarts it from zero.
+		 */
+		if (sk->sk_lat_hist) {
+			memset(sk->sk_lat_hist, 0, sizeof(*sk->sk_lat_hist));
+		} else {
+			struct net_lat_hist *hist;
+
+			hist = kzalloc(sizeof(*hist), GFP_KERNEL);
+			if (!hist) {
+				ret = -ENOMEM;
+				break;
+			}
+			/* zeroed buckets must be visible before the pointer */
+			smp_wmb();
+			ACCESS_ONCE(sk->sk_lat_hist) = hist;
+		}
+		break;
+
 	default:
 		ret = -ENOPROTOOPT;
 		break;
@@ -1214,6 +1262,14 @@ int sock_getsockopt(struct socket *sock, int level, int optname,
 		v.val = sk->sk_max_pacing_rate;
 		break;
 
+	case SO_ZEROCOPY:
+		v.val = sock_flag(sk, SOCK_ZEROCOPY);
+		break;
+
+	case SO_LATENCY_HIST:
+		v.val = !!sk->sk_lat_hist;
+		break;
+
 	default:
 		return -ENOPROTOOPT;
 	}
@@ -1383,6 +1439,13 @@ struct sock *sk_alloc(struct net *net, int family, gfp_t priority,
 }
 EXPORT_SYMBOL(sk_alloc);
 
+static void sk_prot_free_rcu(struct rcu_head *head)
+{
+	struct sock *sk = container_of(head, struct sock, sk_rcu);
+
+	sk_prot_free(sk->sk_prot_creator, sk);
+}
+
 static void __sk_free(struct sock *sk)
 {
 	struct sk_filter *filter;
@@ -1397,7 +1460,11 @@ static void __sk_free(struct sock *sk)
 		RCU_INIT_POINTER(sk->sk_filter, NULL);
 	}
 
+	if (rcu_access_pointer(sk->sk_reuseport_cb))
+		reuseport_detach_sock(sk);
+
 	sock_disable_timestamp(sk, SK_FLAGS_TIMESTAMP);
+	kfree(sk->sk_lat_hist);
 
 	if (atomic_read(&sk->sk_omem_alloc))
 		pr_debug("%s: optmem leakage (%d bytes) detected\n",
@@ -1407,7 +1474,15 @@ static void __sk_free(struct sock *sk)
 		put_cred(sk->sk_peer_cred);
 	put_pid(sk->sk_peer_pid);
 	put_net(sock_net(sk));
-	sk_prot_free(sk->sk_prot_creator, sk);
+	/*
+	 * Protocols doing lockless lookups under rcu_read_lock() may still
+	 * be looking at this sock: only hand the memory back once they are
+	 * done with it.
+	 */
+	if (sock_flag(sk, SOCK_RCU_FREE))
+		call_rcu(&sk->sk_rcu, sk_prot_free_rcu);
+	else
+		sk_prot_free(sk->sk_prot_creator, sk);
 }
 
 void sk_free(struct sock *sk)
@@ -1482,6 +1557,7 @@ struct sock *sk_clone_lock(const struct sock *sk, const gfp_t priority)
 		 */
 		atomic_set(&newsk->sk_wmem_alloc, 1);
 		atomic_set(&newsk->sk_omem_alloc, 0);
+		atomic_set(&newsk->sk_zckey, 0);
 		skb_queue_head_init(&newsk->sk_receive_queue);
 		skb_queue_head_init(&newsk->sk_write_queue);
 
@@ -1492,6 +1568,11 @@ struct sock *sk_clone_lock(const struct sock *sk, const gfp_t priority)
 				af_family_clock_key_strings[newsk->sk_family]);
 
 		newsk->sk_dst_cache	= NULL;
+		RCU_INIT_POINTER(newsk->sk_reuseport_cb, NULL);
+		/* children of a listener collecting latencies do so too */
+		if (sk->sk_lat_hist)
+			newsk->sk_lat_hist = kzalloc(sizeof(struct net_lat_hist),
+						     priority);
 		newsk->sk_wmem_queued	= 0;
 		newsk->sk_forward_alloc = 0;
 		newsk->sk_send_head	= NULL;
@@ -195,6 +195,19 @@ static int flow_limit_table_len_sysctl(struct ctl_table *table, int write,
 }
 #endif /* CONFIG_NET_FLOW_LIMIT */
 
+static int sysctl_net_lat_hist;
+
+static int net_lat_hist_sysctl(struct ctl_table *table, int write,
+			       void __user *buffer, size_t *lenp, loff_t *ppos)
+{
+	int ret;
+
+	ret = proc_dointvec_minmax(table, write, buffer, lenp, ppos);
+	if (write && ret == 0)
+		net_lat_hist_set(sysctl_net_lat_hist);
+	return ret;
+}
+
 #ifdef CONFIG_NET_SCHED
 static int set_default_qdisc(struct ctl_table *table, int write,
 			     void __user *buffer, size_t *lenp, loff_t *ppos)
@@ -279,6 +292,15 @@ static struct ctl_table net_core_table[] = {
 		.mode		= 0644,
 		.proc_handler	= proc_dointvec
 	},
+	{
+		.procname	= "latency_hist",
+		.data		= &sysctl_net_lat_hist,
+		.maxlen		= sizeof(int),
+		.mode		= 0644,
+		.proc_handler	= net_lat_hist_sysctl,
+		.extra1		= &zero,
+		.extra2		= &one,
+	},
 	{
 		.procname	= "message_cost",
 		.data		= &net_ratelimit_state.interval,
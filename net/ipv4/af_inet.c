@@ -935,7 +935,7 @@ const struct proto_ops inet_stream_ops = {
 	.getsockopt	   = sock_common_getsockopt,
 	.sendmsg	   = inet_sendmsg,
 	.recvmsg	   = inet_recvmsg,
-	.mmap		   = sock_no_mmap,
+	.mmap		   = tcp_mmap,
 	.sendpage	   = inet_sendpage,
 	.splice_read	   = tcp_splice_read,
 #ifdef CONFIG_COMPAT
@@ -1247,6 +1247,7 @@ static struct sk_buff *inet_gso_segment(struct sk_buff *skb,
 		       SKB_GSO_UDP_TUNNEL |
 		       SKB_GSO_UDP_TUNNEL_CSUM |
 		       SKB_GSO_MPLS |
+		       SKB_GSO_UDP_L4 |
 		       0)))
 		goto out;
 
@@ -1283,6 +1284,10 @@ static struct sk_buff *inet_gso_segment(struct sk_buff *skb,
 	else
 		udpfrag = proto == IPPROTO_UDP && !skb->encapsulation;
 
+	/* UDP_SEGMENT produces whole datagrams, not IP fragments */
+	if (skb_shinfo(skb)->gso_type & SKB_GSO_UDP_L4)
+		udpfrag = false;
+
 	ops = rcu_dereference(inet_offloads[proto]);
 	if (likely(ops && ops->callbacks.gso_segment))
 		segs = ops->callbacks.gso_segment(skb, features);
@@ -287,6 +287,8 @@ static const struct snmp_mib snmp4_net_list[] = {
 	SNMP_MIB_ITEM("TCPWantZeroWindowAdv", LINUX_MIB_TCPWANTZEROWINDOWADV),
 	SNMP_MIB_ITEM("TCPSynRetrans", LINUX_MIB_TCPSYNRETRANS),
 	SNMP_MIB_ITEM("TCPOrigDataSent", LINUX_MIB_TCPORIGDATASENT),
+	SNMP_MIB_ITEM("TCPZeroCopyRxBytes", LINUX_MIB_TCPZEROCOPYRXBYTES),
+	SNMP_MIB_ITEM("TCPZeroCopyRxFallback", LINUX_MIB_TCPZEROCOPYRXFALLBACK),
 	SNMP_MIB_SENTINEL
 };
 
@@ -142,6 +142,120 @@ out_unlock:
 	return segs;
 }
 
+/* Cut a UDP_SEGMENT (or UDP GRO) packet into gso_size datagrams, each with
+ * its own UDP header.  Unlike UFO, the result are independent datagrams and
+ * not IP fragments.  The caller has pulled the network header, the UDP
+ * header is at skb->data and its check field holds the pseudo header sum.
+ */
+struct sk_buff *__udp_gso_segment(struct sk_buff *gso_skb,
+				  netdev_features_t features)
+{
+	struct sk_buff *segs, *seg;
+	unsigned int sum_truesize = 0;
+	struct udphdr *uh;
+	unsigned int mss;
+	bool copy_destructor;
+	__sum16 check;
+	__be16 newlen;
+
+	mss = skb_shinfo(gso_skb)->gso_size;
+	if (gso_skb->len <= sizeof(*uh) + mss)
+		return ERR_PTR(-EINVAL);
+
+	skb_pull(gso_skb, sizeof(*uh));
+
+	/* Keep the send buffer charged until the last segment is gone. */
+	copy_destructor = gso_skb->destructor == sock_wfree;
+
+	segs = skb_segment(gso_skb, features);
+	if (IS_ERR_OR_NULL(segs))
+		return segs;
+
+	seg = segs;
+	uh = udp_hdr(seg);
+
+	/* Adjust the pseudo header sum for the per-segment length. */
+	newlen = htons(sizeof(*uh) + mss);
+	check = csum16_add(csum16_sub(uh->check, uh->len), newlen);
+
+	for (;;) {
+		if (!seg->next)
+			break;
+
+		if (copy_destructor) {
+			seg->destructor = gso_skb->destructor;
+			seg->sk = gso_skb->sk;
+			sum_truesize += seg->truesize;
+		}
+
+		uh->len = newlen;
+		uh->check = check;
+		if (seg->ip_summed != CHECKSUM_PARTIAL)
+			uh->check = gso_make_checksum(seg, ~check) ? :
+				    CSUM_MANGLED_0;
+
+		seg = seg->next;
+		uh = udp_hdr(seg);
+	}
+
+	/* The last segment may be shorter than gso_size. */
+	newlen = htons(skb_tail_pointer(seg) - skb_transport_header(seg) +
+		       seg->data_len);
+	check = csum16_add(csum16_sub(uh->check, uh->len), newlen);
+
+	uh->len = newlen;
+	uh->check = check;
+	if (seg->ip_summed != CHECKSUM_PARTIAL)
+		uh->check = gso_make_checksum(seg, ~check) ? : CSUM_MANGLED_0;
+
+	/* The last segment takes over the charge of gso_skb, so that freeing
+	 * gso_skb does not uncharge it a second time.
+	 */
+	if (copy_destructor) {
+		swap(gso_skb->sk, seg->sk);
+		swap(gso_skb->destructor, seg->destructor);
+		sum_truesize += seg->truesize;
+		atomic_add(sum_truesize - gso_skb->truesize,
+			   &seg->sk->sk_wmem_alloc);
+	}
+
+	return segs;
+}
+EXPORT_SYMBOL_GPL(__udp_gso_segment);
+
+static struct sk_buff *udp4_gso_segment(struct sk_buff *skb,
+					netdev_features_t features)
+{
+	struct udphdr *uh;
+
+	if (!pskb_may_pull(skb, sizeof(struct udphdr)))
+		return ERR_PTR(-EINVAL);
+
+	if (skb_gso_ok(skb, features | NETIF_F_GSO_ROBUST)) {
+		/* Packet is from an untrusted source, reset gso_segs. */
+		unsigned int mss = skb_shinfo(skb)->gso_size;
+
+		skb_shinfo(skb)->gso_segs = DIV_ROUND_UP(skb->len - sizeof(*uh),
+							 mss);
+		return NULL;
+	}
+
+	/* Received GRO packets being forwarded may not have a pseudo header
+	 * checksum set up yet.
+	 */
+	uh = udp_hdr(skb);
+	if (unlikely(skb->ip_summed != CHECKSUM_PARTIAL)) {
+		const struct iphdr *iph = ip_hdr(skb);
+
+		uh->check = ~udp_v4_check(skb->len, iph->saddr, iph->daddr, 0);
+		skb->ip_summed = CHECKSUM_PARTIAL;
+		skb->csum_start = skb_transport_header(skb) - skb->head;
+		skb->csum_offset = offsetof(struct udphdr, check);
+	}
+
+	return __udp_gso_segment(skb, features);
+}
+
 static struct sk_buff *udp4_ufo_fragment(struct sk_buff *skb,
 					 netdev_features_t features)
 {
@@ -158,6 +272,9 @@ static struct sk_buff *udp4_ufo_fragment(struct sk_buff *skb,
 		goto out;
 	}
 
+	if (skb_shinfo(skb)->gso_type & SKB_GSO_UDP_L4)
+		return udp4_gso_segment(skb, features);
+
 	if (!pskb_may_pull(skb, sizeof(struct udphdr)))
 		goto out;
 
@@ -315,6 +432,85 @@ out:
 	return pp;
 }
 
+/* Enabled once any socket asks for UDP_GRO, so that plain UDP traffic does
+ * not pay for a socket lookup in the GRO path.
+ */
+static struct static_key udp_gro_needed __read_mostly;
+void udp_gro_enable(void)
+{
+	if (!static_key_enabled(&udp_gro_needed))
+		static_key_slow_inc(&udp_gro_needed);
+}
+EXPORT_SYMBOL_GPL(udp_gro_enable);
+
+/* Avoid building aggregates with an unbounded number of segments. */
+#define UDP_GRO_CNT_MAX 64
+
+static bool udp4_gro_sk_enabled(struct sk_buff *skb, struct udphdr *uh)
+{
+	const struct iphdr *iph = skb_gro_network_header(skb);
+	struct sock *sk;
+	bool ret;
+
+	sk = __udp4_lib_lookup(dev_net(skb->dev), iph->saddr, uh->source,
+			       iph->daddr, uh->dest, skb->dev->ifindex,
+			       &udp_table, NULL);
+	if (!sk)
+		return false;
+
+	ret = udp_sk(sk)->gro_enabled;
+	sock_put(sk);
+	return ret;
+}
+
+/* Coalesce datagrams of one flow towards a UDP_GRO socket.  All datagrams
+ * but the last must have the same length; the aggregate is then handed to
+ * the socket as one skb with gso_size set to that length.
+ */
+static struct sk_buff **udp_gro_receive_segment(struct sk_buff **head,
+						struct sk_buff *skb,
+						struct udphdr *uh)
+{
+	struct sk_buff *p, **pp = NULL;
+	unsigned int off = skb_gro_offset(skb);
+	struct udphdr *uh2;
+
+	/* Segmentation needs a checksum to fix up, see __udp_gso_segment() */
+	if (!uh->check) {
+		NAPI_GRO_CB(skb)->flush = 1;
+		return NULL;
+	}
+
+	skb_gro_pull(skb, sizeof(struct udphdr));
+	skb_gro_postpull_rcsum(skb, uh, sizeof(struct udphdr));
+
+	for (; (p = *head); head = &p->next) {
+		if (!NAPI_GRO_CB(p)->same_flow)
+			continue;
+
+		uh2 = (struct udphdr *)(p->data + off);
+
+		if (*(u32 *)&uh->source != *(u32 *)&uh2->source) {
+			NAPI_GRO_CB(p)->same_flow = 0;
+			continue;
+		}
+
+		/* Terminate the aggregate on a longer datagram, after a
+		 * shorter one, or when it has grown too much.
+		 */
+		if (NAPI_GRO_CB(p)->flush ||
+		    ntohs(uh->len) > ntohs(uh2->len) ||
+		    skb_gro_receive(head, skb) ||
+		    uh->len != uh2->len ||
+		    NAPI_GRO_CB(p)->count >= UDP_GRO_CNT_MAX)
+			pp = head;
+
+		return pp;
+	}
+
+	return NULL;
+}
+
 static struct sk_buff **udp4_gro_receive(struct sk_buff **head,
 					 struct sk_buff *skb)
 {
@@ -335,6 +531,14 @@ static struct sk_buff **udp4_gro_receive(struct sk_buff **head,
 					     inet_gro_compute_pseudo);
 skip:
 	NAPI_GRO_CB(skb)->is_ipv6 = 0;
+	/* Tunnel aggregates go through udp_gro_receive(), which sets
+	 * udp_mark; that is how udp4_gro_complete() tells them apart.
+	 */
+	if (static_key_false(&udp_gro_needed) &&
+	    !NAPI_GRO_CB(skb)->flush && !NAPI_GRO_CB(skb)->udp_mark &&
+	    udp4_gro_sk_enabled(skb, uh))
+		return udp_gro_receive_segment(head, skb, uh);
+
 	return udp_gro_receive(head, skb, uh);
 
 flush:
@@ -378,6 +582,18 @@ static int udp4_gro_complete(struct sk_buff *skb, int nhoff)
 		uh->check = ~udp_v4_check(skb->len - nhoff, iph->saddr,
 					  iph->daddr, 0);
 
+	if (!NAPI_GRO_CB(skb)->udp_mark) {
+		/* gso_size was set to the first datagram's payload length
+		 * when the aggregate was started.
+		 */
+		uh->len = htons(skb->len - nhoff);
+		skb_shinfo(skb)->gso_segs = NAPI_GRO_CB(skb)->count;
+		skb_shinfo(skb)->gso_type |= SKB_GSO_UDP_L4;
+		/* Every datagram was verified in udp4_gro_receive() */
+		skb->ip_summed = CHECKSUM_UNNECESSARY;
+		return 0;
+	}
+
 	return udp_gro_complete(skb, nhoff);
 }
 
@@ -175,6 +175,82 @@ static ssize_t queues_read(struct file *file, char __user *user_buf,
 	return simple_read_from_buffer(user_buf, count, ppos, buf, res);
 }
 
+static ssize_t aqm_read(struct file *file, char __user *user_buf,
+			size_t count, loff_t *ppos)
+{
+	struct ieee80211_local *local = file->private_data;
+	char buf[400];
+	int len;
+
+	spin_lock_bh(&local->fq_lock);
+	len = scnprintf(buf, sizeof(buf),
+			"access name value\n"
+			"R fq_flows_cnt %u\n"
+			"R fq_backlog %u\n"
+			"R fq_overlimit %u\n"
+			"R fq_collisions %u\n"
+			"RW fq_limit %u\n"
+			"RW fq_quantum %u\n"
+			"RW codel_target_us %u\n"
+			"RW codel_interval_us %u\n",
+			IEEE80211_TXQ_FLOWS,
+			local->fq_backlog,
+			local->fq_overlimit,
+			local->fq_collisions,
+			local->fq_limit,
+			local->fq_quantum,
+			local->codel_target / NSEC_PER_USEC,
+			local->codel_interval / NSEC_PER_USEC);
+	spin_unlock_bh(&local->fq_lock);
+
+	return simple_read_from_buffer(user_buf, count, ppos, buf, len);
+}
+
+static ssize_t aqm_write(struct file *file, const char __user *user_buf,
+			 size_t count, loff_t *ppos)
+{
+	struct ieee80211_local *local = file->private_data;
+	char buf[100];
+	size_t len;
+	u32 val;
+	int ret = 0;
+
+	if (count >= sizeof(buf))
+		return -EINVAL;
+
+	if (copy_from_user(buf, user_buf, count))
+		return -EFAULT;
+
+	buf[count] = '\0';
+	len = strlen(buf);
+	if (len > 0 && buf[len - 1] == '\n')
+		buf[len - 1] = '\0';
+
+	spin_lock_bh(&local->fq_lock);
+	if (sscanf(buf, "fq_limit %u", &val) == 1 && val)
+		local->fq_limit = val;
+	else if (sscanf(buf, "fq_quantum %u", &val) == 1 && val)
+		local->fq_quantum = val;
+	else if (sscanf(buf, "codel_target_us %u", &val) == 1 &&
+		 val && val <= USEC_PER_SEC)
+		local->codel_target = val * NSEC_PER_USEC;
+	else if (sscanf(buf, "codel_interval_us %u", &val) == 1 &&
+		 val && val <= USEC_PER_SEC)
+		local->codel_interval = val * NSEC_PER_USEC;
+	else
+		ret = -EINVAL;
+	spin_unlock_bh(&local->fq_lock);
+
+	return ret ? ret : count;
+}
+
+static const struct file_operations aqm_ops = {
+	.read = aqm_read,
+	.write = aqm_write,
+	.open = simple_open,
+	.llseek = default_llseek,
+};
+
 DEBUGFS_READONLY_FILE_OPS(hwflags);
 DEBUGFS_READONLY_FILE_OPS(queues);
 
@@ -252,6 +328,12 @@ void debugfs_hw_add(struct ieee80211_local *local)
 	DEBUGFS_ADD(user_power);
 	DEBUGFS_ADD(power);
 
+	if (local->ops->wake_tx_queue) {
+		DEBUGFS_ADD_MODE(aqm, 0600);
+		debugfs_create_u32("airtime_flags", 0600, phyd,
+				   &local->airtime_flags);
+	}
+
 	statsd = debugfs_create_dir("statistics", phyd);
 
 	/* if the dir failed, don't put all the other things into the root! */
@@ -110,6 +110,114 @@ static ssize_t sta_last_seq_ctrl_read(struct file *file, char __user *userbuf,
 }
 STA_OPS(last_seq_ctrl);
 
+static ssize_t sta_aqm_read(struct file *file, char __user *userbuf,
+			    size_t count, loff_t *ppos)
+{
+	struct sta_info *sta = file->private_data;
+	struct ieee80211_local *local = sta->local;
+	size_t bufsz = 100 + IEEE80211_NUM_TIDS * 90;
+	char *buf = kzalloc(bufsz, GFP_KERNEL), *p = buf;
+	ssize_t rv;
+	int i;
+
+	if (!buf)
+		return -ENOMEM;
+
+	p += scnprintf(p, bufsz + buf - p,
+		       "tid ac backlog-bytes backlog-packets flows drops "
+		       "overlimit collisions tx-bytes tx-packets\n");
+
+	spin_lock_bh(&local->fq_lock);
+	for (i = 0; i < IEEE80211_NUM_TIDS; i++) {
+		struct txq_info *txqi = to_txq_info(sta->sta.txq[i]);
+
+		p += scnprintf(p, bufsz + buf - p,
+			       "%d %d %u %u %u %u %u %u %llu %u\n",
+			       i, txqi->txq.ac,
+			       txqi->backlog_bytes,
+			       txqi->backlog_packets,
+			       txqi->flows,
+			       txqi->drops,
+			       txqi->overlimit,
+			       txqi->collisions,
+			       txqi->tx_bytes,
+			       txqi->tx_packets);
+	}
+	spin_unlock_bh(&local->fq_lock);
+
+	rv = simple_read_from_buffer(userbuf, count, ppos, buf, p - buf);
+	kfree(buf);
+	return rv;
+}
+STA_OPS(aqm);
+
+static ssize_t sta_airtime_read(struct file *file, char __user *userbuf,
+				size_t count, loff_t *ppos)
+{
+	struct sta_info *sta = file->private_data;
+	struct ieee80211_local *local = sta->local;
+	char buf[100 + IEEE80211_NUM_ACS * 70], *p = buf;
+	int ac;
+
+	p += scnprintf(p, sizeof(buf) + buf - p,
+		       "weight: %u\nAC RX-airtime TX-airtime deficit\n",
+		       sta->airtime_weight);
+
+	spin_lock_bh(&local->active_txq_lock);
+	for (ac = 0; ac < IEEE80211_NUM_ACS; ac++)
+		p += scnprintf(p, sizeof(buf) + buf - p, "%d %llu %llu %lld\n",
+			       ac, sta->airtime[ac].rx_airtime,
+			       sta->airtime[ac].tx_airtime,
+			       sta->airtime[ac].deficit);
+	spin_unlock_bh(&local->active_txq_lock);
+
+	return simple_read_from_buffer(userbuf, count, ppos, buf, p - buf);
+}
+
+static ssize_t sta_airtime_write(struct file *file, const char __user *userbuf,
+				 size_t count, loff_t *ppos)
+{
+	struct sta_info *sta = file->private_data;
+	struct ieee80211_local *local = sta->local;
+	int ac;
+
+	/* any write resets the counters */
+	spin_lock_bh(&local->active_txq_lock);
+	for (ac = 0; ac < IEEE80211_NUM_ACS; ac++) {
+		sta->airtime[ac].rx_airtime = 0;
+		sta->airtime[ac].tx_airtime = 0;
+		sta->airtime[ac].deficit = sta->airtime_weight;
+	}
+	spin_unlock_bh(&local->active_txq_lock);
+
+	return count;
+}
+STA_OPS_RW(airtime);
+
+STA_READ(airtime_weight, airtime_weight, "%u\n");
+
+static ssize_t sta_airtime_weight_write(struct file *file,
+					const char __user *userbuf,
+					size_t count, loff_t *ppos)
+{
+	struct sta_info *sta = file->private_data;
+	u16 weight;
+	int ret;
+
+	ret = kstrtou16_from_user(userbuf, count, 0, &weight);
+	if (ret)
+		return ret;
+
+	/* a zero quantum would never pay back the station's deficit */
+	if (!weight)
+		return -EINVAL;
+
+	sta->airtime_weight = weight;
+
+	return count;
+}
+STA_OPS_RW(airtime_weight);
+
 static ssize_t sta_agg_status_read(struct file *file, char __user *userbuf,
 					size_t count, loff_t *ppos)
 {
@@ -372,6 +480,14 @@ void ieee80211_sta_debugfs_add(struct sta_info *sta)
 	DEBUGFS_ADD_COUNTER(rx_fragments, rx_fragments);
 	DEBUGFS_ADD_COUNTER(tx_filtered, tx_filtered_count);
 
+	if (sta->sta.txq[0]) {
+		DEBUGFS_ADD(aqm);
+		debugfs_create_file("airtime", 0600, sta->debugfs.dir, sta,
+				    &sta_airtime_ops);
+		debugfs_create_file("airtime_weight", 0600, sta->debugfs.dir,
+				    sta, &sta_airtime_weight_ops);
+	}
+
 	if (sizeof(sta->driver_buffered_tids) == sizeof(u32))
 		debugfs_create_x32("driver_buffered_tids", 0400,
 				   sta->debugfs.dir,
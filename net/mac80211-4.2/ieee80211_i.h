@@ -806,10 +806,103 @@ struct mac80211_qos_map {
 enum txq_info_flags {
 	IEEE80211_TXQ_STOP,
 	IEEE80211_TXQ_AMPDU,
+	IEEE80211_TXQ_AIRTIME_DEFER,
 };
 
-struct txq_info {
+/* number of hashed flow queues shared by all txqs of a device */
+#define IEEE80211_TXQ_FLOWS		1024
+#define IEEE80211_TXQ_DEFAULT_LIMIT	8192
+#define IEEE80211_TXQ_DEFAULT_QUANTUM	300
+
+/* the default CoDel parameters are relaxed compared to wired links,
+ * since aggregation and contention add latency on their own
+ */
+#define IEEE80211_CODEL_TARGET		(20 * NSEC_PER_MSEC)
+#define IEEE80211_CODEL_INTERVAL	(100 * NSEC_PER_MSEC)
+
+/* local->airtime_flags: which airtime is charged to the stations */
+#define AIRTIME_USE_TX		BIT(0)
+#define AIRTIME_USE_RX		BIT(1)
+
+/**
+ * struct txq_codel_vars - CoDel state of a flow queue
+ *
+ * @count: number of drops since the last time the flow entered
+ *	the dropping state
+ * @lastcount: @count when the flow last entered the dropping state
+ * @dropping: the flow is in the dropping state
+ * @rec_inv_sqrt: reciprocal value of sqrt(@count) >> 16
+ * @first_above_time: time (in ns) the sojourn time will have been above
+ *	target for an interval, 0 while it's below target
+ * @drop_next: time (in ns) of the next drop while dropping
+ */
+struct txq_codel_vars {
+	u32 count;
+	u32 lastcount;
+	bool dropping;
+	u16 rec_inv_sqrt;
+	u64 first_above_time;
+	u64 drop_next;
+};
+
+/**
+ * struct txq_flow - flow queue of an intermediate tx queue
+ *
+ * Frames are hashed into the flow queues of the device, which are owned
+ * by a txq while they have frames or are on one of its flow lists. A
+ * frame whose flow is owned by another txq goes to the default flow of
+ * its own txq instead.
+ *
+ * @queue: frames of the flow, only used with local->fq_lock held
+ * @flowchain: entry in the new_flows or old_flows list of the owner
+ * @txqi: txq owning the flow, %NULL if the flow is idle
+ * @deficit: DRR byte deficit among the flows of the owner
+ * @backlog: bytes queued on the flow
+ * @cvars: CoDel state of the flow
+ */
+struct txq_flow {
 	struct sk_buff_head queue;
+	struct list_head flowchain;
+	struct txq_info *txqi;
+	int deficit;
+	u32 backlog;
+	struct txq_codel_vars cvars;
+};
+
+/**
+ * struct txq_info - intermediate tx queue
+ *
+ * All fields but @flags and @txq are protected by local->fq_lock,
+ * except @schedule_order which belongs to local->active_txq_lock.
+ *
+ * @def_flow: flow queue for frames whose hashed flow is taken
+ * @new_flows: flows that recently became active, served first
+ * @old_flows: flows that have used up their first quantum
+ * @schedule_order: entry in local->active_txqs while frames are queued
+ * @backlog_bytes: bytes queued on all flows of the txq
+ * @backlog_packets: frames queued on all flows of the txq
+ * @flows: number of flows that became active on the txq
+ * @drops: frames dropped by CoDel
+ * @overlimit: frames dropped because the device queue limit was hit
+ * @collisions: frames that went to @def_flow because of a hash collision
+ * @tx_bytes: bytes dequeued by the driver
+ * @tx_packets: frames dequeued by the driver
+ * @flags: &enum txq_info_flags
+ * @txq: driver visible part
+ */
+struct txq_info {
+	struct txq_flow def_flow;
+	struct list_head new_flows;
+	struct list_head old_flows;
+	struct list_head schedule_order;
+	u32 backlog_bytes;
+	u32 backlog_packets;
+	u32 flows;
+	u32 drops;
+	u32 overlimit;
+	u32 collisions;
+	u64 tx_bytes;
+	u32 tx_packets;
 	unsigned long flags;
 
 	/* keep last! */
@@ -1200,6 +1293,32 @@ struct ieee80211_local {
 	struct sk_buff_head pending[IEEE80211_MAX_QUEUES];
 	struct tasklet_struct tx_pending_tasklet;
 
+	/*
+	 * Flow queues of the intermediate tx queues, only used if the
+	 * driver implements wake_tx_queue. All txqs share one table and
+	 * one lock; the limit applies to all of them together.
+	 */
+	spinlock_t fq_lock;
+	struct txq_flow *fq_flows;
+	u32 fq_perturbation;
+	u32 fq_backlog;
+	u32 fq_limit;
+	u32 fq_quantum;
+	u32 fq_overlimit;
+	u32 fq_collisions;
+	u32 codel_target;
+	u32 codel_interval;
+
+	/*
+	 * Airtime fairness: stations with frames on their txqs, per AC,
+	 * in deficit round robin order. Protected by active_txq_lock,
+	 * which also covers the airtime accounting of the stations.
+	 */
+	spinlock_t active_txq_lock;
+	struct list_head active_txqs[IEEE80211_NUM_ACS];
+	struct tasklet_struct wake_txqs_tasklet;
+	u32 airtime_flags;
+
 	atomic_t agg_queue_stop[IEEE80211_MAX_QUEUES];
 
 	/* number of interfaces with allmulti RX */
@@ -1922,6 +2041,11 @@ static inline bool ieee80211_can_run_worker(struct ieee80211_local *local)
 void ieee80211_init_tx_queue(struct ieee80211_sub_if_data *sdata,
 			     struct sta_info *sta,
 			     struct txq_info *txq, int tid);
+int ieee80211_txq_setup_flows(struct ieee80211_local *local);
+void ieee80211_txq_teardown_flows(struct ieee80211_local *local);
+void ieee80211_txq_purge(struct ieee80211_local *local,
+			 struct txq_info *txqi);
+void ieee80211_wake_txqs(unsigned long data);
 void ieee80211_send_auth(struct ieee80211_sub_if_data *sdata,
 			 u16 transaction, u16 auth_alg, u16 status,
 			 const u8 *extra, size_t extra_len, const u8 *bssid,
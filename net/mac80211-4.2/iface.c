@@ -974,7 +974,7 @@ static void ieee80211_do_stop(struct ieee80211_sub_if_data *sdata,
 	if (sdata->vif.txq) {
 		struct txq_info *txqi = to_txq_info(sdata->vif.txq);
 
-		ieee80211_purge_tx_queue(&local->hw, &txqi->queue);
+		ieee80211_txq_purge(local, txqi);
 		atomic_set(&sdata->txqs_len[txqi->txq.ac], 0);
 	}
 
@@ -639,6 +639,9 @@ struct ieee80211_hw *ieee80211_alloc_hw_nm(size_t priv_data_len,
 	tasklet_init(&local->tx_pending_tasklet, ieee80211_tx_pending,
 		     (unsigned long)local);
 
+	if (ieee80211_txq_setup_flows(local))
+		goto err_sta;
+
 	tasklet_init(&local->tasklet,
 		     ieee80211_tasklet_handler,
 		     (unsigned long) local);
@@ -651,6 +654,8 @@ struct ieee80211_hw *ieee80211_alloc_hw_nm(size_t priv_data_len,
 	ieee80211_roc_setup(local);
 
 	return &local->hw;
+ err_sta:
+	sta_info_stop(local);
  err_free:
 	wiphy_free(wiphy);
 	return NULL;
@@ -1149,6 +1154,7 @@ void ieee80211_unregister_hw(struct ieee80211_hw *hw)
 	struct ieee80211_local *local = hw_to_local(hw);
 
 	tasklet_kill(&local->tx_pending_tasklet);
+	tasklet_kill(&local->wake_txqs_tasklet);
 	tasklet_kill(&local->tasklet);
 
 	pm_qos_remove_notifier(PM_QOS_NETWORK_LATENCY,
@@ -1215,6 +1221,8 @@ void ieee80211_free_hw(struct ieee80211_hw *hw)
 
 	sta_info_stop(local);
 
+	ieee80211_txq_teardown_flows(local);
+
 	ieee80211_free_led_names(local);
 
 	wiphy_free(local->hw.wiphy);
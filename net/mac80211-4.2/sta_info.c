@@ -111,10 +111,8 @@ static void __cleanup_single_sta(struct sta_info *sta)
 	if (sta->sta.txq[0]) {
 		for (i = 0; i < ARRAY_SIZE(sta->sta.txq); i++) {
 			struct txq_info *txqi = to_txq_info(sta->sta.txq[i]);
-			int n = skb_queue_len(&txqi->queue);
 
-			ieee80211_purge_tx_queue(&local->hw, &txqi->queue);
-			atomic_sub(n, &sdata->txqs_len[txqi->txq.ac]);
+			ieee80211_txq_purge(local, txqi);
 		}
 	}
 
@@ -380,6 +378,8 @@ struct sta_info *sta_info_alloc(struct ieee80211_sub_if_data *sdata,
 	for (i = 0; i < IEEE80211_NUM_TIDS; i++)
 		sta->last_seq_ctrl[i] = cpu_to_le16(USHRT_MAX);
 
+	sta->airtime_weight = IEEE80211_DEFAULT_AIRTIME_WEIGHT;
+
 	sta->sta.smps_mode = IEEE80211_SMPS_OFF;
 	if (sdata->vif.type == NL80211_IFTYPE_AP ||
 	    sdata->vif.type == NL80211_IFTYPE_AP_VLAN) {
@@ -1164,7 +1164,7 @@ void ieee80211_sta_ps_deliver_wakeup(struct sta_info *sta)
 		for (i = 0; i < ARRAY_SIZE(sta->sta.txq); i++) {
 			struct txq_info *txqi = to_txq_info(sta->sta.txq[i]);
 
-			if (!skb_queue_len(&txqi->queue))
+			if (!txqi->backlog_packets)
 				continue;
 
 			drv_wake_tx_queue(local, txqi);
@@ -1560,7 +1560,7 @@ ieee80211_sta_ps_deliver_response(struct sta_info *sta,
 		for (tid = 0; tid < ARRAY_SIZE(sta->sta.txq); tid++) {
 			struct txq_info *txqi = to_txq_info(sta->sta.txq[tid]);
 
-			if (!(tids & BIT(tid)) || skb_queue_len(&txqi->queue))
+			if (!(tids & BIT(tid)) || txqi->backlog_packets)
 				continue;
 
 			sta_info_recalc_tim(sta);
@@ -2022,3 +2022,80 @@ void sta_set_sinfo(struct sta_info *sta, struct station_info *sinfo)
 		sinfo->expected_throughput = thr;
 	}
 }
+
+void ieee80211_sta_register_airtime(struct sta_info *sta, u8 ac,
+				    u32 tx_airtime, u32 rx_airtime)
+{
+	struct ieee80211_local *local = sta->local;
+	u32 airtime = 0;
+
+	if (local->airtime_flags & AIRTIME_USE_TX)
+		airtime += tx_airtime;
+	if (local->airtime_flags & AIRTIME_USE_RX)
+		airtime += rx_airtime;
+
+	spin_lock_bh(&local->active_txq_lock);
+	sta->airtime[ac].tx_airtime += tx_airtime;
+	sta->airtime[ac].rx_airtime += rx_airtime;
+	sta->airtime[ac].deficit -= airtime;
+	spin_unlock_bh(&local->active_txq_lock);
+}
+
+/* time on air of @len bytes at the given rate, in usec */
+static u32 ieee80211_rate_airtime(struct rate_info *rinfo, int len)
+{
+	/* in units of 100 kbit/s */
+	u32 rate = cfg80211_calculate_bitrate(rinfo);
+
+	if (!rate)
+		return 0;
+
+	return DIV_ROUND_UP(len * 80, rate);
+}
+
+/*
+ * The airtime of a transmitted frame is estimated from the rates and
+ * attempts in its tx status. This leaves out preambles and protection,
+ * but it's what the stations are weighed against each other with, so
+ * only the relation between them matters.
+ */
+void ieee80211_sta_tx_airtime(struct sta_info *sta, struct sk_buff *skb,
+			      int tid)
+{
+	struct ieee80211_tx_info *info = IEEE80211_SKB_CB(skb);
+	struct rate_info rinfo;
+	u32 airtime = 0;
+	int i;
+
+	/* only stations on intermediate queues are scheduled by airtime */
+	if (!sta->sta.txq[0])
+		return;
+
+	for (i = 0; i < IEEE80211_TX_MAX_RATES; i++) {
+		struct ieee80211_tx_rate *rate = &info->status.rates[i];
+
+		if (rate->idx < 0 || !rate->count)
+			break;
+
+		sta_set_rate_info_tx(sta, rate, &rinfo);
+		airtime += rate->count *
+			   ieee80211_rate_airtime(&rinfo, skb->len);
+	}
+
+	ieee80211_sta_register_airtime(sta, ieee80211_ac_from_tid(tid),
+				       airtime, 0);
+}
+
+void ieee80211_sta_rx_airtime(struct sta_info *sta, struct sk_buff *skb,
+			      int tid)
+{
+	struct rate_info rinfo;
+
+	if (!sta->sta.txq[0])
+		return;
+
+	sta_set_rate_info_rx(sta, &rinfo);
+	ieee80211_sta_register_airtime(sta, ieee80211_ac_from_tid(tid), 0,
+				       ieee80211_rate_airtime(&rinfo,
+							      skb->len));
+}
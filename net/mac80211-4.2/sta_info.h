@@ -243,6 +243,23 @@ struct sta_ampdu_mlme {
 /* Value to indicate no TID reservation */
 #define IEEE80211_TID_UNRESERVED	0xff
 
+/* default airtime quantum of a station, in usec */
+#define IEEE80211_DEFAULT_AIRTIME_WEIGHT	256
+
+/**
+ * struct airtime_info - per-AC airtime accounting of a station
+ *
+ * @rx_airtime: estimated airtime used receiving from the station, in usec
+ * @tx_airtime: estimated airtime used transmitting to the station, in usec
+ * @deficit: airtime the station may still use in the current round of
+ *	the scheduler, in usec; the station is skipped while it's negative
+ */
+struct airtime_info {
+	u64 rx_airtime;
+	u64 tx_airtime;
+	s64 deficit;
+};
+
 #define IEEE80211_FAST_XMIT_MAX_IV	18
 
 /**
@@ -407,6 +424,9 @@ struct mesh_sta {
  * @rx_msdu: MSDUs received from this station, using IEEE80211_NUM_TID
  *	entry for non-QoS frames
  * @fast_tx: TX fastpath information
+ * @airtime: per-AC airtime accounting, protected by local->active_txq_lock
+ * @airtime_weight: airtime quantum added to the deficit each scheduler
+ *	round, in usec
  */
 struct sta_info {
 	/* General information, mostly static */
@@ -488,6 +508,9 @@ struct sta_info {
 	u64 tx_msdu_failed[IEEE80211_NUM_TIDS + 1];
 	u64 rx_msdu[IEEE80211_NUM_TIDS + 1];
 
+	struct airtime_info airtime[IEEE80211_NUM_ACS];
+	u16 airtime_weight;
+
 	/*
 	 * Aggregation information, locked with lock.
 	 */
@@ -684,6 +707,13 @@ void sta_set_rate_info_rx(struct sta_info *sta,
 			  struct rate_info *rinfo);
 void sta_set_sinfo(struct sta_info *sta, struct station_info *sinfo);
 
+void ieee80211_sta_register_airtime(struct sta_info *sta, u8 ac,
+				    u32 tx_airtime, u32 rx_airtime);
+void ieee80211_sta_tx_airtime(struct sta_info *sta, struct sk_buff *skb,
+			      int tid);
+void ieee80211_sta_rx_airtime(struct sta_info *sta, struct sk_buff *skb,
+			      int tid);
+
 void ieee80211_sta_expire(struct ieee80211_sub_if_data *sdata,
 			  unsigned long exp_time);
 u8 sta_info_tx_streams(struct sta_info *sta);
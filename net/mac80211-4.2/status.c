@@ -786,6 +786,7 @@ void ieee80211_tx_status(struct ieee80211_hw *hw, struct sk_buff *skb)
 				if (!acked)
 					sta->tx_msdu_failed[tid]++;
 				sta->tx_msdu_retries[tid] += retry_count;
+				ieee80211_sta_tx_airtime(sta, skb, tid);
 			}
 		}
 
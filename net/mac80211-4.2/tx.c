@@ -19,6 +19,8 @@
 #include <linux/etherdevice.h>
 #include <linux/bitmap.h>
 #include <linux/rcupdate.h>
+#include <linux/jhash.h>
+#include <linux/random.h>
 #include <linux/export.h>
 #include <net/net_namespace.h>
 #include <net/ieee80211_radiotap.h>
@@ -1226,6 +1228,545 @@ ieee80211_tx_prepare(struct ieee80211_sub_if_data *sdata,
 	return TX_CONTINUE;
 }
 
+/*
+ * Intermediate tx queues
+ *
+ * The frames of a txq are spread over flow queues by their flow hash and
+ * the flows are served in deficit round robin order, new flows first, as
+ * in fq_codel. Every flow runs CoDel against its own sojourn time, so a
+ * bulk flow can't build up latency for the others.
+ *
+ * Across stations, the txqs of each AC are scheduled by airtime: each
+ * station is charged for the estimated airtime of the frames it sends
+ * and receives, and a station that used up its quantum is deferred
+ * until the others had their turn, see ieee80211_txq_may_transmit().
+ */
+
+int ieee80211_txq_setup_flows(struct ieee80211_local *local)
+{
+	int i;
+
+	spin_lock_init(&local->fq_lock);
+	spin_lock_init(&local->active_txq_lock);
+	for (i = 0; i < IEEE80211_NUM_ACS; i++)
+		INIT_LIST_HEAD(&local->active_txqs[i]);
+	tasklet_init(&local->wake_txqs_tasklet, ieee80211_wake_txqs,
+		     (unsigned long)local);
+
+	local->fq_limit = IEEE80211_TXQ_DEFAULT_LIMIT;
+	local->fq_quantum = IEEE80211_TXQ_DEFAULT_QUANTUM;
+	local->codel_target = IEEE80211_CODEL_TARGET;
+	local->codel_interval = IEEE80211_CODEL_INTERVAL;
+	local->airtime_flags = AIRTIME_USE_TX | AIRTIME_USE_RX;
+	get_random_bytes(&local->fq_perturbation,
+			 sizeof(local->fq_perturbation));
+
+	if (!local->ops->wake_tx_queue)
+		return 0;
+
+	local->fq_flows = kcalloc(IEEE80211_TXQ_FLOWS,
+				  sizeof(*local->fq_flows), GFP_KERNEL);
+	if (!local->fq_flows)
+		return -ENOMEM;
+
+	for (i = 0; i < IEEE80211_TXQ_FLOWS; i++) {
+		__skb_queue_head_init(&local->fq_flows[i].queue);
+		INIT_LIST_HEAD(&local->fq_flows[i].flowchain);
+	}
+
+	return 0;
+}
+
+void ieee80211_txq_teardown_flows(struct ieee80211_local *local)
+{
+	tasklet_kill(&local->wake_txqs_tasklet);
+	kfree(local->fq_flows);
+	local->fq_flows = NULL;
+}
+
+static void ieee80211_txq_schedule(struct ieee80211_local *local,
+				   struct txq_info *txqi)
+{
+	if (!txqi->txq.sta)
+		return;
+
+	spin_lock_bh(&local->active_txq_lock);
+	if (list_empty(&txqi->schedule_order))
+		list_add_tail(&txqi->schedule_order,
+			      &local->active_txqs[txqi->txq.ac]);
+	spin_unlock_bh(&local->active_txq_lock);
+}
+
+/*
+ * Move a txq to the back of its AC's round. This is the only place a
+ * station earns airtime: it gets a quantum each time one of its txqs
+ * is rotated while it is in debt. Returns whether it may transmit.
+ * Called with active_txq_lock held.
+ */
+static bool ieee80211_txq_airtime_rotate(struct ieee80211_local *local,
+					 struct txq_info *txqi)
+{
+	struct sta_info *sta = container_of(txqi->txq.sta, struct sta_info,
+					    sta);
+	u8 ac = txqi->txq.ac;
+
+	if (sta->airtime[ac].deficit < 0)
+		sta->airtime[ac].deficit += sta->airtime_weight;
+	list_move_tail(&txqi->schedule_order, &local->active_txqs[ac]);
+
+	return sta->airtime[ac].deficit >= 0;
+}
+
+/*
+ * Every txq of the AC is deferred or stopped, so nobody transmits to
+ * end the round: hand out quanta in list order until one station is
+ * back in credit. Called with active_txq_lock held.
+ */
+static bool ieee80211_txq_airtime_next_round(struct ieee80211_local *local,
+					     u8 ac)
+{
+	struct txq_info *txqi;
+	struct sta_info *sta;
+
+	list_for_each_entry(txqi, &local->active_txqs[ac], schedule_order)
+		if (!test_bit(IEEE80211_TXQ_AIRTIME_DEFER, &txqi->flags) &&
+		    !test_bit(IEEE80211_TXQ_STOP, &txqi->flags))
+			return false;
+
+	for (;;) {
+		txqi = list_first_entry(&local->active_txqs[ac],
+					struct txq_info, schedule_order);
+		sta = container_of(txqi->txq.sta, struct sta_info, sta);
+		if (sta->airtime[ac].deficit >= 0)
+			return true;
+		ieee80211_txq_airtime_rotate(local, txqi);
+	}
+}
+
+/*
+ * Take a txq out of the round. If that leaves only deferred txqs on the
+ * AC, the round is over and the next one has to be started here, as
+ * none of them will call ieee80211_txq_may_transmit() by itself.
+ */
+static void ieee80211_txq_unschedule(struct ieee80211_local *local,
+				     struct txq_info *txqi)
+{
+	u8 ac = txqi->txq.ac;
+	bool wake = false;
+
+	spin_lock_bh(&local->active_txq_lock);
+	list_del_init(&txqi->schedule_order);
+	clear_bit(IEEE80211_TXQ_AIRTIME_DEFER, &txqi->flags);
+	if (!list_empty(&local->active_txqs[ac]))
+		wake = ieee80211_txq_airtime_next_round(local, ac);
+	spin_unlock_bh(&local->active_txq_lock);
+
+	if (wake)
+		tasklet_schedule(&local->wake_txqs_tasklet);
+}
+
+/*
+ * Deficit round robin by airtime between the stations that have frames
+ * queued on an AC. A station in credit may transmit; the txqs ahead of
+ * it in the round had their turn, so they go to the back. A station out
+ * of airtime is rotated and deferred. The wake_txqs tasklet has the
+ * driver pull from a deferred txq again once its station is back in
+ * credit.
+ */
+static bool ieee80211_txq_may_transmit(struct ieee80211_local *local,
+				       struct txq_info *txqi)
+{
+	struct txq_info *iter, *tmp;
+	struct sta_info *sta;
+	u8 ac = txqi->txq.ac;
+	bool wake = false;
+	bool ret = true;
+
+	if (!txqi->txq.sta || !local->airtime_flags)
+		return true;
+
+	spin_lock_bh(&local->active_txq_lock);
+
+	if (list_empty(&txqi->schedule_order))
+		goto out;
+
+	sta = container_of(txqi->txq.sta, struct sta_info, sta);
+	if (sta->airtime[ac].deficit >= 0) {
+		list_for_each_entry_safe(iter, tmp, &local->active_txqs[ac],
+					 schedule_order) {
+			if (iter == txqi)
+				break;
+			if (ieee80211_txq_airtime_rotate(local, iter) &&
+			    test_bit(IEEE80211_TXQ_AIRTIME_DEFER, &iter->flags))
+				wake = true;
+		}
+		goto out;
+	}
+
+	/* nobody to give way to */
+	if (list_is_singular(&local->active_txqs[ac])) {
+		while (!ieee80211_txq_airtime_rotate(local, txqi))
+			;
+		goto out;
+	}
+
+	ieee80211_txq_airtime_rotate(local, txqi);
+	set_bit(IEEE80211_TXQ_AIRTIME_DEFER, &txqi->flags);
+	wake = ieee80211_txq_airtime_next_round(local, ac);
+	ret = false;
+out:
+	spin_unlock_bh(&local->active_txq_lock);
+
+	if (wake)
+		tasklet_schedule(&local->wake_txqs_tasklet);
+
+	return ret;
+}
+
+void ieee80211_wake_txqs(unsigned long data)
+{
+	struct ieee80211_local *local = (struct ieee80211_local *)data;
+	struct sta_info *sta;
+	bool wake;
+	int i;
+
+	rcu_read_lock();
+	list_for_each_entry_rcu(sta, &local->sta_list, list) {
+		if (!sta->sta.txq[0])
+			continue;
+
+		for (i = 0; i < ARRAY_SIZE(sta->sta.txq); i++) {
+			struct txq_info *txqi = to_txq_info(sta->sta.txq[i]);
+
+			/* still in debt: wait for the next rotation */
+			spin_lock_bh(&local->active_txq_lock);
+			wake = test_bit(IEEE80211_TXQ_AIRTIME_DEFER,
+					&txqi->flags) &&
+			       sta->airtime[txqi->txq.ac].deficit >= 0;
+			if (wake)
+				clear_bit(IEEE80211_TXQ_AIRTIME_DEFER,
+					  &txqi->flags);
+			spin_unlock_bh(&local->active_txq_lock);
+
+			if (wake)
+				drv_wake_tx_queue(local, txqi);
+		}
+	}
+	rcu_read_unlock();
+}
+
+static struct sk_buff *ieee80211_txq_flow_pop(struct ieee80211_local *local,
+					      struct txq_flow *flow)
+{
+	struct txq_info *txqi = flow->txqi;
+	struct sk_buff *skb;
+
+	skb = __skb_dequeue(&flow->queue);
+	if (!skb)
+		return NULL;
+
+	flow->backlog -= skb->len;
+	txqi->backlog_bytes -= skb->len;
+	txqi->backlog_packets--;
+	local->fq_backlog--;
+
+	return skb;
+}
+
+static void ieee80211_txq_drop(struct ieee80211_local *local,
+			       struct txq_info *txqi, struct sk_buff *skb)
+{
+	struct ieee80211_sub_if_data *sdata = vif_to_sdata(txqi->txq.vif);
+
+	atomic_dec(&sdata->txqs_len[txqi->txq.ac]);
+	ieee80211_free_txskb(&local->hw, skb);
+}
+
+static struct txq_flow *ieee80211_txq_fattest(struct list_head *head,
+					      struct txq_flow *fat)
+{
+	struct txq_flow *flow;
+
+	list_for_each_entry(flow, head, flowchain)
+		if (!fat || flow->backlog > fat->backlog)
+			fat = flow;
+
+	return fat;
+}
+
+static void ieee80211_txq_drop_fattest(struct ieee80211_local *local,
+				       struct txq_info *txqi)
+{
+	struct txq_flow *flow;
+	struct sk_buff *skb;
+
+	flow = ieee80211_txq_fattest(&txqi->new_flows, NULL);
+	flow = ieee80211_txq_fattest(&txqi->old_flows, flow);
+	if (WARN_ON_ONCE(!flow))
+		return;
+
+	skb = ieee80211_txq_flow_pop(local, flow);
+	if (!skb)
+		return;
+
+	ieee80211_txq_drop(local, txqi, skb);
+	txqi->overlimit++;
+	local->fq_overlimit++;
+}
+
+static struct txq_flow *ieee80211_txq_classify(struct ieee80211_local *local,
+					       struct txq_info *txqi,
+					       struct sk_buff *skb)
+{
+	struct txq_flow *flow;
+	u32 hash;
+
+	hash = jhash_1word(skb_get_hash(skb), local->fq_perturbation);
+	flow = &local->fq_flows[reciprocal_scale(hash, IEEE80211_TXQ_FLOWS)];
+
+	if (flow->txqi && flow->txqi != txqi) {
+		txqi->collisions++;
+		local->fq_collisions++;
+		flow = &txqi->def_flow;
+	}
+
+	return flow;
+}
+
+static void ieee80211_txq_enqueue(struct ieee80211_local *local,
+				  struct txq_info *txqi,
+				  struct sk_buff *skb)
+{
+	struct txq_flow *flow = ieee80211_txq_classify(local, txqi, skb);
+
+	/*
+	 * skb->cb is taken by the tx info, keep the enqueue time for
+	 * CoDel in the timestamp instead; it's unused on the tx path
+	 * and is cleared again on dequeue.
+	 */
+	skb->tstamp = ktime_get();
+
+	flow->txqi = txqi;
+	flow->backlog += skb->len;
+	txqi->backlog_bytes += skb->len;
+	txqi->backlog_packets++;
+	local->fq_backlog++;
+	__skb_queue_tail(&flow->queue, skb);
+
+	if (list_empty(&flow->flowchain)) {
+		flow->deficit = local->fq_quantum;
+		txqi->flows++;
+		list_add_tail(&flow->flowchain, &txqi->new_flows);
+	}
+
+	if (local->fq_backlog > local->fq_limit)
+		ieee80211_txq_drop_fattest(local, txqi);
+
+	if (txqi->backlog_packets)
+		ieee80211_txq_schedule(local, txqi);
+}
+
+/* CoDel, see net/sched/sch_codel.c; times are kept in ns */
+
+static void ieee80211_codel_newton_step(struct txq_codel_vars *vars)
+{
+	u32 invsqrt = ((u32)vars->rec_inv_sqrt) << 16;
+	u32 invsqrt2 = ((u64)invsqrt * invsqrt) >> 32;
+	u64 val = (3LL << 32) - ((u64)vars->count * invsqrt2);
+
+	val >>= 2; /* avoid overflow in following multiply */
+	val = (val * invsqrt) >> (32 - 2 + 1);
+
+	vars->rec_inv_sqrt = val >> 16;
+}
+
+/* t + interval/sqrt(count) */
+static u64 ieee80211_codel_control_law(u64 t, u32 interval, u16 rec_inv_sqrt)
+{
+	return t + reciprocal_scale(interval, (u32)rec_inv_sqrt << 16);
+}
+
+static bool ieee80211_codel_should_drop(struct ieee80211_local *local,
+					struct txq_flow *flow,
+					struct sk_buff *skb, u64 now)
+{
+	struct txq_codel_vars *vars = &flow->cvars;
+
+	if (!skb) {
+		vars->first_above_time = 0;
+		return false;
+	}
+
+	if (now - ktime_to_ns(skb->tstamp) < local->codel_target ||
+	    flow->backlog <= IEEE80211_MAX_DATA_LEN) {
+		/* went below - stay below for at least interval */
+		vars->first_above_time = 0;
+		return false;
+	}
+
+	if (!vars->first_above_time) {
+		/* just went above, drop if we stay above for an interval */
+		vars->first_above_time = now + local->codel_interval;
+		return false;
+	}
+
+	return now > vars->first_above_time;
+}
+
+static struct sk_buff *ieee80211_codel_dequeue(struct ieee80211_local *local,
+					       struct txq_flow *flow)
+{
+	struct txq_codel_vars *vars = &flow->cvars;
+	struct txq_info *txqi = flow->txqi;
+	struct sk_buff *skb;
+	u64 now;
+	u32 delta;
+
+	skb = ieee80211_txq_flow_pop(local, flow);
+	if (!skb) {
+		vars->dropping = false;
+		return NULL;
+	}
+
+	now = ktime_get_ns();
+
+	if (vars->dropping) {
+		if (!ieee80211_codel_should_drop(local, flow, skb, now)) {
+			/* sojourn time below target - leave dropping state */
+			vars->dropping = false;
+			return skb;
+		}
+
+		while (vars->dropping && now >= vars->drop_next) {
+			vars->count++;
+			ieee80211_codel_newton_step(vars);
+			ieee80211_txq_drop(local, txqi, skb);
+			txqi->drops++;
+
+			skb = ieee80211_txq_flow_pop(local, flow);
+			if (!ieee80211_codel_should_drop(local, flow, skb, now))
+				vars->dropping = false;
+			else
+				vars->drop_next = ieee80211_codel_control_law(
+						vars->drop_next,
+						local->codel_interval,
+						vars->rec_inv_sqrt);
+		}
+
+		return skb;
+	}
+
+	if (!ieee80211_codel_should_drop(local, flow, skb, now))
+		return skb;
+
+	ieee80211_txq_drop(local, txqi, skb);
+	txqi->drops++;
+
+	skb = ieee80211_txq_flow_pop(local, flow);
+	ieee80211_codel_should_drop(local, flow, skb, now);
+
+	vars->dropping = true;
+	/*
+	 * if min went above target close to when we last went below it,
+	 * assume that the drop rate that controlled the queue on the last
+	 * cycle is a good starting point to control it now.
+	 */
+	delta = vars->count - vars->lastcount;
+	if (delta > 1 && (s64)(now - vars->drop_next) <
+			 16 * (s64)local->codel_interval) {
+		vars->count = delta;
+		ieee80211_codel_newton_step(vars);
+	} else {
+		vars->count = 1;
+		vars->rec_inv_sqrt = ~0U >> 16;
+	}
+	vars->lastcount = vars->count;
+	vars->drop_next = ieee80211_codel_control_law(now,
+						      local->codel_interval,
+						      vars->rec_inv_sqrt);
+
+	return skb;
+}
+
+static struct sk_buff *ieee80211_txq_fq_dequeue(struct ieee80211_local *local,
+						struct txq_info *txqi)
+{
+	struct list_head *head;
+	struct txq_flow *flow;
+	struct sk_buff *skb;
+
+begin:
+	head = &txqi->new_flows;
+	if (list_empty(head)) {
+		head = &txqi->old_flows;
+		if (list_empty(head))
+			return NULL;
+	}
+
+	flow = list_first_entry(head, struct txq_flow, flowchain);
+
+	if (flow->deficit <= 0) {
+		flow->deficit += local->fq_quantum;
+		list_move_tail(&flow->flowchain, &txqi->old_flows);
+		goto begin;
+	}
+
+	skb = ieee80211_codel_dequeue(local, flow);
+	if (!skb) {
+		/* force a pass through old_flows to prevent starvation */
+		if (head == &txqi->new_flows &&
+		    !list_empty(&txqi->old_flows)) {
+			list_move_tail(&flow->flowchain, &txqi->old_flows);
+		} else {
+			list_del_init(&flow->flowchain);
+			if (flow != &txqi->def_flow)
+				flow->txqi = NULL;
+		}
+		goto begin;
+	}
+
+	flow->deficit -= skb->len;
+
+	return skb;
+}
+
+static void ieee80211_txq_flow_reset(struct ieee80211_local *local,
+				     struct txq_flow *flow,
+				     struct sk_buff_head *frames)
+{
+	struct txq_info *txqi = flow->txqi;
+	struct sk_buff *skb;
+
+	while ((skb = ieee80211_txq_flow_pop(local, flow)))
+		__skb_queue_tail(frames, skb);
+
+	list_del_init(&flow->flowchain);
+	if (flow != &txqi->def_flow)
+		flow->txqi = NULL;
+}
+
+void ieee80211_txq_purge(struct ieee80211_local *local,
+			 struct txq_info *txqi)
+{
+	struct ieee80211_sub_if_data *sdata = vif_to_sdata(txqi->txq.vif);
+	struct txq_flow *flow, *tmp;
+	struct sk_buff_head frames;
+
+	__skb_queue_head_init(&frames);
+
+	spin_lock_bh(&local->fq_lock);
+	list_for_each_entry_safe(flow, tmp, &txqi->new_flows, flowchain)
+		ieee80211_txq_flow_reset(local, flow, &frames);
+	list_for_each_entry_safe(flow, tmp, &txqi->old_flows, flowchain)
+		ieee80211_txq_flow_reset(local, flow, &frames);
+	spin_unlock_bh(&local->fq_lock);
+
+	ieee80211_txq_unschedule(local, txqi);
+
+	atomic_sub(skb_queue_len(&frames), &sdata->txqs_len[txqi->txq.ac]);
+	ieee80211_purge_tx_queue(&local->hw, &frames);
+}
+
 static void ieee80211_drv_tx(struct ieee80211_local *local,
 			     struct ieee80211_vif *vif,
 			     struct ieee80211_sta *pubsta,
@@ -1264,7 +1805,10 @@ static void ieee80211_drv_tx(struct ieee80211_local *local,
 	if (atomic_read(&sdata->txqs_len[ac]) >= local->hw.txq_ac_max_pending)
 		netif_stop_subqueue(sdata->dev, ac);
 
-	skb_queue_tail(&txqi->queue, skb);
+	spin_lock_bh(&local->fq_lock);
+	ieee80211_txq_enqueue(local, txqi, skb);
+	spin_unlock_bh(&local->fq_lock);
+
 	drv_wake_tx_queue(local, txqi);
 
 	return;
@@ -1283,15 +1827,24 @@ struct sk_buff *ieee80211_tx_dequeue(struct ieee80211_hw *hw,
 	struct sk_buff *skb = NULL;
 	u8 ac = txq->ac;
 
-	spin_lock_bh(&txqi->queue.lock);
+	spin_lock_bh(&local->fq_lock);
 
 	if (test_bit(IEEE80211_TXQ_STOP, &txqi->flags))
 		goto out;
 
-	skb = __skb_dequeue(&txqi->queue);
+	if (!ieee80211_txq_may_transmit(local, txqi))
+		goto out;
+
+	skb = ieee80211_txq_fq_dequeue(local, txqi);
+	if (!txqi->backlog_packets)
+		ieee80211_txq_unschedule(local, txqi);
 	if (!skb)
 		goto out;
 
+	skb->tstamp.tv64 = 0;
+	txqi->tx_bytes += skb->len;
+	txqi->tx_packets++;
+
 	atomic_dec(&sdata->txqs_len[ac]);
 	if (__netif_subqueue_stopped(sdata->dev, ac))
 		ieee80211_propagate_queue_wake(local, sdata->vif.hw_queue[ac]);
@@ -1310,7 +1863,7 @@ struct sk_buff *ieee80211_tx_dequeue(struct ieee80211_hw *hw,
 	}
 
 out:
-	spin_unlock_bh(&txqi->queue.lock);
+	spin_unlock_bh(&local->fq_lock);
 
 	return skb;
 }
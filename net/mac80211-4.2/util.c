@@ -3327,7 +3327,12 @@ void ieee80211_init_tx_queue(struct ieee80211_sub_if_data *sdata,
 			     struct sta_info *sta,
 			     struct txq_info *txqi, int tid)
 {
-	skb_queue_head_init(&txqi->queue);
+	__skb_queue_head_init(&txqi->def_flow.queue);
+	INIT_LIST_HEAD(&txqi->def_flow.flowchain);
+	txqi->def_flow.txqi = txqi;
+	INIT_LIST_HEAD(&txqi->new_flows);
+	INIT_LIST_HEAD(&txqi->old_flows);
+	INIT_LIST_HEAD(&txqi->schedule_order);
 	txqi->txq.vif = &sdata->vif;
 
 	if (sta) {
@@ -296,7 +296,6 @@ destroy_conntrack(struct nf_conntrack *nfct)
 
 	pr_debug("destroy_conntrack(%pK)\n", ct);
 	NF_CT_ASSERT(atomic_read(&nfct->use) == 0);
-	NF_CT_ASSERT(!timer_pending(&ct->timeout));
 
 	rcu_read_lock();
 	l4proto = __nf_ct_l4proto_find(nf_ct_l3num(ct), nf_ct_protonum(ct));
@@ -352,37 +351,45 @@ static void nf_ct_delete_from_lists(struct nf_conn *ct)
 	local_bh_enable();
 }
 
+/* Whoever sets the dying bit first owns the hash table reference. */
 bool nf_ct_delete(struct nf_conn *ct, u32 portid, int report)
 {
 	struct nf_conn_tstamp *tstamp;
 
+	if (test_and_set_bit(IPS_DYING_BIT, &ct->status))
+		return false;
+
 	tstamp = nf_conn_tstamp_find(ct);
 	if (tstamp && tstamp->stop == 0)
 		tstamp->stop = ktime_get_real_ns();
 
-	if (nf_ct_is_dying(ct))
-		goto delete;
-
 	if (nf_conntrack_event_report(IPCT_DESTROY, ct,
 				    portid, report) < 0) {
-		/* destroy event was not delivered */
+		/* destroy event was not delivered. nf_ct_put will
+		 * be done by event cache worker on redelivery.
+		 */
 		nf_ct_delete_from_lists(ct);
 		nf_conntrack_ecache_delayed_work(nf_ct_net(ct));
 		return false;
 	}
 
 	nf_conntrack_ecache_work(nf_ct_net(ct));
-	set_bit(IPS_DYING_BIT, &ct->status);
- delete:
 	nf_ct_delete_from_lists(ct);
 	nf_ct_put(ct);
 	return true;
 }
 EXPORT_SYMBOL_GPL(nf_ct_delete);
 
-static void death_by_timeout(unsigned long ul_conntrack)
+/* Reap a ct whose timeout has passed, lookups must not find it anymore. */
+static void nf_ct_gc_expired(struct nf_conn *ct)
 {
-	nf_ct_delete((struct nf_conn *)ul_conntrack, 0, 0);
+	if (!atomic_inc_not_zero(&ct->ct_general.use))
+		return;
+
+	if (nf_ct_should_gc(ct) && nf_ct_kill(ct))
+		NF_CT_STAT_INC_ATOMIC(nf_ct_net(ct), expired);
+
+	nf_ct_put(ct);
 }
 
 static inline bool
@@ -419,6 +426,13 @@ ____nf_conntrack_find(struct net *net, u16 zone,
 	local_bh_disable();
 begin:
 	hlist_nulls_for_each_entry_rcu(h, n, &net->ct.hash[bucket], hnnode) {
+		struct nf_conn *ct = nf_ct_tuplehash_to_ctrack(h);
+
+		if (nf_ct_is_expired(ct)) {
+			nf_ct_gc_expired(ct);
+			continue;
+		}
+
 		if (nf_ct_key_equal(h, tuple, zone)) {
 			NF_CT_STAT_INC(net, found);
 			local_bh_enable();
@@ -522,7 +536,6 @@ nf_conntrack_hash_check_insert(struct nf_conn *ct)
 		    zone == nf_ct_zone(nf_ct_tuplehash_to_ctrack(h)))
 			goto out;
 
-	add_timer(&ct->timeout);
 	smp_wmb();
 	/* The caller holds a reference to this object */
 	atomic_set(&ct->ct_general.use, 2);
@@ -638,11 +651,10 @@ __nf_conntrack_confirm(struct sk_buff *skb)
 
 	nf_ct_del_from_dying_or_unconfirmed_list(ct);
 
-	/* Timer relative to confirmation time, not original
+	/* Timeout relative to confirmation time, not original
 	   setting time, otherwise we'd get timer wrap in
 	   weird delay cases. */
-	ct->timeout.expires += jiffies;
-	add_timer(&ct->timeout);
+	ct->timeout += nfct_time_stamp;
 	atomic_inc(&ct->ct_general.use);
 	ct->status |= IPS_CONFIRMED;
 
@@ -655,7 +667,7 @@ __nf_conntrack_confirm(struct sk_buff *skb)
 		tstamp->start = ktime_to_ns(skb->tstamp);
 	}
 	/* Since the lookup is lockless, hash insertion must be done after
-	 * starting the timer and setting the CONFIRMED bit. The RCU barriers
+	 * setting the timeout and the CONFIRMED bit. The RCU barriers
 	 * guarantee that no other CPU can find the conntrack before the above
 	 * stores are visible.
 	 */
@@ -699,6 +711,13 @@ nf_conntrack_tuple_taken(const struct nf_conntrack_tuple *tuple,
 	rcu_read_lock_bh();
 	hlist_nulls_for_each_entry_rcu(h, n, &net->ct.hash[hash], hnnode) {
 		ct = nf_ct_tuplehash_to_ctrack(h);
+
+		/* The gc worker may not have reaped it yet. */
+		if (nf_ct_is_expired(ct)) {
+			nf_ct_gc_expired(ct);
+			continue;
+		}
+
 		if (ct != ignored_conntrack &&
 		    nf_ct_tuple_equal(tuple, &h->tuple) &&
 		    nf_ct_zone(ct) == zone) {
@@ -717,7 +736,9 @@ EXPORT_SYMBOL_GPL(nf_conntrack_tuple_taken);
 #define NF_CT_EVICTION_RANGE	8
 
 /* There's a small race here where we may free a just-assured
-   connection.  Too bad: we're in trouble anyway. */
+   connection.  Too bad: we're in trouble anyway.
+   An entry the gc worker didn't get to yet is the best victim of all,
+   assured or not. */
 static noinline int early_drop(struct net *net, unsigned int _hash)
 {
 	/* Use oldest entry, which is roughly LRU */
@@ -743,7 +764,8 @@ restart:
 		hlist_nulls_for_each_entry_rcu(h, n, &net->ct.hash[hash],
 					 hnnode) {
 			tmp = nf_ct_tuplehash_to_ctrack(h);
-			if (!test_bit(IPS_ASSURED_BIT, &tmp->status) &&
+			if ((!test_bit(IPS_ASSURED_BIT, &tmp->status) ||
+			     nf_ct_is_expired(tmp)) &&
 			    !nf_ct_is_dying(tmp) &&
 			    atomic_inc_not_zero(&tmp->ct_general.use)) {
 				ct = tmp;
@@ -761,19 +783,85 @@ restart:
 	}
 	local_bh_enable();
 
-	if (!ct)
+	if (!ct) {
+		NF_CT_STAT_INC_ATOMIC(net, early_drop_fail);
 		return dropped;
+	}
 
-	if (del_timer(&ct->timeout)) {
-		if (nf_ct_delete(ct, 0, 0)) {
-			dropped = 1;
-			NF_CT_STAT_INC_ATOMIC(net, early_drop);
-		}
+	if (nf_ct_delete(ct, 0, 0)) {
+		dropped = 1;
+		NF_CT_STAT_INC_ATOMIC(net, early_drop);
 	}
 	nf_ct_put(ct);
 	return dropped;
 }
 
+/*
+ * Conntracks carry no timer of their own: a deferrable worker per netns
+ * walks a slice of the table every GC_INTERVAL and kills whatever has
+ * expired.  The slice grows with the table but is capped so a run never
+ * hogs the cpu; when most of what it saw was expired it runs again right
+ * away rather than waiting for the next interval.
+ */
+#define GC_MAX_BUCKETS_DIV	64u
+#define GC_MAX_BUCKETS		8192u
+#define GC_INTERVAL		(5 * HZ)
+#define GC_MAX_EVICTS		256u
+
+static void gc_worker(struct work_struct *work)
+{
+	struct net *net = container_of(to_delayed_work(work), struct net,
+				       ct.gc_dwork);
+	unsigned int i, goal, buckets = 0, expired_count = 0;
+	unsigned long next_run = GC_INTERVAL;
+	unsigned int ratio, scanned = 0;
+
+	goal = min(net->ct.htable_size / GC_MAX_BUCKETS_DIV, GC_MAX_BUCKETS);
+	i = net->ct.gc_next_bucket;
+
+	do {
+		struct nf_conntrack_tuple_hash *h;
+		struct hlist_nulls_node *n;
+		struct hlist_nulls_head *ct_hash;
+		struct nf_conn *tmp;
+		unsigned int sequence;
+
+		rcu_read_lock();
+		do {
+			sequence = read_seqcount_begin(&net->ct.generation);
+			if (i >= net->ct.htable_size)
+				i = 0;
+			ct_hash = &net->ct.hash[i];
+		} while (read_seqcount_retry(&net->ct.generation, sequence));
+
+		hlist_nulls_for_each_entry_rcu(h, n, ct_hash, hnnode) {
+			tmp = nf_ct_tuplehash_to_ctrack(h);
+
+			scanned++;
+			if (nf_ct_is_expired(tmp)) {
+				nf_ct_gc_expired(tmp);
+				expired_count++;
+			}
+		}
+
+		/* could check get_nulls_value() here and restart if ct
+		 * was moved to another chain.  But given gc is best-effort
+		 * we will just continue with next hash slot.
+		 */
+		rcu_read_unlock();
+		cond_resched();
+		i++;
+	} while (++buckets < goal &&
+		 expired_count < GC_MAX_EVICTS);
+
+	ratio = scanned ? expired_count * 100 / scanned : 0;
+	if (ratio >= 90)
+		next_run = 0;
+
+	net->ct.gc_next_bucket = i;
+	queue_delayed_work(system_long_wq, &net->ct.gc_dwork, next_run);
+}
+
 void init_nf_conntrack_hash_rnd(void)
 {
 	unsigned int rand;
@@ -837,8 +925,6 @@ __nf_conntrack_alloc(struct net *net, u16 zone,
 	ct->tuplehash[IP_CT_DIR_REPLY].tuple = *repl;
 	/* save hash for reusing when confirming */
 	*(unsigned long *)(&ct->tuplehash[IP_CT_DIR_REPLY].hnnode.pprev) = hash;
-	/* Don't set timer yet: wait for confirmation */
-	setup_timer(&ct->timeout, death_by_timeout, (unsigned long)ct);
 	write_pnet(&ct->ct_net, net);
 #ifdef CONFIG_NF_CONNTRACK_ZONES
 	if (zone) {
@@ -1212,24 +1298,23 @@ void __nf_ct_refresh_acct(struct nf_conn *ct,
 			  unsigned long extra_jiffies,
 			  int do_acct)
 {
-	NF_CT_ASSERT(ct->timeout.data == (unsigned long)ct);
 	NF_CT_ASSERT(skb);
 
 	/* Only update if this is not a fixed timeout */
 	if (test_bit(IPS_FIXED_TIMEOUT_BIT, &ct->status))
 		goto acct;
 
-	/* If not in hash table, timer will not be active yet */
+	/* If not in hash table, the timeout is relative to confirmation */
 	if (!nf_ct_is_confirmed(ct)) {
-		ct->timeout.expires = extra_jiffies;
+		ct->timeout = extra_jiffies;
 	} else {
-		unsigned long newtime = jiffies + extra_jiffies;
+		u32 newtime = nfct_time_stamp + extra_jiffies;
 
 		/* Only update the timeout if the new timeout is at least
-		   HZ jiffies from the old timeout. Need del_timer for race
-		   avoidance (may already be dying). */
-		if (newtime - ct->timeout.expires >= HZ)
-			mod_timer_pending(&ct->timeout, newtime);
+		   HZ jiffies from the old timeout, so that every packet
+		   doesn't dirty the cacheline. */
+		if (newtime - ct->timeout >= HZ)
+			ct->timeout = newtime;
 	}
 
 acct:
@@ -1265,11 +1350,11 @@ bool __nf_ct_kill_acct(struct nf_conn *ct,
 		}
 	}
 
-	if (del_timer(&ct->timeout)) {
-		ct->timeout.function((unsigned long)ct);
-		return true;
-	}
-	return false;
+	/* an unconfirmed ct is only freed by dropping its references */
+	if (!nf_ct_is_confirmed(ct))
+		return false;
+
+	return nf_ct_delete(ct, 0, 0);
 }
 EXPORT_SYMBOL_GPL(__nf_ct_kill_acct);
 
@@ -1404,11 +1489,7 @@ void nf_ct_iterate_cleanup(struct net *net,
 
 	while ((ct = get_next_corpse(net, iter, data, &bucket)) != NULL) {
 		/* Time to push up daises... */
-		if (del_timer(&ct->timeout))
-			nf_ct_delete(ct, portid, report);
-
-		/* ... else the timer will get him soon. */
-
+		nf_ct_delete(ct, portid, report);
 		nf_ct_put(ct);
 	}
 }
@@ -1489,6 +1570,9 @@ void nf_conntrack_cleanup_net_list(struct list_head *net_exit_list)
 	int busy;
 	struct net *net;
 
+	list_for_each_entry(net, net_exit_list, exit_list)
+		cancel_delayed_work_sync(&net->ct.gc_dwork);
+
 	/*
 	 * This makes sure all current packets have passed through
 	 *  netfilter framework.  Roll on, two-stage module
@@ -1602,6 +1686,8 @@ int nf_conntrack_set_hashsize(const char *val, struct kernel_param *kp)
 	nf_conntrack_all_unlock();
 	local_bh_enable();
 
+	/* the gc worker and lookups walk the old table under rcu */
+	synchronize_net();
 	nf_ct_free_hashtable(old_hash, old_size);
 	return 0;
 }
@@ -1800,6 +1886,9 @@ int nf_conntrack_init_net(struct net *net)
 	ret = nf_conntrack_proto_pernet_init(net);
 	if (ret < 0)
 		goto err_proto;
+
+	INIT_DEFERRABLE_WORK(&net->ct.gc_dwork, gc_worker);
+	queue_delayed_work(system_long_wq, &net->ct.gc_dwork, GC_INTERVAL);
 	return 0;
 
 err_proto:
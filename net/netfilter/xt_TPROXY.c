@@ -112,7 +112,7 @@ nf_tproxy_get_sock_v4(struct net *net, const u8 protocol,
 		switch (lookup_type) {
 		case NFT_LOOKUP_LISTENER:
 			sk = inet_lookup_listener(net, &tcp_hashinfo,
-						    saddr, sport,
+						    NULL, 0, saddr, sport,
 						    daddr, dport,
 						    in->ifindex);
 
@@ -176,7 +176,7 @@ nf_tproxy_get_sock_v6(struct net *net, const u8 protocol,
 		switch (lookup_type) {
 		case NFT_LOOKUP_LISTENER:
 			sk = inet6_lookup_listener(net, &tcp_hashinfo,
-						   saddr, sport,
+						   NULL, 0, saddr, sport,
 						   daddr, ntohs(dport),
 						   in->ifindex);
 
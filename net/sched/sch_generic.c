@@ -29,6 +29,7 @@
 #include <net/sch_generic.h>
 #include <net/pkt_sched.h>
 #include <net/dst.h>
+#include <net/lat_hist.h>
 
 /* Qdisc to use by default */
 const struct Qdisc_ops *default_qdisc_ops = &pfifo_fast_ops;
@@ -103,6 +104,7 @@ static struct sk_buff *dequeue_skb(struct Qdisc *q, bool *validate,
 			skb = q->dequeue(q);
 			if (skb && qdisc_may_bulk(q))
 				try_bulk_dequeue_skb(q, skb, txq, packets);
+			net_lat_hist_dequeue(qdisc_dev(q), skb);
 		}
 	}
 	return skb;
@@ -120,19 +120,19 @@
 
 struct hlist_head unix_socket_table[2 * UNIX_HASH_SIZE];
 EXPORT_SYMBOL_GPL(unix_socket_table);
-DEFINE_SPINLOCK(unix_table_lock);
-EXPORT_SYMBOL_GPL(unix_table_lock);
+spinlock_t unix_table_locks[2 * UNIX_HASH_SIZE];
+EXPORT_SYMBOL_GPL(unix_table_locks);
 static atomic_long_t unix_nr_socks;
 
 
-static struct hlist_head *unix_sockets_unbound(void *addr)
+static unsigned int unix_unbound_hash(void *addr)
 {
 	unsigned long hash = (unsigned long)addr;
 
 	hash ^= hash >> 16;
 	hash ^= hash >> 8;
 	hash %= UNIX_HASH_SIZE;
-	return &unix_socket_table[UNIX_HASH_SIZE + hash];
+	return UNIX_HASH_SIZE + hash;
 }
 
 #define UNIX_ABSTRACT(sk)	(unix_sk(sk)->addr->hash < UNIX_HASH_SIZE)
@@ -157,8 +157,15 @@ static inline void unix_set_secdata(struct scm_cookie *scm, struct sk_buff *skb)
 
 /*
  *  SMP locking strategy:
- *    hash table is protected with spinlock unix_table_lock
+ *    each hash bucket is protected by its own spinlock in unix_table_locks,
+ *    lookups of bound sockets walk the buckets under rcu_read_lock().
  *    each socket state is protected by separate spin lock.
+ *
+ *  A socket only ever moves from an unbound bucket to a bound one, and
+ *  nobody walks the unbound buckets locklessly, so an RCU reader can not
+ *  be dragged into another chain under its feet.  Sockets are flagged
+ *  SOCK_RCU_FREE and their address is freed with kfree_rcu(), so both stay
+ *  valid for the reader until it leaves the read side section.
  */
 
 static inline unsigned int unix_hash_fold(__wsum n)
@@ -202,7 +209,7 @@ EXPORT_SYMBOL_GPL(unix_peer_get);
 static inline void unix_release_addr(struct unix_address *addr)
 {
 	if (atomic_dec_and_test(&addr->refcnt))
-		kfree(addr);
+		kfree_rcu(addr, rcu);
 }
 
 /*
@@ -235,31 +242,65 @@ static int unix_mkname(struct sockaddr_un *sunaddr, int len, unsigned int *hashp
 	return len;
 }
 
+/* The bucket a socket is hashed in is kept in sk->sk_hash. */
 static void __unix_remove_socket(struct sock *sk)
 {
-	sk_del_node_init(sk);
+	sk_del_node_init_rcu(sk);
 }
 
-static void __unix_insert_socket(struct hlist_head *list, struct sock *sk)
+static void __unix_insert_socket(unsigned int hash, struct sock *sk)
 {
 	WARN_ON(!sk_unhashed(sk));
-	sk_add_node(sk, list);
+	sk->sk_hash = hash;
+	sk_add_node_rcu(sk, &unix_socket_table[hash]);
 }
 
 static inline void unix_remove_socket(struct sock *sk)
 {
-	spin_lock(&unix_table_lock);
+	spinlock_t *lock = &unix_table_locks[sk->sk_hash];
+
+	spin_lock(lock);
 	__unix_remove_socket(sk);
-	spin_unlock(&unix_table_lock);
+	spin_unlock(lock);
+}
+
+static inline void unix_insert_socket(unsigned int hash, struct sock *sk)
+{
+	spin_lock(&unix_table_locks[hash]);
+	__unix_insert_socket(hash, sk);
+	spin_unlock(&unix_table_locks[hash]);
+}
+
+/*
+ * Binding moves a socket from its unbound bucket to a bound one.  The
+ * former is always above UNIX_HASH_SIZE and the latter below, so taking
+ * the lower one first gives a stable order.
+ */
+static void unix_table_double_lock(unsigned int hash1, unsigned int hash2)
+{
+	if (hash1 > hash2)
+		swap(hash1, hash2);
+
+	spin_lock(&unix_table_locks[hash1]);
+	spin_lock_nested(&unix_table_locks[hash2], SINGLE_DEPTH_NESTING);
+}
+
+static void unix_table_double_unlock(unsigned int hash1, unsigned int hash2)
+{
+	spin_unlock(&unix_table_locks[hash1]);
+	spin_unlock(&unix_table_locks[hash2]);
 }
 
-static inline void unix_insert_socket(struct hlist_head *list, struct sock *sk)
+static inline bool unix_name_match(struct sock *s, struct net *net,
+				   struct sockaddr_un *sunname, int len)
 {
-	spin_lock(&unix_table_lock);
-	__unix_insert_socket(list, sk);
-	spin_unlock(&unix_table_lock);
+	struct unix_address *addr = ACCESS_ONCE(unix_sk(s)->addr);
+
+	return net_eq(sock_net(s), net) && addr && addr->len == len &&
+	       !memcmp(addr->name, sunname, len);
 }
 
+/* Called with the lock of bucket hash ^ type held. */
 static struct sock *__unix_find_socket_byname(struct net *net,
 					      struct sockaddr_un *sunname,
 					      int len, int type, unsigned int hash)
@@ -267,13 +308,7 @@ static struct sock *__unix_find_socket_byname(struct net *net,
 	struct sock *s;
 
 	sk_for_each(s, &unix_socket_table[hash ^ type]) {
-		struct unix_sock *u = unix_sk(s);
-
-		if (!net_eq(sock_net(s), net))
-			continue;
-
-		if (u->addr->len == len &&
-		    !memcmp(u->addr->name, sunname, len))
+		if (unix_name_match(s, net, sunname, len))
 			goto found;
 	}
 	s = NULL;
@@ -281,18 +316,29 @@ found:
 	return s;
 }
 
-static inline struct sock *unix_find_socket_byname(struct net *net,
-						   struct sockaddr_un *sunname,
-						   int len, int type,
-						   unsigned int hash)
+static struct sock *unix_find_socket_byname(struct net *net,
+					    struct sockaddr_un *sunname,
+					    int len, int type,
+					    unsigned int hash)
 {
 	struct sock *s;
 
-	spin_lock(&unix_table_lock);
-	s = __unix_find_socket_byname(net, sunname, len, type, hash);
-	if (s)
-		sock_hold(s);
-	spin_unlock(&unix_table_lock);
+	rcu_read_lock();
+begin:
+	sk_for_each_rcu(s, &unix_socket_table[hash ^ type]) {
+		if (!unix_name_match(s, net, sunname, len))
+			continue;
+		/*
+		 * A zero refcount means the owner already unhashed it, so
+		 * the name may have been taken by a newer socket since.
+		 */
+		if (unlikely(!atomic_inc_not_zero(&s->sk_refcnt)))
+			goto begin;
+		goto found;
+	}
+	s = NULL;
+found:
+	rcu_read_unlock();
 	return s;
 }
 
@@ -300,19 +346,22 @@ static struct sock *unix_find_socket_byinode(struct inode *i)
 {
 	struct sock *s;
 
-	spin_lock(&unix_table_lock);
-	sk_for_each(s,
+	rcu_read_lock();
+begin:
+	sk_for_each_rcu(s,
 		    &unix_socket_table[i->i_ino & (UNIX_HASH_SIZE - 1)]) {
-		struct dentry *dentry = unix_sk(s)->path.dentry;
+		struct dentry *dentry = ACCESS_ONCE(unix_sk(s)->path.dentry);
 
+		/* hashed dentries are freed by RCU, see d_free() */
 		if (dentry && dentry->d_inode == i) {
-			sock_hold(s);
+			if (unlikely(!atomic_inc_not_zero(&s->sk_refcnt)))
+				goto begin;
 			goto found;
 		}
 	}
 	s = NULL;
 found:
-	spin_unlock(&unix_table_lock);
+	rcu_read_unlock();
 	return s;
 }
 
@@ -768,7 +817,8 @@ static struct sock *unix_create1(struct net *net, struct socket *sock)
 	mutex_init(&u->readlock); /* single task reading lock */
 	init_waitqueue_head(&u->peer_wait);
 	init_waitqueue_func_entry(&u->peer_wake, unix_dgram_peer_wake_relay);
-	unix_insert_socket(unix_sockets_unbound(sk), sk);
+	sock_set_flag(sk, SOCK_RCU_FREE);
+	unix_insert_socket(unix_unbound_hash(sk), sk);
 out:
 	if (sk == NULL)
 		atomic_long_dec(&unix_nr_socks);
@@ -831,6 +881,7 @@ static int unix_autobind(struct socket *sock)
 	struct unix_sock *u = unix_sk(sk);
 	static u32 ordernum = 1;
 	struct unix_address *addr;
+	unsigned int old_hash;
 	int err;
 	unsigned int retries = 0;
 
@@ -849,17 +900,19 @@ static int unix_autobind(struct socket *sock)
 
 	addr->name->sun_family = AF_UNIX;
 	atomic_set(&addr->refcnt, 1);
+	old_hash = sk->sk_hash;
 
 retry:
 	addr->len = sprintf(addr->name->sun_path+1, "%05x", ordernum) + 1 + sizeof(short);
 	addr->hash = unix_hash_fold(csum_partial(addr->name, addr->len, 0));
+	addr->hash ^= sk->sk_type;
 
-	spin_lock(&unix_table_lock);
+	unix_table_double_lock(old_hash, addr->hash);
 	ordernum = (ordernum+1)&0xFFFFF;
 
-	if (__unix_find_socket_byname(net, addr->name, addr->len, sock->type,
+	if (__unix_find_socket_byname(net, addr->name, addr->len, 0,
 				      addr->hash)) {
-		spin_unlock(&unix_table_lock);
+		unix_table_double_unlock(old_hash, addr->hash);
 		/*
 		 * __unix_find_socket_byname() may take long time if many names
 		 * are already in use.
@@ -873,12 +926,11 @@ retry:
 		}
 		goto retry;
 	}
-	addr->hash ^= sk->sk_type;
 
 	__unix_remove_socket(sk);
 	u->addr = addr;
-	__unix_insert_socket(&unix_socket_table[addr->hash], sk);
-	spin_unlock(&unix_table_lock);
+	__unix_insert_socket(addr->hash, sk);
+	unix_table_double_unlock(old_hash, addr->hash);
 	err = 0;
 
 out:	mutex_unlock(&u->readlock);
@@ -977,9 +1029,8 @@ static int unix_bind(struct socket *sock, struct sockaddr *uaddr, int addr_len)
 	struct sockaddr_un *sunaddr = (struct sockaddr_un *)uaddr;
 	char *sun_path = sunaddr->sun_path;
 	int err;
-	unsigned int hash;
+	unsigned int hash, old_hash;
 	struct unix_address *addr;
-	struct hlist_head *list;
 
 	err = -EINVAL;
 	if (sunaddr->sun_family != AF_UNIX)
@@ -1002,6 +1053,7 @@ static int unix_bind(struct socket *sock, struct sockaddr *uaddr, int addr_len)
 	err = -EINVAL;
 	if (u->addr)
 		goto out_up;
+	old_hash = sk->sk_hash;
 
 	err = -ENOMEM;
 	addr = kmalloc(sizeof(*addr)+addr_len, GFP_KERNEL);
@@ -1026,28 +1078,26 @@ static int unix_bind(struct socket *sock, struct sockaddr *uaddr, int addr_len)
 		}
 		addr->hash = UNIX_HASH_SIZE;
 		hash = path.dentry->d_inode->i_ino & (UNIX_HASH_SIZE-1);
-		spin_lock(&unix_table_lock);
+		unix_table_double_lock(old_hash, hash);
 		u->path = path;
-		list = &unix_socket_table[hash];
 	} else {
-		spin_lock(&unix_table_lock);
+		hash = addr->hash;
+		unix_table_double_lock(old_hash, hash);
 		err = -EADDRINUSE;
 		if (__unix_find_socket_byname(net, sunaddr, addr_len,
-					      sk->sk_type, hash)) {
+					      0, hash)) {
 			unix_release_addr(addr);
 			goto out_unlock;
 		}
-
-		list = &unix_socket_table[addr->hash];
 	}
 
 	err = 0;
 	__unix_remove_socket(sk);
 	u->addr = addr;
-	__unix_insert_socket(list, sk);
+	__unix_insert_socket(hash, sk);
 
 out_unlock:
-	spin_unlock(&unix_table_lock);
+	unix_table_double_unlock(old_hash, hash);
 out_up:
 	mutex_unlock(&u->readlock);
 out:
@@ -1580,11 +1630,12 @@ static int unix_dgram_sendmsg(struct kiocb *kiocb, struct socket *sock,
 
 	if (NULL == siocb->scm)
 		siocb->scm = &tmp_scm;
-	wait_for_unix_gc();
 	err = scm_send(sock, msg, siocb->scm, false);
 	if (err < 0)
 		return err;
 
+	wait_for_unix_gc(siocb->scm->fp);
+
 	err = -EOPNOTSUPP;
 	if (msg->msg_flags&MSG_OOB)
 		goto out;
@@ -1789,11 +1840,12 @@ static int unix_stream_sendmsg(struct kiocb *kiocb, struct socket *sock,
 
 	if (NULL == siocb->scm)
 		siocb->scm = &tmp_scm;
-	wait_for_unix_gc();
 	err = scm_send(sock, msg, siocb->scm, false);
 	if (err < 0)
 		return err;
 
+	wait_for_unix_gc(siocb->scm->fp);
+
 	err = -EOPNOTSUPP;
 	if (msg->msg_flags&MSG_OOB)
 		goto out_err;
@@ -2448,57 +2500,67 @@ static struct sock *unix_from_bucket(struct seq_file *seq, loff_t *pos)
 	return sk;
 }
 
-static struct sock *unix_next_socket(struct seq_file *seq,
-				     struct sock *sk,
-				     loff_t *pos)
+/*
+ * The socket handed out by the iterator is returned with the lock of its
+ * bucket held, unix_seq_stop() drops it.
+ */
+static struct sock *unix_get_first(struct seq_file *seq, loff_t *pos)
 {
-	unsigned long bucket;
-
-	while (sk > (struct sock *)SEQ_START_TOKEN) {
-		sk = sk_next(sk);
-		if (!sk)
-			goto next_bucket;
-		if (sock_net(sk) == seq_file_net(seq))
-			return sk;
-	}
+	unsigned long bucket = get_bucket(*pos);
+	struct sock *sk;
 
-	do {
+	while (bucket < ARRAY_SIZE(unix_socket_table)) {
+		spin_lock(&unix_table_locks[bucket]);
 		sk = unix_from_bucket(seq, pos);
 		if (sk)
 			return sk;
+		spin_unlock(&unix_table_locks[bucket]);
 
-next_bucket:
-		bucket = get_bucket(*pos) + 1;
-		*pos = set_bucket_offset(bucket, 1);
-	} while (bucket < ARRAY_SIZE(unix_socket_table));
+		*pos = set_bucket_offset(++bucket, 1);
+	}
 
 	return NULL;
 }
 
-static void *unix_seq_start(struct seq_file *seq, loff_t *pos)
-	__acquires(unix_table_lock)
+static struct sock *unix_get_next(struct seq_file *seq, struct sock *sk,
+				  loff_t *pos)
 {
-	spin_lock(&unix_table_lock);
+	unsigned long bucket = get_bucket(*pos);
+
+	for (sk = sk_next(sk); sk; sk = sk_next(sk))
+		if (sock_net(sk) == seq_file_net(seq))
+			return sk;
 
+	spin_unlock(&unix_table_locks[bucket]);
+	*pos = set_bucket_offset(++bucket, 1);
+
+	return unix_get_first(seq, pos);
+}
+
+static void *unix_seq_start(struct seq_file *seq, loff_t *pos)
+{
 	if (!*pos)
 		return SEQ_START_TOKEN;
 
-	if (get_bucket(*pos) >= ARRAY_SIZE(unix_socket_table))
-		return NULL;
-
-	return unix_next_socket(seq, NULL, pos);
+	return unix_get_first(seq, pos);
 }
 
 static void *unix_seq_next(struct seq_file *seq, void *v, loff_t *pos)
 {
 	++*pos;
-	return unix_next_socket(seq, v, pos);
+
+	if (v == SEQ_START_TOKEN)
+		return unix_get_first(seq, pos);
+
+	return unix_get_next(seq, v, pos);
 }
 
 static void unix_seq_stop(struct seq_file *seq, void *v)
-	__releases(unix_table_lock)
 {
-	spin_unlock(&unix_table_lock);
+	struct sock *sk = v;
+
+	if (sk && v != SEQ_START_TOKEN)
+		spin_unlock(&unix_table_locks[sk->sk_hash]);
 }
 
 static int unix_seq_show(struct seq_file *seq, void *v)
@@ -2607,10 +2669,13 @@ static struct pernet_operations unix_net_ops = {
 
 static int __init af_unix_init(void)
 {
-	int rc = -1;
+	int i, rc = -1;
 
 	BUILD_BUG_ON(sizeof(struct unix_skb_parms) > FIELD_SIZEOF(struct sk_buff, cb));
 
+	for (i = 0; i < ARRAY_SIZE(unix_table_locks); i++)
+		spin_lock_init(&unix_table_locks[i]);
+
 	rc = proto_register(&unix_proto, 1);
 	if (rc != 0) {
 		pr_crit("%s: Cannot create unix_sock SLAB cache!\n", __func__);
@@ -2626,6 +2691,8 @@ out:
 static void __exit af_unix_exit(void)
 {
 	sock_unregister(PF_UNIX);
+	/* Wait for the socks still on their way to SOCK_RCU_FREE */
+	rcu_barrier();
 	proto_unregister(&unix_proto);
 	unregister_pernet_subsys(&unix_net_ops);
 }
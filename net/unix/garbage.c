@@ -80,6 +80,7 @@
 #include <linux/proc_fs.h>
 #include <linux/mutex.h>
 #include <linux/wait.h>
+#include <linux/workqueue.h>
 
 #include <net/sock.h>
 #include <net/af_unix.h>
@@ -261,19 +262,38 @@ static void inc_inflight_move_tail(struct unix_sock *u)
 static bool gc_in_progress;
 #define UNIX_INFLIGHT_TRIGGER_GC 16000
 
-void wait_for_unix_gc(void)
+static void __unix_gc(struct work_struct *work);
+static DECLARE_WORK(unix_gc_work, __unix_gc);
+
+/*
+ * Called on sendmsg with the descriptors about to be passed, if any.
+ * Only senders of descriptors can grow the graph, and they are only
+ * throttled once the number of inflight sockets gets insane: a pass of
+ * the collector alone never makes a sender wait.
+ */
+void wait_for_unix_gc(struct scm_fp_list *fpl)
 {
-	/*
-	 * If number of inflight sockets is insane,
-	 * force a garbage collect right now.
-	 */
-	if (unix_tot_inflight > UNIX_INFLIGHT_TRIGGER_GC && !gc_in_progress)
-		unix_gc();
-	wait_event(unix_gc_wait, gc_in_progress == false);
+	if (!fpl)
+		return;
+
+	if (ACCESS_ONCE(unix_tot_inflight) > UNIX_INFLIGHT_TRIGGER_GC) {
+		if (!ACCESS_ONCE(gc_in_progress))
+			unix_gc();
+		wait_event(unix_gc_wait, !ACCESS_ONCE(gc_in_progress));
+	}
 }
 
-/* The external entry point: unix_gc() */
+/*
+ * The external entry point: unix_gc().  The collection itself runs from
+ * a work item, so neither close() nor sendmsg() pays for the graph walk.
+ */
 void unix_gc(void)
+{
+	ACCESS_ONCE(gc_in_progress) = true;
+	queue_work(system_unbound_wq, &unix_gc_work);
+}
+
+static void __unix_gc(struct work_struct *work)
 {
 	struct unix_sock *u;
 	struct unix_sock *next;
@@ -283,10 +303,6 @@ void unix_gc(void)
 
 	spin_lock(&unix_gc_lock);
 
-	/* Avoid a recursive GC. */
-	if (gc_in_progress)
-		goto out;
-
 	gc_in_progress = true;
 	/*
 	 * First, select candidates for garbage collection.  Only
@@ -381,6 +397,5 @@ void unix_gc(void)
 	gc_in_progress = false;
 	wake_up(&unix_gc_wait);
 
- out:
 	spin_unlock(&unix_gc_lock);
 }
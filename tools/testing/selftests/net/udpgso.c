@@ -0,0 +1,166 @@
+/*
+ * UDP_SEGMENT over loopback: check that every send arrives as the
+ * expected list of datagrams and that the send buffer charge of the
+ * socket is back to zero once the segments are gone.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+#include <string.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <linux/sockios.h>
+
+#ifndef SOL_UDP
+#define SOL_UDP		17
+#endif
+
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT	103
+#endif
+
+#define GSO_SIZE	1000
+#define MAX_SEGS	64
+
+struct udpgso_testcase {
+	const char	*name;
+	int		len;
+
+	/* 0    = send succeeds
+	 * -foo = send fails with error foo
+	 */
+	int		expect;
+};
+
+static struct udpgso_testcase tests[] = {
+	{ "one byte",			1,			0 },
+	{ "exactly one segment",	GSO_SIZE,		0 },
+	{ "one segment plus one byte",	GSO_SIZE + 1,		0 },
+	{ "short last segment",		GSO_SIZE * 2 + 500,	0 },
+	{ "many full segments",		GSO_SIZE * 40,		0 },
+	{ "too many segments",		GSO_SIZE * (MAX_SEGS + 1), -EINVAL },
+};
+
+#define ARRAY_SIZE(arr) (sizeof(arr) / sizeof((arr)[0]))
+
+static char buf[GSO_SIZE * (MAX_SEGS + 1)];
+
+static int recv_segments(int fd, struct udpgso_testcase *t)
+{
+	int left = t->len;
+	int ret;
+
+	while (left) {
+		int expect = left < GSO_SIZE ? left : GSO_SIZE;
+		struct pollfd pfd = { .fd = fd, .events = POLLIN };
+
+		if (poll(&pfd, 1, 1000) != 1) {
+			fprintf(stderr, "%s: %d bytes never arrived\n",
+				t->name, left);
+			return -1;
+		}
+
+		ret = recv(fd, buf, sizeof(buf), MSG_DONTWAIT);
+		if (ret != expect) {
+			fprintf(stderr, "%s: got a %d byte datagram, "
+				"expected %d\n", t->name, ret, expect);
+			return -1;
+		}
+		left -= ret;
+	}
+
+	ret = recv(fd, buf, sizeof(buf), MSG_DONTWAIT);
+	if (ret != -1 || errno != EAGAIN) {
+		fprintf(stderr, "%s: extra datagram of %d bytes\n",
+			t->name, ret);
+		return -1;
+	}
+	return 0;
+}
+
+static int run_test(int tx, int rx, struct udpgso_testcase *t)
+{
+	int outq;
+	int ret;
+
+	ret = send(tx, buf, t->len, 0);
+	if (t->expect < 0) {
+		if (ret == -1 && errno == -t->expect)
+			return 0;
+		fprintf(stderr, "%s: expected error (%s) got %d (%s)\n",
+			t->name, strerror(-t->expect), ret,
+			ret == -1 ? strerror(errno) : "success");
+		return -1;
+	}
+	if (ret != t->len) {
+		fprintf(stderr, "%s: send returned %d (%s)\n",
+			t->name, ret, ret == -1 ? strerror(errno) : "short");
+		return -1;
+	}
+
+	if (recv_segments(rx, t))
+		return -1;
+
+	if (ioctl(tx, SIOCOUTQ, &outq)) {
+		perror("ioctl SIOCOUTQ");
+		return -1;
+	}
+	if (outq) {
+		fprintf(stderr, "%s: %d bytes still charged to the "
+			"sender\n", t->name, outq);
+		return -1;
+	}
+	return 0;
+}
+
+int main(void)
+{
+	struct sockaddr_in addr;
+	socklen_t alen = sizeof(addr);
+	int gso_size = GSO_SIZE;
+	int tx, rx, i;
+	int err = 0;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	rx = socket(AF_INET, SOCK_DGRAM, 0);
+	tx = socket(AF_INET, SOCK_DGRAM, 0);
+	if (rx < 0 || tx < 0) {
+		perror("socket");
+		return 1;
+	}
+
+	if (bind(rx, (struct sockaddr *)&addr, sizeof(addr)) ||
+	    getsockname(rx, (struct sockaddr *)&addr, &alen) ||
+	    connect(tx, (struct sockaddr *)&addr, sizeof(addr))) {
+		perror("bind/connect");
+		return 1;
+	}
+
+	if (setsockopt(tx, SOL_UDP, UDP_SEGMENT, &gso_size,
+		       sizeof(gso_size))) {
+		if (errno == ENOPROTOOPT) {
+			fprintf(stderr, "UDP_SEGMENT not supported, skipping\n");
+			return 0;
+		}
+		perror("setsockopt UDP_SEGMENT");
+		return 1;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(tests); i++) {
+		if (run_test(tx, rx, &tests[i]))
+			err = 1;
+	}
+
+	close(tx);
+	close(rx);
+	return err;
+}